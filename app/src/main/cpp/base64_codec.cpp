@@ -0,0 +1,399 @@
+#include "base64_codec.h"
+#include "kernel_dispatch.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define BASE64_X86 1
+#elif defined(__aarch64__)
+#include <arm_neon.h>
+#define BASE64_NEON 1
+#endif
+
+namespace {
+    // Base64 encoding characters
+    const char ENCODE_TABLE[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+    // Character -> 6-bit value, 0xFF for anything outside the alphabet (including '=')
+    struct DecodeTable {
+        uint8_t values[256];
+
+        constexpr DecodeTable() : values() {
+            for (int i = 0; i < 256; ++i) {
+                values[i] = 0xFF;
+            }
+            for (int i = 0; i < 64; ++i) {
+                values[static_cast<uint8_t>(ENCODE_TABLE[i])] = static_cast<uint8_t>(i);
+            }
+        }
+    };
+
+    constexpr DecodeTable DECODE_TABLE;
+
+    size_t encodeScalar(const uint8_t* input, size_t length, char* output) {
+        size_t i = 0;
+        size_t o = 0;
+
+        for (; i + 3 <= length; i += 3) {
+            uint32_t value = (static_cast<uint32_t>(input[i]) << 16) |
+                             (static_cast<uint32_t>(input[i + 1]) << 8) |
+                             static_cast<uint32_t>(input[i + 2]);
+            output[o++] = ENCODE_TABLE[(value >> 18) & 0x3F];
+            output[o++] = ENCODE_TABLE[(value >> 12) & 0x3F];
+            output[o++] = ENCODE_TABLE[(value >> 6) & 0x3F];
+            output[o++] = ENCODE_TABLE[value & 0x3F];
+        }
+
+        size_t remaining = length - i;
+        if (remaining > 0) {
+            uint32_t value = static_cast<uint32_t>(input[i]) << 16;
+            if (remaining == 2) {
+                value |= static_cast<uint32_t>(input[i + 1]) << 8;
+            }
+            output[o++] = ENCODE_TABLE[(value >> 18) & 0x3F];
+            output[o++] = ENCODE_TABLE[(value >> 12) & 0x3F];
+            output[o++] = remaining == 2 ? ENCODE_TABLE[(value >> 6) & 0x3F] : '=';
+            output[o++] = '=';
+        }
+
+        return o;
+    }
+
+    size_t decodeScalar(const char* input, size_t length, uint8_t* output) {
+        const uint8_t* in = reinterpret_cast<const uint8_t*>(input);
+        const uint8_t* table = DECODE_TABLE.values;
+        size_t i = 0;
+        size_t o = 0;
+
+        // Fast path: whole quads of valid characters
+        for (; i + 4 <= length; i += 4) {
+            uint32_t a = table[in[i]];
+            uint32_t b = table[in[i + 1]];
+            uint32_t c = table[in[i + 2]];
+            uint32_t d = table[in[i + 3]];
+            if ((a | b | c | d) & 0xC0) {
+                break;
+            }
+            uint32_t value = (a << 18) | (b << 12) | (c << 6) | d;
+            output[o++] = static_cast<uint8_t>(value >> 16);
+            output[o++] = static_cast<uint8_t>(value >> 8);
+            output[o++] = static_cast<uint8_t>(value);
+        }
+
+        // Slow path for padding and invalid characters, bit-for-bit the original decoder
+        uint32_t value = 0;
+        int valueBits = -8;
+        for (; i < length; ++i) {
+            if (in[i] == '=') {
+                break;
+            }
+            uint32_t sextet = table[in[i]];
+            if (sextet & 0xC0) {
+                continue; // Skip invalid characters
+            }
+            value = (value << 6) | sextet;
+            valueBits += 6;
+            if (valueBits >= 0) {
+                output[o++] = static_cast<uint8_t>((value >> valueBits) & 0xFF);
+                valueBits -= 8;
+            }
+        }
+
+        return o;
+    }
+
+#if BASE64_X86
+    // SIMD kernels after Muła and Lemire, "Faster Base64 Encoding and Decoding Using AVX2
+    // Instructions". Each consumes whole blocks and hands the tail to the narrower kernel.
+
+    __attribute__((target("ssse3")))
+    inline __m128i encodeReshuffle128(__m128i in) {
+        in = _mm_shuffle_epi8(in, _mm_set_epi8(10, 11, 9, 10, 7, 8, 6, 7, 4, 5, 3, 4, 1, 2, 0, 1));
+        const __m128i t0 = _mm_and_si128(in, _mm_set1_epi32(0x0fc0fc00));
+        const __m128i t1 = _mm_mulhi_epu16(t0, _mm_set1_epi32(0x04000040));
+        const __m128i t2 = _mm_and_si128(in, _mm_set1_epi32(0x003f03f0));
+        const __m128i t3 = _mm_mullo_epi16(t2, _mm_set1_epi32(0x01000010));
+        return _mm_or_si128(t1, t3);
+    }
+
+    __attribute__((target("ssse3")))
+    inline __m128i encodeTranslate128(__m128i indices) {
+        const __m128i shiftLut = _mm_setr_epi8(
+            'a' - 26, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+            '0' - 52, '0' - 52, '0' - 52, '+' - 62, '/' - 63, 'A', 0, 0);
+        __m128i result = _mm_subs_epu8(indices, _mm_set1_epi8(51));
+        const __m128i less = _mm_cmpgt_epi8(_mm_set1_epi8(26), indices);
+        result = _mm_or_si128(result, _mm_and_si128(less, _mm_set1_epi8(13)));
+        result = _mm_shuffle_epi8(shiftLut, result);
+        return _mm_add_epi8(result, indices);
+    }
+
+    __attribute__((target("ssse3")))
+    size_t encodeSsse3(const uint8_t* input, size_t length, char* output) {
+        size_t i = 0;
+        size_t o = 0;
+
+        // Loads 16 bytes but consumes 12
+        for (; i + 16 <= length; i += 12, o += 16) {
+            __m128i in = _mm_loadu_si128(reinterpret_cast<const __m128i*>(input + i));
+            __m128i chars = encodeTranslate128(encodeReshuffle128(in));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(output + o), chars);
+        }
+
+        return o + encodeScalar(input + i, length - i, output + o);
+    }
+
+    __attribute__((target("ssse3")))
+    inline bool decodeTranslate128(__m128i input, __m128i& values) {
+        const __m128i higherNibble = _mm_and_si128(_mm_srli_epi32(input, 4), _mm_set1_epi8(0x0f));
+        const __m128i lowerNibble = _mm_and_si128(input, _mm_set1_epi8(0x0f));
+
+        const __m128i shiftLut = _mm_setr_epi8(0, 0, 19, 4, -65, -65, -71, -71, 0, 0, 0, 0, 0, 0, 0, 0);
+        const __m128i maskLut = _mm_setr_epi8(
+            static_cast<char>(0xa8), static_cast<char>(0xf8), static_cast<char>(0xf8), static_cast<char>(0xf8),
+            static_cast<char>(0xf8), static_cast<char>(0xf8), static_cast<char>(0xf8), static_cast<char>(0xf8),
+            static_cast<char>(0xf8), static_cast<char>(0xf8), static_cast<char>(0xf0), 0x54, 0x50, 0x50, 0x50, 0x54);
+        const __m128i bitposLut = _mm_setr_epi8(
+            0x01, 0x02, 0x04, 0x08, 0x10, 0x20, 0x40, static_cast<char>(0x80), 0, 0, 0, 0, 0, 0, 0, 0);
+
+        const __m128i mask = _mm_shuffle_epi8(maskLut, lowerNibble);
+        const __m128i bit = _mm_shuffle_epi8(bitposLut, higherNibble);
+        const __m128i nonMatch = _mm_cmpeq_epi8(_mm_and_si128(mask, bit), _mm_setzero_si128());
+        if (_mm_movemask_epi8(nonMatch) != 0) {
+            return false;
+        }
+
+        // '/' shares its high nibble with '+' but needs a different offset
+        const __m128i isSlash = _mm_cmpeq_epi8(input, _mm_set1_epi8(0x2f));
+        const __m128i shift = _mm_or_si128(
+            _mm_andnot_si128(isSlash, _mm_shuffle_epi8(shiftLut, higherNibble)),
+            _mm_and_si128(isSlash, _mm_set1_epi8(16)));
+        values = _mm_add_epi8(input, shift);
+        return true;
+    }
+
+    __attribute__((target("ssse3")))
+    inline __m128i decodePack128(__m128i values) {
+        const __m128i mergeAbAndBc = _mm_maddubs_epi16(values, _mm_set1_epi32(0x01400140));
+        const __m128i merged = _mm_madd_epi16(mergeAbAndBc, _mm_set1_epi32(0x00011000));
+        return _mm_shuffle_epi8(merged, _mm_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1));
+    }
+
+    __attribute__((target("ssse3")))
+    size_t decodeSsse3(const char* input, size_t length, uint8_t* output) {
+        size_t i = 0;
+        size_t o = 0;
+
+        // Stores 16 bytes but produces 12; the extra input margin keeps the spill
+        // inside base64DecodedMaxLength(length)
+        for (; i + 24 <= length; i += 16, o += 12) {
+            __m128i in = _mm_loadu_si128(reinterpret_cast<const __m128i*>(input + i));
+            __m128i values;
+            if (!decodeTranslate128(in, values)) {
+                break;
+            }
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(output + o), decodePack128(values));
+        }
+
+        return o + decodeScalar(input + i, length - i, output + o);
+    }
+
+    __attribute__((target("avx2")))
+    size_t encodeAvx2(const uint8_t* input, size_t length, char* output) {
+        size_t i = 0;
+        size_t o = 0;
+
+        const __m256i shuffle = _mm256_setr_epi8(
+            1, 0, 2, 1, 4, 3, 5, 4, 7, 6, 8, 7, 10, 9, 11, 10,
+            1, 0, 2, 1, 4, 3, 5, 4, 7, 6, 8, 7, 10, 9, 11, 10);
+        const __m256i shiftLut = _mm256_setr_epi8(
+            'a' - 26, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+            '0' - 52, '0' - 52, '0' - 52, '+' - 62, '/' - 63, 'A', 0, 0,
+            'a' - 26, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+            '0' - 52, '0' - 52, '0' - 52, '+' - 62, '/' - 63, 'A', 0, 0);
+
+        // Two 16-byte loads (12 bytes consumed from each) per 32 output characters
+        for (; i + 28 <= length; i += 24, o += 32) {
+            __m128i lo = _mm_loadu_si128(reinterpret_cast<const __m128i*>(input + i));
+            __m128i hi = _mm_loadu_si128(reinterpret_cast<const __m128i*>(input + i + 12));
+            __m256i in = _mm256_inserti128_si256(_mm256_castsi128_si256(lo), hi, 1);
+
+            in = _mm256_shuffle_epi8(in, shuffle);
+            const __m256i t0 = _mm256_and_si256(in, _mm256_set1_epi32(0x0fc0fc00));
+            const __m256i t1 = _mm256_mulhi_epu16(t0, _mm256_set1_epi32(0x04000040));
+            const __m256i t2 = _mm256_and_si256(in, _mm256_set1_epi32(0x003f03f0));
+            const __m256i t3 = _mm256_mullo_epi16(t2, _mm256_set1_epi32(0x01000010));
+            const __m256i indices = _mm256_or_si256(t1, t3);
+
+            __m256i result = _mm256_subs_epu8(indices, _mm256_set1_epi8(51));
+            const __m256i less = _mm256_cmpgt_epi8(_mm256_set1_epi8(26), indices);
+            result = _mm256_or_si256(result, _mm256_and_si256(less, _mm256_set1_epi8(13)));
+            result = _mm256_shuffle_epi8(shiftLut, result);
+            result = _mm256_add_epi8(result, indices);
+
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(output + o), result);
+        }
+
+        return o + encodeSsse3(input + i, length - i, output + o);
+    }
+
+    __attribute__((target("avx2")))
+    size_t decodeAvx2(const char* input, size_t length, uint8_t* output) {
+        size_t i = 0;
+        size_t o = 0;
+
+        const __m256i shiftLut = _mm256_setr_epi8(
+            0, 0, 19, 4, -65, -65, -71, -71, 0, 0, 0, 0, 0, 0, 0, 0,
+            0, 0, 19, 4, -65, -65, -71, -71, 0, 0, 0, 0, 0, 0, 0, 0);
+        const __m256i maskLut = _mm256_broadcastsi128_si256(_mm_setr_epi8(
+            static_cast<char>(0xa8), static_cast<char>(0xf8), static_cast<char>(0xf8), static_cast<char>(0xf8),
+            static_cast<char>(0xf8), static_cast<char>(0xf8), static_cast<char>(0xf8), static_cast<char>(0xf8),
+            static_cast<char>(0xf8), static_cast<char>(0xf8), static_cast<char>(0xf0), 0x54, 0x50, 0x50, 0x50, 0x54));
+        const __m256i bitposLut = _mm256_broadcastsi128_si256(_mm_setr_epi8(
+            0x01, 0x02, 0x04, 0x08, 0x10, 0x20, 0x40, static_cast<char>(0x80), 0, 0, 0, 0, 0, 0, 0, 0));
+        const __m256i packShuffle = _mm256_broadcastsi128_si256(
+            _mm_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1));
+        const __m256i packPermute = _mm256_setr_epi32(0, 1, 2, 4, 5, 6, 7, 7);
+
+        // Stores 32 bytes but produces 24; see decodeSsse3 for the margin
+        for (; i + 48 <= length; i += 32, o += 24) {
+            __m256i in = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(input + i));
+
+            const __m256i higherNibble = _mm256_and_si256(_mm256_srli_epi32(in, 4), _mm256_set1_epi8(0x0f));
+            const __m256i lowerNibble = _mm256_and_si256(in, _mm256_set1_epi8(0x0f));
+            const __m256i mask = _mm256_shuffle_epi8(maskLut, lowerNibble);
+            const __m256i bit = _mm256_shuffle_epi8(bitposLut, higherNibble);
+            const __m256i nonMatch = _mm256_cmpeq_epi8(_mm256_and_si256(mask, bit), _mm256_setzero_si256());
+            if (_mm256_movemask_epi8(nonMatch) != 0) {
+                break;
+            }
+
+            const __m256i isSlash = _mm256_cmpeq_epi8(in, _mm256_set1_epi8(0x2f));
+            const __m256i shift = _mm256_blendv_epi8(_mm256_shuffle_epi8(shiftLut, higherNibble),
+                                                     _mm256_set1_epi8(16), isSlash);
+            const __m256i values = _mm256_add_epi8(in, shift);
+
+            const __m256i mergeAbAndBc = _mm256_maddubs_epi16(values, _mm256_set1_epi32(0x01400140));
+            const __m256i merged = _mm256_madd_epi16(mergeAbAndBc, _mm256_set1_epi32(0x00011000));
+            const __m256i packed = _mm256_permutevar8x32_epi32(_mm256_shuffle_epi8(merged, packShuffle), packPermute);
+
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(output + o), packed);
+        }
+
+        return o + decodeSsse3(input + i, length - i, output + o);
+    }
+#endif // BASE64_X86
+
+#if BASE64_NEON
+    inline uint8x16x4_t loadTable64(const uint8_t* table) {
+        uint8x16x4_t result;
+        result.val[0] = vld1q_u8(table);
+        result.val[1] = vld1q_u8(table + 16);
+        result.val[2] = vld1q_u8(table + 32);
+        result.val[3] = vld1q_u8(table + 48);
+        return result;
+    }
+
+    size_t encodeNeon(const uint8_t* input, size_t length, char* output) {
+        const uint8x16x4_t table = loadTable64(reinterpret_cast<const uint8_t*>(ENCODE_TABLE));
+        size_t i = 0;
+        size_t o = 0;
+
+        // De-interleave 48 bytes into three registers, interleave 64 characters back out
+        for (; i + 48 <= length; i += 48, o += 64) {
+            uint8x16x3_t in = vld3q_u8(input + i);
+
+            uint8x16x4_t indices;
+            indices.val[0] = vshrq_n_u8(in.val[0], 2);
+            indices.val[1] = vorrq_u8(vshlq_n_u8(vandq_u8(in.val[0], vdupq_n_u8(0x03)), 4), vshrq_n_u8(in.val[1], 4));
+            indices.val[2] = vorrq_u8(vshlq_n_u8(vandq_u8(in.val[1], vdupq_n_u8(0x0F)), 2), vshrq_n_u8(in.val[2], 6));
+            indices.val[3] = vandq_u8(in.val[2], vdupq_n_u8(0x3F));
+
+            uint8x16x4_t chars;
+            chars.val[0] = vqtbl4q_u8(table, indices.val[0]);
+            chars.val[1] = vqtbl4q_u8(table, indices.val[1]);
+            chars.val[2] = vqtbl4q_u8(table, indices.val[2]);
+            chars.val[3] = vqtbl4q_u8(table, indices.val[3]);
+            vst4q_u8(reinterpret_cast<uint8_t*>(output + o), chars);
+        }
+
+        return o + encodeScalar(input + i, length - i, output + o);
+    }
+
+    size_t decodeNeon(const char* input, size_t length, uint8_t* output) {
+        const uint8x16x4_t tableLow = loadTable64(DECODE_TABLE.values);
+        const uint8x16x4_t tableHigh = loadTable64(DECODE_TABLE.values + 64);
+        const uint8x16_t offset = vdupq_n_u8(64);
+        const uint8x16_t highBit = vdupq_n_u8(0x80);
+        size_t i = 0;
+        size_t o = 0;
+
+        for (; i + 64 <= length; i += 64, o += 48) {
+            uint8x16x4_t in = vld4q_u8(reinterpret_cast<const uint8_t*>(input + i));
+
+            uint8x16x4_t values;
+            uint8x16_t error = vdupq_n_u8(0);
+            for (int lane = 0; lane < 4; ++lane) {
+                // Characters 0..63 hit the first table, 64..127 the second; >= 128 is invalid
+                uint8x16_t v = vqtbl4q_u8(tableLow, in.val[lane]);
+                v = vqtbx4q_u8(v, tableHigh, vsubq_u8(in.val[lane], offset));
+                error = vorrq_u8(error, vorrq_u8(v, vandq_u8(in.val[lane], highBit)));
+                values.val[lane] = v;
+            }
+            if (vmaxvq_u8(error) > 63) {
+                break;
+            }
+
+            uint8x16x3_t bytes;
+            bytes.val[0] = vorrq_u8(vshlq_n_u8(values.val[0], 2), vshrq_n_u8(values.val[1], 4));
+            bytes.val[1] = vorrq_u8(vshlq_n_u8(values.val[1], 4), vshrq_n_u8(values.val[2], 2));
+            bytes.val[2] = vorrq_u8(vshlq_n_u8(values.val[2], 6), values.val[3]);
+            vst3q_u8(output + o, bytes);
+        }
+
+        return o + decodeScalar(input + i, length - i, output + o);
+    }
+#endif // BASE64_NEON
+
+    struct Base64Kernels {
+        size_t (*encode)(const uint8_t*, size_t, char*);
+        size_t (*decode)(const char*, size_t, uint8_t*);
+        const char* name;
+        bool (*supported)(const CpuFeatures&);
+    };
+
+    constexpr Base64Kernels VARIANTS[] = {
+#if BASE64_X86
+        {encodeAvx2, decodeAvx2, "avx2", [](const CpuFeatures& cpu) { return cpu.avx2; }},
+        {encodeSsse3, decodeSsse3, "ssse3", [](const CpuFeatures& cpu) { return cpu.ssse3; }},
+#elif BASE64_NEON
+        {encodeNeon, decodeNeon, "neon", [](const CpuFeatures& cpu) { return cpu.neon; }},
+#endif
+        {encodeScalar, decodeScalar, "scalar", anyCpu},
+    };
+
+    KernelTable<Base64Kernels> kernels("base64", VARIANTS);
+}
+
+size_t base64EncodedLength(size_t inputLength) {
+    return ((inputLength + 2) / 3) * 4;
+}
+
+size_t base64DecodedMaxLength(size_t inputLength) {
+    return (inputLength / 4) * 3 + 3;
+}
+
+size_t base64Encode(const uint8_t* input, size_t length, char* output) {
+    return kernels.active().encode(input, length, output);
+}
+
+size_t base64Decode(const char* input, size_t length, uint8_t* output) {
+    return kernels.active().decode(input, length, output);
+}
+
+const char* base64KernelName() {
+    return kernels.activeName();
+}
+
+KernelFamily& base64Kernels() {
+    return kernels;
+}
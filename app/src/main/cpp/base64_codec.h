@@ -0,0 +1,52 @@
+#ifndef BASE64_CODEC_H
+#define BASE64_CODEC_H
+
+#include <cstddef>
+#include <cstdint>
+
+class KernelFamily;
+
+/**
+ * Exact length of the padded base64 encoding of inputLength bytes
+ */
+size_t base64EncodedLength(size_t inputLength);
+
+/**
+ * Upper bound on the decoded length of inputLength base64 characters.
+ * Output buffers passed to base64Decode must be at least this large.
+ */
+size_t base64DecodedMaxLength(size_t inputLength);
+
+/**
+ * Encode bytes to padded base64 (standard alphabet)
+ * @param input Bytes to encode
+ * @param length Number of input bytes
+ * @param output Destination, at least base64EncodedLength(length) bytes. To encode in place,
+ *               place the input at the end of the output buffer, i.e. at
+ *               output + base64EncodedLength(length) - length; output never overtakes unread input.
+ * @return Number of characters written
+ */
+size_t base64Encode(const uint8_t* input, size_t length, char* output);
+
+/**
+ * Decode base64. Decoding stops at the first '=' and characters outside the
+ * alphabet are skipped, so malformed input decodes exactly as it always has.
+ * @param input Characters to decode
+ * @param length Number of input characters
+ * @param output Destination, at least base64DecodedMaxLength(length) bytes, or input
+ *               itself to decode in place (output never overtakes unread input)
+ * @return Number of bytes written
+ */
+size_t base64Decode(const char* input, size_t length, uint8_t* output);
+
+/**
+ * Name of the encode/decode kernel selected for this CPU ("avx2", "ssse3", "neon" or "scalar")
+ */
+const char* base64KernelName();
+
+/**
+ * Variant table of the base64 kernels, for kernel_dispatch
+ */
+KernelFamily& base64Kernels();
+
+#endif // BASE64_CODEC_H
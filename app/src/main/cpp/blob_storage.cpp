@@ -1,8 +1,18 @@
 #include "blob_storage.h"
-#include <fstream>
+#include "cipher_stream.h"
+#include "message_log.h"
+#include "message_codec.h"
+#include "block_compression.h"
+#include "snapshot_checksum.h"
+#include "thread_manager.h"
+#include <algorithm>
+#include <optional>
 #include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
 #include <sys/stat.h>
 #include <sys/types.h>
+#include <sys/uio.h>
 #include <dirent.h>
 #include <unistd.h>
 #include <cerrno>
@@ -12,10 +22,605 @@
 #define LOGI(...) __android_log_print(ANDROID_LOG_INFO, LOG_TAG, __VA_ARGS__)
 #define LOGE(...) __android_log_print(ANDROID_LOG_ERROR, LOG_TAG, __VA_ARGS__)
 
-BlobStorage::BlobStorage() {
+namespace {
+    // Mapped files are fed to decoding and decryption in slices of this size
+    constexpr size_t READ_SLICE_SIZE = 64 * 1024;
+    
+    // Leading part of a message view that is read ahead right away
+    constexpr size_t VIEW_PREFETCH_SIZE = 1024 * 1024;
+    
+    // Saves are written here first and then renamed over the storage file
+    const char* const TEMP_SUFFIX = ".tmp";
+    
+    /**
+     * Add a batch to a merged batch, summing the counts and appending the messages
+     * @return false if the batch is malformed or the total count overflows
+     */
+    bool mergeBatch(std::vector<uint8_t>& merged, ConstByteSpan batch) {
+        uint32_t mergedCount = 0;
+        uint32_t batchCount = 0;
+        if (!readMessageCount(merged, mergedCount) || !readMessageCount(batch, batchCount)) {
+            return false;
+        }
+        uint64_t count = static_cast<uint64_t>(mergedCount) + batchCount;
+        if (count > INT32_MAX) {
+            return false;
+        }
+        writeMessageCount(merged, static_cast<uint32_t>(count));
+        merged.insert(merged.end(), batch.begin() + MESSAGE_COUNT_SIZE, batch.end());
+        return true;
+    }
+    
+    /**
+     * Whether a batch is exactly as many well-formed records as its count says. Appended
+     * batches are merged by their counts alone, so one that is not would misalign the
+     * messages after it.
+     */
+    bool isWellFormedBatch(ConstByteSpan batch) {
+        MessageCursor cursor(batch);
+        MessageRecordView record;
+        while (cursor.next(record)) {
+        }
+        return !cursor.failed() && cursor.offset() == batch.size();
+    }
+    
+    bool writeFully(int fd, ConstByteSpan data) {
+        size_t offset = 0;
+        while (offset < data.size()) {
+            ssize_t written = write(fd, data.data() + offset, data.size() - offset);
+            if (written < 0 && errno == EINTR) {
+                continue;
+            }
+            if (written <= 0) {
+                return false;
+            }
+            offset += static_cast<size_t>(written);
+        }
+        return true;
+    }
+    
+    /**
+     * Flush a file's data to stable storage
+     */
+    bool syncFileData(int fd) {
+#ifdef __APPLE__
+        // fsync() on Darwin stops at the drive cache
+        return fcntl(fd, F_FULLFSYNC) != -1 || fsync(fd) == 0;
+#else
+        return fdatasync(fd) == 0;
+#endif
+    }
+    
+    /**
+     * Flush the directory holding a file, making a rename or creation in it durable
+     */
+    bool syncDirectory(const std::string& filePath) {
+        size_t lastSlash = filePath.find_last_of('/');
+        std::string dirPath = lastSlash == 0 ? "/" : filePath.substr(0, lastSlash);
+        int fd = open(dirPath.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+        if (fd < 0) {
+            return false;
+        }
+        bool ok = fsync(fd) == 0;
+        close(fd);
+        return ok;
+    }
+    
+    /**
+     * Read a whole file
+     * @return false if it cannot be opened or read
+     */
+    bool readWholeFile(const std::string& path, std::vector<uint8_t>& data) {
+        int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd < 0) {
+            return false;
+        }
+        struct stat info;
+        bool ok = fstat(fd, &info) == 0;
+        data.resize(ok ? static_cast<size_t>(info.st_size) : 0);
+        size_t offset = 0;
+        while (ok && offset < data.size()) {
+            ssize_t length = read(fd, data.data() + offset, data.size() - offset);
+            if (length < 0 && errno == EINTR) {
+                continue;
+            }
+            ok = length > 0;
+            offset += ok ? static_cast<size_t>(length) : 0;
+        }
+        close(fd);
+        return ok;
+    }
+    
+    /**
+     * Number of consecutive log segments of a storage file, starting at segment 0
+     */
+    uint32_t countLogSegments(const std::string& filePath) {
+        uint32_t count = 0;
+        struct stat info;
+        while (stat(logSegmentPath(filePath, count).c_str(), &info) == 0) {
+            count++;
+        }
+        return count;
+    }
+    
+    /**
+     * Describe a storage file's snapshot the way its log recorded it. A snapshot whose first
+     * block was damaged after the log was written no longer matches the checksum of its head
+     * in the log's header; its unchanged size and modification time still tie the log to it.
+     * @return false if the snapshot exists but cannot be read
+     */
+    bool readSnapshotBase(const std::string& filePath, LogBase& base) {
+        if (!readLogBase(filePath, base)) {
+            return false;
+        }
+        
+        MappedFile segment;
+        if (!segment.open(logSegmentPath(filePath, 0))) {
+            return true;
+        }
+        uint32_t segmentIndex = 0;
+        LogBase logged;
+        if (segment.bytes().size() < LOG_SEGMENT_HEADER_SIZE ||
+            !readLogSegmentHeader(segment.bytes().data(), segmentIndex, logged) || segmentIndex != 0 ||
+            logged.crc == base.crc || logged.size != base.size || logged.mtimeNs != base.mtimeNs) {
+            return true;
+        }
+        
+        MappedFile snapshot;
+        SnapshotChecksums checksums;
+        if (snapshot.open(filePath) && checksums.read(snapshot.bytes()) &&
+            checksums.intactLength() < std::min(checksums.storedLength(), SNAPSHOT_CHECKSUM_BLOCK_SIZE)) {
+            LOGI("Keeping the message log of a snapshot damaged in its first block: %s", filePath.c_str());
+            base.crc = logged.crc;
+        }
+        return true;
+    }
+    
+    /**
+     * Where a walk over a log got to: the last segment reached and the length of it that
+     * holds intact records
+     */
+    struct LogPosition {
+        uint32_t segment = 0;
+        size_t length = 0;
+    };
+    
+    /**
+     * Visit the intact records of a storage file's log in order, starting at position. The
+     * walk ends at a segment that does not extend the given snapshot, or at a torn or
+     * corrupt record, after which nothing is reachable.
+     * @param position Where to start; receives where the intact records end
+     * @param visit Receives the segment index, the payload's offset in the segment file and
+     *              the payload; returning false aborts the walk
+     * @return false if a segment cannot be read or visit aborted
+     */
+    bool walkLog(const std::string& filePath, const LogBase& base, LogPosition& position,
+                 const std::function<bool(uint32_t, size_t, ConstByteSpan)>& visit) {
+        uint32_t segments = countLogSegments(filePath);
+        for (uint32_t index = position.segment; index < segments; ++index) {
+            std::string segmentPath = logSegmentPath(filePath, index);
+            MappedFile segment;
+            if (!segment.open(segmentPath)) {
+                LOGE("Failed to read log segment: %s", segmentPath.c_str());
+                return false;
+            }
+            ConstByteSpan bytes = segment.bytes();
+            uint32_t segmentIndex = 0;
+            LogBase logBase;
+            if (bytes.size() < LOG_SEGMENT_HEADER_SIZE || !readLogSegmentHeader(bytes.data(), segmentIndex, logBase) ||
+                segmentIndex != index || logBase != base) {
+                if (index == 0) {
+                    LOGI("Ignoring stale message log of: %s", filePath.c_str());
+                } else {
+                    LOGE("Log segment with a torn header: %s", segmentPath.c_str());
+                }
+                break;
+            }
+            
+            size_t from = index == position.segment ? std::max(position.length, LOG_SEGMENT_HEADER_SIZE)
+                                                    : LOG_SEGMENT_HEADER_SIZE;
+            if (from > bytes.size()) {
+                LOGE("Log segment shorter than expected: %s", segmentPath.c_str());
+                return false;
+            }
+            segment.advise(from, bytes.size() - from, MADV_SEQUENTIAL);
+            bool aborted = false;
+            size_t valid = scanLogRecords(bytes.subspan(from), [&](ConstByteSpan payload) {
+                aborted = !visit(index, static_cast<size_t>(payload.data() - bytes.data()), payload);
+                return !aborted;
+            });
+            if (aborted) {
+                return false;
+            }
+            position.segment = index;
+            position.length = from + valid;
+            if (position.length < bytes.size()) {
+                LOGE("Log segment %s ends in a torn record; dropped %zu bytes", segmentPath.c_str(),
+                     bytes.size() - position.length);
+                break;
+            }
+        }
+        return true;
+    }
+    
+    /**
+     * Where the plaintext starts in stored bytes that need no decryption, read the way
+     * loads read them: with an encoding configured, a payload header byte is honoured
+     * @return false if the bytes are BASE64 or compressed and have no plaintext to point into
+     */
+    bool plaintextOffset(ConstByteSpan stored, PayloadEncoding configured, size_t& offset) {
+        offset = 0;
+        if (configured != PayloadEncoding::NONE) {
+            PayloadEncoding encoding = detectPayloadEncoding(stored, PayloadEncoding::NONE);
+            if (encoding == PayloadEncoding::BASE64) {
+                return false;
+            }
+            offset = encoding == PayloadEncoding::BINARY ? 1 : 0;
+        }
+        return !isCompressedContainer(stored.subspan(offset));
+    }
+    
+    /**
+     * Replace a compressed container with its plaintext; anything else is left as it is
+     * @return false if data is a malformed container
+     */
+    bool expandCompressed(std::vector<uint8_t>& data, ThreadManager* threadManager) {
+        if (!isCompressedContainer(data)) {
+            return true;
+        }
+        std::vector<uint8_t> expanded;
+        if (!decompressBlocks(data, expanded, threadManager)) {
+            return false;
+        }
+        data.swap(expanded);
+        return true;
+    }
+    
+    /**
+     * Decompress a snapshot container, or as many of its leading blocks as are intact
+     * @param damaged Set if blocks were lost
+     * @return false if not even the container header is intact
+     */
+    bool decompressSnapshot(ConstByteSpan container, std::vector<uint8_t>& data, ThreadManager* threadManager,
+                            bool& damaged) {
+        if (decompressBlocks(container, data, threadManager)) {
+            return true;
+        }
+        damaged = true;
+        return salvageBlocks(container, data);
+    }
+    
+    /**
+     * Copy the records of index entries begin..end-1 whose timestamp is within [from, to]
+     * into a batch. Each file they lie in is mapped, so only the pages holding them are read,
+     * and the snapshot's checksums are verified for the blocks they touch.
+     * @return false if a file cannot be mapped, a record is not where the index says or
+     *         lies in a damaged block
+     */
+    bool copyIndexedRecords(const std::string& filePath, const MessageIndex& index, size_t begin, size_t end,
+                            int64_t from, int64_t to, std::vector<uint8_t>& data) {
+        std::vector<MappedFile> sources;
+        SnapshotChecksums checksums;
+        bool checked = false;
+        MessageBatchWriter writer(data);
+        MessageRecordView record;
+        for (size_t i = begin; i < end; ++i) {
+            const MessageIndexEntry& entry = index.entries[i];
+            if (entry.timestamp < from || entry.timestamp > to) {
+                continue;
+            }
+            uint32_t source = messageLocationSource(entry.location);
+            if (source >= sources.size()) {
+                sources.resize(source + 1);
+            }
+            if (sources[source].bytes().empty() &&
+                !sources[source].open(source == 0 ? filePath : logSegmentPath(filePath, source - 1))) {
+                return false;
+            }
+            ConstByteSpan bytes = sources[source].bytes();
+            if (source == 0) {
+                checked = checked || checksums.read(bytes);
+                bytes = checked ? bytes.first(checksums.storedLength()) : bytes;
+            }
+            size_t offset = static_cast<size_t>(messageLocationOffset(entry.location));
+            if (!readMessageRecord(bytes, offset, record) || record.timestamp != entry.timestamp ||
+                (source == 0 && checked && !checksums.verify(offset, record.encodedSize())) || !writer.add(record)) {
+                return false;
+            }
+        }
+        return true;
+    }
+    
+    /**
+     * Add the messages of a plaintext batch stored at batchOffset in a source file
+     * @return false if the batch is malformed or lies beyond what a location can address
+     */
+    bool indexBatch(MessageIndex& index, uint32_t source, size_t batchOffset, ConstByteSpan batch) {
+        MessageCursor cursor(batch);
+        MessageRecordView record;
+        while (cursor.next(record)) {
+            uint64_t offset = batchOffset + record.offset;
+            if (offset >> MESSAGE_LOCATION_OFFSET_BITS != 0) {
+                return false;
+            }
+            index.entries.push_back({messageLocation(source, offset), record.timestamp});
+        }
+        return !cursor.failed();
+    }
+    
+    /**
+     * Delete the log segments of a storage file, newest first so that an interrupted
+     * removal still leaves a prefix of the log
+     */
+    bool deleteLogSegments(const std::string& filePath) {
+        bool ok = true;
+        for (uint32_t segments = countLogSegments(filePath); segments > 0; --segments) {
+            std::string segmentPath = logSegmentPath(filePath, segments - 1);
+            if (unlink(segmentPath.c_str()) != 0 && errno != ENOENT) {
+                LOGE("Failed to delete log segment: %s", segmentPath.c_str());
+                ok = false;
+            }
+        }
+        return ok;
+    }
+}
+
+BlobStorage::BlobStorage() : encryptStorage_(false), keyManager_(nullptr), payloadEncoding_(PayloadEncoding::NONE),
+                             compression_(false), threadManager_(nullptr), logSegmentSize_(DEFAULT_LOG_SEGMENT_SIZE),
+                             groupCommit_(false), commitCount_(0), writeBehind_(false),
+                             writeQueue_(std::make_shared<WriteBehind>()) {
+    writeQueue_->storage = this;
 }
 
 BlobStorage::~BlobStorage() {
+    // Pool tasks still to come find the queue empty and the storage gone
+    flush();
+    {
+        std::lock_guard<std::mutex> lock(writeQueue_->mutex);
+        writeQueue_->storage = nullptr;
+    }
+    secureZero(storageKey_, sizeof(storageKey_));
+}
+
+void BlobStorage::setEncryptionKey(const uint8_t* key) {
+    if (key == nullptr) {
+        encryptStorage_ = false;
+        secureZero(storageKey_, sizeof(storageKey_));
+        cache_.clear();
+        return;
+    }
+    std::memcpy(storageKey_, key, sizeof(storageKey_));
+    encryptStorage_ = true;
+    cache_.clear(); // Files are to be read with the new key
+}
+
+void BlobStorage::setKeyManager(KeyManager* keyManager) {
+    keyManager_ = keyManager;
+    cache_.clear();
+}
+
+const uint8_t* BlobStorage::fileKey(const std::string& filePath, SessionKey& derived) {
+    if (keyManager_ != nullptr) {
+        keyManager_->sessionKey(KeyManager::sessionIdFor(filePath), derived);
+        return derived.key;
+    }
+    return encryptStorage_ ? storageKey_ : nullptr;
+}
+
+void BlobStorage::setPayloadEncoding(PayloadEncoding encoding) {
+    payloadEncoding_ = encoding;
+}
+
+void BlobStorage::setCompression(bool enabled) {
+    compression_.store(enabled, std::memory_order_relaxed);
+}
+
+void BlobStorage::setThreadManager(ThreadManager* threadManager) {
+    threadManager_.store(threadManager);
+}
+
+void BlobStorage::setGroupCommit(bool enabled) {
+    groupCommit_.store(enabled, std::memory_order_relaxed);
+}
+
+uint64_t BlobStorage::commitCount() const {
+    return commitCount_.load(std::memory_order_relaxed);
+}
+
+void BlobStorage::setCacheCapacity(size_t bytes) {
+    cache_.setCapacity(bytes);
+}
+
+uint64_t BlobStorage::cacheHitCount() const {
+    return cache_.hitCount();
+}
+
+void BlobStorage::setWriteBehind(bool enabled) {
+    writeBehind_.store(enabled);
+}
+
+void BlobStorage::setWriteCallback(WriteCallback callback) {
+    std::lock_guard<std::mutex> lock(writeQueue_->mutex);
+    writeQueue_->callback = std::move(callback);
+}
+
+bool BlobStorage::flush() {
+    WriteBehind& queue = *writeQueue_;
+    std::unique_lock<std::mutex> lock(queue.mutex);
+    std::vector<std::string> filePaths;
+    for (const auto& pending : queue.pending) {
+        filePaths.push_back(pending.first);
+    }
+    for (const std::string& filePath : filePaths) {
+        drainWrites(filePath, lock);
+    }
+    queue.settled.wait(lock, [&queue]() { return queue.pending.empty(); });
+    bool ok = !queue.failed;
+    queue.failed = false;
+    return ok;
+}
+
+bool BlobStorage::queueWrite(const std::string& filePath, const uint8_t* data, size_t length, bool replace) {
+    WriteBehind& queue = *writeQueue_;
+    {
+        std::lock_guard<std::mutex> lock(queue.mutex);
+        PendingWrite& pending = queue.pending[filePath];
+        if (replace) {
+            // The snapshot holds every message, so whatever was queued before it is moot
+            pending.replace = true;
+            pending.snapshot.assign(data, data + length);
+            pending.appended.clear();
+        } else if (pending.appended.empty()) {
+            pending.appended.assign(data, data + length);
+        } else if (!mergeBatch(pending.appended, ConstByteSpan(data, length))) {
+            LOGE("Failed to queue appended messages for: %s", filePath.c_str());
+            return false;
+        }
+        if (pending.scheduled || pending.writing) {
+            return true; // The writer picks this up along with the rest
+        }
+        pending.scheduled = true;
+    }
+    
+    ThreadManager* threadManager = threadManager_.load();
+    if (threadManager == nullptr) {
+        settleWrites(filePath);
+        return true;
+    }
+    std::shared_ptr<WriteBehind> shared = writeQueue_;
+    threadManager->submitTask([shared, filePath]() {
+        std::unique_lock<std::mutex> lock(shared->mutex);
+        if (shared->storage != nullptr) {
+            shared->storage->drainWrites(filePath, lock);
+        }
+    });
+    return true;
+}
+
+void BlobStorage::drainWrites(const std::string& filePath, std::unique_lock<std::mutex>& lock) {
+    WriteBehind& queue = *writeQueue_;
+    auto found = queue.pending.find(filePath);
+    if (found == queue.pending.end() || found->second.writing) {
+        return;
+    }
+    PendingWrite& pending = found->second; // Stays valid while other files are queued
+    pending.writing = true;
+    pending.scheduled = false;
+    
+    while (pending.replace || !pending.appended.empty()) {
+        bool replace = pending.replace;
+        std::vector<uint8_t> snapshot;
+        std::vector<uint8_t> appended;
+        snapshot.swap(pending.snapshot);
+        appended.swap(pending.appended);
+        pending.replace = false;
+        WriteCallback callback = queue.callback;
+        lock.unlock();
+        
+        // Appends queued after a snapshot that failed would land on an older one; they fail with it
+        bool ok = !replace || saveSnapshot(filePath, snapshot.data(), snapshot.size());
+        if (ok && !appended.empty()) {
+            ok = appendBatch(filePath, appended.data(), appended.size());
+        }
+        if (callback) {
+            callback(filePath, ok);
+        }
+        
+        lock.lock();
+        queue.failed = queue.failed || !ok;
+    }
+    
+    // A task still scheduled for the file finds nothing and returns
+    queue.pending.erase(filePath);
+    queue.settled.notify_all();
+}
+
+void BlobStorage::settleWrites(const std::string& filePath) {
+    WriteBehind& queue = *writeQueue_;
+    std::unique_lock<std::mutex> lock(queue.mutex);
+    if (queue.pending.empty()) {
+        return;
+    }
+    drainWrites(filePath, lock);
+    queue.settled.wait(lock, [&queue, &filePath]() { return queue.pending.count(filePath) == 0; });
+}
+
+void BlobStorage::setLogSegmentSize(size_t bytes) {
+    std::lock_guard<std::mutex> lock(logMutex_);
+    logSegmentSize_ = bytes;
+}
+
+bool BlobStorage::writeEncoded(const StreamSink& output, const uint8_t* key, const uint8_t* data, size_t length) {
+    // data -> [encryptor] -> encoder -> output, one bounded piece at a time
+    PayloadEncoder encoder(payloadEncoding_, output);
+    
+    if (key == nullptr) {
+        return encoder.update(ConstByteSpan(data, length)) && encoder.finalize();
+    }
+    
+    StreamEncryptor encryptor(key, length, [&encoder](ConstByteSpan piece) {
+        return encoder.update(piece);
+    });
+    return encryptor.update(ConstByteSpan(data, length)) && encryptor.finalize() && encoder.finalize();
+}
+
+bool BlobStorage::readDecoded(const std::function<bool(const StreamSink&)>& source, const uint8_t* key, size_t inputSize,
+                              std::vector<uint8_t>& data) {
+    data.clear();
+    StreamSink appendData = [&data](ConstByteSpan piece) {
+        data.insert(data.end(), piece.begin(), piece.end());
+        return true;
+    };
+    
+    // Decoded content is collected in data until a container header could be recognized.
+    // With a key set, a container is then decrypted; anything else is a plaintext file
+    // from before encryption was enabled and passes through.
+    std::optional<StreamDecryptor> decryptor;
+    bool contentKnown = key == nullptr;
+    StreamSink content = [&](ConstByteSpan piece) {
+        if (contentKnown) {
+            return decryptor ? decryptor->update(piece) : appendData(piece);
+        }
+        
+        appendData(piece);
+        ChunkedHeader header;
+        if (data.size() < CHUNKED_HEADER_SIZE) {
+            return true;
+        }
+        contentKnown = true;
+        if (!readChunkedHeader(data.data(), header)) {
+            return true;
+        }
+        
+        std::vector<uint8_t> received;
+        received.swap(data);
+        // Capped by the input size, so a forged header cannot inflate the allocation
+        if (header.plaintextLength <= inputSize) {
+            data.reserve(static_cast<size_t>(header.plaintextLength));
+        }
+        decryptor.emplace(key, appendData);
+        return decryptor->update(received);
+    };
+    
+    // Files without a payload header byte are read as they are. Telling them apart by their
+    // first byte is safe only because that is the high byte of the big-endian message count,
+    // 0 below 16M messages, and compressed containers start with 'F': neither is a header byte.
+    std::optional<PayloadDecoder> decoder;
+    StreamSink input = content;
+    if (payloadEncoding_ != PayloadEncoding::NONE) {
+        decoder.emplace(PayloadEncoding::NONE, content);
+        input = [&decoder](ConstByteSpan piece) {
+            return decoder->update(piece);
+        };
+    }
+    
+    bool ok = source(input);
+    ok = ok && (!decoder || decoder->finalize()) && (!decryptor || decryptor->finalize());
+    if (!ok) {
+        // Never hand out chunks of a container that failed authentication later on
+        data.clear();
+    }
+    return ok;
 }
 
 bool BlobStorage::ensureDirectoryExists(const std::string& filePath) {
@@ -64,33 +669,689 @@ bool BlobStorage::saveMessages(const std::string& filePath, const uint8_t* data,
         return false;
     }
     
+    if (writeBehind_.load()) {
+        return queueWrite(filePath, data, length, true);
+    }
+    settleWrites(filePath);
+    return saveSnapshot(filePath, data, length);
+}
+
+bool BlobStorage::saveSnapshot(const std::string& filePath, const uint8_t* data, size_t length) {
     // Ensure directory exists
     if (!ensureDirectoryExists(filePath)) {
         LOGE("Failed to ensure directory exists for: %s", filePath.c_str());
         return false;
     }
     
-    // Open file for writing in binary mode
-    std::ofstream file(filePath, std::ios::binary | std::ios::trunc);
-    if (!file.is_open()) {
-        LOGE("Failed to open file for writing: %s", filePath.c_str());
+    SaveQueue& queue = saveQueue(filePath);
+    std::unique_lock<std::mutex> lock(queue.mutex);
+    bool group = groupCommit_.load(std::memory_order_relaxed);
+    uint64_t ticket = ++queue.issued;
+    if (group) {
+        queue.newestData = data;
+        queue.newestLength = length;
+        queue.newest = ticket;
+    }
+    
+    // Saves of one file take turns, as they share the temporary file. In a group, whoever
+    // commits writes the newest waiting snapshot, which settles every older one as well.
+    for (;;) {
+        if (group && queue.durable >= ticket) {
+            return true;
+        }
+        if (group && queue.failed >= ticket) {
+            return false;
+        }
+        if (!queue.committing) {
+            break;
+        }
+        queue.changed.wait(lock);
+    }
+    
+    queue.committing = true;
+    const uint8_t* commitData = group ? queue.newestData : data;
+    size_t commitLength = group ? queue.newestLength : length;
+    uint64_t committed = group ? queue.newest : ticket;
+    lock.unlock();
+    
+    bool ok = commitSnapshot(filePath, commitData, commitLength);
+    
+    lock.lock();
+    queue.committing = false;
+    if (group) {
+        uint64_t& settled = ok ? queue.durable : queue.failed;
+        settled = std::max(settled, committed);
+    }
+    queue.changed.notify_all();
+    return ok;
+}
+
+BlobStorage::SaveQueue& BlobStorage::saveQueue(const std::string& filePath) {
+    std::lock_guard<std::mutex> lock(saveQueuesMutex_);
+    std::unique_ptr<SaveQueue>& queue = saveQueues_[filePath];
+    if (!queue) {
+        queue.reset(new SaveQueue());
+    }
+    return *queue;
+}
+
+bool BlobStorage::commitSnapshot(const std::string& filePath, const uint8_t* data, size_t length) {
+    // Write a temporary file and rename it over the old one once its data is on disk, so
+    // a crash leaves either the previous snapshot or the new one, never a partial file
+    std::string tempPath = filePath + TEMP_SUFFIX;
+    int fd = open(tempPath.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        LOGE("Failed to open file for writing: %s", tempPath.c_str());
         return false;
     }
     
-    // Write data
-    file.write(reinterpret_cast<const char*>(data), length);
+    SessionKey derived;
+    const uint8_t* key = fileKey(filePath, derived);
+    std::vector<uint8_t> compressed;
+    bool indexable = key == nullptr && payloadEncoding_ != PayloadEncoding::BASE64;
+    if (compression_.load(std::memory_order_relaxed) &&
+        compressBlocks(ConstByteSpan(data, length), compressed, threadManager_.load()) && compressed.size() < length) {
+        data = compressed.data();
+        length = compressed.size();
+        indexable = false;
+    }
+    
+    // Plaintext snapshots end in block checksums of what was stored before them
+    SnapshotChecksumWriter checksums;
+    StreamSink output = [fd, indexable, &checksums](ConstByteSpan piece) {
+        if (indexable) {
+            checksums.update(piece);
+        }
+        return writeFully(fd, piece);
+    };
+    bool ok;
+    if (key != nullptr || payloadEncoding_ != PayloadEncoding::NONE) {
+        ok = writeEncoded(output, key, data, length);
+    } else {
+        ok = output(ConstByteSpan(data, length));
+    }
+    if (ok && indexable) {
+        ok = writeFully(fd, checksums.finish());
+    }
+    ok = ok && syncFileData(fd);
+    ok = close(fd) == 0 && ok;
     
-    if (!file.good()) {
+    // Appends trust the log tail they remember, so none may go to the old log between the
+    // rename and its removal
+    std::lock_guard<std::mutex> lock(logMutex_);
+    if (!ok || rename(tempPath.c_str(), filePath.c_str()) != 0) {
         LOGE("Failed to write data to file: %s", filePath.c_str());
-        file.close();
+        unlink(tempPath.c_str());
+        return false;
+    }
+    
+    // Make the rename itself durable
+    bool synced = syncDirectory(filePath);
+    if (!synced) {
+        LOGE("Failed to sync directory of: %s", filePath.c_str());
+    }
+    commitCount_.fetch_add(1, std::memory_order_relaxed);
+    
+    // The snapshot now holds everything, so the log is obsolete. Should this not complete,
+    // the log no longer matches the snapshot and loads ignore it.
+    bool removed = removeLog(filePath);
+    cache_.invalidate(filePath); // Only now that the files are final, as stamps are not rechecked
+    if (!removed) {
         return false;
     }
     
-    file.close();
+    // The index of a plaintext snapshot comes from the batch in hand, without reading it back
+    if (indexable) {
+        MessageIndex index;
+        size_t start = payloadEncoding_ == PayloadEncoding::BINARY ? 1 : 0;
+        if (readLogBase(filePath, index.base) && indexBatch(index, 0, start, ConstByteSpan(data, length))) {
+            persistIndex(filePath, indexes_[filePath] = std::move(index), 0);
+        }
+    }
+    return synced;
+}
+
+bool BlobStorage::appendMessages(const std::string& filePath, const uint8_t* data, size_t length) {
+    if (data == nullptr || !isWellFormedBatch(ConstByteSpan(data, length))) {
+        LOGE("Invalid data for appendMessages");
+        return false;
+    }
+    
+    if (writeBehind_.load()) {
+        return queueWrite(filePath, data, length, false);
+    }
+    settleWrites(filePath);
+    return appendBatch(filePath, data, length);
+}
+
+bool BlobStorage::appendBatch(const std::string& filePath, const uint8_t* data, size_t length) {
+    if (!ensureDirectoryExists(filePath)) {
+        LOGE("Failed to ensure directory exists for: %s", filePath.c_str());
+        return false;
+    }
+    
+    // The record payload is the batch, compressed, encrypted and encoded like a saved file
+    SessionKey derived;
+    const uint8_t* key = fileKey(filePath, derived);
+    std::vector<uint8_t> compressed;
+    if (compression_.load(std::memory_order_relaxed) &&
+        compressBlocks(ConstByteSpan(data, length), compressed, threadManager_.load()) && compressed.size() < length) {
+        data = compressed.data();
+        length = compressed.size();
+    }
+    std::vector<uint8_t> encoded;
+    ConstByteSpan payload(data, length);
+    if (key != nullptr || payloadEncoding_ != PayloadEncoding::NONE) {
+        StreamSink output = [&encoded](ConstByteSpan piece) {
+            encoded.insert(encoded.end(), piece.begin(), piece.end());
+            return true;
+        };
+        if (!writeEncoded(output, key, data, length)) {
+            LOGE("Failed to encode appended messages for: %s", filePath.c_str());
+            return false;
+        }
+        payload = ConstByteSpan(encoded.data(), encoded.size());
+    }
+    if (payload.size() > UINT32_MAX) {
+        LOGE("Appended batch too large: %zu bytes", payload.size());
+        return false;
+    }
+    
+    std::lock_guard<std::mutex> lock(logMutex_);
+    
+    // The remembered tail holds as long as nobody else changed the segment since
+    LogTail tail;
+    auto cached = logTails_.find(filePath);
+    struct stat info;
+    bool known = false;
+    if (cached != logTails_.end()) {
+        tail = cached->second;
+        bool exists = stat(logSegmentPath(filePath, tail.segmentIndex).c_str(), &info) == 0;
+        known = tail.length == 0 ? !exists : exists && static_cast<size_t>(info.st_size) == tail.length;
+    }
+    if (!known && !recoverLogTail(filePath, tail)) {
+        logTails_.erase(filePath);
+        return false;
+    }
+    MessageIndex* index = currentIndex(filePath, key);
+    
+    size_t recordSize = LOG_RECORD_HEADER_SIZE + payload.size();
+    if (tail.length > 0 && tail.length + recordSize > logSegmentSize_) {
+        tail.segmentIndex++;
+        tail.length = 0;
+    }
+    size_t payloadOffset = (tail.length == 0 ? LOG_SEGMENT_HEADER_SIZE : tail.length) + LOG_RECORD_HEADER_SIZE;
+    
+    // A new segment gets its header in the same write as its first record
+    uint8_t segmentHeader[LOG_SEGMENT_HEADER_SIZE];
+    uint8_t recordHeader[LOG_RECORD_HEADER_SIZE];
+    struct iovec pieces[3];
+    int pieceCount = 0;
+    if (tail.length == 0) {
+        LogBase base;
+        if (!readSnapshotBase(filePath, base)) {
+            LOGE("Failed to read storage file: %s", filePath.c_str());
+            return false;
+        }
+        writeLogSegmentHeader(segmentHeader, tail.segmentIndex, base);
+        pieces[pieceCount++] = {segmentHeader, sizeof(segmentHeader)};
+    }
+    writeLogRecordHeader(recordHeader, payload);
+    pieces[pieceCount++] = {recordHeader, sizeof(recordHeader)};
+    pieces[pieceCount++] = {const_cast<uint8_t*>(payload.data()), payload.size()};
+    size_t total = (tail.length == 0 ? LOG_SEGMENT_HEADER_SIZE : 0) + recordSize;
+    
+    std::string segmentPath = logSegmentPath(filePath, tail.segmentIndex);
+    int flags = O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC | (tail.length == 0 ? O_TRUNC : 0);
+    int fd = open(segmentPath.c_str(), flags, 0644);
+    if (fd < 0) {
+        LOGE("Failed to open log segment: %s", segmentPath.c_str());
+        logTails_.erase(filePath);
+        return false;
+    }
+    ssize_t written;
+    do {
+        written = writev(fd, pieces, pieceCount);
+    } while (written < 0 && errno == EINTR);
+    bool ok = written == static_cast<ssize_t>(total);
+    if (!ok) {
+        // Take back a partial record rather than leave it for the next append to follow
+        LOGE("Failed to append to log segment: %s", segmentPath.c_str());
+        if (tail.length == 0) {
+            unlink(segmentPath.c_str());
+        } else if (ftruncate(fd, static_cast<off_t>(tail.length)) != 0) {
+            LOGE("Failed to truncate log segment: %s", segmentPath.c_str());
+        }
+    }
+    close(fd);
+    cache_.invalidate(filePath);
+    
+    if (!ok) {
+        logTails_.erase(filePath);
+        return false;
+    }
+    tail.length += total;
+    logTails_[filePath] = tail;
+    
+    if (index != nullptr) {
+        // Indexing the new messages costs only their own entries
+        size_t from = index->entries.size();
+        size_t start = 0;
+        if (plaintextOffset(payload, payloadEncoding_, start) &&
+            indexBatch(*index, tail.segmentIndex + 1, payloadOffset + start, payload.subspan(start))) {
+            index->logSegment = tail.segmentIndex;
+            index->logLength = tail.length;
+            persistIndex(filePath, *index, from);
+        } else {
+            dropIndex(filePath);
+        }
+    }
+    return true;
+}
+
+bool BlobStorage::recoverLogTail(const std::string& filePath, LogTail& tail) {
+    tail = {0, 0};
+    uint32_t segments = countLogSegments(filePath);
+    if (segments == 0) {
+        return true;
+    }
+    
+    LogBase base;
+    if (!readSnapshotBase(filePath, base)) {
+        LOGE("Failed to read storage file: %s", filePath.c_str());
+        return false;
+    }
+    
+    std::vector<uint8_t> segment;
+    uint32_t segmentIndex = 0;
+    LogBase logBase;
+    bool current = readWholeFile(logSegmentPath(filePath, 0), segment) && segment.size() >= LOG_SEGMENT_HEADER_SIZE &&
+                   readLogSegmentHeader(segment.data(), segmentIndex, logBase) && segmentIndex == 0 && logBase == base;
+    if (!current) {
+        LOGI("Discarding stale message log of: %s", filePath.c_str());
+        return deleteLogSegments(filePath);
+    }
+    
+    // Only the last segment can have been cut short
+    uint32_t last = segments - 1;
+    std::string segmentPath = logSegmentPath(filePath, last);
+    if (last > 0 && !readWholeFile(segmentPath, segment)) {
+        LOGE("Failed to read log segment: %s", segmentPath.c_str());
+        return false;
+    }
+    if (segment.size() < LOG_SEGMENT_HEADER_SIZE || !readLogSegmentHeader(segment.data(), segmentIndex, logBase) ||
+        segmentIndex != last || logBase != base) {
+        LOGE("Dropping log segment with a torn header: %s", segmentPath.c_str());
+        if (unlink(segmentPath.c_str()) != 0) {
+            return false;
+        }
+        tail = {last, 0};
+        return true;
+    }
+    
+    ConstByteSpan body(segment.data() + LOG_SEGMENT_HEADER_SIZE, segment.size() - LOG_SEGMENT_HEADER_SIZE);
+    size_t valid = LOG_SEGMENT_HEADER_SIZE + scanLogRecords(body, [](ConstByteSpan) { return true; });
+    if (valid < segment.size()) {
+        LOGE("Truncating log segment %s from %zu to %zu bytes after a torn record",
+             segmentPath.c_str(), segment.size(), valid);
+        if (truncate(segmentPath.c_str(), static_cast<off_t>(valid)) != 0) {
+            LOGE("Failed to truncate log segment: %s", segmentPath.c_str());
+            return false;
+        }
+    }
+    tail = {last, valid};
+    return true;
+}
+
+bool BlobStorage::mergeLog(const std::string& filePath, const uint8_t* key, std::vector<uint8_t>& data) {
+    if (countLogSegments(filePath) == 0) {
+        return true;
+    }
+    
+    LogBase base;
+    if (!readSnapshotBase(filePath, base)) {
+        LOGE("Failed to read storage file: %s", filePath.c_str());
+        return false;
+    }
+    
+    // An empty snapshot is an empty batch
+    if (data.empty()) {
+        data.assign(MESSAGE_COUNT_SIZE, 0);
+    } else if (data.size() < MESSAGE_COUNT_SIZE) {
+        LOGE("Storage file too short to extend: %s", filePath.c_str());
+        return false;
+    }
+    
+    std::vector<uint8_t> batch;
+    LogPosition position;
+    bool ok = walkLog(filePath, base, position, [&](uint32_t segmentIndex, size_t, ConstByteSpan payload) {
+        bool merged;
+        if (key != nullptr || payloadEncoding_ != PayloadEncoding::NONE) {
+            auto source = [payload](const StreamSink& input) {
+                return input(payload);
+            };
+            merged = readDecoded(source, key, payload.size(), batch) &&
+                     expandCompressed(batch, threadManager_.load()) && mergeBatch(data, batch);
+        } else if (isCompressedContainer(payload)) {
+            merged = decompressBlocks(payload, batch, threadManager_.load()) && mergeBatch(data, batch);
+        } else {
+            merged = mergeBatch(data, payload);
+        }
+        if (!merged) {
+            LOGE("Failed to decode log record in: %s", logSegmentPath(filePath, segmentIndex).c_str());
+        }
+        return merged;
+    });
+    
+    if (!ok) {
+        data.clear();
+    }
+    return ok;
+}
+
+bool BlobStorage::removeLog(const std::string& filePath) {
+    logTails_.erase(filePath);
+    dropIndex(filePath);
+    return deleteLogSegments(filePath);
+}
+
+MessageIndex* BlobStorage::currentIndex(const std::string& filePath, const uint8_t* key) {
+    if (key != nullptr || payloadEncoding_ == PayloadEncoding::BASE64 || compression_.load(std::memory_order_relaxed)) {
+        dropIndex(filePath);
+        return nullptr;
+    }
+    LogBase base;
+    if (!readLogBase(filePath, base)) {
+        return nullptr;
+    }
+    
+    auto found = indexes_.find(filePath);
+    if (found == indexes_.end()) {
+        MessageIndex loaded;
+        if (readMessageIndex(messageIndexPath(filePath), loaded) && loaded.base == base) {
+            found = indexes_.emplace(filePath, std::move(loaded)).first;
+        }
+    }
+    
+    // Compare what the index covers with the log as it is now
+    MessageIndex* index = found != indexes_.end() && found->second.base == base ? &found->second : nullptr;
+    if (index != nullptr) {
+        uint32_t segments = countLogSegments(filePath);
+        struct stat info;
+        int64_t covered = -1;
+        if (index->logLength == 0) {
+            covered = 0;
+        } else if (stat(logSegmentPath(filePath, index->logSegment).c_str(), &info) == 0) {
+            covered = static_cast<int64_t>(info.st_size);
+        }
+        bool shrunk = covered < 0 || (index->logLength > 0 && (segments <= index->logSegment ||
+                                                               static_cast<uint64_t>(covered) < index->logLength));
+        bool current = index->logLength == 0 ? segments == 0
+                                             : segments == index->logSegment + 1 &&
+                                               static_cast<uint64_t>(covered) == index->logLength;
+        if (current) {
+            return index;
+        }
+        if (!shrunk) {
+            // Catch up with batches appended since, e.g. by an earlier process
+            size_t from = index->entries.size();
+            LogPosition position;
+            position.segment = index->logSegment;
+            position.length = static_cast<size_t>(index->logLength);
+            bool extended = walkLog(filePath, base, position, [&](uint32_t segment, size_t offset, ConstByteSpan payload) {
+                size_t start = 0;
+                return plaintextOffset(payload, payloadEncoding_, start) &&
+                       indexBatch(*index, segment + 1, offset + start, payload.subspan(start));
+            });
+            if (extended) {
+                index->logSegment = position.segment;
+                index->logLength = position.length;
+                persistIndex(filePath, *index, from);
+                return index;
+            }
+        }
+    }
+    
+    MessageIndex rebuilt;
+    if (!buildIndex(filePath, base, rebuilt)) {
+        dropIndex(filePath);
+        return nullptr;
+    }
+    index = &(indexes_[filePath] = std::move(rebuilt));
+    persistIndex(filePath, *index, 0);
+    return index;
+}
+
+bool BlobStorage::buildIndex(const std::string& filePath, const LogBase& base, MessageIndex& index) {
+    index = MessageIndex();
+    index.base = base;
+    if (base.size > 0) {
+        MappedFile snapshot;
+        if (!snapshot.open(filePath)) {
+            return false;
+        }
+        ConstByteSpan bytes = snapshot.bytes();
+        size_t start = 0;
+        snapshot.advise(0, bytes.size(), MADV_SEQUENTIAL);
+        
+        // A damaged snapshot is left to loads, which keep what comes before the damage
+        SnapshotChecksums checksums;
+        if (checksums.read(bytes)) {
+            if (checksums.intactLength() < checksums.storedLength()) {
+                return false;
+            }
+            bytes = bytes.first(checksums.storedLength());
+        }
+        if (!plaintextOffset(bytes, payloadEncoding_, start) || !indexBatch(index, 0, start, bytes.subspan(start))) {
+            return false;
+        }
+    }
+    
+    LogPosition position;
+    bool indexed = walkLog(filePath, base, position, [&](uint32_t segment, size_t offset, ConstByteSpan payload) {
+        size_t start = 0;
+        return plaintextOffset(payload, payloadEncoding_, start) &&
+               indexBatch(index, segment + 1, offset + start, payload.subspan(start));
+    });
+    index.logSegment = position.segment;
+    index.logLength = position.length;
+    return indexed;
+}
+
+void BlobStorage::persistIndex(const std::string& filePath, const MessageIndex& index, size_t from) {
+    std::string indexPath = messageIndexPath(filePath);
+    bool ok = from == 0 ? writeMessageIndex(indexPath, index) : appendMessageIndex(indexPath, index, from);
+    if (!ok) {
+        LOGE("Failed to update message index: %s", indexPath.c_str());
+        unlink(indexPath.c_str());
+    }
+}
+
+void BlobStorage::dropIndex(const std::string& filePath) {
+    indexes_.erase(filePath);
+    std::string indexPath = messageIndexPath(filePath);
+    if (unlink(indexPath.c_str()) != 0 && errno != ENOENT) {
+        LOGE("Failed to delete message index: %s", indexPath.c_str());
+    }
+}
+
+bool BlobStorage::loadRange(const std::string& filePath, uint32_t first, uint32_t count, std::vector<uint8_t>& data) {
+    return loadPage(filePath, first, count, data);
+}
+
+bool BlobStorage::loadLatest(const std::string& filePath, uint32_t count, std::vector<uint8_t>& data) {
+    return loadPage(filePath, -1, count, data);
+}
+
+int64_t BlobStorage::countMessages(const std::string& filePath) {
+    settleWrites(filePath);
+    SessionKey derived;
+    const uint8_t* key = fileKey(filePath, derived);
+    {
+        std::lock_guard<std::mutex> lock(logMutex_);
+        MessageIndex* index = currentIndex(filePath, key);
+        if (index != nullptr) {
+            return static_cast<int64_t>(index->entries.size());
+        }
+    }
+    
+    std::vector<uint8_t> data;
+    uint32_t count = 0;
+    if (!loadMessages(filePath, data)) {
+        return -1;
+    }
+    return data.empty() || readMessageCount(data, count) ? count : -1;
+}
+
+bool BlobStorage::loadPage(const std::string& filePath, int64_t first, uint32_t count, std::vector<uint8_t>& data) {
+    settleWrites(filePath);
+    data.clear();
+    SessionKey derived;
+    const uint8_t* key = fileKey(filePath, derived);
+    {
+        std::lock_guard<std::mutex> lock(logMutex_);
+        MessageIndex* index = currentIndex(filePath, key);
+        if (index != nullptr) {
+            size_t total = index->entries.size();
+            size_t begin = first < 0 ? total - std::min<size_t>(total, count) : std::min<size_t>(total, first);
+            size_t end = begin + std::min<size_t>(total - begin, count);
+            if (copyIndexedRecords(filePath, *index, begin, end, INT64_MIN, INT64_MAX, data)) {
+                return true;
+            }
+            LOGE("Message index out of step with: %s", filePath.c_str());
+            dropIndex(filePath);
+            data.clear();
+        }
+    }
+    
+    // Files that have to be decoded are loaded whole and paged here
+    std::vector<uint8_t> all;
+    if (!loadMessages(filePath, all)) {
+        return false;
+    }
+    if (all.empty()) {
+        return true;
+    }
+    MessageCursor cursor(all);
+    MessageBatchWriter writer(data);
+    uint32_t begin = first < 0 ? cursor.count() - std::min(cursor.count(), count)
+                               : static_cast<uint32_t>(std::min<int64_t>(first, cursor.count()));
+    MessageRecordView record;
+    cursor.skip(begin);
+    while (writer.count() < count && cursor.next(record)) {
+        writer.add(record);
+    }
+    if (cursor.failed()) {
+        LOGE("Malformed messages in: %s", filePath.c_str());
+        data.clear();
+        return false;
+    }
+    return true;
+}
+
+bool BlobStorage::loadSince(const std::string& filePath, int64_t since, std::vector<uint8_t>& data) {
+    return loadBetween(filePath, since, INT64_MAX, data);
+}
+
+bool BlobStorage::loadBetween(const std::string& filePath, int64_t from, int64_t to, std::vector<uint8_t>& data) {
+    settleWrites(filePath);
+    data.clear();
+    SessionKey derived;
+    const uint8_t* key = fileKey(filePath, derived);
+    {
+        std::lock_guard<std::mutex> lock(logMutex_);
+        MessageIndex* index = currentIndex(filePath, key);
+        if (index != nullptr) {
+            size_t begin = 0;
+            size_t end = 0;
+            indexMessageTimes(*index);
+            findMessageTimes(*index, from, to, begin, end);
+            if (copyIndexedRecords(filePath, *index, begin, end, from, to, data)) {
+                return true;
+            }
+            LOGE("Message index out of step with: %s", filePath.c_str());
+            dropIndex(filePath);
+            data.clear();
+        }
+    }
+    
+    // Files that have to be decoded are loaded whole and filtered here
+    std::vector<uint8_t> all;
+    if (!loadMessages(filePath, all)) {
+        return false;
+    }
+    if (!all.empty() && !selectMessages(all, [from, to](const MessageRecordView& record) {
+            return record.timestamp >= from && record.timestamp <= to;
+        }, data)) {
+        LOGE("Malformed messages in: %s", filePath.c_str());
+        data.clear();
+        return false;
+    }
     return true;
 }
 
 bool BlobStorage::loadMessages(const std::string& filePath, std::vector<uint8_t>& data) {
+    settleWrites(filePath);
+    if (cache_.capacity() > 0) {
+        std::shared_ptr<const std::vector<uint8_t>> messages = loadCached(filePath);
+        if (!messages) {
+            return false;
+        }
+        data = *messages;
+        return true;
+    }
+    
+    SessionKey derived;
+    const uint8_t* key = fileKey(filePath, derived);
+    // The log is merged even onto a damaged snapshot: its records are intact, and the next
+    // saveMessages() would otherwise fold it away without them
+    bool damaged = false;
+    return loadSnapshot(filePath, key, data, damaged) && mergeLog(filePath, key, data);
+}
+
+std::shared_ptr<const std::vector<uint8_t>> BlobStorage::loadCached(const std::string& filePath) {
+    uint64_t generation = cache_.generation();
+    StorageStamp stamp;
+    bool stamped = readStorageStamp(filePath, stamp);
+    if (stamped) {
+        std::shared_ptr<const std::vector<uint8_t>> cached = cache_.find(filePath, stamp);
+        if (cached) {
+            return cached;
+        }
+    }
+    
+    SessionKey derived;
+    const uint8_t* key = fileKey(filePath, derived);
+    std::vector<uint8_t> data;
+    bool damaged = false;
+    if (!loadSnapshot(filePath, key, data, damaged) || !mergeLog(filePath, key, data)) {
+        return nullptr;
+    }
+    auto messages = std::make_shared<const std::vector<uint8_t>>(std::move(data));
+    
+    // Files that changed while being read are not cached; the next load reads them again
+    StorageStamp after;
+    if (stamped && readStorageStamp(filePath, after) && after == stamp) {
+        cache_.store(filePath, stamp, messages, generation);
+    }
+    return messages;
+}
+
+bool BlobStorage::storageStamp(const std::string& filePath, StorageStamp& stamp) {
+    if (cache_.findStamp(filePath, stamp)) {
+        return true;
+    }
+    uint64_t generation = cache_.generation();
+    if (!readStorageStamp(filePath, stamp)) {
+        return false;
+    }
+    cache_.store(filePath, stamp, nullptr, generation);
+    return true;
+}
+
+bool BlobStorage::loadSnapshot(const std::string& filePath, const uint8_t* key, std::vector<uint8_t>& data,
+                               bool& damaged) {
+    damaged = false;
     // Check if file exists and is readable
     struct stat info;
     if (stat(filePath.c_str(), &info) != 0) {
@@ -104,75 +1365,169 @@ bool BlobStorage::loadMessages(const std::string& filePath, std::vector<uint8_t>
         return false;
     }
     
-    // Open file for reading in binary mode
-    std::ifstream file(filePath, std::ios::binary | std::ios::ate);
-    if (!file.is_open()) {
+    MappedFile mapping;
+    if (!mapping.open(filePath)) {
         LOGE("Failed to open file for reading: %s", filePath.c_str());
         return false;
     }
     
-    // Get file size
-    std::streamsize fileSize = file.tellg();
-    file.seekg(0, std::ios::beg);
-    
-    if (fileSize <= 0) {
+    ConstByteSpan bytes = mapping.bytes();
+    if (bytes.empty()) {
         data.clear();
-        file.close();
         return true; // Empty file is valid
     }
+    mapping.advise(0, bytes.size(), MADV_SEQUENTIAL);
     
-    // Read file content
-    data.resize(static_cast<size_t>(fileSize));
-    file.read(reinterpret_cast<char*>(data.data()), fileSize);
+    // Checksums come off first; a damaged block ends what is read
+    SnapshotChecksums checksums;
+    if (checksums.read(bytes)) {
+        size_t intact = checksums.intactLength();
+        damaged = intact < checksums.storedLength();
+        bytes = bytes.first(intact);
+    }
     
-    if (!file.good() && !file.eof()) {
-        LOGE("Failed to read data from file: %s", filePath.c_str());
-        file.close();
-        return false;
+    bool ok;
+    if (key != nullptr || payloadEncoding_ != PayloadEncoding::NONE) {
+        auto source = [bytes](const StreamSink& input) {
+            for (size_t offset = 0; offset < bytes.size(); offset += READ_SLICE_SIZE) {
+                if (!input(bytes.subspan(offset, std::min(READ_SLICE_SIZE, bytes.size() - offset)))) {
+                    return false;
+                }
+            }
+            return true;
+        };
+        ok = readDecoded(source, key, bytes.size(), data);
+        if (ok && isCompressedContainer(data)) {
+            std::vector<uint8_t> container;
+            container.swap(data);
+            ok = decompressSnapshot(container, data, threadManager_.load(), damaged);
+        }
+        if (!ok) {
+            LOGE("Failed to decode file: %s", filePath.c_str());
+        }
+    } else if (isCompressedContainer(bytes)) {
+        // Blocks are decompressed straight out of the mapping
+        ok = decompressSnapshot(bytes, data, threadManager_.load(), damaged);
+        if (!ok) {
+            LOGE("Failed to decompress file: %s", filePath.c_str());
+        }
+    } else {
+        data.assign(bytes.begin(), bytes.end());
+        ok = true;
     }
     
-    file.close();
-    return true;
+    if (ok && damaged) {
+        uint32_t kept = truncateMessages(data);
+        LOGE("Storage file damaged, loaded the %u messages before the damage: %s", kept, filePath.c_str());
+    }
+    return ok;
 }
 
-bool BlobStorage::clearMessages(const std::string& filePath) {
-    // Check if file exists
+bool BlobStorage::viewMessages(const std::string& filePath, MessageView& view) {
+    settleWrites(filePath);
+    view.mapping_.close();
+    view.copy_.clear();
+    view.shared_.reset();
+    view.bytes_ = ConstByteSpan();
+    
+    StorageStamp stamp;
+    if (cache_.capacity() > 0 && readStorageStamp(filePath, stamp)) {
+        view.shared_ = cache_.find(filePath, stamp);
+        if (view.shared_) {
+            view.bytes_ = ConstByteSpan(view.shared_->data(), view.shared_->size());
+            return true;
+        }
+    }
+    
+    // A plaintext file without appended batches is handed out as it is stored
+    SessionKey derived;
+    const uint8_t* key = fileKey(filePath, derived);
     struct stat info;
-    if (stat(filePath.c_str(), &info) != 0) {
-        return true; // File doesn't exist, nothing to clear
+    if (key == nullptr && countLogSegments(filePath) == 0 && stat(filePath.c_str(), &info) == 0) {
+        if (!view.mapping_.open(filePath)) {
+            LOGE("Failed to map file: %s", filePath.c_str());
+            return false;
+        }
+        ConstByteSpan bytes = view.mapping_.bytes();
+        view.mapping_.advise(0, bytes.size(), MADV_SEQUENTIAL);
+        
+        // Every block is checked up front, as the caller reads the bytes without us. A
+        // damaged file goes through loadMessages(), which keeps what comes before the damage.
+        SnapshotChecksums checksums;
+        bool intact = true;
+        if (checksums.read(bytes)) {
+            intact = checksums.intactLength() == checksums.storedLength();
+            bytes = bytes.first(checksums.storedLength());
+        }
+        // Headerless snapshots start with the high byte of their count, never a header byte
+        PayloadEncoding encoding = payloadEncoding_ == PayloadEncoding::NONE
+                                   ? PayloadEncoding::NONE : detectPayloadEncoding(bytes, PayloadEncoding::NONE);
+        ConstByteSpan content = bytes.subspan(encoding == PayloadEncoding::BINARY ? 1 : 0);
+        if (intact && encoding != PayloadEncoding::BASE64 && !isCompressedContainer(content)) {
+            view.bytes_ = content;
+            view.mapping_.advise(0, VIEW_PREFETCH_SIZE, MADV_WILLNEED);
+            return true;
+        }
+        view.mapping_.close();
     }
     
-    // Delete file
-    if (unlink(filePath.c_str()) != 0) {
-        LOGE("Failed to delete file: %s", filePath.c_str());
+    if (cache_.capacity() > 0) {
+        view.shared_ = loadCached(filePath);
+        if (!view.shared_) {
+            return false;
+        }
+        view.bytes_ = ConstByteSpan(view.shared_->data(), view.shared_->size());
+        return true;
+    }
+    if (!loadMessages(filePath, view.copy_)) {
         return false;
     }
-    
+    view.bytes_ = ConstByteSpan(view.copy_.data(), view.copy_.size());
     return true;
 }
 
+bool BlobStorage::clearMessages(const std::string& filePath) {
+    settleWrites(filePath); // Queued writes come before the clear
+    
+    // The log goes first: on its own it would still extend an empty snapshot. Appends wait
+    // until both are gone, or they would start a log on the snapshot being deleted.
+    std::lock_guard<std::mutex> lock(logMutex_);
+    bool ok = removeLog(filePath);
+    if (ok) {
+        unlink((filePath + TEMP_SUFFIX).c_str()); // Left over from an interrupted save, if any
+        if (unlink(filePath.c_str()) != 0 && errno != ENOENT) {
+            LOGE("Failed to delete file: %s", filePath.c_str());
+            ok = false;
+        }
+    }
+    cache_.invalidate(filePath);
+    return ok;
+}
+
 bool BlobStorage::hasMessages(const std::string& filePath) {
-    struct stat info;
-    if (stat(filePath.c_str(), &info) != 0) {
-        return false; // File doesn't exist
+    settleWrites(filePath);
+    StorageStamp stamp;
+    if (!storageStamp(filePath, stamp)) {
+        return false;
     }
-    
-    if (!S_ISREG(info.st_mode)) {
-        return false; // Not a regular file
+    if (!stamp.segments.empty() && stamp.segments[0].size > LOG_SEGMENT_HEADER_SIZE) {
+        return true; // Messages were appended
     }
-    
-    return info.st_size > 0;
+    return stamp.snapshotExists && stamp.snapshot.regular && stamp.snapshot.size > 0;
 }
 
 int64_t BlobStorage::getStorageSize(const std::string& filePath) {
-    struct stat info;
-    if (stat(filePath.c_str(), &info) != 0) {
-        return 0; // File doesn't exist
+    settleWrites(filePath);
+    StorageStamp stamp;
+    if (!storageStamp(filePath, stamp)) {
+        return 0;
     }
-    
-    if (!S_ISREG(info.st_mode)) {
-        return 0; // Not a regular file
+    uint64_t size = 0;
+    for (const FileStamp& segment : stamp.segments) {
+        size += segment.size;
     }
-    
-    return static_cast<int64_t>(info.st_size);
+    if (stamp.snapshotExists && stamp.snapshot.regular) {
+        size += stamp.snapshot.size;
+    }
+    return static_cast<int64_t>(size);
 }
@@ -4,6 +4,45 @@
 #include <string>
 #include <vector>
 #include <cstdint>
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include "payload_encoding.h"
+#include "key_manager.h"
+#include "mapped_file.h"
+#include "message_index.h"
+#include "message_cache.h"
+
+// Forward declaration
+class ThreadManager;
+
+/**
+ * Loaded messages, read-only: a mapping of the storage file when it can be used as
+ * stored, otherwise a decoded copy, possibly shared with the message cache
+ */
+class MessageView {
+public:
+    ConstByteSpan bytes() const {
+        return bytes_;
+    }
+    
+    /**
+     * @return true if bytes() points into the mapped storage file
+     */
+    bool isMapped() const {
+        return !bytes_.empty() && !mapping_.bytes().empty();
+    }
+    
+private:
+    friend class BlobStorage;
+    MappedFile mapping_;
+    std::vector<uint8_t> copy_;
+    std::shared_ptr<const std::vector<uint8_t>> shared_;
+    ConstByteSpan bytes_;
+};
 
 /**
  * BlobStorage - Handles local persistence of messages using binary file storage (C++ implementation)
@@ -18,7 +57,111 @@ public:
     BlobStorage& operator=(const BlobStorage&) = delete;
     
     /**
-     * Save messages to blob storage
+     * Enable at-rest encryption. Saves are then written as a chunked ChaCha20-Poly1305
+     * container, encrypted on the fly in bounded memory; loads decrypt containers and still
+     * accept plaintext files written before encryption was enabled.
+     * @param key 32-byte key, copied; nullptr disables encryption
+     */
+    void setEncryptionKey(const uint8_t* key);
+    
+    /**
+     * Encrypt each file with its own key, derived by the manager from the file path as
+     * given, so a file must be loaded through the same path it was saved with. Takes precedence over setEncryptionKey(); loads still accept plaintext files.
+     * @param keyManager Must outlive this object; nullptr goes back to the single key, if any
+     */
+    void setKeyManager(KeyManager* keyManager);
+    
+    /**
+     * Select the file encoding, applied after encryption. With BINARY or BASE64 saved files
+     * start with a payload header byte, and loads decode files by theirs; files without one
+     * are read as they are. NONE (the default) writes the original headerless format.
+     * @param encoding Encoding for subsequent saves
+     */
+    void setPayloadEncoding(PayloadEncoding encoding);
+    
+    /**
+     * Compress saved snapshots and appended batches in blocks (see block_compression.h),
+     * before encryption and encoding. Data that does not shrink is stored as it is, and
+     * loads accept compressed and uncompressed data alike. Compressed files are not
+     * mapped or indexed, so views and pages of them go through a full load.
+     * @param enabled Off by default
+     */
+    void setCompression(bool enabled);
+    
+    /**
+     * Pool to compress and decompress blocks on, with the calling thread taking part, and
+     * to write behind on
+     * @param threadManager Must outlive this object; nullptr (the default) works on the calling thread only
+     */
+    void setThreadManager(ThreadManager* threadManager);
+    
+    /**
+     * Let concurrent saves of the same file share one commit. A save that arrives while
+     * another one is being committed waits; the next commit then writes only the newest
+     * waiting snapshot, and each waiting save returns once a snapshot at least as new as
+     * its own is durable. A burst of saves thus costs two commits rather than one each.
+     * @param enabled Off by default, where every save commits its own data
+     */
+    void setGroupCommit(bool enabled);
+    
+    /**
+     * Number of snapshots committed (synced and renamed into place) so far
+     */
+    uint64_t commitCount() const;
+    
+    /**
+     * Keep recently loaded messages in memory (see message_cache.h), so that loading a file
+     * again is a copy as long as it has not changed on disk, which one stat() per file
+     * checks; views of cached files share the cached bytes. Files are cached as loaded
+     * from their log and snapshot, not as mapped, so plaintext files read through views
+     * stay with the page cache. Writes through this storage drop the file from the cache.
+     * hasMessages() and getStorageSize() answer from the last stamp of a file without a
+     * stat() and so only see changes made through this storage or noticed by a load.
+     * @param bytes Size bound, messages and bookkeeping included; 0 (the default) disables caching
+     */
+    void setCacheCapacity(size_t bytes);
+    
+    /**
+     * Number of loads and views served from the message cache so far
+     */
+    uint64_t cacheHitCount() const;
+    
+    /**
+     * Called after each background write with the storage file and whether it succeeded
+     */
+    using WriteCallback = std::function<void(const std::string& filePath, bool ok)>;
+    
+    /**
+     * Write behind: saveMessages() and appendMessages() queue a copy of their data and
+     * return right away, and a writer on the thread pool stores it. Writes queued for a
+     * file before its writer gets to them coalesce: a save supersedes everything queued
+     * before it, and appends queued after it are merged into one batch, so a burst costs
+     * one commit and one log record. Loads, size queries and clears of a file write what
+     * is queued for it first, so they always see it. Without a thread pool the queue is
+     * written on the calling thread before returning.
+     * @param enabled Off by default; turning it off leaves queued writes to flush() or the next access
+     */
+    void setWriteBehind(bool enabled);
+    
+    /**
+     * Callback for the outcome of background writes, run on the writing thread. It must
+     * not access this storage, whose writer for the file is still busy while it runs.
+     * @param callback Empty (the default) for none
+     */
+    void setWriteCallback(WriteCallback callback);
+    
+    /**
+     * Write everything queued, taking part on the calling thread, and wait for writes in
+     * progress to finish. Destroying the storage flushes it as well.
+     * @return false if a background write failed since the last flush()
+     */
+    bool flush();
+    
+    /**
+     * Save messages to blob storage, atomically replacing the file: the data goes to a
+     * temporary file that is synced to disk and then renamed over the old one, so a crash
+     * leaves either the old or the new messages. Returns once the new file is durable,
+     * or once the data is queued when writing behind (see setWriteBehind()).
      * @param filePath Full path to the storage file
      * @param data Serialized message data (binary format)
      * @param length Length of data in bytes
@@ -27,13 +170,86 @@ public:
     bool saveMessages(const std::string& filePath, const uint8_t* data, size_t length);
     
     /**
-     * Load messages from blob storage
+     * Add messages without rewriting the ones already stored. The batch is appended as one
+     * checksummed record to the log kept next to the storage file (see message_log.h), so
+     * the cost is proportional to the batch; the next saveMessages() folds the log away.
+     * @param filePath Full path to the storage file
+     * @param data Serialized message batch, in the saveMessages() format: a big-endian
+     *             32-bit message count followed by the messages
+     * @param length Length of data in bytes
+     * @return true on success (or once queued when writing behind), false on error or if
+     *         the batch is malformed, in which case nothing is stored
+     */
+    bool appendMessages(const std::string& filePath, const uint8_t* data, size_t length);
+    
+    /**
+     * Start a new log segment once the current one would grow past this size
+     * @param bytes Segment size; a single larger batch still gets a segment of its own
+     */
+    void setLogSegmentSize(size_t bytes);
+    
+    /**
+     * Load messages from blob storage. Batches appended since the last save are merged in:
+     * their counts are added to the saved count and their messages follow the saved ones.
+     * A log that ends in a torn or corrupt record is read up to the last intact one, and a
+     * plaintext or compressed file with a damaged block up to the last message before it,
+     * followed by the log, whose records are checked on their own.
      * @param filePath Full path to the storage file
      * @param data Output buffer for serialized message data
      * @return true on success, false on error
      */
     bool loadMessages(const std::string& filePath, std::vector<uint8_t>& data);
     
+    /**
+     * Load messages without copying them where possible. A file stored in plaintext (or
+     * with the BINARY header) that has no appended batches is mapped; otherwise this falls
+     * back to loadMessages(). The mapping saves the copy, not the reading: a file with
+     * block checksums is checked whole before the view is returned, which reads every
+     * page of it. Only files written without checksums are read as the caller touches them.
+     * @param filePath Full path to the storage file
+     * @param view Receives the messages; stays valid when the file is saved over
+     * @return true on success, false on error
+     */
+    bool viewMessages(const std::string& filePath, MessageView& view);
+    
+    /**
+     * Load a page of messages. With the file stored in plaintext this reads only the
+     * requested records, located through the sidecar index (see message_index.h), which is
+     * kept up to date by saves and appends; otherwise the file is loaded and then paged.
+     * @param filePath Full path to the storage file
+     * @param first Position of the first message to load, counting from the oldest
+     * @param count Number of messages to load at most
+     * @param data Receives the messages as a batch in the saveMessages() format
+     * @return true on success, false on error
+     */
+    bool loadRange(const std::string& filePath, uint32_t first, uint32_t count, std::vector<uint8_t>& data);
+    
+    /**
+     * Load the newest messages, oldest first, like loadRange()
+     * @param count Number of messages to load at most
+     * @return true on success, false on error
+     */
+    bool loadLatest(const std::string& filePath, uint32_t count, std::vector<uint8_t>& data);
+    
+    /**
+     * Load the messages with a timestamp of since or later, in stored order, like loadRange()
+     * @return true on success, false on error
+     */
+    bool loadSince(const std::string& filePath, int64_t since, std::vector<uint8_t>& data);
+    
+    /**
+     * Load the messages with a timestamp within [from, to], in stored order. Indexed files
+     * only read the blocks of messages whose time range overlaps it.
+     * @return true on success, false on error
+     */
+    bool loadBetween(const std::string& filePath, int64_t from, int64_t to, std::vector<uint8_t>& data);
+    
+    /**
+     * Number of stored messages, from the index where there is one
+     * @return Message count, or -1 on error
+     */
+    int64_t countMessages(const std::string& filePath);
+    
     /**
      * Clear all stored messages
      * @param filePath Full path to the storage file
@@ -44,18 +260,219 @@ public:
     /**
      * Check if messages exist in storage
      * @param filePath Full path to the storage file
-     * @return true if file exists and has size > 0, false otherwise
+     * @return true if the file or its log holds data, false otherwise
      */
     bool hasMessages(const std::string& filePath);
     
     /**
      * Get storage file size in bytes
      * @param filePath Full path to the storage file
-     * @return File size in bytes, or 0 if file doesn't exist
+     * @return Size of the file and its log in bytes, or 0 if neither exists
      */
     int64_t getStorageSize(const std::string& filePath);
     
 private:
+    uint8_t storageKey_[32];
+    bool encryptStorage_;
+    KeyManager* keyManager_;
+    PayloadEncoding payloadEncoding_;
+    std::atomic<bool> compression_;
+    std::atomic<ThreadManager*> threadManager_;
+    
+    /**
+     * End of the last log segment of a storage file, as of the last append
+     */
+    struct LogTail {
+        uint32_t segmentIndex;
+        size_t length; // Header included; 0 if the segment has not been created yet
+    };
+    
+    // Appends are serialized, and the tail of each log is remembered so that appending
+    // does not rescan the segment
+    std::mutex logMutex_;
+    std::unordered_map<std::string, LogTail> logTails_;
+    std::unordered_map<std::string, MessageIndex> indexes_; // Also guarded by logMutex_
+    size_t logSegmentSize_;
+    
+    /**
+     * Saves of one storage file, waiting for or taking part in a commit
+     */
+    struct SaveQueue {
+        std::mutex mutex;
+        std::condition_variable changed;
+        bool committing = false;
+        uint64_t issued = 0;    // Last ticket handed to a save
+        uint64_t newest = 0;    // Ticket of the newest grouped save waiting to be written
+        const uint8_t* newestData = nullptr; // Owned by that save, which waits until it is settled
+        size_t newestLength = 0;
+        uint64_t durable = 0;   // Grouped saves up to this ticket are on disk
+        uint64_t failed = 0;    // Grouped saves up to this ticket failed, unless durable
+    };
+    
+    std::atomic<bool> groupCommit_;
+    std::atomic<uint64_t> commitCount_;
+    std::mutex saveQueuesMutex_;
+    std::unordered_map<std::string, std::unique_ptr<SaveQueue>> saveQueues_;
+    
+    /**
+     * Writes queued for one storage file
+     */
+    struct PendingWrite {
+        bool replace = false;           // snapshot holds a save to commit first
+        std::vector<uint8_t> snapshot;
+        std::vector<uint8_t> appended;  // Batches appended after it, merged into one
+        bool scheduled = false;         // A pool task has been submitted to write them
+        bool writing = false;           // A thread is writing them
+    };
+    
+    /**
+     * Write-behind queue, shared with the pool tasks that drain it so that a task running
+     * after the storage is gone finds nothing to do
+     */
+    struct WriteBehind {
+        std::mutex mutex;
+        std::condition_variable settled;
+        BlobStorage* storage = nullptr; // Cleared once the storage is destroyed
+        std::unordered_map<std::string, PendingWrite> pending;
+        WriteCallback callback;
+        bool failed = false;            // A write failed since the last flush()
+    };
+    
+    std::atomic<bool> writeBehind_;
+    std::shared_ptr<WriteBehind> writeQueue_;
+    
+    MessageCache cache_;
+    
+    /**
+     * Key for a file, or nullptr when storage is not encrypted
+     * @param derived Holds the key if it comes from the key manager
+     */
+    const uint8_t* fileKey(const std::string& filePath, SessionKey& derived);
+    
+    /**
+     * Queue for saves of a storage file, created on first use
+     */
+    SaveQueue& saveQueue(const std::string& filePath);
+    
+    /**
+     * saveMessages() and appendMessages() proper, writing right away
+     * @return true on success, false on error
+     */
+    bool saveSnapshot(const std::string& filePath, const uint8_t* data, size_t length);
+    bool appendBatch(const std::string& filePath, const uint8_t* data, size_t length);
+    
+    /**
+     * Queue a save (replace) or an append for the background writer
+     * @return false if the data is invalid
+     */
+    bool queueWrite(const std::string& filePath, const uint8_t* data, size_t length, bool replace);
+    
+    /**
+     * Write what is queued for a file until nothing is left, unless another thread is at
+     * it already. Caller holds writeQueue_->mutex through lock, which is released while writing.
+     */
+    void drainWrites(const std::string& filePath, std::unique_lock<std::mutex>& lock);
+    
+    /**
+     * Write what is queued for a file and wait until it is on disk
+     */
+    void settleWrites(const std::string& filePath);
+    
+    /**
+     * Write, sync and rename one snapshot into place, then drop the log it supersedes
+     * @return true on success, false on error
+     */
+    bool commitSnapshot(const std::string& filePath, const uint8_t* data, size_t length);
+    
+    /**
+     * Stream data to output, encrypted and encoded as configured
+     * @param key Encryption key, or nullptr to write plaintext
+     * @return true on success, false on error
+     */
+    bool writeEncoded(const StreamSink& output, const uint8_t* key, const uint8_t* data, size_t length);
+    
+    /**
+     * Pass stored bytes through decoding and decryption
+     * @param source Feeds the stored bytes, in order, to the sink it is given
+     * @param key Decryption key, or nullptr to read plaintext
+     * @param inputSize Number of stored bytes, bounding the output allocation
+     * @return true on success, false on error
+     */
+    bool readDecoded(const std::function<bool(const StreamSink&)>& source, const uint8_t* key, size_t inputSize,
+                     std::vector<uint8_t>& data);
+    
+    /**
+     * Find where the next log record of a storage file goes, truncating a torn tail and
+     * discarding a log left over from an earlier snapshot. Caller holds logMutex_.
+     * @return true on success, false on error
+     */
+    bool recoverLogTail(const std::string& filePath, LogTail& tail);
+    
+    /**
+     * Load the storage file itself, without its log
+     * @param key Decryption key, or nullptr to read plaintext
+     * @param damaged Set if blocks of the file were lost; data then holds the messages before them
+     * @return true on success, false on error
+     */
+    bool loadSnapshot(const std::string& filePath, const uint8_t* key, std::vector<uint8_t>& data, bool& damaged);
+    
+    /**
+     * Merge the logged batches of a storage file into its loaded snapshot
+     * @param key Decryption key, or nullptr to read plaintext
+     * @return true on success, false on error
+     */
+    bool mergeLog(const std::string& filePath, const uint8_t* key, std::vector<uint8_t>& data);
+    
+    /**
+     * Load the snapshot and log of a storage file through the message cache
+     * @return nullptr on error
+     */
+    std::shared_ptr<const std::vector<uint8_t>> loadCached(const std::string& filePath);
+    
+    /**
+     * Stamp of a storage file, from the message cache if it has one and stat() otherwise
+     * @return false if the files cannot be examined
+     */
+    bool storageStamp(const std::string& filePath, StorageStamp& stamp);
+    
+    /**
+     * Index of a storage file, brought up to date with its snapshot and log: read from the
+     * sidecar or rebuilt once, then caught up with whatever was appended since. Caller
+     * holds logMutex_.
+     * @param key Key the file is stored under, if any
+     * @return nullptr if the file is not stored in plaintext and cannot be indexed
+     */
+    MessageIndex* currentIndex(const std::string& filePath, const uint8_t* key);
+    
+    /**
+     * Index the snapshot and log of a storage file from scratch
+     * @return false if they cannot be indexed
+     */
+    bool buildIndex(const std::string& filePath, const LogBase& base, MessageIndex& index);
+    
+    /**
+     * Write index entries from position from onwards to the sidecar, or all of them if
+     * from is 0; a sidecar that cannot be updated is deleted so that it gets rebuilt
+     */
+    void persistIndex(const std::string& filePath, const MessageIndex& index, size_t from);
+    
+    /**
+     * Forget the index of a storage file and delete its sidecar. Caller holds logMutex_.
+     */
+    void dropIndex(const std::string& filePath);
+    
+    /**
+     * Load a page of messages
+     * @param first Position of the first message, or -1 for the last count messages
+     */
+    bool loadPage(const std::string& filePath, int64_t first, uint32_t count, std::vector<uint8_t>& data);
+    
+    /**
+     * Delete every log segment of a storage file. Caller holds logMutex_.
+     * @return true on success, false on error
+     */
+    bool removeLog(const std::string& filePath);
+    
     /**
      * Ensure directory exists for the given file path
      * @param filePath Full path to the file
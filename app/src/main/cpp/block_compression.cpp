@@ -0,0 +1,413 @@
+#include "block_compression.h"
+#include "checksum.h"
+#include "thread_manager.h"
+#include <algorithm>
+#include <cstring>
+
+namespace {
+    const uint8_t COMPRESSED_MAGIC[4] = {'F', 'X', 'Z', '1'};
+    constexpr uint8_t COMPRESSED_VERSION = 1;
+
+    constexpr size_t MIN_MATCH = 4;
+    constexpr size_t LAST_LITERALS = 5;         // A block ends in at least this many literals
+    constexpr size_t MATCH_FIND_LIMIT = 12;     // and no match starts this close to its end
+    constexpr size_t MAX_OFFSET = 65535;
+    constexpr int HASH_BITS = 12;
+    constexpr uint32_t RAW_BLOCK_FLAG = 0x80000000u;
+
+    // Copies this short are done in one fixed-size step, reading and writing past their end
+    // where the buffers allow
+    constexpr size_t WILD_COPY = 16;
+
+    // No stored byte decompresses to more than this, which bounds what a container can claim
+    constexpr uint64_t MAX_EXPANSION = 255;
+
+    void store32(uint8_t* p, uint32_t v) {
+        for (int i = 0; i < 4; ++i) {
+            p[i] = static_cast<uint8_t>(v >> (8 * i));
+        }
+    }
+
+    void store64(uint8_t* p, uint64_t v) {
+        for (int i = 0; i < 8; ++i) {
+            p[i] = static_cast<uint8_t>(v >> (8 * i));
+        }
+    }
+
+    uint32_t load32(const uint8_t* p) {
+        uint32_t v = 0;
+        for (int i = 0; i < 4; ++i) {
+            v |= static_cast<uint32_t>(p[i]) << (8 * i);
+        }
+        return v;
+    }
+
+    uint64_t load64(const uint8_t* p) {
+        uint64_t v = 0;
+        for (int i = 0; i < 8; ++i) {
+            v |= static_cast<uint64_t>(p[i]) << (8 * i);
+        }
+        return v;
+    }
+
+    uint32_t readPrefix(const uint8_t* p) {
+        uint32_t v;
+        std::memcpy(&v, p, sizeof(v));
+        return v;
+    }
+
+    uint32_t hashPrefix(uint32_t prefix) {
+        return (prefix * 2654435761u) >> (32 - HASH_BITS);
+    }
+
+    bool isValidBlockSize(size_t blockSize) {
+        return blockSize >= MIN_COMPRESSION_BLOCK_SIZE && blockSize <= MAX_COMPRESSION_BLOCK_SIZE &&
+               (blockSize & (blockSize - 1)) == 0;
+    }
+
+    uint8_t log2Of(size_t value) {
+        uint8_t shift = 0;
+        while ((static_cast<size_t>(1) << shift) < value) {
+            shift++;
+        }
+        return shift;
+    }
+
+    uint8_t* putLengthExtension(uint8_t* output, size_t length) {
+        while (length >= 255) {
+            *output++ = 255;
+            length -= 255;
+        }
+        *output++ = static_cast<uint8_t>(length);
+        return output;
+    }
+
+    bool readLengthExtension(const uint8_t*& input, const uint8_t* end, size_t& length) {
+        uint8_t byte;
+        do {
+            if (input == end) {
+                return false;
+            }
+            byte = *input++;
+            length += byte;
+        } while (byte == 255);
+        return true;
+    }
+
+    /**
+     * Write one sequence; a matchLength of 0 writes the final, literals-only one
+     * @return false if it does not fit before end
+     */
+    bool writeSequence(uint8_t*& output, const uint8_t* end, const uint8_t* literals, size_t literalLength,
+                       size_t offset, size_t matchLength) {
+        size_t needed = 1 + literalLength + literalLength / 255 + 1 + (matchLength > 0 ? 3 + matchLength / 255 : 0);
+        if (needed > static_cast<size_t>(end - output)) {
+            return false;
+        }
+
+        uint8_t* token = output++;
+        uint8_t literalCode = static_cast<uint8_t>(std::min<size_t>(literalLength, 15));
+        if (literalLength >= 15) {
+            output = putLengthExtension(output, literalLength - 15);
+        }
+        if (literalLength > 0) {
+            std::memcpy(output, literals, literalLength);
+            output += literalLength;
+        }
+
+        uint8_t matchCode = 0;
+        if (matchLength > 0) {
+            *output++ = static_cast<uint8_t>(offset);
+            *output++ = static_cast<uint8_t>(offset >> 8);
+            size_t code = matchLength - MIN_MATCH;
+            matchCode = static_cast<uint8_t>(std::min<size_t>(code, 15));
+            if (code >= 15) {
+                output = putLengthExtension(output, code - 15);
+            }
+        }
+        *token = static_cast<uint8_t>(literalCode << 4 | matchCode);
+        return true;
+    }
+
+    void writeHeader(uint8_t* header, size_t blockSize, uint64_t plaintextLength, uint32_t blockCount) {
+        std::memcpy(header, COMPRESSED_MAGIC, sizeof(COMPRESSED_MAGIC));
+        header[4] = COMPRESSED_VERSION;
+        header[5] = log2Of(blockSize);
+        header[6] = 0;
+        header[7] = 0;
+        store64(header + 8, plaintextLength);
+        store32(header + 16, blockCount);
+        store32(header + 20, crc32c(header, 20));
+    }
+
+    /**
+     * Where the blocks of a container lie
+     */
+    struct ContainerLayout {
+        size_t blockSize = 0;
+        uint64_t length = 0;
+        const uint8_t* table = nullptr;
+        std::vector<size_t> offsets;    // Of the leading blocks that fit in the container
+        bool complete = false;          // Every block fits and the last one ends the container
+    };
+
+    /**
+     * Check the header and place the blocks, stopping at the first one that does not fit
+     * @return false if the header is malformed
+     */
+    bool readLayout(ConstByteSpan container, ContainerLayout& layout) {
+        if (!isCompressedContainer(container)) {
+            return false;
+        }
+        const uint8_t* header = container.data();
+        uint8_t shift = header[5];
+        if (header[4] != COMPRESSED_VERSION || load32(header + 20) != crc32c(header, 20) ||
+            shift < log2Of(MIN_COMPRESSION_BLOCK_SIZE) || shift > log2Of(MAX_COMPRESSION_BLOCK_SIZE)) {
+            return false;
+        }
+        layout.blockSize = static_cast<size_t>(1) << shift;
+        layout.length = load64(header + 8);
+        uint32_t count = load32(header + 16);
+        if (layout.length > SIZE_MAX ||
+            count != layout.length / layout.blockSize + (layout.length % layout.blockSize != 0 ? 1 : 0) ||
+            static_cast<uint64_t>(count) * COMPRESSED_BLOCK_ENTRY_SIZE > container.size() - COMPRESSED_HEADER_SIZE) {
+            return false;
+        }
+
+        layout.table = header + COMPRESSED_HEADER_SIZE;
+        layout.offsets.reserve(count);
+        size_t offset = COMPRESSED_HEADER_SIZE + count * COMPRESSED_BLOCK_ENTRY_SIZE;
+        for (uint32_t i = 0; i < count; ++i) {
+            uint32_t entry = load32(layout.table + i * COMPRESSED_BLOCK_ENTRY_SIZE);
+            size_t stored = entry & ~RAW_BLOCK_FLAG;
+            uint64_t blockLength = std::min<uint64_t>(layout.blockSize,
+                                                      layout.length - static_cast<uint64_t>(i) * layout.blockSize);
+            bool raw = (entry & RAW_BLOCK_FLAG) != 0;
+            if (stored > container.size() - offset || (raw && stored != blockLength) ||
+                (!raw && blockLength / MAX_EXPANSION > stored)) {
+                return true;
+            }
+            layout.offsets.push_back(offset);
+            offset += stored;
+        }
+        layout.complete = offset == container.size();
+        return true;
+    }
+
+    /**
+     * Decompress one placed block and check it against its checksum
+     * @param block Exactly the block's original length
+     */
+    bool expandBlock(ConstByteSpan container, const ContainerLayout& layout, size_t blockIndex, ByteSpan block) {
+        const uint8_t* entry = layout.table + blockIndex * COMPRESSED_BLOCK_ENTRY_SIZE;
+        size_t stored = load32(entry) & ~RAW_BLOCK_FLAG;
+        ConstByteSpan input = container.subspan(layout.offsets[blockIndex], stored);
+        if ((load32(entry) & RAW_BLOCK_FLAG) != 0) {
+            std::memcpy(block.data(), input.data(), stored);
+        } else if (!decompressBlock(input, block)) {
+            return false;
+        }
+        return crc32c(block.data(), block.size()) == load32(entry + 4);
+    }
+}
+
+size_t compressBlockBound(size_t inputLength) {
+    return inputLength + inputLength / 255 + 16;
+}
+
+size_t compressBlock(ConstByteSpan input, ByteSpan output) {
+    const uint8_t* in = input.data();
+    size_t length = input.size();
+    uint8_t* out = output.data();
+    const uint8_t* outEnd = out + output.size();
+    size_t anchor = 0;
+
+    if (length > MATCH_FIND_LIMIT) {
+        // Last position each 4-byte prefix was seen at; stale or colliding entries are
+        // caught by comparing the prefixes
+        uint32_t table[1 << HASH_BITS] = {};
+        size_t matchStartLimit = length - MATCH_FIND_LIMIT;
+        size_t matchEndLimit = length - LAST_LITERALS;
+        size_t position = 0;
+        while (position < matchStartLimit) {
+            uint32_t prefix = readPrefix(in + position);
+            uint32_t& slot = table[hashPrefix(prefix)];
+            size_t candidate = slot;
+            slot = static_cast<uint32_t>(position);
+            if (candidate >= position || position - candidate > MAX_OFFSET || readPrefix(in + candidate) != prefix) {
+                // Step faster through data that keeps missing
+                position += 1 + ((position - anchor) >> 6);
+                continue;
+            }
+
+            while (position > anchor && candidate > 0 && in[position - 1] == in[candidate - 1]) {
+                position--;
+                candidate--;
+            }
+            size_t matchLength = MIN_MATCH;
+            while (position + matchLength < matchEndLimit && in[position + matchLength] == in[candidate + matchLength]) {
+                matchLength++;
+            }
+            if (!writeSequence(out, outEnd, in + anchor, position - anchor, position - candidate, matchLength)) {
+                return 0;
+            }
+            position += matchLength;
+            anchor = position;
+        }
+    }
+
+    if (!writeSequence(out, outEnd, in + anchor, length - anchor, 0, 0)) {
+        return 0;
+    }
+    return static_cast<size_t>(out - output.data());
+}
+
+bool decompressBlock(ConstByteSpan input, ByteSpan output) {
+    const uint8_t* in = input.data();
+    const uint8_t* inEnd = in + input.size();
+    uint8_t* out = output.data();
+    uint8_t* outEnd = out + output.size();
+
+    while (in < inEnd) {
+        uint8_t token = *in++;
+        size_t literalLength = token >> 4;
+        if (literalLength == 15 && !readLengthExtension(in, inEnd, literalLength)) {
+            return false;
+        }
+        if (literalLength > static_cast<size_t>(inEnd - in) || literalLength > static_cast<size_t>(outEnd - out)) {
+            return false;
+        }
+        if (literalLength <= WILD_COPY && inEnd - in >= static_cast<ptrdiff_t>(WILD_COPY) &&
+            outEnd - out >= static_cast<ptrdiff_t>(WILD_COPY)) {
+            // Short runs, the common case, as one fixed-size copy; the excess is overwritten next
+            std::memcpy(out, in, WILD_COPY);
+        } else if (literalLength > 0) {
+            std::memcpy(out, in, literalLength);
+        }
+        in += literalLength;
+        out += literalLength;
+        if (in == inEnd) {
+            return out == outEnd; // The last sequence has literals only
+        }
+
+        if (inEnd - in < 2) {
+            return false;
+        }
+        size_t offset = static_cast<size_t>(in[0]) | static_cast<size_t>(in[1]) << 8;
+        in += 2;
+        if (offset == 0 || offset > static_cast<size_t>(out - output.data())) {
+            return false;
+        }
+        size_t matchLength = token & 15;
+        if (matchLength == 15 && !readLengthExtension(in, inEnd, matchLength)) {
+            return false;
+        }
+        matchLength += MIN_MATCH;
+        if (matchLength > static_cast<size_t>(outEnd - out)) {
+            return false;
+        }
+
+        const uint8_t* match = out - offset;
+        if (offset >= WILD_COPY && static_cast<size_t>(outEnd - out) >= matchLength + WILD_COPY) {
+            for (size_t i = 0; i < matchLength; i += WILD_COPY) {
+                std::memcpy(out + i, match + i, WILD_COPY);
+            }
+        } else if (offset >= matchLength) {
+            std::memcpy(out, match, matchLength);
+        } else {
+            // Overlapping: the match repeats the last offset bytes
+            for (size_t i = 0; i < matchLength; ++i) {
+                out[i] = match[i];
+            }
+        }
+        out += matchLength;
+    }
+    return false;
+}
+
+bool isCompressedContainer(ConstByteSpan bytes) {
+    return bytes.size() >= COMPRESSED_HEADER_SIZE && std::memcmp(bytes.data(), COMPRESSED_MAGIC, sizeof(COMPRESSED_MAGIC)) == 0;
+}
+
+bool compressBlocks(ConstByteSpan plaintext, std::vector<uint8_t>& container, ThreadManager* threadManager,
+                    size_t blockSize) {
+    container.clear();
+    uint64_t count = (static_cast<uint64_t>(plaintext.size()) + blockSize - 1) / blockSize;
+    if (!isValidBlockSize(blockSize) || count > UINT32_MAX) {
+        return false;
+    }
+
+    std::vector<std::vector<uint8_t>> blocks(static_cast<size_t>(count));
+    std::vector<uint8_t> table(blocks.size() * COMPRESSED_BLOCK_ENTRY_SIZE);
+    runParallel(threadManager, blocks.size(), [&](size_t blockIndex) {
+        size_t offset = blockIndex * blockSize;
+        ConstByteSpan block = plaintext.subspan(offset, std::min(blockSize, plaintext.size() - offset));
+        std::vector<uint8_t>& stored = blocks[blockIndex];
+        stored.resize(compressBlockBound(block.size()));
+        size_t length = compressBlock(block, ByteSpan(stored.data(), stored.size()));
+        uint32_t entry = static_cast<uint32_t>(length);
+        if (length == 0 || length >= block.size()) {
+            stored.assign(block.begin(), block.end());
+            entry = static_cast<uint32_t>(block.size()) | RAW_BLOCK_FLAG;
+        } else {
+            stored.resize(length);
+        }
+        uint8_t* tableEntry = table.data() + blockIndex * COMPRESSED_BLOCK_ENTRY_SIZE;
+        store32(tableEntry, entry);
+        store32(tableEntry + 4, crc32c(block.data(), block.size()));
+        return true;
+    });
+
+    size_t total = COMPRESSED_HEADER_SIZE + table.size();
+    for (const std::vector<uint8_t>& stored : blocks) {
+        total += stored.size();
+    }
+    container.resize(COMPRESSED_HEADER_SIZE);
+    container.reserve(total);
+    writeHeader(container.data(), blockSize, plaintext.size(), static_cast<uint32_t>(count));
+    container.insert(container.end(), table.begin(), table.end());
+    for (const std::vector<uint8_t>& stored : blocks) {
+        container.insert(container.end(), stored.begin(), stored.end());
+    }
+    return true;
+}
+
+bool decompressBlocks(ConstByteSpan container, std::vector<uint8_t>& plaintext, ThreadManager* threadManager) {
+    plaintext.clear();
+    // Place every block before allocating anything, so a forged table is rejected cheaply
+    ContainerLayout layout;
+    if (!readLayout(container, layout) || !layout.complete) {
+        return false;
+    }
+
+    plaintext.resize(static_cast<size_t>(layout.length));
+    bool ok = runParallel(threadManager, layout.offsets.size(), [&](size_t blockIndex) {
+        size_t position = blockIndex * layout.blockSize;
+        ByteSpan block(plaintext.data() + position, std::min(layout.blockSize, plaintext.size() - position));
+        return expandBlock(container, layout, blockIndex, block);
+    });
+    if (!ok) {
+        plaintext.clear();
+    }
+    return ok;
+}
+
+bool salvageBlocks(ConstByteSpan container, std::vector<uint8_t>& plaintext) {
+    plaintext.clear();
+    ContainerLayout layout;
+    if (!readLayout(container, layout)) {
+        return false;
+    }
+
+    // One block after the other, so nothing is allocated for blocks past the damage
+    for (size_t blockIndex = 0; blockIndex < layout.offsets.size(); ++blockIndex) {
+        size_t position = plaintext.size();
+        size_t blockLength = std::min<size_t>(layout.blockSize, static_cast<size_t>(layout.length) - position);
+        plaintext.resize(position + blockLength);
+        if (!expandBlock(container, layout, blockIndex, ByteSpan(plaintext.data() + position, blockLength))) {
+            plaintext.resize(position);
+            break;
+        }
+    }
+    return true;
+}
@@ -0,0 +1,82 @@
+#ifndef BLOCK_COMPRESSION_H
+#define BLOCK_COMPRESSION_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include "span.h"
+
+// Forward declaration
+class ThreadManager;
+
+// Block compression for stored message batches, using an LZ77 variant of the LZ4 class:
+// byte-aligned sequences of literals and a match, a hash table of 4-byte prefixes and a
+// 64 KB window, trading some ratio for decompression at memory speed.
+//
+//   container  "FXZ1" | version u8 | log2(block size) u8 | reserved u16 | plaintext length u64 |
+//              block count u32 | header crc u32                                         (LE)
+//   table      per block: stored length u32, top bit set if stored raw | crc32c(block plaintext) u32
+//   blocks     the stored blocks, back to back
+//
+// Blocks are compressed independently, so they are compressed and decompressed in
+// parallel, and a block that does not shrink is stored as it is. The sequence format is
+// the LZ4 block format:
+//
+//   sequence   token u8 (literal length << 4 | match length - 4) | literal length extension |
+//              literals | match offset u16 LE | match length extension
+//
+// where a length field of 15 is extended by following bytes up to and including the first
+// one below 255, and the last sequence of a block has literals only.
+
+constexpr size_t COMPRESSED_HEADER_SIZE = 24;
+constexpr size_t COMPRESSED_BLOCK_ENTRY_SIZE = 8;
+constexpr size_t MIN_COMPRESSION_BLOCK_SIZE = 4 * 1024;
+constexpr size_t MAX_COMPRESSION_BLOCK_SIZE = 4 * 1024 * 1024;
+constexpr size_t DEFAULT_COMPRESSION_BLOCK_SIZE = 64 * 1024;
+
+/**
+ * Largest compressed size of a block of inputLength bytes
+ */
+size_t compressBlockBound(size_t inputLength);
+
+/**
+ * Compress one block
+ * @param output Room for the compressed block
+ * @return Compressed length, or 0 if it does not fit in output
+ */
+size_t compressBlock(ConstByteSpan input, ByteSpan output);
+
+/**
+ * Decompress one block
+ * @param output Exactly the block's original length
+ * @return false if the block is malformed or does not decompress to exactly output.size() bytes
+ */
+bool decompressBlock(ConstByteSpan input, ByteSpan output);
+
+/**
+ * @return true if bytes start with a compressed container header
+ */
+bool isCompressedContainer(ConstByteSpan bytes);
+
+/**
+ * Compress into a container, in parallel when a thread pool is given
+ * @param blockSize Power of two between MIN_COMPRESSION_BLOCK_SIZE and MAX_COMPRESSION_BLOCK_SIZE
+ * @return false if blockSize is invalid or the plaintext needs more than 2^32 blocks
+ */
+bool compressBlocks(ConstByteSpan plaintext, std::vector<uint8_t>& container, ThreadManager* threadManager = nullptr,
+                    size_t blockSize = DEFAULT_COMPRESSION_BLOCK_SIZE);
+
+/**
+ * Decompress a whole container, in parallel when a thread pool is given
+ * @return false if the container is malformed or a block fails its checksum; plaintext is then empty
+ */
+bool decompressBlocks(ConstByteSpan container, std::vector<uint8_t>& plaintext, ThreadManager* threadManager = nullptr);
+
+/**
+ * Decompress the leading blocks of a damaged container, up to the first one that is
+ * malformed, cut off or fails its checksum
+ * @return false if the header is damaged; plaintext is then empty
+ */
+bool salvageBlocks(ConstByteSpan container, std::vector<uint8_t>& plaintext);
+
+#endif // BLOCK_COMPRESSION_H
@@ -0,0 +1,91 @@
+#include "bulk_copy.h"
+#include "kernel_dispatch.h"
+#include <cstdint>
+#include <cstring>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define BULK_COPY_X86 1
+#endif
+
+namespace {
+    void copyLibc(uint8_t* destination, const uint8_t* source, size_t length) {
+        std::memcpy(destination, source, length);
+    }
+
+#if BULK_COPY_X86
+    // Copy the head with memcpy until destination is aligned for streaming stores, stream
+    // whole 128-byte groups, then fence so the stores are ordered before later writes
+
+    __attribute__((target("avx2")))
+    void copyStreamAvx2(uint8_t* destination, const uint8_t* source, size_t length) {
+        size_t head = (32 - (reinterpret_cast<uintptr_t>(destination) & 31)) & 31;
+        std::memcpy(destination, source, head);
+        destination += head;
+        source += head;
+        length -= head;
+
+        for (; length >= 128; destination += 128, source += 128, length -= 128) {
+            __m256i a = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(source));
+            __m256i b = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(source + 32));
+            __m256i c = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(source + 64));
+            __m256i d = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(source + 96));
+            _mm256_stream_si256(reinterpret_cast<__m256i*>(destination), a);
+            _mm256_stream_si256(reinterpret_cast<__m256i*>(destination + 32), b);
+            _mm256_stream_si256(reinterpret_cast<__m256i*>(destination + 64), c);
+            _mm256_stream_si256(reinterpret_cast<__m256i*>(destination + 96), d);
+        }
+        _mm_sfence();
+        std::memcpy(destination, source, length);
+    }
+
+    __attribute__((target("sse2")))
+    void copyStreamSse2(uint8_t* destination, const uint8_t* source, size_t length) {
+        size_t head = (16 - (reinterpret_cast<uintptr_t>(destination) & 15)) & 15;
+        std::memcpy(destination, source, head);
+        destination += head;
+        source += head;
+        length -= head;
+
+        for (; length >= 128; destination += 128, source += 128, length -= 128) {
+            for (size_t i = 0; i < 128; i += 16) {
+                __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(source + i));
+                _mm_stream_si128(reinterpret_cast<__m128i*>(destination + i), v);
+            }
+        }
+        _mm_sfence();
+        std::memcpy(destination, source, length);
+    }
+#endif // BULK_COPY_X86
+
+    struct CopyKernel {
+        void (*copy)(uint8_t*, const uint8_t*, size_t);
+        const char* name;
+        bool (*supported)(const CpuFeatures&);
+    };
+
+    // ARM keeps libc: bionic's memcpy is already tuned per core
+    constexpr CopyKernel VARIANTS[] = {
+#if BULK_COPY_X86
+        {copyStreamAvx2, "avx2-stream", [](const CpuFeatures& cpu) { return cpu.avx2; }},
+        {copyStreamSse2, "sse2-stream", [](const CpuFeatures& cpu) { return cpu.sse2; }},
+#endif
+        {copyLibc, "libc", anyCpu},
+    };
+
+    KernelTable<CopyKernel> kernels("copy", VARIANTS);
+}
+
+void bulkCopy(void* destination, const void* source, size_t length) {
+    if (length < BULK_COPY_STREAM_THRESHOLD) {
+        if (length > 0) {
+            std::memcpy(destination, source, length);
+        }
+        return;
+    }
+    kernels.active().copy(static_cast<uint8_t*>(destination), static_cast<const uint8_t*>(source), length);
+}
+
+KernelFamily& copyKernels() {
+    return kernels;
+}
@@ -0,0 +1,27 @@
+#ifndef BULK_COPY_H
+#define BULK_COPY_H
+
+#include <cstddef>
+
+class KernelFamily;
+
+/**
+ * Copies at least this large may bypass the cache with non-temporal stores
+ */
+constexpr size_t BULK_COPY_STREAM_THRESHOLD = 1024 * 1024;
+
+/**
+ * memcpy for payload-sized buffers. Copies of BULK_COPY_STREAM_THRESHOLD bytes or more
+ * use non-temporal stores where the CPU supports them, which avoids reading every
+ * destination line into the cache first and evicting the working set; smaller copies
+ * go to memcpy.
+ * @param destination Must not overlap source
+ */
+void bulkCopy(void* destination, const void* source, size_t length);
+
+/**
+ * Variant table of the copy kernels, for kernel_dispatch
+ */
+KernelFamily& copyKernels();
+
+#endif // BULK_COPY_H
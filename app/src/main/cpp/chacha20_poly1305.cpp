@@ -0,0 +1,784 @@
+#include "chacha20_poly1305.h"
+#include "kernel_dispatch.h"
+#include <algorithm>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+#include <cerrno>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define CHACHA_X86 1
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#define CHACHA_NEON 1
+#endif
+
+void secureZero(void* data, size_t length) {
+    volatile uint8_t* p = static_cast<volatile uint8_t*>(data);
+    while (length--) {
+        *p++ = 0;
+    }
+}
+
+namespace {
+    // "expand 32-byte k"
+    constexpr uint32_t SIGMA[4] = {0x61707865, 0x3320646e, 0x79622d32, 0x6b206574};
+
+    inline uint32_t load32(const uint8_t* p) {
+        return static_cast<uint32_t>(p[0]) | (static_cast<uint32_t>(p[1]) << 8) |
+               (static_cast<uint32_t>(p[2]) << 16) | (static_cast<uint32_t>(p[3]) << 24);
+    }
+
+    inline void store32(uint8_t* p, uint32_t v) {
+        p[0] = static_cast<uint8_t>(v);
+        p[1] = static_cast<uint8_t>(v >> 8);
+        p[2] = static_cast<uint8_t>(v >> 16);
+        p[3] = static_cast<uint8_t>(v >> 24);
+    }
+
+    inline void store64(uint8_t* p, uint64_t v) {
+        store32(p, static_cast<uint32_t>(v));
+        store32(p + 4, static_cast<uint32_t>(v >> 32));
+    }
+
+    inline uint32_t rotl32(uint32_t v, int n) {
+        return (v << n) | (v >> (32 - n));
+    }
+
+    void initState(uint32_t* state, const uint8_t* key, const uint8_t* nonce, uint32_t counter) {
+        state[0] = SIGMA[0];
+        state[1] = SIGMA[1];
+        state[2] = SIGMA[2];
+        state[3] = SIGMA[3];
+        for (int i = 0; i < 8; ++i) {
+            state[4 + i] = load32(key + 4 * i);
+        }
+        state[12] = counter;
+        state[13] = load32(nonce);
+        state[14] = load32(nonce + 4);
+        state[15] = load32(nonce + 8);
+    }
+
+#define CHACHA_QUARTER_ROUND(a, b, c, d) \
+    a += b; d ^= a; d = rotl32(d, 16);   \
+    c += d; b ^= c; b = rotl32(b, 12);   \
+    a += b; d ^= a; d = rotl32(d, 8);    \
+    c += d; b ^= c; b = rotl32(b, 7);
+
+    void chacha20Block(const uint32_t* state, uint8_t* output) {
+        uint32_t x[16];
+        std::memcpy(x, state, sizeof(x));
+
+        for (int round = 0; round < 10; ++round) {
+            CHACHA_QUARTER_ROUND(x[0], x[4], x[8], x[12])
+            CHACHA_QUARTER_ROUND(x[1], x[5], x[9], x[13])
+            CHACHA_QUARTER_ROUND(x[2], x[6], x[10], x[14])
+            CHACHA_QUARTER_ROUND(x[3], x[7], x[11], x[15])
+            CHACHA_QUARTER_ROUND(x[0], x[5], x[10], x[15])
+            CHACHA_QUARTER_ROUND(x[1], x[6], x[11], x[12])
+            CHACHA_QUARTER_ROUND(x[2], x[7], x[8], x[13])
+            CHACHA_QUARTER_ROUND(x[3], x[4], x[9], x[14])
+        }
+
+        for (int i = 0; i < 16; ++i) {
+            store32(output + 4 * i, x[i] + state[i]);
+        }
+    }
+
+#undef CHACHA_QUARTER_ROUND
+
+    // Block kernels XOR `blocks` whole 64-byte blocks starting at counter state[12].
+    // Wider kernels process as many full groups as they can and hand the rest down.
+
+    void xorBlocksScalar(const uint32_t* state, const uint8_t* input, uint8_t* output, size_t blocks) {
+        uint32_t current[16];
+        std::memcpy(current, state, sizeof(current));
+        uint8_t keystream[CHACHA20_BLOCK_SIZE];
+
+        for (size_t b = 0; b < blocks; ++b) {
+            chacha20Block(current, keystream);
+            current[12]++;
+            for (size_t i = 0; i < CHACHA20_BLOCK_SIZE; ++i) {
+                output[i] = input[i] ^ keystream[i];
+            }
+            input += CHACHA20_BLOCK_SIZE;
+            output += CHACHA20_BLOCK_SIZE;
+        }
+
+        secureZero(keystream, sizeof(keystream));
+    }
+
+#if CHACHA_X86
+    // Four blocks at a time, one block per 32-bit lane. SSE2 is the x86 baseline.
+    inline __m128i rotl128(__m128i v, int n) {
+        return _mm_or_si128(_mm_slli_epi32(v, n), _mm_srli_epi32(v, 32 - n));
+    }
+
+#define CHACHA_QUARTER_ROUND_SSE2(a, b, c, d)                       \
+    a = _mm_add_epi32(a, b); d = rotl128(_mm_xor_si128(d, a), 16);  \
+    c = _mm_add_epi32(c, d); b = rotl128(_mm_xor_si128(b, c), 12);  \
+    a = _mm_add_epi32(a, b); d = rotl128(_mm_xor_si128(d, a), 8);   \
+    c = _mm_add_epi32(c, d); b = rotl128(_mm_xor_si128(b, c), 7);
+
+    void xorBlocksSse2(const uint32_t* state, const uint8_t* input, uint8_t* output, size_t blocks) {
+        uint32_t current[16];
+        std::memcpy(current, state, sizeof(current));
+
+        for (; blocks >= 4; blocks -= 4) {
+            __m128i x[16];
+            __m128i initial[16];
+            for (int i = 0; i < 16; ++i) {
+                initial[i] = _mm_set1_epi32(static_cast<int>(current[i]));
+            }
+            initial[12] = _mm_add_epi32(initial[12], _mm_setr_epi32(0, 1, 2, 3));
+            for (int i = 0; i < 16; ++i) {
+                x[i] = initial[i];
+            }
+
+            for (int round = 0; round < 10; ++round) {
+                CHACHA_QUARTER_ROUND_SSE2(x[0], x[4], x[8], x[12])
+                CHACHA_QUARTER_ROUND_SSE2(x[1], x[5], x[9], x[13])
+                CHACHA_QUARTER_ROUND_SSE2(x[2], x[6], x[10], x[14])
+                CHACHA_QUARTER_ROUND_SSE2(x[3], x[7], x[11], x[15])
+                CHACHA_QUARTER_ROUND_SSE2(x[0], x[5], x[10], x[15])
+                CHACHA_QUARTER_ROUND_SSE2(x[1], x[6], x[11], x[12])
+                CHACHA_QUARTER_ROUND_SSE2(x[2], x[7], x[8], x[13])
+                CHACHA_QUARTER_ROUND_SSE2(x[3], x[4], x[9], x[14])
+            }
+
+            for (int i = 0; i < 16; ++i) {
+                x[i] = _mm_add_epi32(x[i], initial[i]);
+            }
+
+            // Transpose each group of four words so every register holds 16 bytes of one block
+            for (int g = 0; g < 4; ++g) {
+                __m128i t0 = _mm_unpacklo_epi32(x[4 * g], x[4 * g + 1]);
+                __m128i t1 = _mm_unpacklo_epi32(x[4 * g + 2], x[4 * g + 3]);
+                __m128i t2 = _mm_unpackhi_epi32(x[4 * g], x[4 * g + 1]);
+                __m128i t3 = _mm_unpackhi_epi32(x[4 * g + 2], x[4 * g + 3]);
+                __m128i rows[4] = {
+                    _mm_unpacklo_epi64(t0, t1), _mm_unpackhi_epi64(t0, t1),
+                    _mm_unpacklo_epi64(t2, t3), _mm_unpackhi_epi64(t2, t3)
+                };
+                for (int b = 0; b < 4; ++b) {
+                    size_t offset = b * CHACHA20_BLOCK_SIZE + g * 16;
+                    __m128i in = _mm_loadu_si128(reinterpret_cast<const __m128i*>(input + offset));
+                    _mm_storeu_si128(reinterpret_cast<__m128i*>(output + offset), _mm_xor_si128(in, rows[b]));
+                }
+            }
+
+            current[12] += 4;
+            input += 4 * CHACHA20_BLOCK_SIZE;
+            output += 4 * CHACHA20_BLOCK_SIZE;
+        }
+
+        xorBlocksScalar(current, input, output, blocks);
+    }
+
+#undef CHACHA_QUARTER_ROUND_SSE2
+
+    // Eight blocks at a time
+    __attribute__((target("avx2")))
+    inline __m256i rotl256(__m256i v, int n) {
+        return _mm256_or_si256(_mm256_slli_epi32(v, n), _mm256_srli_epi32(v, 32 - n));
+    }
+
+#define CHACHA_QUARTER_ROUND_AVX2(a, b, c, d)                                        \
+    a = _mm256_add_epi32(a, b); d = _mm256_shuffle_epi8(_mm256_xor_si256(d, a), rot16); \
+    c = _mm256_add_epi32(c, d); b = rotl256(_mm256_xor_si256(b, c), 12);               \
+    a = _mm256_add_epi32(a, b); d = _mm256_shuffle_epi8(_mm256_xor_si256(d, a), rot8);  \
+    c = _mm256_add_epi32(c, d); b = rotl256(_mm256_xor_si256(b, c), 7);
+
+    __attribute__((target("avx2")))
+    void xorBlocksAvx2(const uint32_t* state, const uint8_t* input, uint8_t* output, size_t blocks) {
+        uint32_t current[16];
+        std::memcpy(current, state, sizeof(current));
+
+        // Byte rotations by 16 and 8 bits are single shuffles
+        const __m256i rot16 = _mm256_setr_epi8(
+            2, 3, 0, 1, 6, 7, 4, 5, 10, 11, 8, 9, 14, 15, 12, 13,
+            2, 3, 0, 1, 6, 7, 4, 5, 10, 11, 8, 9, 14, 15, 12, 13);
+        const __m256i rot8 = _mm256_setr_epi8(
+            3, 0, 1, 2, 7, 4, 5, 6, 11, 8, 9, 10, 15, 12, 13, 14,
+            3, 0, 1, 2, 7, 4, 5, 6, 11, 8, 9, 10, 15, 12, 13, 14);
+
+        for (; blocks >= 8; blocks -= 8) {
+            __m256i x[16];
+            __m256i initial[16];
+            for (int i = 0; i < 16; ++i) {
+                initial[i] = _mm256_set1_epi32(static_cast<int>(current[i]));
+            }
+            initial[12] = _mm256_add_epi32(initial[12], _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7));
+            for (int i = 0; i < 16; ++i) {
+                x[i] = initial[i];
+            }
+
+            for (int round = 0; round < 10; ++round) {
+                CHACHA_QUARTER_ROUND_AVX2(x[0], x[4], x[8], x[12])
+                CHACHA_QUARTER_ROUND_AVX2(x[1], x[5], x[9], x[13])
+                CHACHA_QUARTER_ROUND_AVX2(x[2], x[6], x[10], x[14])
+                CHACHA_QUARTER_ROUND_AVX2(x[3], x[7], x[11], x[15])
+                CHACHA_QUARTER_ROUND_AVX2(x[0], x[5], x[10], x[15])
+                CHACHA_QUARTER_ROUND_AVX2(x[1], x[6], x[11], x[12])
+                CHACHA_QUARTER_ROUND_AVX2(x[2], x[7], x[8], x[13])
+                CHACHA_QUARTER_ROUND_AVX2(x[3], x[4], x[9], x[14])
+            }
+
+            for (int i = 0; i < 16; ++i) {
+                x[i] = _mm256_add_epi32(x[i], initial[i]);
+            }
+
+            // Transpose within 128-bit lanes: rows[g][b] holds words 4g..4g+3 of
+            // block b in the low lane and of block b + 4 in the high lane
+            __m256i rows[4][4];
+            for (int g = 0; g < 4; ++g) {
+                __m256i t0 = _mm256_unpacklo_epi32(x[4 * g], x[4 * g + 1]);
+                __m256i t1 = _mm256_unpacklo_epi32(x[4 * g + 2], x[4 * g + 3]);
+                __m256i t2 = _mm256_unpackhi_epi32(x[4 * g], x[4 * g + 1]);
+                __m256i t3 = _mm256_unpackhi_epi32(x[4 * g + 2], x[4 * g + 3]);
+                rows[g][0] = _mm256_unpacklo_epi64(t0, t1);
+                rows[g][1] = _mm256_unpackhi_epi64(t0, t1);
+                rows[g][2] = _mm256_unpacklo_epi64(t2, t3);
+                rows[g][3] = _mm256_unpackhi_epi64(t2, t3);
+            }
+
+            for (int b = 0; b < 4; ++b) {
+                const __m256i parts[4] = {
+                    _mm256_permute2x128_si256(rows[0][b], rows[1][b], 0x20), // block b, bytes 0..31
+                    _mm256_permute2x128_si256(rows[2][b], rows[3][b], 0x20), // block b, bytes 32..63
+                    _mm256_permute2x128_si256(rows[0][b], rows[1][b], 0x31), // block b + 4, bytes 0..31
+                    _mm256_permute2x128_si256(rows[2][b], rows[3][b], 0x31)  // block b + 4, bytes 32..63
+                };
+                const size_t offsets[4] = {
+                    b * CHACHA20_BLOCK_SIZE, b * CHACHA20_BLOCK_SIZE + 32,
+                    (b + 4) * CHACHA20_BLOCK_SIZE, (b + 4) * CHACHA20_BLOCK_SIZE + 32
+                };
+                for (int p = 0; p < 4; ++p) {
+                    __m256i in = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(input + offsets[p]));
+                    _mm256_storeu_si256(reinterpret_cast<__m256i*>(output + offsets[p]), _mm256_xor_si256(in, parts[p]));
+                }
+            }
+
+            current[12] += 8;
+            input += 8 * CHACHA20_BLOCK_SIZE;
+            output += 8 * CHACHA20_BLOCK_SIZE;
+        }
+
+        xorBlocksSse2(current, input, output, blocks);
+    }
+
+#undef CHACHA_QUARTER_ROUND_AVX2
+#endif // CHACHA_X86
+
+#if CHACHA_NEON
+    // Four blocks at a time, one block per 32-bit lane
+    inline uint32x4_t rotl128(uint32x4_t v, int n) {
+        return vorrq_u32(vshlq_u32(v, vdupq_n_s32(n)), vshlq_u32(v, vdupq_n_s32(n - 32)));
+    }
+
+    inline uint32x4_t rotl128By16(uint32x4_t v) {
+        return vreinterpretq_u32_u16(vrev32q_u16(vreinterpretq_u16_u32(v)));
+    }
+
+#define CHACHA_QUARTER_ROUND_NEON(a, b, c, d)                     \
+    a = vaddq_u32(a, b); d = rotl128By16(veorq_u32(d, a));        \
+    c = vaddq_u32(c, d); b = rotl128(veorq_u32(b, c), 12);        \
+    a = vaddq_u32(a, b); d = rotl128(veorq_u32(d, a), 8);         \
+    c = vaddq_u32(c, d); b = rotl128(veorq_u32(b, c), 7);
+
+    void xorBlocksNeon(const uint32_t* state, const uint8_t* input, uint8_t* output, size_t blocks) {
+        uint32_t current[16];
+        std::memcpy(current, state, sizeof(current));
+        const uint32_t laneOffsets[4] = {0, 1, 2, 3};
+
+        for (; blocks >= 4; blocks -= 4) {
+            uint32x4_t x[16];
+            uint32x4_t initial[16];
+            for (int i = 0; i < 16; ++i) {
+                initial[i] = vdupq_n_u32(current[i]);
+            }
+            initial[12] = vaddq_u32(initial[12], vld1q_u32(laneOffsets));
+            for (int i = 0; i < 16; ++i) {
+                x[i] = initial[i];
+            }
+
+            for (int round = 0; round < 10; ++round) {
+                CHACHA_QUARTER_ROUND_NEON(x[0], x[4], x[8], x[12])
+                CHACHA_QUARTER_ROUND_NEON(x[1], x[5], x[9], x[13])
+                CHACHA_QUARTER_ROUND_NEON(x[2], x[6], x[10], x[14])
+                CHACHA_QUARTER_ROUND_NEON(x[3], x[7], x[11], x[15])
+                CHACHA_QUARTER_ROUND_NEON(x[0], x[5], x[10], x[15])
+                CHACHA_QUARTER_ROUND_NEON(x[1], x[6], x[11], x[12])
+                CHACHA_QUARTER_ROUND_NEON(x[2], x[7], x[8], x[13])
+                CHACHA_QUARTER_ROUND_NEON(x[3], x[4], x[9], x[14])
+            }
+
+            for (int i = 0; i < 16; ++i) {
+                x[i] = vaddq_u32(x[i], initial[i]);
+            }
+
+            // Transpose each group of four words so every register holds 16 bytes of one block
+            for (int g = 0; g < 4; ++g) {
+                uint32x4x2_t ab = vtrnq_u32(x[4 * g], x[4 * g + 1]);
+                uint32x4x2_t cd = vtrnq_u32(x[4 * g + 2], x[4 * g + 3]);
+                uint32x4_t rows[4] = {
+                    vcombine_u32(vget_low_u32(ab.val[0]), vget_low_u32(cd.val[0])),
+                    vcombine_u32(vget_low_u32(ab.val[1]), vget_low_u32(cd.val[1])),
+                    vcombine_u32(vget_high_u32(ab.val[0]), vget_high_u32(cd.val[0])),
+                    vcombine_u32(vget_high_u32(ab.val[1]), vget_high_u32(cd.val[1]))
+                };
+                for (int b = 0; b < 4; ++b) {
+                    size_t offset = b * CHACHA20_BLOCK_SIZE + g * 16;
+                    uint8x16_t in = vld1q_u8(input + offset);
+                    vst1q_u8(output + offset, veorq_u8(in, vreinterpretq_u8_u32(rows[b])));
+                }
+            }
+
+            current[12] += 4;
+            input += 4 * CHACHA20_BLOCK_SIZE;
+            output += 4 * CHACHA20_BLOCK_SIZE;
+        }
+
+        xorBlocksScalar(current, input, output, blocks);
+    }
+
+#undef CHACHA_QUARTER_ROUND_NEON
+#endif // CHACHA_NEON
+
+    struct ChaChaKernel {
+        void (*xorBlocks)(const uint32_t*, const uint8_t*, uint8_t*, size_t);
+        const char* name;
+        bool (*supported)(const CpuFeatures&);
+    };
+
+    constexpr ChaChaKernel VARIANTS[] = {
+#if CHACHA_X86
+        {xorBlocksAvx2, "avx2", [](const CpuFeatures& cpu) { return cpu.avx2; }},
+        {xorBlocksSse2, "sse2", [](const CpuFeatures& cpu) { return cpu.sse2; }},
+#elif CHACHA_NEON
+        {xorBlocksNeon, "neon", [](const CpuFeatures& cpu) { return cpu.neon; }},
+#endif
+        {xorBlocksScalar, "scalar", anyCpu},
+    };
+
+    KernelTable<ChaChaKernel> kernels("chacha20", VARIANTS);
+
+    const uint8_t ZERO_PADDING[16] = {};
+
+    void macPadded(Poly1305& mac, const uint8_t* data, size_t length) {
+        mac.update(data, length);
+        if (length % 16 != 0) {
+            mac.update(ZERO_PADDING, 16 - length % 16);
+        }
+    }
+
+    void macLengths(Poly1305& mac, uint64_t associatedLength, uint64_t messageLength) {
+        uint8_t lengths[16];
+        store64(lengths, associatedLength);
+        store64(lengths + 8, messageLength);
+        mac.update(lengths, sizeof(lengths));
+    }
+
+    // Poly1305 key from keystream block 0 (RFC 8439 section 2.6)
+    void derivePolyKey(const uint32_t* state, uint8_t* polyKey) {
+        uint32_t blockZero[16];
+        std::memcpy(blockZero, state, sizeof(blockZero));
+        blockZero[12] = 0;
+        uint8_t block[CHACHA20_BLOCK_SIZE];
+        chacha20Block(blockZero, block);
+        std::memcpy(polyKey, block, 32);
+        secureZero(block, sizeof(block));
+        secureZero(blockZero, sizeof(blockZero));
+    }
+
+    void computeAeadTag(const uint8_t* key, const uint8_t* nonce, ConstByteSpan associatedData,
+                        ConstByteSpan ciphertext, uint8_t* tag) {
+        uint32_t state[16];
+        initState(state, key, nonce, 0);
+        uint8_t polyKey[32];
+        derivePolyKey(state, polyKey);
+        secureZero(state, sizeof(state));
+
+        Poly1305 mac(polyKey);
+        secureZero(polyKey, sizeof(polyKey));
+        macPadded(mac, associatedData.data(), associatedData.size());
+        macPadded(mac, ciphertext.data(), ciphertext.size());
+        macLengths(mac, associatedData.size(), ciphertext.size());
+        mac.finish(tag);
+    }
+
+    bool tagsEqual(const uint8_t* a, const uint8_t* b) {
+        uint8_t difference = 0;
+        for (size_t i = 0; i < POLY1305_TAG_SIZE; ++i) {
+            difference |= a[i] ^ b[i];
+        }
+        return difference == 0;
+    }
+}
+
+void chacha20Xor(const uint8_t* key, const uint8_t* nonce, uint32_t counter,
+                 const uint8_t* input, uint8_t* output, size_t length) {
+    uint32_t state[16];
+    initState(state, key, nonce, counter);
+
+    size_t blocks = length / CHACHA20_BLOCK_SIZE;
+    if (blocks > 0) {
+        kernels.active().xorBlocks(state, input, output, blocks);
+        state[12] += static_cast<uint32_t>(blocks);
+    }
+
+    size_t done = blocks * CHACHA20_BLOCK_SIZE;
+    if (done < length) {
+        uint8_t keystream[CHACHA20_BLOCK_SIZE];
+        chacha20Block(state, keystream);
+        for (size_t i = done; i < length; ++i) {
+            output[i] = input[i] ^ keystream[i - done];
+        }
+        secureZero(keystream, sizeof(keystream));
+    }
+
+    secureZero(state, sizeof(state));
+}
+
+const char* chacha20KernelName() {
+    return kernels.activeName();
+}
+
+KernelFamily& chacha20Kernels() {
+    return kernels;
+}
+
+// Poly1305 over 26-bit limbs with 64-bit products, which stays portable to 32-bit ARM
+
+Poly1305::Poly1305() : buffered_(0) {
+    std::memset(r_, 0, sizeof(r_));
+    std::memset(h_, 0, sizeof(h_));
+    std::memset(pad_, 0, sizeof(pad_));
+}
+
+Poly1305::Poly1305(const uint8_t* key) : Poly1305() {
+    init(key);
+}
+
+Poly1305::~Poly1305() {
+    secureZero(r_, sizeof(r_));
+    secureZero(h_, sizeof(h_));
+    secureZero(pad_, sizeof(pad_));
+    secureZero(buffer_, sizeof(buffer_));
+}
+
+void Poly1305::init(const uint8_t* key) {
+    // r is clamped as the specification requires
+    r_[0] = load32(key) & 0x3ffffff;
+    r_[1] = (load32(key + 3) >> 2) & 0x3ffff03;
+    r_[2] = (load32(key + 6) >> 4) & 0x3ffc0ff;
+    r_[3] = (load32(key + 9) >> 6) & 0x3f03fff;
+    r_[4] = (load32(key + 12) >> 8) & 0x00fffff;
+
+    std::memset(h_, 0, sizeof(h_));
+
+    for (int i = 0; i < 4; ++i) {
+        pad_[i] = load32(key + 16 + 4 * i);
+    }
+
+    buffered_ = 0;
+}
+
+void Poly1305::processBlocks(const uint8_t* data, size_t length, uint32_t hibit) {
+    const uint32_t r0 = r_[0], r1 = r_[1], r2 = r_[2], r3 = r_[3], r4 = r_[4];
+    const uint32_t s1 = r1 * 5, s2 = r2 * 5, s3 = r3 * 5, s4 = r4 * 5;
+    uint32_t h0 = h_[0], h1 = h_[1], h2 = h_[2], h3 = h_[3], h4 = h_[4];
+
+    while (length >= 16) {
+        h0 += load32(data) & 0x3ffffff;
+        h1 += (load32(data + 3) >> 2) & 0x3ffffff;
+        h2 += (load32(data + 6) >> 4) & 0x3ffffff;
+        h3 += (load32(data + 9) >> 6) & 0x3ffffff;
+        h4 += (load32(data + 12) >> 8) | hibit;
+
+        uint64_t d0 = static_cast<uint64_t>(h0) * r0 + static_cast<uint64_t>(h1) * s4 +
+                      static_cast<uint64_t>(h2) * s3 + static_cast<uint64_t>(h3) * s2 +
+                      static_cast<uint64_t>(h4) * s1;
+        uint64_t d1 = static_cast<uint64_t>(h0) * r1 + static_cast<uint64_t>(h1) * r0 +
+                      static_cast<uint64_t>(h2) * s4 + static_cast<uint64_t>(h3) * s3 +
+                      static_cast<uint64_t>(h4) * s2;
+        uint64_t d2 = static_cast<uint64_t>(h0) * r2 + static_cast<uint64_t>(h1) * r1 +
+                      static_cast<uint64_t>(h2) * r0 + static_cast<uint64_t>(h3) * s4 +
+                      static_cast<uint64_t>(h4) * s3;
+        uint64_t d3 = static_cast<uint64_t>(h0) * r3 + static_cast<uint64_t>(h1) * r2 +
+                      static_cast<uint64_t>(h2) * r1 + static_cast<uint64_t>(h3) * r0 +
+                      static_cast<uint64_t>(h4) * s4;
+        uint64_t d4 = static_cast<uint64_t>(h0) * r4 + static_cast<uint64_t>(h1) * r3 +
+                      static_cast<uint64_t>(h2) * r2 + static_cast<uint64_t>(h3) * r1 +
+                      static_cast<uint64_t>(h4) * r0;
+
+        uint32_t carry = static_cast<uint32_t>(d0 >> 26);
+        h0 = static_cast<uint32_t>(d0) & 0x3ffffff;
+        d1 += carry;
+        carry = static_cast<uint32_t>(d1 >> 26);
+        h1 = static_cast<uint32_t>(d1) & 0x3ffffff;
+        d2 += carry;
+        carry = static_cast<uint32_t>(d2 >> 26);
+        h2 = static_cast<uint32_t>(d2) & 0x3ffffff;
+        d3 += carry;
+        carry = static_cast<uint32_t>(d3 >> 26);
+        h3 = static_cast<uint32_t>(d3) & 0x3ffffff;
+        d4 += carry;
+        carry = static_cast<uint32_t>(d4 >> 26);
+        h4 = static_cast<uint32_t>(d4) & 0x3ffffff;
+        h0 += carry * 5;
+        carry = h0 >> 26;
+        h0 &= 0x3ffffff;
+        h1 += carry;
+
+        data += 16;
+        length -= 16;
+    }
+
+    h_[0] = h0;
+    h_[1] = h1;
+    h_[2] = h2;
+    h_[3] = h3;
+    h_[4] = h4;
+}
+
+void Poly1305::update(const uint8_t* data, size_t length) {
+    if (buffered_ > 0) {
+        size_t take = std::min(length, sizeof(buffer_) - buffered_);
+        std::memcpy(buffer_ + buffered_, data, take);
+        buffered_ += take;
+        data += take;
+        length -= take;
+        if (buffered_ < sizeof(buffer_)) {
+            return;
+        }
+        processBlocks(buffer_, sizeof(buffer_), 1u << 24);
+        buffered_ = 0;
+    }
+
+    size_t whole = length & ~static_cast<size_t>(15);
+    if (whole > 0) {
+        processBlocks(data, whole, 1u << 24);
+        data += whole;
+        length -= whole;
+    }
+
+    if (length > 0) {
+        std::memcpy(buffer_, data, length);
+        buffered_ = length;
+    }
+}
+
+void Poly1305::finish(uint8_t* tag) {
+    // A trailing partial block is padded with a single 1 bit instead of the implicit 2^128
+    if (buffered_ > 0) {
+        buffer_[buffered_] = 1;
+        std::memset(buffer_ + buffered_ + 1, 0, sizeof(buffer_) - buffered_ - 1);
+        processBlocks(buffer_, sizeof(buffer_), 0);
+        buffered_ = 0;
+    }
+
+    uint32_t h0 = h_[0], h1 = h_[1], h2 = h_[2], h3 = h_[3], h4 = h_[4];
+
+    // Fully carry h
+    uint32_t carry = h1 >> 26;
+    h1 &= 0x3ffffff;
+    h2 += carry;
+    carry = h2 >> 26;
+    h2 &= 0x3ffffff;
+    h3 += carry;
+    carry = h3 >> 26;
+    h3 &= 0x3ffffff;
+    h4 += carry;
+    carry = h4 >> 26;
+    h4 &= 0x3ffffff;
+    h0 += carry * 5;
+    carry = h0 >> 26;
+    h0 &= 0x3ffffff;
+    h1 += carry;
+
+    // Compute h + -p and select it if h >= p, in constant time
+    uint32_t g0 = h0 + 5;
+    carry = g0 >> 26;
+    g0 &= 0x3ffffff;
+    uint32_t g1 = h1 + carry;
+    carry = g1 >> 26;
+    g1 &= 0x3ffffff;
+    uint32_t g2 = h2 + carry;
+    carry = g2 >> 26;
+    g2 &= 0x3ffffff;
+    uint32_t g3 = h3 + carry;
+    carry = g3 >> 26;
+    g3 &= 0x3ffffff;
+    uint32_t g4 = h4 + carry - (1u << 26);
+
+    uint32_t mask = (g4 >> 31) - 1;
+    g0 &= mask;
+    g1 &= mask;
+    g2 &= mask;
+    g3 &= mask;
+    g4 &= mask;
+    mask = ~mask;
+    h0 = (h0 & mask) | g0;
+    h1 = (h1 & mask) | g1;
+    h2 = (h2 & mask) | g2;
+    h3 = (h3 & mask) | g3;
+    h4 = (h4 & mask) | g4;
+
+    // h = (h + pad) mod 2^128
+    h0 = h0 | (h1 << 26);
+    h1 = (h1 >> 6) | (h2 << 20);
+    h2 = (h2 >> 12) | (h3 << 14);
+    h3 = (h3 >> 18) | (h4 << 8);
+
+    uint64_t f = static_cast<uint64_t>(h0) + pad_[0];
+    store32(tag, static_cast<uint32_t>(f));
+    f = static_cast<uint64_t>(h1) + pad_[1] + (f >> 32);
+    store32(tag + 4, static_cast<uint32_t>(f));
+    f = static_cast<uint64_t>(h2) + pad_[2] + (f >> 32);
+    store32(tag + 8, static_cast<uint32_t>(f));
+    f = static_cast<uint64_t>(h3) + pad_[3] + (f >> 32);
+    store32(tag + 12, static_cast<uint32_t>(f));
+
+    std::memset(h_, 0, sizeof(h_));
+}
+
+ChaCha20Poly1305::ChaCha20Poly1305(const uint8_t* key, const uint8_t* nonce, Direction direction,
+                                   ConstByteSpan associatedData)
+    : keystreamOffset_(CHACHA20_BLOCK_SIZE),
+      direction_(direction),
+      associatedLength_(associatedData.size()),
+      messageLength_(0) {
+    initState(state_, key, nonce, 1);
+
+    uint8_t polyKey[32];
+    derivePolyKey(state_, polyKey);
+    mac_.init(polyKey);
+    secureZero(polyKey, sizeof(polyKey));
+
+    macPadded(mac_, associatedData.data(), associatedData.size());
+}
+
+ChaCha20Poly1305::~ChaCha20Poly1305() {
+    secureZero(state_, sizeof(state_));
+    secureZero(keystream_, sizeof(keystream_));
+}
+
+void ChaCha20Poly1305::update(const uint8_t* input, uint8_t* output, size_t length) {
+    // The tag always covers ciphertext: before the transform when decrypting, after it when encrypting
+    if (direction_ == Direction::DECRYPT) {
+        mac_.update(input, length);
+    }
+
+    size_t i = 0;
+
+    // Finish the keystream block left over from the previous call
+    while (keystreamOffset_ < CHACHA20_BLOCK_SIZE && i < length) {
+        output[i] = input[i] ^ keystream_[keystreamOffset_++];
+        i++;
+    }
+
+    size_t blocks = (length - i) / CHACHA20_BLOCK_SIZE;
+    if (blocks > 0) {
+        kernels.active().xorBlocks(state_, input + i, output + i, blocks);
+        state_[12] += static_cast<uint32_t>(blocks);
+        i += blocks * CHACHA20_BLOCK_SIZE;
+    }
+
+    if (i < length) {
+        chacha20Block(state_, keystream_);
+        state_[12]++;
+        keystreamOffset_ = 0;
+        while (i < length) {
+            output[i] = input[i] ^ keystream_[keystreamOffset_++];
+            i++;
+        }
+    }
+
+    if (direction_ == Direction::ENCRYPT) {
+        mac_.update(output, length);
+    }
+    messageLength_ += length;
+}
+
+void ChaCha20Poly1305::computeTag(uint8_t* tag) {
+    if (messageLength_ % 16 != 0) {
+        mac_.update(ZERO_PADDING, 16 - messageLength_ % 16);
+    }
+    macLengths(mac_, associatedLength_, messageLength_);
+    mac_.finish(tag);
+}
+
+void ChaCha20Poly1305::finish(uint8_t* tag) {
+    computeTag(tag);
+}
+
+bool ChaCha20Poly1305::verify(const uint8_t* tag) {
+    uint8_t expected[POLY1305_TAG_SIZE];
+    computeTag(expected);
+    bool valid = tagsEqual(expected, tag);
+    secureZero(expected, sizeof(expected));
+    return valid;
+}
+
+void aeadSeal(const uint8_t* key, const uint8_t* nonce, ConstByteSpan associatedData,
+              ConstByteSpan plaintext, uint8_t* ciphertext, uint8_t* tag) {
+    chacha20Xor(key, nonce, 1, plaintext.data(), ciphertext, plaintext.size());
+    computeAeadTag(key, nonce, associatedData, ConstByteSpan(ciphertext, plaintext.size()), tag);
+}
+
+bool aeadOpen(const uint8_t* key, const uint8_t* nonce, ConstByteSpan associatedData,
+              ConstByteSpan ciphertext, const uint8_t* tag, uint8_t* plaintext) {
+    // Authenticate before decrypting so forged input never reaches the output buffer
+    uint8_t expected[POLY1305_TAG_SIZE];
+    computeAeadTag(key, nonce, associatedData, ciphertext, expected);
+    bool valid = tagsEqual(expected, tag);
+    secureZero(expected, sizeof(expected));
+    if (!valid) {
+        return false;
+    }
+
+    chacha20Xor(key, nonce, 1, ciphertext.data(), plaintext, ciphertext.size());
+    return true;
+}
+
+bool secureRandomBytes(uint8_t* output, size_t length) {
+    // Opened once and kept for the life of the process; per-call open() dominated small seals
+    static const int fd = open("/dev/urandom", O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return false;
+    }
+
+    size_t filled = 0;
+    while (filled < length) {
+        ssize_t result = read(fd, output + filled, length - filled);
+        if (result < 0 && errno == EINTR) {
+            continue;
+        }
+        if (result <= 0) {
+            return false;
+        }
+        filled += static_cast<size_t>(result);
+    }
+
+    return true;
+}
+
+std::unique_ptr<NonceSequence> NonceSequence::create() {
+    uint8_t prefix[4];
+    if (!secureRandomBytes(prefix, sizeof(prefix))) {
+        return nullptr;
+    }
+    return std::unique_ptr<NonceSequence>(new NonceSequence(prefix));
+}
+
+NonceSequence::NonceSequence(const uint8_t* prefix) : counter_(0) {
+    std::memcpy(prefix_, prefix, sizeof(prefix_));
+}
+
+void NonceSequence::next(uint8_t* nonce) {
+    uint64_t value = counter_.fetch_add(1, std::memory_order_relaxed);
+    std::memcpy(nonce, prefix_, sizeof(prefix_));
+    store64(nonce + 4, value);
+}
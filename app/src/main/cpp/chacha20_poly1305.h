@@ -0,0 +1,160 @@
+#ifndef CHACHA20_POLY1305_H
+#define CHACHA20_POLY1305_H
+
+#include <atomic>
+#include <memory>
+#include <cstddef>
+#include <cstdint>
+#include "span.h"
+
+class KernelFamily;
+
+// ChaCha20-Poly1305 AEAD as specified in RFC 8439
+
+constexpr size_t CHACHA20_KEY_SIZE = 32;
+constexpr size_t CHACHA20_NONCE_SIZE = 12;
+constexpr size_t CHACHA20_BLOCK_SIZE = 64;
+constexpr size_t POLY1305_TAG_SIZE = 16;
+
+/**
+ * XOR data with the raw ChaCha20 keystream (RFC 8439 section 2.4)
+ * @param key 32-byte key
+ * @param nonce 12-byte nonce
+ * @param counter Block counter of the first keystream block
+ * @param input Data to transform
+ * @param output Destination of the same length; may equal input
+ * @param length Number of bytes
+ */
+void chacha20Xor(const uint8_t* key, const uint8_t* nonce, uint32_t counter,
+                 const uint8_t* input, uint8_t* output, size_t length);
+
+/**
+ * Name of the ChaCha20 block kernel selected for this CPU ("avx2", "sse2", "neon" or "scalar")
+ */
+const char* chacha20KernelName();
+
+/**
+ * Variant table of the ChaCha20 block kernels, for kernel_dispatch
+ */
+KernelFamily& chacha20Kernels();
+
+/**
+ * Incremental Poly1305 one-time authenticator (RFC 8439 section 2.5)
+ */
+class Poly1305 {
+public:
+    Poly1305();
+    explicit Poly1305(const uint8_t* key);
+    ~Poly1305();
+
+    Poly1305(const Poly1305&) = delete;
+    Poly1305& operator=(const Poly1305&) = delete;
+
+    void init(const uint8_t* key);
+
+    void update(const uint8_t* data, size_t length);
+    void finish(uint8_t* tag);
+
+private:
+    uint32_t r_[5];
+    uint32_t h_[5];
+    uint32_t pad_[4];
+    uint8_t buffer_[16];
+    size_t buffered_;
+
+    void processBlocks(const uint8_t* data, size_t length, uint32_t hibit);
+};
+
+/**
+ * Streaming ChaCha20-Poly1305 context for one message. Feed the message through
+ * update() in pieces of any size, then call finish() to produce the tag when
+ * encrypting or verify() to check it when decrypting.
+ */
+class ChaCha20Poly1305 {
+public:
+    enum class Direction {
+        ENCRYPT,
+        DECRYPT
+    };
+
+    ChaCha20Poly1305(const uint8_t* key, const uint8_t* nonce, Direction direction,
+                     ConstByteSpan associatedData = ConstByteSpan());
+    ~ChaCha20Poly1305();
+
+    ChaCha20Poly1305(const ChaCha20Poly1305&) = delete;
+    ChaCha20Poly1305& operator=(const ChaCha20Poly1305&) = delete;
+
+    // Transform the next length bytes; output may equal input
+    void update(const uint8_t* input, uint8_t* output, size_t length);
+
+    // Encrypt side: write the 16-byte tag
+    void finish(uint8_t* tag);
+
+    // Decrypt side: constant-time comparison against the received tag
+    bool verify(const uint8_t* tag);
+
+private:
+    uint32_t state_[16];
+    uint8_t keystream_[CHACHA20_BLOCK_SIZE];
+    size_t keystreamOffset_;
+    Poly1305 mac_;
+    Direction direction_;
+    uint64_t associatedLength_;
+    uint64_t messageLength_;
+
+    void computeTag(uint8_t* tag);
+};
+
+/**
+ * One-shot encryption
+ * @param ciphertext Destination, plaintext.size() bytes; may equal plaintext.data()
+ * @param tag Receives the 16-byte authentication tag
+ */
+void aeadSeal(const uint8_t* key, const uint8_t* nonce, ConstByteSpan associatedData,
+              ConstByteSpan plaintext, uint8_t* ciphertext, uint8_t* tag);
+
+/**
+ * One-shot decryption. The plaintext is only written if the tag verifies.
+ * @param plaintext Destination, ciphertext.size() bytes; may equal ciphertext.data()
+ * @return true if the tag is valid
+ */
+bool aeadOpen(const uint8_t* key, const uint8_t* nonce, ConstByteSpan associatedData,
+              ConstByteSpan ciphertext, const uint8_t* tag, uint8_t* plaintext);
+
+/**
+ * Fill a buffer from the system CSPRNG
+ * @return false if no randomness could be read
+ */
+bool secureRandomBytes(uint8_t* output, size_t length);
+
+/**
+ * Zero key material in a way the optimizer may not elide
+ */
+void secureZero(void* data, size_t length);
+
+/**
+ * Per-message nonces for one key: a random 32-bit prefix followed by a 64-bit
+ * counter, so nonces never repeat within the lifetime of the sequence.
+ */
+class NonceSequence {
+public:
+    /**
+     * Start a sequence with a fresh random prefix
+     * @return nullptr if the system random source fails. There is deliberately no weaker
+     *         fallback: a guessable prefix could repeat nonces under the same key.
+     */
+    static std::unique_ptr<NonceSequence> create();
+
+    NonceSequence(const NonceSequence&) = delete;
+    NonceSequence& operator=(const NonceSequence&) = delete;
+
+    void next(uint8_t* nonce);
+
+private:
+    explicit NonceSequence(const uint8_t* prefix);
+
+    uint8_t prefix_[4];
+    std::atomic<uint64_t> counter_;
+};
+
+#endif // CHACHA20_POLY1305_H
@@ -0,0 +1,225 @@
+#include "checksum.h"
+#include "kernel_dispatch.h"
+#include <cstring>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define CHECKSUM_X86 1
+#elif defined(__aarch64__)
+#include <arm_acle.h>
+#define CHECKSUM_ARM64 1
+#if defined(__clang__)
+#define CHECKSUM_TARGET_CRC __attribute__((target("crc")))
+#else
+#define CHECKSUM_TARGET_CRC __attribute__((target("+crc")))
+#endif
+#endif
+
+namespace {
+    // Reflected Castagnoli polynomial
+    constexpr uint32_t CRC32C_POLYNOMIAL = 0x82F63B78;
+
+    // Slicing-by-8: values[k][b] is the state contribution of byte b followed by k zero bytes
+    struct CrcTable {
+        uint32_t values[8][256];
+
+        constexpr CrcTable() : values() {
+            for (uint32_t i = 0; i < 256; ++i) {
+                uint32_t crc = i;
+                for (int bit = 0; bit < 8; ++bit) {
+                    crc = (crc >> 1) ^ ((crc & 1) != 0 ? CRC32C_POLYNOMIAL : 0);
+                }
+                values[0][i] = crc;
+            }
+            for (int k = 1; k < 8; ++k) {
+                for (uint32_t i = 0; i < 256; ++i) {
+                    values[k][i] = (values[k - 1][i] >> 8) ^ values[0][values[k - 1][i] & 0xFF];
+                }
+            }
+        }
+    };
+
+    constexpr CrcTable CRC_TABLE;
+
+    // The hardware kernels run three independent streams over adjacent lanes of this many
+    // bytes, as the CRC instructions have a latency of three cycles but issue every cycle,
+    // and then shift the first two states over the lanes after them to combine the three
+    constexpr size_t CRC_LANE_SIZE = 512;
+
+    /**
+     * Product of two polynomials modulo the CRC polynomial, bit-reflected (bit 31 is x^0)
+     */
+    constexpr uint32_t multiplyModP(uint32_t a, uint32_t b) {
+        uint32_t product = 0;
+        for (uint32_t mask = 1u << 31; mask != 0; mask >>= 1) {
+            if ((a & mask) != 0) {
+                product ^= b;
+            }
+            b = (b & 1) != 0 ? (b >> 1) ^ CRC32C_POLYNOMIAL : b >> 1;
+        }
+        return product;
+    }
+
+    /**
+     * x^(2^exponent) modulo the CRC polynomial
+     */
+    constexpr uint32_t xToPowerOfTwo(int exponent) {
+        uint32_t power = 1u << 30; // x^1
+        for (int i = 0; i < exponent; ++i) {
+            power = multiplyModP(power, power);
+        }
+        return power;
+    }
+
+    /**
+     * Advances a CRC state over a fixed number of zero bytes: multiplication by
+     * x^(8 * bytes), a power of two, one byte of the state at a time
+     */
+    struct CrcShift {
+        uint32_t values[4][256];
+
+        constexpr explicit CrcShift(uint32_t power) : values() {
+            for (int k = 0; k < 4; ++k) {
+                for (uint32_t i = 0; i < 256; ++i) {
+                    values[k][i] = multiplyModP(power, i << (8 * k));
+                }
+            }
+        }
+
+        uint32_t apply(uint32_t state) const {
+            return values[0][state & 0xFF] ^ values[1][(state >> 8) & 0xFF] ^ values[2][(state >> 16) & 0xFF] ^
+                   values[3][state >> 24];
+        }
+    };
+
+    static_assert(CRC_LANE_SIZE == 512, "shift tables assume 512-byte lanes");
+    constexpr CrcShift SHIFT_ONE_LANE(xToPowerOfTwo(12));   // 8 * 512 bits
+    constexpr CrcShift SHIFT_TWO_LANES(xToPowerOfTwo(13));
+
+    /**
+     * State after three lanes from the states of each, the first one started from the
+     * incoming state and the other two from 0
+     */
+    inline uint32_t combineLanes(uint32_t first, uint32_t second, uint32_t third) {
+        return SHIFT_TWO_LANES.apply(first) ^ SHIFT_ONE_LANE.apply(second) ^ third;
+    }
+
+    inline uint32_t load32(const uint8_t* p) {
+        return static_cast<uint32_t>(p[0]) | static_cast<uint32_t>(p[1]) << 8 | static_cast<uint32_t>(p[2]) << 16 |
+               static_cast<uint32_t>(p[3]) << 24;
+    }
+
+    // Kernels take and return the inverted running state
+
+    uint32_t crc32cScalar(const uint8_t* data, size_t length, uint32_t state) {
+        const auto& t = CRC_TABLE.values;
+        for (; length >= 8; data += 8, length -= 8) {
+            uint32_t low = load32(data) ^ state;
+            uint32_t high = load32(data + 4);
+            state = t[7][low & 0xFF] ^ t[6][(low >> 8) & 0xFF] ^ t[5][(low >> 16) & 0xFF] ^ t[4][low >> 24] ^
+                    t[3][high & 0xFF] ^ t[2][(high >> 8) & 0xFF] ^ t[1][(high >> 16) & 0xFF] ^ t[0][high >> 24];
+        }
+        for (; length > 0; ++data, --length) {
+            state = (state >> 8) ^ t[0][(state ^ *data) & 0xFF];
+        }
+        return state;
+    }
+
+#if CHECKSUM_X86
+    __attribute__((target("sse4.2")))
+    uint32_t crc32cSse42(const uint8_t* data, size_t length, uint32_t state) {
+#if defined(__x86_64__)
+        for (; length >= 3 * CRC_LANE_SIZE; data += 3 * CRC_LANE_SIZE, length -= 3 * CRC_LANE_SIZE) {
+            uint64_t first = state;
+            uint64_t second = 0;
+            uint64_t third = 0;
+            for (size_t i = 0; i < CRC_LANE_SIZE; i += 8) {
+                uint64_t words[3];
+                std::memcpy(&words[0], data + i, 8);
+                std::memcpy(&words[1], data + CRC_LANE_SIZE + i, 8);
+                std::memcpy(&words[2], data + 2 * CRC_LANE_SIZE + i, 8);
+                first = _mm_crc32_u64(first, words[0]);
+                second = _mm_crc32_u64(second, words[1]);
+                third = _mm_crc32_u64(third, words[2]);
+            }
+            state = combineLanes(static_cast<uint32_t>(first), static_cast<uint32_t>(second),
+                                 static_cast<uint32_t>(third));
+        }
+        uint64_t wide = state;
+        for (; length >= 8; data += 8, length -= 8) {
+            uint64_t word;
+            std::memcpy(&word, data, sizeof(word));
+            wide = _mm_crc32_u64(wide, word);
+        }
+        state = static_cast<uint32_t>(wide);
+#endif
+        for (; length >= 4; data += 4, length -= 4) {
+            uint32_t word;
+            std::memcpy(&word, data, sizeof(word));
+            state = _mm_crc32_u32(state, word);
+        }
+        for (; length > 0; ++data, --length) {
+            state = _mm_crc32_u8(state, *data);
+        }
+        return state;
+    }
+#endif // CHECKSUM_X86
+
+#if CHECKSUM_ARM64
+    CHECKSUM_TARGET_CRC
+    uint32_t crc32cArmv8(const uint8_t* data, size_t length, uint32_t state) {
+        for (; length >= 3 * CRC_LANE_SIZE; data += 3 * CRC_LANE_SIZE, length -= 3 * CRC_LANE_SIZE) {
+            uint32_t first = state;
+            uint32_t second = 0;
+            uint32_t third = 0;
+            for (size_t i = 0; i < CRC_LANE_SIZE; i += 8) {
+                uint64_t words[3];
+                std::memcpy(&words[0], data + i, 8);
+                std::memcpy(&words[1], data + CRC_LANE_SIZE + i, 8);
+                std::memcpy(&words[2], data + 2 * CRC_LANE_SIZE + i, 8);
+                first = __crc32cd(first, words[0]);
+                second = __crc32cd(second, words[1]);
+                third = __crc32cd(third, words[2]);
+            }
+            state = combineLanes(first, second, third);
+        }
+        for (; length >= 8; data += 8, length -= 8) {
+            uint64_t word;
+            std::memcpy(&word, data, sizeof(word));
+            state = __crc32cd(state, word);
+        }
+        for (; length > 0; ++data, --length) {
+            state = __crc32cb(state, *data);
+        }
+        return state;
+    }
+#endif // CHECKSUM_ARM64
+
+    struct ChecksumKernel {
+        uint32_t (*update)(const uint8_t*, size_t, uint32_t);
+        const char* name;
+        bool (*supported)(const CpuFeatures&);
+    };
+
+    constexpr ChecksumKernel VARIANTS[] = {
+#if CHECKSUM_X86
+        {crc32cSse42, "sse4.2", [](const CpuFeatures& cpu) { return cpu.sse42; }},
+#elif CHECKSUM_ARM64
+        {crc32cArmv8, "armv8-crc", [](const CpuFeatures& cpu) { return cpu.crc32; }},
+#endif
+        {crc32cScalar, "scalar", anyCpu},
+    };
+
+    KernelTable<ChecksumKernel> kernels("checksum", VARIANTS);
+}
+
+uint32_t crc32c(const uint8_t* data, size_t length, uint32_t crc) {
+    if (length == 0) {
+        return crc;
+    }
+    return ~kernels.active().update(data, length, ~crc);
+}
+
+KernelFamily& checksumKernels() {
+    return kernels;
+}
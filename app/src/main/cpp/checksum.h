@@ -0,0 +1,25 @@
+#ifndef CHECKSUM_H
+#define CHECKSUM_H
+
+#include <cstddef>
+#include <cstdint>
+
+class KernelFamily;
+
+/**
+ * CRC-32C (Castagnoli, as used by iSCSI and ext4), with the SSE4.2 or ARMv8 CRC
+ * instructions where the CPU has them, running three streams at once on longer inputs,
+ * and slicing-by-8 tables otherwise
+ * @param data Bytes to checksum
+ * @param length Number of bytes
+ * @param crc Checksum of the preceding bytes when continuing a stream, 0 to start
+ * @return Checksum of everything so far
+ */
+uint32_t crc32c(const uint8_t* data, size_t length, uint32_t crc = 0);
+
+/**
+ * Variant table of the CRC-32C kernels, for kernel_dispatch
+ */
+KernelFamily& checksumKernels();
+
+#endif // CHECKSUM_H
@@ -0,0 +1,197 @@
+#include "chunked_cipher.h"
+#include "chacha20_poly1305.h"
+#include "thread_manager.h"
+#include <algorithm>
+#include <cstring>
+#include <limits>
+
+namespace {
+    const uint8_t CHUNKED_MAGIC[4] = {'F', 'X', 'C', '1'};
+    constexpr uint8_t CHUNKED_VERSION = 1;
+
+    bool isValidChunkSize(size_t chunkSize) {
+        return chunkSize >= MIN_CHUNK_SIZE && chunkSize <= MAX_CHUNK_SIZE && (chunkSize & (chunkSize - 1)) == 0;
+    }
+
+    uint8_t log2Of(size_t value) {
+        uint8_t shift = 0;
+        while ((static_cast<size_t>(1) << shift) < value) {
+            shift++;
+        }
+        return shift;
+    }
+
+    size_t chunkPosition(const ChunkedHeader& header, size_t chunkIndex) {
+        return CHUNKED_HEADER_SIZE + chunkIndex * (header.chunkSize + POLY1305_TAG_SIZE);
+    }
+
+    bool openChunk(const uint8_t* key, ConstByteSpan container, const ChunkedHeader& header,
+                   size_t chunkIndex, uint8_t* output) {
+        uint8_t nonce[CHACHA20_NONCE_SIZE];
+        chunkedNonce(header, chunkIndex, nonce);
+        size_t length = header.chunkLength(chunkIndex);
+        const uint8_t* chunk = container.data() + chunkPosition(header, chunkIndex);
+        return aeadOpen(key, nonce, container.first(CHUNKED_HEADER_SIZE), ConstByteSpan(chunk, length),
+                        chunk + length, output);
+    }
+}
+
+size_t ChunkedHeader::chunkCount() const {
+    // An empty payload still carries one empty chunk, so its header is authenticated
+    if (plaintextLength == 0) {
+        return 1;
+    }
+    return static_cast<size_t>((plaintextLength + chunkSize - 1) / chunkSize);
+}
+
+size_t ChunkedHeader::containerSize() const {
+    return CHUNKED_HEADER_SIZE + static_cast<size_t>(plaintextLength) + chunkCount() * POLY1305_TAG_SIZE;
+}
+
+size_t ChunkedHeader::chunkOffset(size_t chunkIndex) const {
+    return chunkIndex * chunkSize;
+}
+
+size_t ChunkedHeader::chunkLength(size_t chunkIndex) const {
+    size_t offset = chunkOffset(chunkIndex);
+    return std::min(chunkSize, static_cast<size_t>(plaintextLength) - offset);
+}
+
+size_t chunkedCiphertextSize(size_t plaintextLength, size_t chunkSize) {
+    ChunkedHeader header;
+    header.plaintextLength = plaintextLength;
+    header.chunkSize = chunkSize;
+    return header.containerSize();
+}
+
+bool initChunkedHeader(ChunkedHeader& header, uint64_t plaintextLength, size_t chunkSize) {
+    if (!isValidChunkSize(chunkSize) || plaintextLength > std::numeric_limits<size_t>::max() / 2) {
+        return false;
+    }
+
+    header.plaintextLength = plaintextLength;
+    header.chunkSize = chunkSize;
+    if (header.chunkCount() > std::numeric_limits<uint32_t>::max()) {
+        return false;
+    }
+    return secureRandomBytes(header.noncePrefix, sizeof(header.noncePrefix));
+}
+
+void writeChunkedHeader(uint8_t* output, const ChunkedHeader& header) {
+    std::memcpy(output, CHUNKED_MAGIC, sizeof(CHUNKED_MAGIC));
+    output[4] = CHUNKED_VERSION;
+    output[5] = log2Of(header.chunkSize);
+    output[6] = 0;
+    output[7] = 0;
+    std::memcpy(output + 8, header.noncePrefix, sizeof(header.noncePrefix));
+    for (int i = 0; i < 8; ++i) {
+        output[16 + i] = static_cast<uint8_t>(header.plaintextLength >> (8 * i));
+    }
+}
+
+bool readChunkedHeader(const uint8_t* bytes, ChunkedHeader& header) {
+    if (std::memcmp(bytes, CHUNKED_MAGIC, sizeof(CHUNKED_MAGIC)) != 0 || bytes[4] != CHUNKED_VERSION) {
+        return false;
+    }
+
+    uint8_t shift = bytes[5];
+    if (shift >= 8 * sizeof(size_t) || !isValidChunkSize(static_cast<size_t>(1) << shift)) {
+        return false;
+    }
+
+    uint64_t plaintextLength = 0;
+    for (int i = 0; i < 8; ++i) {
+        plaintextLength |= static_cast<uint64_t>(bytes[16 + i]) << (8 * i);
+    }
+    if (plaintextLength > std::numeric_limits<size_t>::max() / 2) {
+        return false;
+    }
+
+    header.plaintextLength = plaintextLength;
+    header.chunkSize = static_cast<size_t>(1) << shift;
+    std::memcpy(header.noncePrefix, bytes + 8, sizeof(header.noncePrefix));
+    return header.chunkCount() <= std::numeric_limits<uint32_t>::max();
+}
+
+void chunkedNonce(const ChunkedHeader& header, size_t chunkIndex, uint8_t* nonce) {
+    std::memcpy(nonce, header.noncePrefix, sizeof(header.noncePrefix));
+    nonce[8] = static_cast<uint8_t>(chunkIndex >> 24);
+    nonce[9] = static_cast<uint8_t>(chunkIndex >> 16);
+    nonce[10] = static_cast<uint8_t>(chunkIndex >> 8);
+    nonce[11] = static_cast<uint8_t>(chunkIndex);
+}
+
+bool parseChunkedHeader(ConstByteSpan container, ChunkedHeader& header) {
+    if (container.size() < CHUNKED_HEADER_SIZE || !readChunkedHeader(container.data(), header)) {
+        return false;
+    }
+    return header.plaintextLength <= container.size() && container.size() >= header.containerSize();
+}
+
+bool encryptChunked(const uint8_t* key, ConstByteSpan plaintext, ByteSpan output, size_t& written,
+                    ThreadManager* threadManager, size_t chunkSize) {
+    written = 0;
+
+    ChunkedHeader header;
+    if (!initChunkedHeader(header, plaintext.size(), chunkSize) || output.size() < header.containerSize()) {
+        return false;
+    }
+
+    writeChunkedHeader(output.data(), header);
+    ConstByteSpan associatedData(output.data(), CHUNKED_HEADER_SIZE);
+
+    bool sealed = runParallel(threadManager, header.chunkCount(), [&](size_t chunkIndex) {
+        uint8_t nonce[CHACHA20_NONCE_SIZE];
+        chunkedNonce(header, chunkIndex, nonce);
+        size_t length = header.chunkLength(chunkIndex);
+        uint8_t* chunk = output.data() + chunkPosition(header, chunkIndex);
+        aeadSeal(key, nonce, associatedData, plaintext.subspan(header.chunkOffset(chunkIndex), length),
+                 chunk, chunk + length);
+        return true;
+    });
+
+    written = header.containerSize();
+    return sealed;
+}
+
+bool decryptChunked(const uint8_t* key, ConstByteSpan container, ByteSpan output, size_t& written,
+                    ThreadManager* threadManager) {
+    written = 0;
+
+    ChunkedHeader header;
+    if (!parseChunkedHeader(container, header) || output.size() < header.plaintextLength) {
+        return false;
+    }
+
+    bool opened = runParallel(threadManager, header.chunkCount(), [&](size_t chunkIndex) {
+        return openChunk(key, container, header, chunkIndex, output.data() + header.chunkOffset(chunkIndex));
+    });
+
+    if (!opened) {
+        // Never leave authenticated chunks of a forged container behind
+        if (header.plaintextLength > 0) {
+            std::memset(output.data(), 0, static_cast<size_t>(header.plaintextLength));
+        }
+        return false;
+    }
+
+    written = static_cast<size_t>(header.plaintextLength);
+    return true;
+}
+
+bool decryptChunk(const uint8_t* key, ConstByteSpan container, size_t chunkIndex, ByteSpan output, size_t& written) {
+    written = 0;
+
+    ChunkedHeader header;
+    if (!parseChunkedHeader(container, header) || chunkIndex >= header.chunkCount()) {
+        return false;
+    }
+
+    size_t length = header.chunkLength(chunkIndex);
+    if (output.size() < length || !openChunk(key, container, header, chunkIndex, output.data())) {
+        return false;
+    }
+
+    written = length;
+    return true;
+}
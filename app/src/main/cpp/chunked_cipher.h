@@ -0,0 +1,99 @@
+#ifndef CHUNKED_CIPHER_H
+#define CHUNKED_CIPHER_H
+
+#include <cstddef>
+#include <cstdint>
+#include "span.h"
+
+// Forward declaration
+class ThreadManager;
+
+// Chunked ChaCha20-Poly1305 container for large payloads:
+//
+//   header  "FXC1" | version u8 | log2(chunk size) u8 | reserved u16 | nonce prefix[8] | plaintext length u64 (LE)
+//   chunk i ciphertext[min(chunk size, remaining)] | tag[16]
+//
+// Each chunk is sealed independently with nonce = prefix || be32(i) and the header as
+// associated data, so chunks can be processed in parallel or decrypted on their own,
+// and reordering, truncation or header tampering all fail authentication.
+
+constexpr size_t CHUNKED_HEADER_SIZE = 24;
+constexpr size_t MIN_CHUNK_SIZE = 4 * 1024;
+constexpr size_t MAX_CHUNK_SIZE = 16 * 1024 * 1024;
+constexpr size_t DEFAULT_CHUNK_SIZE = 64 * 1024;
+
+struct ChunkedHeader {
+    uint64_t plaintextLength = 0;
+    size_t chunkSize = 0;
+    uint8_t noncePrefix[8] = {};
+
+    size_t chunkCount() const;
+    size_t containerSize() const;
+
+    // Plaintext offset and length of one chunk
+    size_t chunkOffset(size_t chunkIndex) const;
+    size_t chunkLength(size_t chunkIndex) const;
+};
+
+/**
+ * Size of the container for a plaintext
+ * @param chunkSize Power of two between MIN_CHUNK_SIZE and MAX_CHUNK_SIZE
+ */
+size_t chunkedCiphertextSize(size_t plaintextLength, size_t chunkSize = DEFAULT_CHUNK_SIZE);
+
+/**
+ * Parse and validate a container header
+ * @return false if the header is malformed or the container is shorter than it declares
+ */
+bool parseChunkedHeader(ConstByteSpan container, ChunkedHeader& header);
+
+/**
+ * Start a header for a new container, with a fresh random nonce prefix
+ * @return false if chunkSize is invalid, the payload needs more than 2^32 chunks or no nonce could be generated
+ */
+bool initChunkedHeader(ChunkedHeader& header, uint64_t plaintextLength, size_t chunkSize = DEFAULT_CHUNK_SIZE);
+
+/**
+ * Serialize a header into CHUNKED_HEADER_SIZE bytes
+ */
+void writeChunkedHeader(uint8_t* output, const ChunkedHeader& header);
+
+/**
+ * Parse and validate the CHUNKED_HEADER_SIZE header bytes alone, without checking the container length
+ */
+bool readChunkedHeader(const uint8_t* bytes, ChunkedHeader& header);
+
+/**
+ * Nonce of one chunk: the header's prefix followed by the big-endian chunk index
+ */
+void chunkedNonce(const ChunkedHeader& header, size_t chunkIndex, uint8_t* nonce);
+
+/**
+ * Encrypt into a chunked container. Chunks are sealed on the thread pool when one is
+ * given, with the calling thread taking part, and sequentially otherwise.
+ * @param key 32-byte ChaCha20-Poly1305 key
+ * @param output At least chunkedCiphertextSize(plaintext.size(), chunkSize) bytes
+ * @param written Receives the container size
+ * @return false if chunkSize is invalid, output is too small or no nonce could be generated
+ */
+bool encryptChunked(const uint8_t* key, ConstByteSpan plaintext, ByteSpan output, size_t& written,
+                    ThreadManager* threadManager = nullptr, size_t chunkSize = DEFAULT_CHUNK_SIZE);
+
+/**
+ * Decrypt a whole container, in parallel when a thread pool is given
+ * @param output At least header.plaintextLength bytes
+ * @param written Receives the plaintext length
+ * @return false if the container is malformed or any chunk fails authentication; output is zeroed
+ */
+bool decryptChunked(const uint8_t* key, ConstByteSpan container, ByteSpan output, size_t& written,
+                    ThreadManager* threadManager = nullptr);
+
+/**
+ * Decrypt a single chunk for random access
+ * @param output At least header.chunkLength(chunkIndex) bytes
+ * @param written Receives the chunk's plaintext length
+ * @return false if the container or chunk index is invalid or the chunk fails authentication
+ */
+bool decryptChunk(const uint8_t* key, ConstByteSpan container, size_t chunkIndex, ByteSpan output, size_t& written);
+
+#endif // CHUNKED_CIPHER_H
@@ -0,0 +1,202 @@
+#include "cipher_stream.h"
+#include <algorithm>
+#include <cstring>
+
+namespace {
+    // Ciphertext is staged here between the cipher and the sink, so large update() calls
+    // never need a buffer the size of the input
+    constexpr size_t STREAM_SCRATCH_SIZE = 16 * 1024;
+}
+
+StreamEncryptor::StreamEncryptor(const uint8_t* key, uint64_t plaintextLength, StreamSink sink, size_t chunkSize)
+    : sink_(std::move(sink)),
+      chunkIndex_(0),
+      chunkRemaining_(0),
+      consumed_(0),
+      headerWritten_(false),
+      failed_(false) {
+    std::memcpy(key_, key, sizeof(key_));
+    if (!initChunkedHeader(header_, plaintextLength, chunkSize)) {
+        failed_ = true;
+        return;
+    }
+    writeChunkedHeader(headerBytes_, header_);
+    scratch_.resize(std::min(STREAM_SCRATCH_SIZE, chunkSize));
+}
+
+StreamEncryptor::~StreamEncryptor() {
+    secureZero(key_, sizeof(key_));
+}
+
+bool StreamEncryptor::emit(const uint8_t* data, size_t length) {
+    if (!sink_(ConstByteSpan(data, length))) {
+        failed_ = true;
+    }
+    return !failed_;
+}
+
+bool StreamEncryptor::writeHeader() {
+    if (!headerWritten_) {
+        headerWritten_ = true;
+        return emit(headerBytes_, sizeof(headerBytes_));
+    }
+    return true;
+}
+
+void StreamEncryptor::beginChunk() {
+    uint8_t nonce[CHACHA20_NONCE_SIZE];
+    chunkedNonce(header_, chunkIndex_, nonce);
+    chunk_.emplace(key_, nonce, ChaCha20Poly1305::Direction::ENCRYPT,
+                   ConstByteSpan(headerBytes_, sizeof(headerBytes_)));
+    chunkRemaining_ = header_.chunkLength(chunkIndex_);
+}
+
+bool StreamEncryptor::sealChunk() {
+    uint8_t tag[POLY1305_TAG_SIZE];
+    chunk_->finish(tag);
+    chunk_.reset();
+    chunkIndex_++;
+    return emit(tag, sizeof(tag));
+}
+
+bool StreamEncryptor::update(ConstByteSpan plaintext) {
+    if (failed_ || !writeHeader()) {
+        return false;
+    }
+    if (plaintext.size() > header_.plaintextLength - consumed_) {
+        failed_ = true;
+        return false;
+    }
+
+    const uint8_t* input = plaintext.data();
+    size_t remaining = plaintext.size();
+    while (remaining > 0) {
+        if (!chunk_) {
+            beginChunk();
+        }
+
+        size_t length = std::min({remaining, chunkRemaining_, scratch_.size()});
+        chunk_->update(input, scratch_.data(), length);
+        if (!emit(scratch_.data(), length)) {
+            return false;
+        }
+
+        input += length;
+        remaining -= length;
+        consumed_ += length;
+        chunkRemaining_ -= length;
+        if (chunkRemaining_ == 0 && !sealChunk()) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool StreamEncryptor::finalize() {
+    if (failed_ || !writeHeader() || consumed_ != header_.plaintextLength) {
+        return false;
+    }
+
+    // An empty payload still carries one sealed empty chunk
+    if (header_.plaintextLength == 0 && chunkIndex_ == 0) {
+        beginChunk();
+        return sealChunk();
+    }
+    return true;
+}
+
+size_t StreamEncryptor::containerSize() const {
+    // Zero when the header could not be set up
+    return header_.chunkSize != 0 ? header_.containerSize() : 0;
+}
+
+StreamDecryptor::StreamDecryptor(const uint8_t* key, StreamSink sink)
+    : headerReceived_(0),
+      sink_(std::move(sink)),
+      chunkIndex_(0),
+      complete_(false),
+      failed_(false) {
+    std::memcpy(key_, key, sizeof(key_));
+}
+
+StreamDecryptor::~StreamDecryptor() {
+    secureZero(key_, sizeof(key_));
+    if (!pending_.empty()) {
+        secureZero(pending_.data(), pending_.size());
+    }
+}
+
+bool StreamDecryptor::openChunk() {
+    uint8_t nonce[CHACHA20_NONCE_SIZE];
+    chunkedNonce(header_, chunkIndex_, nonce);
+    size_t length = pending_.size() - POLY1305_TAG_SIZE;
+    if (!aeadOpen(key_, nonce, ConstByteSpan(headerBytes_, sizeof(headerBytes_)),
+                  ConstByteSpan(pending_.data(), length), pending_.data() + length, pending_.data())) {
+        return false;
+    }
+
+    bool accepted = sink_(ConstByteSpan(pending_.data(), length));
+    secureZero(pending_.data(), length);
+    pending_.clear();
+    chunkIndex_++;
+    complete_ = chunkIndex_ == header_.chunkCount();
+    return accepted;
+}
+
+bool StreamDecryptor::update(ConstByteSpan container) {
+    if (failed_) {
+        return false;
+    }
+
+    const uint8_t* input = container.data();
+    size_t remaining = container.size();
+
+    if (headerReceived_ < CHUNKED_HEADER_SIZE) {
+        size_t length = std::min(remaining, CHUNKED_HEADER_SIZE - headerReceived_);
+        std::memcpy(headerBytes_ + headerReceived_, input, length);
+        headerReceived_ += length;
+        input += length;
+        remaining -= length;
+
+        if (headerReceived_ == CHUNKED_HEADER_SIZE) {
+            // pending_ grows with the bytes actually received rather than what the
+            // unauthenticated header claims, and keeps its capacity across chunks
+            if (!readChunkedHeader(headerBytes_, header_)) {
+                failed_ = true;
+                return false;
+            }
+        }
+    }
+
+    while (remaining > 0) {
+        if (complete_) {
+            // Trailing bytes after the last chunk
+            failed_ = true;
+            return false;
+        }
+
+        size_t needed = header_.chunkLength(chunkIndex_) + POLY1305_TAG_SIZE - pending_.size();
+        size_t length = std::min(remaining, needed);
+        pending_.insert(pending_.end(), input, input + length);
+        input += length;
+        remaining -= length;
+
+        if (length == needed && !openChunk()) {
+            failed_ = true;
+            return false;
+        }
+    }
+    return true;
+}
+
+bool StreamDecryptor::finalize() {
+    return !failed_ && complete_;
+}
+
+bool StreamDecryptor::hasHeader() const {
+    return headerReceived_ == CHUNKED_HEADER_SIZE && !failed_;
+}
+
+uint64_t StreamDecryptor::plaintextLength() const {
+    return header_.plaintextLength;
+}
@@ -0,0 +1,115 @@
+#ifndef CIPHER_STREAM_H
+#define CIPHER_STREAM_H
+
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <vector>
+#include "chacha20_poly1305.h"
+#include "chunked_cipher.h"
+#include "span.h"
+
+// Incremental encryption and decryption of the chunked container (see chunked_cipher.h)
+// for socket and file pipelines. Data is pushed through update() in pieces of any size
+// and the transformed bytes are handed to a sink as they become available, so memory
+// stays bounded by one chunk no matter how large the payload is. The bytes produced are
+// the same format encryptChunked/decryptChunked use, so both sides can be mixed.
+
+class StreamEncryptor {
+public:
+    /**
+     * @param key 32-byte ChaCha20-Poly1305 key, copied
+     * @param plaintextLength Total number of bytes that will be passed to update(); it is part of the header
+     * @param sink Receives the container, starting with the header
+     * @param chunkSize Power of two between MIN_CHUNK_SIZE and MAX_CHUNK_SIZE
+     */
+    StreamEncryptor(const uint8_t* key, uint64_t plaintextLength, StreamSink sink,
+                    size_t chunkSize = DEFAULT_CHUNK_SIZE);
+    ~StreamEncryptor();
+
+    StreamEncryptor(const StreamEncryptor&) = delete;
+    StreamEncryptor& operator=(const StreamEncryptor&) = delete;
+
+    /**
+     * Encrypt the next piece of plaintext
+     * @return false if the stream has failed, the sink refused output or more than plaintextLength bytes were given
+     */
+    bool update(ConstByteSpan plaintext);
+
+    /**
+     * Seal the last chunk
+     * @return false unless exactly plaintextLength bytes were encrypted and every piece reached the sink
+     */
+    bool finalize();
+
+    /**
+     * Total container size the sink will have received after finalize(), or 0 if the
+     * chunk size was invalid or no nonce could be generated
+     */
+    size_t containerSize() const;
+
+private:
+    uint8_t key_[CHACHA20_KEY_SIZE];
+    ChunkedHeader header_;
+    uint8_t headerBytes_[CHUNKED_HEADER_SIZE];
+    StreamSink sink_;
+    std::optional<ChaCha20Poly1305> chunk_;
+    size_t chunkIndex_;
+    size_t chunkRemaining_;
+    uint64_t consumed_;
+    std::vector<uint8_t> scratch_;
+    bool headerWritten_;
+    bool failed_;
+
+    bool emit(const uint8_t* data, size_t length);
+    bool writeHeader();
+    void beginChunk();
+    bool sealChunk();
+};
+
+class StreamDecryptor {
+public:
+    /**
+     * @param key 32-byte ChaCha20-Poly1305 key, copied
+     * @param sink Receives plaintext, one authenticated chunk at a time
+     */
+    StreamDecryptor(const uint8_t* key, StreamSink sink);
+    ~StreamDecryptor();
+
+    StreamDecryptor(const StreamDecryptor&) = delete;
+    StreamDecryptor& operator=(const StreamDecryptor&) = delete;
+
+    /**
+     * Consume the next piece of the container. Plaintext is only released once its
+     * chunk has been authenticated.
+     * @return false if the header is malformed, a chunk fails authentication, the sink
+     *         refused output or data follows the last chunk
+     */
+    bool update(ConstByteSpan container);
+
+    /**
+     * @return true if the whole container was received and authenticated
+     */
+    bool finalize();
+
+    /**
+     * True once the header has been parsed; plaintextLength() is valid from then on
+     */
+    bool hasHeader() const;
+    uint64_t plaintextLength() const;
+
+private:
+    uint8_t key_[CHACHA20_KEY_SIZE];
+    ChunkedHeader header_;
+    uint8_t headerBytes_[CHUNKED_HEADER_SIZE];
+    size_t headerReceived_;
+    StreamSink sink_;
+    std::vector<uint8_t> pending_;
+    size_t chunkIndex_;
+    bool complete_;
+    bool failed_;
+
+    bool openChunk();
+};
+
+#endif // CIPHER_STREAM_H
@@ -0,0 +1,84 @@
+#include "cpu_features.h"
+
+#if defined(__aarch64__) || defined(__arm__)
+#include <sys/auxv.h>
+#endif
+
+namespace {
+#if defined(__aarch64__)
+    // AT_HWCAP bits from <asm/hwcap.h>, spelled out for older NDK headers
+    constexpr unsigned long ARM64_HWCAP_ASIMD = 1UL << 1;
+    constexpr unsigned long ARM64_HWCAP_AES = 1UL << 3;
+    constexpr unsigned long ARM64_HWCAP_PMULL = 1UL << 4;
+    constexpr unsigned long ARM64_HWCAP_SHA2 = 1UL << 6;
+    constexpr unsigned long ARM64_HWCAP_CRC32 = 1UL << 7;
+#elif defined(__arm__)
+    constexpr unsigned long ARM_HWCAP_NEON = 1UL << 12;
+    constexpr unsigned long ARM_HWCAP2_AES = 1UL << 0;
+    constexpr unsigned long ARM_HWCAP2_PMULL = 1UL << 1;
+    constexpr unsigned long ARM_HWCAP2_SHA2 = 1UL << 3;
+    constexpr unsigned long ARM_HWCAP2_CRC32 = 1UL << 4;
+#endif
+
+    CpuFeatures detect() {
+        CpuFeatures features;
+#if defined(__x86_64__) || defined(__i386__)
+        __builtin_cpu_init();
+        features.sse2 = __builtin_cpu_supports("sse2");
+        features.ssse3 = __builtin_cpu_supports("ssse3");
+        features.sse42 = __builtin_cpu_supports("sse4.2");
+        features.avx2 = __builtin_cpu_supports("avx2");
+        features.pclmul = __builtin_cpu_supports("pclmul");
+#elif defined(__aarch64__)
+        unsigned long hwcap = getauxval(AT_HWCAP);
+        features.neon = (hwcap & ARM64_HWCAP_ASIMD) != 0;
+        features.aes = (hwcap & ARM64_HWCAP_AES) != 0;
+        features.pmull = (hwcap & ARM64_HWCAP_PMULL) != 0;
+        features.sha2 = (hwcap & ARM64_HWCAP_SHA2) != 0;
+        features.crc32 = (hwcap & ARM64_HWCAP_CRC32) != 0;
+#elif defined(__arm__)
+        unsigned long hwcap = getauxval(AT_HWCAP);
+        unsigned long hwcap2 = getauxval(AT_HWCAP2);
+        features.neon = (hwcap & ARM_HWCAP_NEON) != 0;
+        features.aes = (hwcap2 & ARM_HWCAP2_AES) != 0;
+        features.pmull = (hwcap2 & ARM_HWCAP2_PMULL) != 0;
+        features.sha2 = (hwcap2 & ARM_HWCAP2_SHA2) != 0;
+        features.crc32 = (hwcap2 & ARM_HWCAP2_CRC32) != 0;
+#endif
+        return features;
+    }
+}
+
+const CpuFeatures& cpuFeatures() {
+    static const CpuFeatures features = detect();
+    return features;
+}
+
+std::string cpuFeatureNames(const CpuFeatures& features) {
+    const struct {
+        bool present;
+        const char* name;
+    } flags[] = {
+        {features.sse2, "sse2"},
+        {features.ssse3, "ssse3"},
+        {features.sse42, "sse4.2"},
+        {features.avx2, "avx2"},
+        {features.pclmul, "pclmul"},
+        {features.neon, "neon"},
+        {features.aes, "aes"},
+        {features.pmull, "pmull"},
+        {features.sha2, "sha2"},
+        {features.crc32, "crc32"},
+    };
+
+    std::string names;
+    for (const auto& flag : flags) {
+        if (flag.present) {
+            if (!names.empty()) {
+                names += ' ';
+            }
+            names += flag.name;
+        }
+    }
+    return names.empty() ? "none" : names;
+}
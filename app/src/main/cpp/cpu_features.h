@@ -0,0 +1,37 @@
+#ifndef CPU_FEATURES_H
+#define CPU_FEATURES_H
+
+#include <string>
+
+/**
+ * Instruction set extensions usable by native kernels, detected at runtime. x86 uses
+ * cpuid (including the OS check that AVX state is saved), ARM uses getauxval(AT_HWCAP).
+ * Flags for the other architecture are always false.
+ */
+struct CpuFeatures {
+    // x86
+    bool sse2 = false;
+    bool ssse3 = false;
+    bool sse42 = false;
+    bool avx2 = false;
+    bool pclmul = false;
+
+    // ARM
+    bool neon = false;
+    bool aes = false;
+    bool pmull = false;
+    bool sha2 = false;
+    bool crc32 = false;
+};
+
+/**
+ * Features of the CPU we are running on, detected on first use
+ */
+const CpuFeatures& cpuFeatures();
+
+/**
+ * Space-separated names of the detected features, e.g. "sse2 ssse3 sse4.2 avx2"
+ */
+std::string cpuFeatureNames(const CpuFeatures& features);
+
+#endif // CPU_FEATURES_H
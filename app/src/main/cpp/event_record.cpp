@@ -0,0 +1,183 @@
+#include "event_record.h"
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+
+namespace {
+    // Every pooled buffer is preceded by a small header recording its size class,
+    // so release() does not need the caller to remember the requested length
+    struct PayloadHeader {
+        uint32_t sizeClass;
+        uint32_t reserved;
+        uint64_t padding; // Keep the payload 16-byte aligned
+    };
+
+    constexpr uint32_t UNPOOLED_CLASS = 0xFFFFFFFF;
+
+    PayloadHeader* headerOf(uint8_t* data) {
+        return reinterpret_cast<PayloadHeader*>(data - sizeof(PayloadHeader));
+    }
+}
+
+uint32_t EventIdTable::intern(const std::string& eventId) {
+    {
+        std::shared_lock<std::shared_mutex> lock(mutex_);
+        auto it = ids_.find(eventId);
+        if (it != ids_.end()) {
+            return it->second;
+        }
+    }
+
+    std::unique_lock<std::shared_mutex> lock(mutex_);
+    auto result = ids_.emplace(eventId, static_cast<uint32_t>(names_.size()));
+    if (result.second) {
+        names_.push_back(eventId);
+    }
+    return result.first->second;
+}
+
+std::string EventIdTable::name(uint32_t id) const {
+    std::shared_lock<std::shared_mutex> lock(mutex_);
+    return id < names_.size() ? names_[id] : std::string();
+}
+
+size_t EventIdTable::size() const {
+    std::shared_lock<std::shared_mutex> lock(mutex_);
+    return names_.size();
+}
+
+PayloadPool::PayloadPool() {
+}
+
+PayloadPool::~PayloadPool() {
+    trim();
+}
+
+size_t PayloadPool::classFor(size_t size) {
+    size_t shift = MIN_CLASS_SHIFT;
+    while (shift <= MAX_CLASS_SHIFT && (static_cast<size_t>(1) << shift) < size) {
+        shift++;
+    }
+    return shift - MIN_CLASS_SHIFT;
+}
+
+size_t PayloadPool::cachedLimit(size_t sizeClass) {
+    size_t perClass = CLASS_CACHE_BYTES >> (sizeClass + MIN_CLASS_SHIFT);
+    return std::min(MAX_CACHED_PER_CLASS, std::max(MIN_CACHED_PER_CLASS, perClass));
+}
+
+uint8_t* PayloadPool::acquire(size_t size) {
+    size_t sizeClass = classFor(size);
+
+    if (sizeClass < CLASS_COUNT) {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            auto& freeList = freeLists_[sizeClass];
+            if (!freeList.empty()) {
+                uint8_t* data = freeList.back();
+                freeList.pop_back();
+                outstanding_.insert(data);
+                return data;
+            }
+        }
+        size = static_cast<size_t>(1) << (sizeClass + MIN_CLASS_SHIFT);
+    }
+
+    auto* header = static_cast<PayloadHeader*>(std::malloc(sizeof(PayloadHeader) + size));
+    if (header == nullptr) {
+        return nullptr;
+    }
+    header->sizeClass = sizeClass < CLASS_COUNT ? static_cast<uint32_t>(sizeClass) : UNPOOLED_CLASS;
+    uint8_t* data = reinterpret_cast<uint8_t*>(header + 1);
+    std::lock_guard<std::mutex> lock(mutex_);
+    outstanding_.insert(data);
+    return data;
+}
+
+bool PayloadPool::release(uint8_t* data) {
+    if (data == nullptr) {
+        return false;
+    }
+
+    // Only buffers still handed out are looked at, so a buffer released twice is never
+    // touched again, even after it was freed. Two racing releases cannot both find it.
+    std::unique_lock<std::mutex> lock(mutex_);
+    if (outstanding_.erase(data) == 0) {
+        // Already released or not ours; leaking is safer than freeing it
+        return false;
+    }
+
+    PayloadHeader* header = headerOf(data);
+    if (header->sizeClass != UNPOOLED_CLASS) {
+        auto& freeList = freeLists_[header->sizeClass];
+        if (freeList.size() < cachedLimit(header->sizeClass)) {
+            freeList.push_back(data);
+            return true;
+        }
+    }
+
+    lock.unlock();
+    std::free(header);
+    return true;
+}
+
+void PayloadPool::trim() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (auto& freeList : freeLists_) {
+        for (uint8_t* data : freeList) {
+            std::free(headerOf(data));
+        }
+        freeList.clear();
+    }
+}
+
+uint8_t* Event::allocatePayload(PayloadPool& pool, size_t payloadLength) {
+    length = static_cast<uint32_t>(payloadLength);
+
+    if (payloadLength <= INLINE_CAPACITY) {
+        flags &= ~FLAG_SPILLED;
+        return inlineData;
+    }
+
+    spilledData = pool.acquire(payloadLength);
+    if (spilledData == nullptr) {
+        length = 0;
+        return nullptr;
+    }
+    flags |= FLAG_SPILLED;
+    return spilledData;
+}
+
+void Event::releasePayload(PayloadPool& pool) {
+    if (isSpilled()) {
+        pool.release(spilledData);
+        spilledData = nullptr;
+        flags &= ~FLAG_SPILLED;
+    }
+    length = 0;
+}
+
+void Event::adoptPayload(uint8_t* data, size_t payloadLength) {
+    spilledData = data;
+    length = static_cast<uint32_t>(payloadLength);
+    flags |= FLAG_SPILLED;
+}
+
+uint8_t* Event::detachPayload() {
+    if (!isSpilled()) {
+        return nullptr;
+    }
+    uint8_t* data = spilledData;
+    spilledData = nullptr;
+    flags &= ~FLAG_SPILLED;
+    length = 0;
+    return data;
+}
+
+Event makeEvent(EventType type, uint32_t eventId) {
+    Event event;
+    std::memset(&event, 0, sizeof(event));
+    event.type = type;
+    event.eventId = eventId;
+    return event;
+}
@@ -0,0 +1,134 @@
+#ifndef EVENT_RECORD_H
+#define EVENT_RECORD_H
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <unordered_map>
+#include <unordered_set>
+#include <type_traits>
+#include <cstddef>
+#include <cstdint>
+
+enum class EventType : uint8_t {
+    STRING,
+    INT,
+    FLOAT,
+    DOUBLE,
+    BOOLEAN,
+    BYTE_ARRAY
+};
+
+/**
+ * EventIdTable - Interns event ID strings into dense 32-bit indices
+ *
+ * IDs are never removed, so an index stays valid for the lifetime of the table.
+ */
+class EventIdTable {
+public:
+    EventIdTable() = default;
+
+    EventIdTable(const EventIdTable&) = delete;
+    EventIdTable& operator=(const EventIdTable&) = delete;
+
+    uint32_t intern(const std::string& eventId);
+    std::string name(uint32_t id) const;
+    size_t size() const;
+
+private:
+    mutable std::shared_mutex mutex_;
+    std::unordered_map<std::string, uint32_t> ids_;
+    std::vector<std::string> names_;
+};
+
+/**
+ * PayloadPool - Recycles out-of-line event payload buffers in power-of-two size classes
+ *
+ * Classes reach 16 MB so that image-sized payloads are reused too. Small classes keep up
+ * to MAX_CACHED_PER_CLASS buffers, large ones only as many as fit CLASS_CACHE_BYTES.
+ * Buffers above the largest class are allocated directly and freed on release.
+ */
+class PayloadPool {
+public:
+    PayloadPool();
+    ~PayloadPool();
+
+    PayloadPool(const PayloadPool&) = delete;
+    PayloadPool& operator=(const PayloadPool&) = delete;
+
+    uint8_t* acquire(size_t size);
+
+    // Return a buffer from acquire(). Buffers that were already released or never handed
+    // out by it are rejected and left alone, whether or not the pool kept them.
+    bool release(uint8_t* data);
+
+    // Drop all cached buffers
+    void trim();
+
+private:
+    static constexpr size_t MIN_CLASS_SHIFT = 6;   // 64 bytes
+    static constexpr size_t MAX_CLASS_SHIFT = 24;  // 16 MB
+    static constexpr size_t CLASS_COUNT = MAX_CLASS_SHIFT - MIN_CLASS_SHIFT + 1;
+    static constexpr size_t MAX_CACHED_PER_CLASS = 32;
+    static constexpr size_t MIN_CACHED_PER_CLASS = 2;
+    static constexpr size_t CLASS_CACHE_BYTES = 4 * 1024 * 1024;
+
+    std::mutex mutex_;
+    std::vector<uint8_t*> freeLists_[CLASS_COUNT];
+    std::unordered_set<uint8_t*> outstanding_; // Handed out and not yet released
+
+    static size_t classFor(size_t size);
+    static size_t cachedLimit(size_t sizeClass);
+};
+
+/**
+ * Event - Compact, trivially relocatable queue record
+ *
+ * Exactly one cache line: a 16-byte header followed by 48 bytes of payload storage.
+ * Scalars live in the payload union, STRING and BYTE_ARRAY payloads up to
+ * INLINE_CAPACITY bytes are stored inline, and larger payloads spill to a PayloadPool
+ * buffer that the owner must return with releasePayload().
+ */
+struct alignas(64) Event {
+    static constexpr size_t INLINE_CAPACITY = 48;
+    static constexpr uint8_t FLAG_SPILLED = 0x01;
+
+    uint32_t eventId;     // Index into the bridge's EventIdTable
+    uint32_t length;      // Payload length for STRING and BYTE_ARRAY events
+    EventType type;
+    uint8_t flags;
+    uint8_t reserved[6];
+
+    union {
+        int32_t intValue;
+        float floatValue;
+        double doubleValue;
+        bool boolValue;
+        uint8_t inlineData[INLINE_CAPACITY];
+        uint8_t* spilledData;
+    };
+
+    bool isSpilled() const { return (flags & FLAG_SPILLED) != 0; }
+    const uint8_t* payload() const { return isSpilled() ? spilledData : inlineData; }
+    uint8_t* payload() { return isSpilled() ? spilledData : inlineData; }
+
+    // Reserve payload storage for length bytes, spilling to the pool if it does not fit inline
+    uint8_t* allocatePayload(PayloadPool& pool, size_t payloadLength);
+    void releasePayload(PayloadPool& pool);
+
+    // Take ownership of a PayloadPool buffer without copying it
+    void adoptPayload(uint8_t* data, size_t payloadLength);
+
+    // Hand the spilled buffer to the caller; the event no longer owns a payload afterwards
+    uint8_t* detachPayload();
+};
+
+static_assert(sizeof(Event) == 64, "Event must occupy exactly one cache line");
+static_assert(std::is_trivially_copyable<Event>::value, "Event must be trivially relocatable");
+
+// Create an event with an empty payload
+Event makeEvent(EventType type, uint32_t eventId);
+
+#endif // EVENT_RECORD_H
@@ -0,0 +1,229 @@
+#include "hkdf_sha256.h"
+#include "chacha20_poly1305.h"
+#include <algorithm>
+#include <cstring>
+
+namespace {
+    constexpr uint32_t ROUND_CONSTANTS[64] = {
+        0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+        0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+        0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+        0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+        0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+        0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+        0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+        0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2,
+    };
+
+    constexpr uint32_t INITIAL_STATE[8] = {
+        0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19,
+    };
+
+    inline uint32_t rotr32(uint32_t v, int n) {
+        return (v >> n) | (v << (32 - n));
+    }
+
+    inline uint32_t load32be(const uint8_t* p) {
+        return (static_cast<uint32_t>(p[0]) << 24) | (static_cast<uint32_t>(p[1]) << 16) |
+               (static_cast<uint32_t>(p[2]) << 8) | static_cast<uint32_t>(p[3]);
+    }
+
+    inline void store32be(uint8_t* p, uint32_t v) {
+        p[0] = static_cast<uint8_t>(v >> 24);
+        p[1] = static_cast<uint8_t>(v >> 16);
+        p[2] = static_cast<uint8_t>(v >> 8);
+        p[3] = static_cast<uint8_t>(v);
+    }
+
+    void compress(uint32_t* state, const uint8_t* block) {
+        uint32_t w[64];
+        for (int i = 0; i < 16; ++i) {
+            w[i] = load32be(block + 4 * i);
+        }
+        for (int i = 16; i < 64; ++i) {
+            uint32_t s0 = rotr32(w[i - 15], 7) ^ rotr32(w[i - 15], 18) ^ (w[i - 15] >> 3);
+            uint32_t s1 = rotr32(w[i - 2], 17) ^ rotr32(w[i - 2], 19) ^ (w[i - 2] >> 10);
+            w[i] = w[i - 16] + s0 + w[i - 7] + s1;
+        }
+
+        uint32_t a = state[0], b = state[1], c = state[2], d = state[3];
+        uint32_t e = state[4], f = state[5], g = state[6], h = state[7];
+        for (int i = 0; i < 64; ++i) {
+            uint32_t s1 = rotr32(e, 6) ^ rotr32(e, 11) ^ rotr32(e, 25);
+            uint32_t choice = (e & f) ^ (~e & g);
+            uint32_t t1 = h + s1 + choice + ROUND_CONSTANTS[i] + w[i];
+            uint32_t s0 = rotr32(a, 2) ^ rotr32(a, 13) ^ rotr32(a, 22);
+            uint32_t majority = (a & b) ^ (a & c) ^ (b & c);
+            uint32_t t2 = s0 + majority;
+            h = g;
+            g = f;
+            f = e;
+            e = d + t1;
+            d = c;
+            c = b;
+            b = a;
+            a = t1 + t2;
+        }
+
+        state[0] += a;
+        state[1] += b;
+        state[2] += c;
+        state[3] += d;
+        state[4] += e;
+        state[5] += f;
+        state[6] += g;
+        state[7] += h;
+        secureZero(w, sizeof(w));
+    }
+}
+
+Sha256::Sha256() {
+    reset();
+}
+
+Sha256::~Sha256() {
+    secureZero(state_, sizeof(state_));
+    secureZero(buffer_, sizeof(buffer_));
+}
+
+void Sha256::reset() {
+    std::memcpy(state_, INITIAL_STATE, sizeof(state_));
+    bufferLength_ = 0;
+    totalLength_ = 0;
+}
+
+void Sha256::update(const uint8_t* data, size_t length) {
+    if (length == 0) {
+        return;
+    }
+    totalLength_ += length;
+
+    if (bufferLength_ > 0) {
+        size_t take = std::min(length, SHA256_BLOCK_SIZE - bufferLength_);
+        std::memcpy(buffer_ + bufferLength_, data, take);
+        bufferLength_ += take;
+        data += take;
+        length -= take;
+        if (bufferLength_ < SHA256_BLOCK_SIZE) {
+            return;
+        }
+        compress(state_, buffer_);
+        bufferLength_ = 0;
+    }
+
+    for (; length >= SHA256_BLOCK_SIZE; data += SHA256_BLOCK_SIZE, length -= SHA256_BLOCK_SIZE) {
+        compress(state_, data);
+    }
+
+    if (length > 0) {
+        std::memcpy(buffer_, data, length);
+        bufferLength_ = length;
+    }
+}
+
+void Sha256::finish(uint8_t* digest) {
+    uint64_t bitLength = totalLength_ * 8;
+
+    buffer_[bufferLength_++] = 0x80;
+    if (bufferLength_ > SHA256_BLOCK_SIZE - 8) {
+        std::memset(buffer_ + bufferLength_, 0, SHA256_BLOCK_SIZE - bufferLength_);
+        compress(state_, buffer_);
+        bufferLength_ = 0;
+    }
+    std::memset(buffer_ + bufferLength_, 0, SHA256_BLOCK_SIZE - 8 - bufferLength_);
+    for (int i = 0; i < 8; ++i) {
+        buffer_[SHA256_BLOCK_SIZE - 1 - i] = static_cast<uint8_t>(bitLength >> (8 * i));
+    }
+    compress(state_, buffer_);
+
+    for (int i = 0; i < 8; ++i) {
+        store32be(digest + 4 * i, state_[i]);
+    }
+}
+
+HmacSha256::HmacSha256(const uint8_t* key, size_t keyLength) {
+    uint8_t block[SHA256_BLOCK_SIZE] = {};
+    if (keyLength > SHA256_BLOCK_SIZE) {
+        Sha256 hash;
+        hash.update(key, keyLength);
+        hash.finish(block);
+    } else if (keyLength > 0) {
+        std::memcpy(block, key, keyLength);
+    }
+
+    uint8_t pad[SHA256_BLOCK_SIZE];
+    for (size_t i = 0; i < SHA256_BLOCK_SIZE; ++i) {
+        pad[i] = block[i] ^ 0x36;
+    }
+    inner_.update(pad, sizeof(pad));
+    for (size_t i = 0; i < SHA256_BLOCK_SIZE; ++i) {
+        pad[i] = block[i] ^ 0x5c;
+    }
+    outer_.update(pad, sizeof(pad));
+
+    secureZero(block, sizeof(block));
+    secureZero(pad, sizeof(pad));
+}
+
+HmacSha256::~HmacSha256() {
+}
+
+Sha256 HmacSha256::begin() const {
+    return inner_;
+}
+
+void HmacSha256::finish(Sha256& inner, uint8_t* mac) const {
+    uint8_t innerDigest[SHA256_DIGEST_SIZE];
+    inner.finish(innerDigest);
+
+    Sha256 outer = outer_;
+    outer.update(innerDigest, sizeof(innerDigest));
+    outer.finish(mac);
+    secureZero(innerDigest, sizeof(innerDigest));
+}
+
+void HmacSha256::compute(const uint8_t* data, size_t length, uint8_t* mac) const {
+    Sha256 inner = begin();
+    inner.update(data, length);
+    finish(inner, mac);
+}
+
+void hkdfExtract(const uint8_t* salt, size_t saltLength, const uint8_t* ikm, size_t ikmLength, uint8_t* prk) {
+    // RFC 5869: an absent salt is a block of HashLen zeros, which HMAC pads identically
+    HmacSha256 mac(salt, saltLength);
+    mac.compute(ikm, ikmLength, prk);
+}
+
+bool hkdfExpand(const HmacSha256& prk, const uint8_t* info, size_t infoLength, uint8_t* output, size_t outputLength) {
+    if (outputLength > 255 * SHA256_DIGEST_SIZE) {
+        return false;
+    }
+
+    uint8_t block[SHA256_DIGEST_SIZE];
+    size_t blockLength = 0;
+    for (uint8_t counter = 1; outputLength > 0; ++counter) {
+        // T(i) = HMAC(PRK, T(i-1) | info | i)
+        Sha256 inner = prk.begin();
+        inner.update(block, blockLength);
+        inner.update(info, infoLength);
+        inner.update(&counter, 1);
+        prk.finish(inner, block);
+        blockLength = SHA256_DIGEST_SIZE;
+
+        size_t take = std::min(outputLength, SHA256_DIGEST_SIZE);
+        std::memcpy(output, block, take);
+        output += take;
+        outputLength -= take;
+    }
+    secureZero(block, sizeof(block));
+    return true;
+}
+
+bool hkdf(const uint8_t* salt, size_t saltLength, const uint8_t* ikm, size_t ikmLength,
+          const uint8_t* info, size_t infoLength, uint8_t* output, size_t outputLength) {
+    uint8_t prk[SHA256_DIGEST_SIZE];
+    hkdfExtract(salt, saltLength, ikm, ikmLength, prk);
+    HmacSha256 expander(prk, sizeof(prk));
+    secureZero(prk, sizeof(prk));
+    return hkdfExpand(expander, info, infoLength, output, outputLength);
+}
@@ -0,0 +1,77 @@
+#ifndef HKDF_SHA256_H
+#define HKDF_SHA256_H
+
+#include <cstddef>
+#include <cstdint>
+
+// SHA-256 (FIPS 180-4), HMAC-SHA256 (RFC 2104) and HKDF-SHA256 (RFC 5869) for
+// deriving per-session keys from a master secret.
+
+constexpr size_t SHA256_DIGEST_SIZE = 32;
+constexpr size_t SHA256_BLOCK_SIZE = 64;
+
+class Sha256 {
+public:
+    Sha256();
+    ~Sha256();
+
+    void update(const uint8_t* data, size_t length);
+
+    // Write the digest; the object must be reset before reuse
+    void finish(uint8_t* digest);
+    void reset();
+
+private:
+    uint32_t state_[8];
+    uint8_t buffer_[SHA256_BLOCK_SIZE];
+    size_t bufferLength_;
+    uint64_t totalLength_;
+};
+
+/**
+ * HMAC-SHA256 with the key schedule done once: the inner and outer pad blocks are
+ * compressed at construction, so each MAC costs only the message blocks plus two
+ */
+class HmacSha256 {
+public:
+    HmacSha256(const uint8_t* key, size_t keyLength);
+    ~HmacSha256();
+
+    HmacSha256(const HmacSha256&) = delete;
+    HmacSha256& operator=(const HmacSha256&) = delete;
+
+    /**
+     * @param mac Receives SHA256_DIGEST_SIZE bytes
+     */
+    void compute(const uint8_t* data, size_t length, uint8_t* mac) const;
+
+    // Incremental use: feed the message to the hash returned by begin(), then finish()
+    Sha256 begin() const;
+    void finish(Sha256& inner, uint8_t* mac) const;
+
+private:
+    Sha256 inner_;
+    Sha256 outer_;
+};
+
+/**
+ * HKDF-Extract: prk = HMAC(salt, ikm)
+ * @param prk Receives SHA256_DIGEST_SIZE bytes
+ */
+void hkdfExtract(const uint8_t* salt, size_t saltLength, const uint8_t* ikm, size_t ikmLength, uint8_t* prk);
+
+/**
+ * HKDF-Expand with an HMAC keyed by the pseudorandom key
+ * @param outputLength At most 255 * SHA256_DIGEST_SIZE
+ * @return false if outputLength is too large
+ */
+bool hkdfExpand(const HmacSha256& prk, const uint8_t* info, size_t infoLength, uint8_t* output, size_t outputLength);
+
+/**
+ * One-shot HKDF (extract then expand)
+ * @return false if outputLength is too large
+ */
+bool hkdf(const uint8_t* salt, size_t saltLength, const uint8_t* ikm, size_t ikmLength,
+          const uint8_t* info, size_t infoLength, uint8_t* output, size_t outputLength);
+
+#endif // HKDF_SHA256_H
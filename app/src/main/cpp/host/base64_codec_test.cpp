@@ -0,0 +1,195 @@
+// Base64 codec against the original linear-scan codec it replaced, under every kernel variant
+// the host supports: random inputs around the vector widths, characters outside the alphabet
+// scattered through the input, '=' in the wrong place, truncated groups, and in-place use.
+//
+// Usage: base64_codec_test
+
+#include "base64_codec.h"
+#include "kernel_dispatch.h"
+#include "test_support.h"
+#include <algorithm>
+#include <cstdio>
+#include <random>
+#include <string>
+#include <vector>
+
+namespace {
+    const char BASE64_CHARS[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+    // The codec as message_encryption.cpp first shipped it
+    std::string referenceEncode(const std::vector<uint8_t>& input) {
+        std::string output;
+        uint32_t val = 0;
+        int valb = -6;
+        for (uint8_t c : input) {
+            val = (val << 8) + c;
+            valb += 8;
+            while (valb >= 0) {
+                output.push_back(BASE64_CHARS[(val >> valb) & 0x3F]);
+                valb -= 6;
+            }
+        }
+        if (valb > -6) {
+            output.push_back(BASE64_CHARS[((val << 8) >> (valb + 8)) & 0x3F]);
+        }
+        while (output.size() % 4) {
+            output.push_back('=');
+        }
+        return output;
+    }
+
+    std::vector<uint8_t> referenceDecode(const std::string& input) {
+        std::vector<uint8_t> output;
+        uint32_t val = 0;
+        int valb = -8;
+        for (char c : input) {
+            if (c == '=') {
+                break;
+            }
+            size_t pos = 0;
+            bool found = false;
+            for (size_t i = 0; i < 64; ++i) {
+                if (BASE64_CHARS[i] == c) {
+                    pos = i;
+                    found = true;
+                    break;
+                }
+            }
+            if (!found) {
+                continue;
+            }
+            val = (val << 6) + static_cast<uint32_t>(pos);
+            valb += 6;
+            if (valb >= 0) {
+                output.push_back(static_cast<uint8_t>((val >> valb) & 0xFF));
+                valb -= 8;
+            }
+        }
+        return output;
+    }
+
+    std::vector<uint8_t> randomBytes(std::mt19937& random, size_t size) {
+        std::vector<uint8_t> bytes(size);
+        for (uint8_t& byte : bytes) {
+            byte = static_cast<uint8_t>(random());
+        }
+        return bytes;
+    }
+
+    std::string encode(const std::vector<uint8_t>& input) {
+        std::string output(base64EncodedLength(input.size()), '\0');
+        output.resize(base64Encode(input.data(), input.size(), &output[0]));
+        return output;
+    }
+
+    std::vector<uint8_t> decode(const std::string& input) {
+        std::vector<uint8_t> output(base64DecodedMaxLength(input.size()) + 1);
+        output.resize(base64Decode(input.data(), input.size(), output.data()));
+        return output;
+    }
+
+    std::vector<uint8_t> decodeInPlace(const std::string& input) {
+        std::vector<uint8_t> buffer(input.begin(), input.end());
+        buffer.resize(base64Decode(reinterpret_cast<const char*>(buffer.data()), buffer.size(), buffer.data()));
+        return buffer;
+    }
+
+    std::string encodeInPlace(const std::vector<uint8_t>& input) {
+        size_t length = base64EncodedLength(input.size());
+        std::string buffer(length, '\0');
+        std::copy(input.begin(), input.end(), buffer.begin() + static_cast<long>(length - input.size()));
+        buffer.resize(base64Encode(reinterpret_cast<const uint8_t*>(buffer.data() + length - input.size()),
+                                   input.size(), &buffer[0]));
+        return buffer;
+    }
+
+    /**
+     * Lengths straddling every vector width, plus image-sized ones
+     */
+    std::vector<size_t> testLengths() {
+        std::vector<size_t> lengths;
+        for (size_t length = 0; length <= 130; ++length) {
+            lengths.push_back(length);
+        }
+        for (size_t length : {191, 192, 193, 255, 256, 257, 1000, 4099, 65537}) {
+            lengths.push_back(length);
+        }
+        return lengths;
+    }
+
+    void testRoundTrips(std::mt19937& random) {
+        for (size_t length : testLengths()) {
+            std::vector<uint8_t> input = randomBytes(random, length);
+            std::string expected = referenceEncode(input);
+            expect(base64EncodedLength(length) == expected.size(), "encoded length");
+            expect(encode(input) == expected, "encode matches the reference");
+            expect(encodeInPlace(input) == expected, "in-place encode matches the reference");
+            expect(decode(expected) == input, "decode round trip");
+            expect(decodeInPlace(expected) == input, "in-place decode round trip");
+        }
+    }
+
+    void testJunk(std::mt19937& random) {
+        // Whitespace, URL-safe and punctuation characters, NUL and bytes with the high bit set
+        const char junk[] = {'\n', '\r', ' ', '\t', '-', '_', '.', '!', '*', '\0', '\x80', '\xC3', '\xFF', '@', '['};
+        for (size_t length : testLengths()) {
+            std::string text = referenceEncode(randomBytes(random, length));
+            size_t insertions = 1 + random() % 8;
+            for (size_t i = 0; i < insertions; ++i) {
+                size_t at = text.empty() ? 0 : random() % (text.size() + 1);
+                text.insert(text.begin() + static_cast<long>(at), junk[random() % sizeof(junk)]);
+            }
+            std::vector<uint8_t> expected = referenceDecode(text);
+            expect(decode(text) == expected, "junk skipped as by the reference");
+            expect(decodeInPlace(text) == expected, "junk skipped in place as by the reference");
+        }
+
+        // Line-wrapped, as MIME writers emit it
+        std::string wrapped = referenceEncode(randomBytes(random, 3000));
+        for (size_t at = 76; at < wrapped.size(); at += 78) {
+            wrapped.insert(at, "\r\n");
+        }
+        expect(decode(wrapped) == referenceDecode(wrapped), "line breaks skipped");
+
+        std::string allJunk(300, '\xFF');
+        expect(decode(allJunk).empty() && decode(std::string(300, '\n')).empty(), "nothing but junk decodes empty");
+    }
+
+    void testMisplacedPadding(std::mt19937& random) {
+        for (size_t length : testLengths()) {
+            std::string text = referenceEncode(randomBytes(random, length));
+            std::string padded = text;
+            padded.insert(padded.begin() + static_cast<long>(random() % (text.size() + 1)), '=');
+            std::vector<uint8_t> expected = referenceDecode(padded);
+            expect(decode(padded) == expected, "decoding stops at a misplaced '='");
+            expect(decodeInPlace(padded) == expected, "in-place decoding stops at a misplaced '='");
+
+            // Truncated groups decode their whole bytes
+            if (!text.empty()) {
+                std::string truncated = text.substr(0, random() % text.size());
+                expect(decode(truncated) == referenceDecode(truncated), "truncated group");
+            }
+        }
+
+        for (const char* text : {"=", "==", "====", "=QUJD", "QQ==QUJD", "QUJD=QUJD", "QU=JD", "Q===", "QUI=QQ=="}) {
+            expect(decode(text) == referenceDecode(text), "padding edge case");
+        }
+    }
+}
+
+int main() {
+    KernelFamily& kernels = base64Kernels();
+    for (const char* variant : kernels.supportedVariants()) {
+        expect(kernels.select(variant), "select variant");
+        std::mt19937 random(20240);
+        int before = failures;
+        testRoundTrips(random);
+        testJunk(random);
+        testMisplacedPadding(random);
+        if (failures != before) {
+            std::fprintf(stderr, "FAIL: base64 variant %s\n", variant);
+        }
+    }
+    kernels.select(nullptr);
+    return finishTest("base64 codec");
+}
@@ -0,0 +1,182 @@
+// BlobStorage saves and views: atomic replacement through a synced temporary file, the
+// old file surviving a failed save, group commit settling concurrent saves of one file
+// with fewer commits while the newest snapshot wins, and message views mapping the file
+// when it is stored as is and falling back to a decoded copy otherwise.
+//
+// Usage: blob_storage_test
+
+#include "blob_storage.h"
+#include "test_support.h"
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <sys/stat.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+namespace {
+    std::vector<uint8_t> makeSnapshot(uint32_t id, size_t length) {
+        std::vector<uint8_t> data(length);
+        for (size_t i = 0; i < length; ++i) {
+            data[i] = static_cast<uint8_t>(id * 31 + i);
+        }
+        data[0] = static_cast<uint8_t>(id >> 8);
+        data[1] = static_cast<uint8_t>(id);
+        return data;
+    }
+
+    bool exists(const std::string& path) {
+        struct stat info;
+        return stat(path.c_str(), &info) == 0;
+    }
+
+    void testAtomicSave(const std::string& path) {
+        BlobStorage storage;
+        std::vector<uint8_t> first = makeSnapshot(1, 5000);
+        std::vector<uint8_t> loaded;
+        expect(storage.saveMessages(path, first.data(), first.size()), "save");
+        expect(storage.loadMessages(path, loaded) && loaded == first, "load saved file");
+        expect(!exists(path + ".tmp"), "no temporary file left behind");
+        expect(storage.commitCount() == 1, "one commit per save");
+
+        // A save that cannot be written leaves the previous file as it was
+        std::string tempPath = path + ".tmp";
+        mkdir(tempPath.c_str(), 0755);
+        std::vector<uint8_t> second = makeSnapshot(2, 7000);
+        expect(!storage.saveMessages(path, second.data(), second.size()), "blocked save fails");
+        expect(storage.loadMessages(path, loaded) && loaded == first, "failed save keeps the old file");
+        rmdir(tempPath.c_str());
+
+        expect(storage.saveMessages(path, second.data(), second.size()), "save replaces");
+        expect(storage.loadMessages(path, loaded) && loaded == second, "load replaced file");
+
+        uint8_t key[32] = {9};
+        storage.setEncryptionKey(key);
+        expect(storage.saveMessages(path, first.data(), first.size()) && storage.loadMessages(path, loaded) &&
+               loaded == first, "encrypted save replaces");
+        storage.clearMessages(path);
+    }
+
+    void testViews(const std::string& path) {
+        BlobStorage storage;
+        MessageView view;
+        expect(storage.viewMessages(path, view) && view.bytes().empty(), "missing file views empty");
+
+        std::vector<uint8_t> first = makeSnapshot(3, 300000);
+        storage.saveMessages(path, first.data(), first.size());
+        expect(storage.viewMessages(path, view) && view.isMapped(), "plaintext file is mapped");
+        expect(std::vector<uint8_t>(view.bytes().begin(), view.bytes().end()) == first, "mapped view matches");
+
+        // Saves rename a new file into place, so the mapping keeps the old contents
+        std::vector<uint8_t> second = makeSnapshot(4, 1000);
+        storage.saveMessages(path, second.data(), second.size());
+        expect(std::vector<uint8_t>(view.bytes().begin(), view.bytes().end()) == first, "view survives a save");
+
+        storage.setPayloadEncoding(PayloadEncoding::BINARY);
+        storage.saveMessages(path, second.data(), second.size());
+        expect(storage.viewMessages(path, view) && view.isMapped() &&
+               std::vector<uint8_t>(view.bytes().begin(), view.bytes().end()) == second, "BINARY file is mapped");
+
+        storage.setPayloadEncoding(PayloadEncoding::BASE64);
+        storage.saveMessages(path, second.data(), second.size());
+        expect(storage.viewMessages(path, view) && !view.isMapped() &&
+               std::vector<uint8_t>(view.bytes().begin(), view.bytes().end()) == second, "BASE64 file is decoded");
+        storage.setPayloadEncoding(PayloadEncoding::NONE);
+
+        // Appended batches are merged into a copy
+        std::vector<uint8_t> batch = {0, 0, 0, 1, 0, 0, 0, 1, 'x', 1, 0, 0, 0, 0, 0, 0, 0, 0, 7};
+        std::vector<uint8_t> base = {0, 0, 0, 2, 1, 2};
+        storage.saveMessages(path, base.data(), base.size());
+        storage.appendMessages(path, batch.data(), batch.size());
+        std::vector<uint8_t> merged = {0, 0, 0, 3, 1, 2};
+        merged.insert(merged.end(), batch.begin() + 4, batch.end());
+        expect(storage.viewMessages(path, view) && !view.isMapped() &&
+               std::vector<uint8_t>(view.bytes().begin(), view.bytes().end()) == merged, "log merged into view");
+
+        uint8_t key[32] = {5};
+        storage.setEncryptionKey(key);
+        storage.saveMessages(path, first.data(), first.size());
+        expect(storage.viewMessages(path, view) && !view.isMapped() &&
+               std::vector<uint8_t>(view.bytes().begin(), view.bytes().end()) == first, "encrypted file is decrypted");
+        storage.clearMessages(path);
+    }
+
+    /**
+     * Save from several threads at once
+     * @return Milliseconds taken
+     */
+    double concurrentSaves(BlobStorage& storage, const std::string& path, int threads, int savesPerThread,
+                           std::vector<std::vector<uint8_t>>& lastSaved) {
+        lastSaved.assign(static_cast<size_t>(threads), std::vector<uint8_t>());
+        std::vector<std::thread> workers;
+        int failed = 0;
+        std::vector<int> failedPerThread(static_cast<size_t>(threads), 0);
+        auto start = std::chrono::steady_clock::now();
+        for (int t = 0; t < threads; ++t) {
+            workers.emplace_back([&, t] {
+                for (int i = 0; i < savesPerThread; ++i) {
+                    std::vector<uint8_t> data = makeSnapshot(static_cast<uint32_t>(t * savesPerThread + i), 2048);
+                    if (!storage.saveMessages(path, data.data(), data.size())) {
+                        failedPerThread[static_cast<size_t>(t)]++;
+                    }
+                    lastSaved[static_cast<size_t>(t)] = data;
+                }
+            });
+        }
+        for (std::thread& worker : workers) {
+            worker.join();
+        }
+        for (int count : failedPerThread) {
+            failed += count;
+        }
+        expect(failed == 0, "concurrent saves succeed");
+        return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    void testGroupCommit(const std::string& path) {
+        const int threads = 4;
+        const int savesPerThread = 8;
+        std::vector<std::vector<uint8_t>> lastSaved;
+        std::vector<uint8_t> loaded;
+
+        BlobStorage separate;
+        double separateMs = concurrentSaves(separate, path, threads, savesPerThread, lastSaved);
+        expect(separate.commitCount() == static_cast<uint64_t>(threads * savesPerThread), "every save commits");
+
+        BlobStorage grouped;
+        grouped.setGroupCommit(true);
+        double groupedMs = concurrentSaves(grouped, path, threads, savesPerThread, lastSaved);
+        expect(grouped.commitCount() >= 1 && grouped.commitCount() <= static_cast<uint64_t>(threads * savesPerThread),
+               "grouped commits bounded by saves");
+
+        // The last commit writes the newest save, which is some thread's last one
+        bool newestWins = false;
+        expect(grouped.loadMessages(path, loaded), "load after grouped saves");
+        for (const std::vector<uint8_t>& data : lastSaved) {
+            newestWins = newestWins || data == loaded;
+        }
+        expect(newestWins, "newest save wins");
+
+        std::printf("%d saves from %d threads: %llu commits in %.1f ms separately, %llu commits in %.1f ms grouped\n",
+                    threads * savesPerThread, threads, static_cast<unsigned long long>(separate.commitCount()),
+                    separateMs, static_cast<unsigned long long>(grouped.commitCount()), groupedMs);
+        grouped.clearMessages(path);
+    }
+}
+
+int main() {
+    std::string directory = makeTempDirectory("blob_storage_test");
+    if (directory.empty()) {
+        return 1;
+    }
+    std::string path = directory + "/messages.blob";
+
+    testAtomicSave(path);
+    testViews(path);
+    testGroupCommit(path);
+    rmdir(directory.c_str());
+
+    return finishTest("blob storage");
+}
@@ -0,0 +1,230 @@
+// Block compression: round trips of compressible, incompressible and degenerate inputs at
+// sizes around the block and format limits, a hand-assembled LZ4 block, rejection of
+// truncated and corrupted blocks and containers, parallel and serial containers agreeing,
+// and BlobStorage saving, appending and loading compressed files in every encoding, and
+// keeping the messages before a damaged block.
+//
+// Usage: block_compression_test
+
+#include "block_compression.h"
+#include "blob_storage.h"
+#include "message_codec.h"
+#include "message_log.h"
+#include "thread_manager.h"
+#include "test_support.h"
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <string>
+#include <unistd.h>
+#include <vector>
+
+namespace {
+    std::vector<uint8_t> messageBatch(int count) {
+        std::vector<uint8_t> batch;
+        MessageBatchWriter writer(batch);
+        for (int i = 0; i < count; ++i) {
+            writer.add("Message number " + std::to_string(i) + (i % 3 == 0 ? " sent from the app" : " received"),
+                       i % 2 == 0, static_cast<uint8_t>(i % 4), 1700000000000LL + i * 1000LL);
+        }
+        return batch;
+    }
+
+    std::vector<uint8_t> randomBytes(size_t size, uint32_t seed) {
+        std::mt19937 random(seed);
+        std::vector<uint8_t> bytes(size);
+        for (uint8_t& byte : bytes) {
+            byte = static_cast<uint8_t>(random());
+        }
+        return bytes;
+    }
+
+    bool blockRoundTrip(const std::vector<uint8_t>& input) {
+        std::vector<uint8_t> compressed(compressBlockBound(input.size()));
+        size_t length = compressBlock(input, ByteSpan(compressed.data(), compressed.size()));
+        std::vector<uint8_t> output(input.size());
+        return length > 0 &&
+               decompressBlock(ConstByteSpan(compressed.data(), length), ByteSpan(output.data(), output.size())) &&
+               output == input;
+    }
+
+    void testBlocks() {
+        std::vector<std::vector<uint8_t>> inputs;
+        inputs.push_back({});
+        inputs.push_back({'a'});
+        inputs.push_back(std::vector<uint8_t>(13, 'z'));
+        inputs.push_back(std::vector<uint8_t>(100000, 0));
+        inputs.push_back(randomBytes(70000, 1));
+        inputs.push_back(messageBatch(2000));
+        // Matches further back than the window, and long literal and match runs
+        std::vector<uint8_t> mixed = randomBytes(300, 2);
+        std::vector<uint8_t> noise = randomBytes(70000, 3);
+        mixed.insert(mixed.end(), noise.begin(), noise.end());
+        mixed.insert(mixed.end(), mixed.begin(), mixed.begin() + 300);
+        mixed.insert(mixed.end(), 5000, 'x');
+        inputs.push_back(mixed);
+        for (size_t size = 1; size < 40; ++size) {
+            inputs.push_back(std::vector<uint8_t>(size, static_cast<uint8_t>(size)));
+        }
+        for (const std::vector<uint8_t>& input : inputs) {
+            expect(blockRoundTrip(input), "block round trip");
+        }
+
+        std::vector<uint8_t> text = messageBatch(500);
+        std::vector<uint8_t> compressed(compressBlockBound(text.size()));
+        size_t length = compressBlock(text, ByteSpan(compressed.data(), compressed.size()));
+        expect(length > 0 && length < text.size() / 3, "message text compresses");
+        expect(compressBlock(text, ByteSpan(compressed.data(), length - 1)) == 0, "output too small reported");
+
+        // "abcabcabcabc" + "end": literals "abc", a match at offset 3 of 9 bytes, literals "end"
+        const uint8_t block[] = {0x35, 'a', 'b', 'c', 3, 0, 0x30, 'e', 'n', 'd'};
+        uint8_t output[15];
+        expect(decompressBlock(ConstByteSpan(block, sizeof(block)), ByteSpan(output, sizeof(output))) &&
+               std::memcmp(output, "abcabcabcabcend", 15) == 0, "hand-assembled block");
+        expect(!decompressBlock(ConstByteSpan(block, sizeof(block)), ByteSpan(output, 14)), "output size must match");
+
+        // Every truncation and every single-byte change is rejected or decodes in bounds
+        std::vector<uint8_t> original = messageBatch(40);
+        compressed.assign(compressBlockBound(original.size()), 0);
+        compressed.resize(compressBlock(original, ByteSpan(compressed.data(), compressed.size())));
+        std::vector<uint8_t> decoded(original.size());
+        for (size_t cut = 0; cut < compressed.size(); ++cut) {
+            if (decompressBlock(ConstByteSpan(compressed.data(), cut), ByteSpan(decoded.data(), decoded.size()))) {
+                std::fprintf(stderr, "FAIL: truncated block of %zu bytes accepted\n", cut);
+                failures++;
+            }
+        }
+        for (size_t i = 0; i < compressed.size(); ++i) {
+            std::vector<uint8_t> forged = compressed;
+            forged[i] ^= 0x5A;
+            decompressBlock(forged, ByteSpan(decoded.data(), decoded.size()));
+        }
+    }
+
+    void testContainers() {
+        ThreadManager threadManager;
+        threadManager.initializeThreadPool(4);
+        std::vector<uint8_t> batch = messageBatch(20000);
+        for (size_t blockSize : {MIN_COMPRESSION_BLOCK_SIZE, DEFAULT_COMPRESSION_BLOCK_SIZE, MAX_COMPRESSION_BLOCK_SIZE}) {
+            std::vector<uint8_t> serial;
+            std::vector<uint8_t> parallel;
+            std::vector<uint8_t> output;
+            expect(compressBlocks(batch, serial, nullptr, blockSize) &&
+                   compressBlocks(batch, parallel, &threadManager, blockSize) && serial == parallel,
+                   "parallel compression matches serial");
+            expect(isCompressedContainer(serial) && serial.size() < batch.size() / 3, "container compresses");
+            expect(decompressBlocks(serial, output, &threadManager) && output == batch, "container round trip");
+            expect(decompressBlocks(serial, output) && output == batch, "serial decompression");
+        }
+
+        std::vector<uint8_t> container;
+        std::vector<uint8_t> output;
+        std::vector<uint8_t> empty;
+        expect(compressBlocks(empty, container) && container.size() == COMPRESSED_HEADER_SIZE &&
+               decompressBlocks(container, output) && output.empty(), "empty container");
+        std::vector<uint8_t> noise = randomBytes(200000, 4);
+        expect(compressBlocks(noise, container) &&
+               container.size() <= noise.size() + COMPRESSED_HEADER_SIZE + 4 * COMPRESSED_BLOCK_ENTRY_SIZE &&
+               decompressBlocks(container, output) && output == noise, "incompressible blocks stored raw");
+        expect(!compressBlocks(noise, container, nullptr, 3000), "invalid block size refused");
+
+        // Truncations fail, and so does a flipped byte anywhere unless it still decodes to the
+        // same plaintext (an offset moved to an identical earlier copy)
+        std::vector<uint8_t> original = messageBatch(3000);
+        compressBlocks(original, container, nullptr, MIN_COMPRESSION_BLOCK_SIZE);
+        for (size_t cut = 0; cut < container.size(); cut += 7) {
+            if (decompressBlocks(ConstByteSpan(container.data(), cut), output) || !output.empty()) {
+                std::fprintf(stderr, "FAIL: truncated container of %zu bytes accepted\n", cut);
+                failures++;
+            }
+        }
+        for (size_t i = 0; i < container.size(); i += 11) {
+            std::vector<uint8_t> forged = container;
+            forged[i] ^= 0x01;
+            if (decompressBlocks(forged, output, &threadManager) && output != original) {
+                std::fprintf(stderr, "FAIL: container with byte %zu changed accepted\n", i);
+                failures++;
+            }
+        }
+        threadManager.shutdownThreadPool();
+    }
+
+    void testStorage(const std::string& path) {
+        ThreadManager threadManager;
+        threadManager.initializeThreadPool(2);
+        uint8_t key[32];
+        for (int i = 0; i < 32; ++i) {
+            key[i] = static_cast<uint8_t>(i + 9);
+        }
+        std::vector<uint8_t> snapshot = messageBatch(5000);
+        std::vector<uint8_t> extra = messageBatch(300);
+        std::vector<uint8_t> expected = messageBatch(5000);
+        writeMessageCount(expected, 5300);
+        expected.insert(expected.end(), extra.begin() + MESSAGE_COUNT_SIZE, extra.end());
+
+        for (PayloadEncoding encoding : {PayloadEncoding::NONE, PayloadEncoding::BINARY, PayloadEncoding::BASE64}) {
+            for (bool encrypted : {false, true}) {
+                BlobStorage storage;
+                storage.setPayloadEncoding(encoding);
+                storage.setCompression(true);
+                storage.setThreadManager(&threadManager);
+                if (encrypted) {
+                    storage.setEncryptionKey(key);
+                }
+                expect(storage.saveMessages(path, snapshot.data(), snapshot.size()) &&
+                       storage.appendMessages(path, extra.data(), extra.size()), "compressed save and append");
+                int64_t stored = fileSize(path) + fileSize(logSegmentPath(path, 0));
+                expect(stored > 0 && stored < static_cast<int64_t>(expected.size()) / 2, "stored compressed");
+
+                std::vector<uint8_t> loaded;
+                expect(storage.loadMessages(path, loaded) && loaded == expected, "compressed file loads");
+                MessageView view;
+                expect(storage.viewMessages(path, view) && !view.isMapped() &&
+                       std::vector<uint8_t>(view.bytes().begin(), view.bytes().end()) == expected,
+                       "compressed file viewed through a copy");
+                std::vector<uint8_t> page;
+                expect(storage.loadLatest(path, 300, page) && page == extra, "compressed file paged");
+
+                // Turning compression off keeps what was stored readable
+                storage.setCompression(false);
+                expect(storage.loadMessages(path, loaded) && loaded == expected, "readable with compression off");
+                storage.clearMessages(path);
+            }
+        }
+
+        // A damaged compressed snapshot loads up to the last message before the damaged block
+        BlobStorage storage;
+        storage.setCompression(true);
+        storage.saveMessages(path, snapshot.data(), snapshot.size());
+        FILE* file = std::fopen(path.c_str(), "r+b");
+        if (file != nullptr) {
+            std::fseek(file, -100, SEEK_END);
+            int byte = std::fgetc(file);
+            std::fseek(file, -100, SEEK_END);
+            std::fputc(byte ^ 0x10, file);
+            std::fclose(file);
+        }
+        std::vector<uint8_t> loaded;
+        uint32_t count = 0;
+        expect(storage.loadMessages(path, loaded) && readMessageCount(loaded, count) && count > 0 && count < 5000 &&
+               loaded == messageBatch(static_cast<int>(count)), "corrupt compressed file loads up to the damage");
+        storage.clearMessages(path);
+        threadManager.shutdownThreadPool();
+    }
+}
+
+int main() {
+    std::string directory = makeTempDirectory("block_compression_test");
+    if (directory.empty()) {
+        return 1;
+    }
+    std::string path = directory + "/messages.blob";
+
+    testBlocks();
+    testContainers();
+    testStorage(path);
+    rmdir(directory.c_str());
+
+    return finishTest("block compression");
+}
@@ -0,0 +1,270 @@
+// IOBridge benchmark: post-to-callback latency and throughput under multi-producer load,
+// run against the fake JVM so it is reproducible on any Linux host.
+//
+// Usage: bridge_benchmark [--producers N] [--events N] [--payload-kb N]
+//                         [--alloc-cost-ns N] [--attach-cost-us N]
+//                         [--min-events-per-sec N] [--quick]
+//
+// Exits non-zero if any event is lost or throughput falls below --min-events-per-sec.
+
+#include "fake_jni.h"
+#include "io_bridge.h"
+#include "thread_manager.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace {
+    struct Options {
+        size_t producers = 4;
+        size_t eventsPerProducer = 50000;
+        size_t payloadKb = 1024;
+        size_t payloadEvents = 200;
+        uint32_t allocCostNs = 200;
+        uint32_t attachCostUs = 50;
+        double minEventsPerSec = 0.0;
+    };
+
+    enum class Mode {
+        THREAD_POOL,
+        DISPATCHER,
+        DISPATCHER_SPIN
+    };
+
+    const char* modeName(Mode mode) {
+        switch (mode) {
+            case Mode::THREAD_POOL: return "thread-pool";
+            case Mode::DISPATCHER: return "dispatcher";
+            case Mode::DISPATCHER_SPIN: return "dispatcher+spin";
+        }
+        return "?";
+    }
+
+    int64_t nowNs() {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+    bool waitFor(const std::atomic<size_t>& counter, size_t expected) {
+        int64_t deadline = nowNs() + 60LL * 1000000000LL;
+        while (counter.load() < expected) {
+            if (nowNs() > deadline) {
+                return false;
+            }
+            std::this_thread::sleep_for(std::chrono::microseconds(200));
+        }
+        return true;
+    }
+
+    int64_t percentile(std::vector<int64_t>& sorted, double p) {
+        if (sorted.empty()) {
+            return 0;
+        }
+        size_t index = static_cast<size_t>(p * static_cast<double>(sorted.size() - 1));
+        return sorted[index];
+    }
+
+    struct Result {
+        bool complete = false;
+        double eventsPerSec = 0.0;
+    };
+
+    // Small scalar events: measures scheduling, JNI call overhead and delivery latency
+    Result runIntEvents(const Options& options, Mode mode) {
+        FakeJniConfig config;
+        config.allocationCostNs = options.allocCostNs;
+        config.attachCostNs = options.attachCostUs * 1000;
+        FakeJavaVM vm(config);
+
+        ThreadManager threadManager;
+        threadManager.initializeThreadPool(4);
+
+        IOBridge bridge;
+        bridge.initialize(&vm);
+        bridge.enableEncryption(false);
+        bridge.setThreadManager(&threadManager);
+
+        FakeListener listener;
+        bridge.registerListener(vm.attachCurrentThread(), &listener);
+
+        size_t total = options.producers * options.eventsPerProducer;
+        std::vector<int64_t> postTimes(total);
+        std::vector<int64_t> latencies(total);
+        std::atomic<size_t> delivered(0);
+
+        vm.setCallbackHandler([&](const FakeCallback& callback) {
+            size_t slot = static_cast<size_t>(callback.intValue);
+            latencies[slot] = nowNs() - postTimes[slot];
+            delivered++;
+        });
+
+        if (mode != Mode::THREAD_POOL) {
+            bridge.startDispatcher(mode == Mode::DISPATCHER_SPIN);
+        }
+        vm.stats().reset();
+
+        int64_t start = nowNs();
+        std::vector<std::thread> producers;
+        for (size_t p = 0; p < options.producers; ++p) {
+            producers.emplace_back([&, p]() {
+                const std::string eventId = "bench_int_" + std::to_string(p);
+                for (size_t i = 0; i < options.eventsPerProducer; ++i) {
+                    size_t slot = p * options.eventsPerProducer + i;
+                    postTimes[slot] = nowNs();
+                    bridge.postIntEvent(eventId, static_cast<int32_t>(slot));
+                }
+            });
+        }
+        for (auto& producer : producers) {
+            producer.join();
+        }
+
+        Result result;
+        result.complete = waitFor(delivered, total);
+        int64_t elapsed = nowNs() - start;
+        result.eventsPerSec = static_cast<double>(delivered.load()) * 1e9 / static_cast<double>(elapsed);
+
+        std::sort(latencies.begin(), latencies.end());
+        std::printf("%-16s %10zu %12.0f %9.1f %9.1f %9.1f %9.1f %7llu %9llu\n",
+                    modeName(mode), delivered.load(), result.eventsPerSec,
+                    percentile(latencies, 0.50) / 1000.0,
+                    percentile(latencies, 0.99) / 1000.0,
+                    percentile(latencies, 0.999) / 1000.0,
+                    latencies.empty() ? 0.0 : latencies.back() / 1000.0,
+                    static_cast<unsigned long long>(vm.stats().attachCurrentThread.load()),
+                    static_cast<unsigned long long>(vm.stats().newStringUTF.load()));
+
+        bridge.cleanup();
+        threadManager.shutdownThreadPool();
+        return result;
+    }
+
+    // Image-sized byte array events: measures copies on the byte[] and DirectByteBuffer paths
+    Result runPayloadEvents(const Options& options, bool directBuffers) {
+        FakeJniConfig config;
+        config.allocationCostNs = options.allocCostNs;
+        config.directBufferSupport = directBuffers;
+        FakeJavaVM vm(config);
+
+        IOBridge bridge;
+        bridge.initialize(&vm);
+        bridge.enableEncryption(false);
+
+        FakeListener listener;
+        bridge.registerListener(vm.attachCurrentThread(), &listener);
+
+        std::atomic<size_t> delivered(0);
+        vm.setCallbackHandler([&](const FakeCallback& callback) {
+            if (callback.bufferHandle != 0) {
+                bridge.releaseLentBuffer(callback.bufferHandle);
+            }
+            delivered++;
+        });
+
+        bridge.startDispatcher();
+        vm.stats().reset();
+
+        size_t payloadSize = options.payloadKb * 1024;
+        std::vector<uint8_t> source(payloadSize, 0x5A);
+
+        int64_t start = nowNs();
+        for (size_t i = 0; i < options.payloadEvents; ++i) {
+            // Mirrors the JNI entry point: one copy from the Java array into a pooled buffer
+            uint8_t* buffer = bridge.acquireBuffer(payloadSize);
+            std::memcpy(buffer, source.data(), payloadSize);
+            bridge.postByteArrayBuffer("bench_bytes", buffer, payloadSize);
+        }
+
+        Result result;
+        result.complete = waitFor(delivered, options.payloadEvents);
+        int64_t elapsed = nowNs() - start;
+        result.eventsPerSec = static_cast<double>(delivered.load()) * 1e9 / static_cast<double>(elapsed);
+        double megabytesPerSec = result.eventsPerSec * static_cast<double>(payloadSize) / (1024.0 * 1024.0);
+
+        std::printf("%-16s %10zu %12.0f %12.1f %14.2f\n",
+                    directBuffers ? "direct-buffer" : "byte-array",
+                    delivered.load(), result.eventsPerSec, megabytesPerSec,
+                    static_cast<double>(vm.stats().bytesCopied.load()) /
+                        static_cast<double>(std::max<size_t>(delivered.load(), 1) * payloadSize));
+
+        bridge.cleanup();
+        return result;
+    }
+
+    bool parseOptions(int argc, char** argv, Options& options) {
+        for (int i = 1; i < argc; ++i) {
+            std::string arg = argv[i];
+            auto next = [&](size_t& value) {
+                if (i + 1 >= argc) {
+                    return false;
+                }
+                value = static_cast<size_t>(std::strtoull(argv[++i], nullptr, 10));
+                return true;
+            };
+            size_t value = 0;
+            if (arg == "--quick") {
+                options.eventsPerProducer = 5000;
+                options.payloadEvents = 20;
+            } else if (arg == "--producers" && next(value)) {
+                options.producers = std::max<size_t>(value, 1);
+            } else if (arg == "--events" && next(value)) {
+                options.eventsPerProducer = value;
+            } else if (arg == "--payload-kb" && next(value)) {
+                options.payloadKb = std::max<size_t>(value, 1);
+            } else if (arg == "--alloc-cost-ns" && next(value)) {
+                options.allocCostNs = static_cast<uint32_t>(value);
+            } else if (arg == "--attach-cost-us" && next(value)) {
+                options.attachCostUs = static_cast<uint32_t>(value);
+            } else if (arg == "--min-events-per-sec" && next(value)) {
+                options.minEventsPerSec = static_cast<double>(value);
+            } else {
+                std::fprintf(stderr, "Unknown or incomplete option: %s\n", arg.c_str());
+                return false;
+            }
+        }
+        return true;
+    }
+}
+
+int main(int argc, char** argv) {
+    Options options;
+    if (!parseOptions(argc, argv, options)) {
+        return 2;
+    }
+
+    bool ok = true;
+
+    std::printf("Int events: %zu producers x %zu events, simulated alloc %u ns, attach %u us\n",
+                options.producers, options.eventsPerProducer, options.allocCostNs, options.attachCostUs);
+    std::printf("%-16s %10s %12s %9s %9s %9s %9s %7s %9s\n",
+                "mode", "delivered", "events/s", "p50 us", "p99 us", "p99.9 us", "max us", "attach", "newStr");
+    for (Mode mode : {Mode::THREAD_POOL, Mode::DISPATCHER, Mode::DISPATCHER_SPIN}) {
+        Result result = runIntEvents(options, mode);
+        if (!result.complete) {
+            std::fprintf(stderr, "FAIL: %s lost events\n", modeName(mode));
+            ok = false;
+        }
+        if (options.minEventsPerSec > 0.0 && result.eventsPerSec < options.minEventsPerSec) {
+            std::fprintf(stderr, "FAIL: %s below %.0f events/s\n", modeName(mode), options.minEventsPerSec);
+            ok = false;
+        }
+    }
+
+    std::printf("\nByte array events: %zu x %zu KB\n", options.payloadEvents, options.payloadKb);
+    std::printf("%-16s %10s %12s %12s %14s\n", "path", "delivered", "events/s", "MB/s", "JNI copies/ev");
+    for (bool direct : {false, true}) {
+        Result result = runPayloadEvents(options, direct);
+        if (!result.complete) {
+            std::fprintf(stderr, "FAIL: %s lost events\n", direct ? "direct-buffer" : "byte-array");
+            ok = false;
+        }
+    }
+
+    return ok ? 0 : 1;
+}
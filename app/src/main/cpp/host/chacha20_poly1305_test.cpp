@@ -0,0 +1,221 @@
+// ChaCha20-Poly1305 known-answer tests from RFC 8439, plus consistency checks between
+// the SIMD multi-block kernels, the streaming context and the one-shot functions.
+//
+// Usage: chacha20_poly1305_test
+
+#include "chacha20_poly1305.h"
+#include "test_support.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+
+namespace {
+    std::vector<uint8_t> fromHex(const char* hex) {
+        std::vector<uint8_t> bytes;
+        for (size_t i = 0; hex[i] != '\0' && hex[i + 1] != '\0'; i += 2) {
+            unsigned int value = 0;
+            std::sscanf(hex + i, "%2x", &value);
+            bytes.push_back(static_cast<uint8_t>(value));
+        }
+        return bytes;
+    }
+
+    std::vector<uint8_t> sequence(uint8_t first, size_t count) {
+        std::vector<uint8_t> bytes(count);
+        for (size_t i = 0; i < count; ++i) {
+            bytes[i] = static_cast<uint8_t>(first + i);
+        }
+        return bytes;
+    }
+
+    void expectBytes(const uint8_t* actual, const std::vector<uint8_t>& expected, const char* name) {
+        expect(std::memcmp(actual, expected.data(), expected.size()) == 0, name);
+    }
+
+    const char SUNSCREEN[] =
+        "Ladies and Gentlemen of the class of '99: If I could offer you only one tip for the future, "
+        "sunscreen would be it.";
+
+    // RFC 8439 section 2.3.2
+    void testBlockFunction() {
+        std::vector<uint8_t> key = sequence(0, 32);
+        std::vector<uint8_t> nonce = fromHex("000000090000004a00000000");
+        std::vector<uint8_t> zeros(64, 0);
+        std::vector<uint8_t> block(64);
+        chacha20Xor(key.data(), nonce.data(), 1, zeros.data(), block.data(), block.size());
+        expectBytes(block.data(), fromHex(
+            "10f1e7e4d13b5915500fdd1fa32071c4c7d1f4c733c068030422aa9ac3d46c4e"
+            "d2826446079faa0914c2d705d98b02a2b5129cd1de164eb9cbd083e8a2503c4e"), "block function (2.3.2)");
+    }
+
+    // RFC 8439 section 2.4.2
+    void testEncryption() {
+        std::vector<uint8_t> key = sequence(0, 32);
+        std::vector<uint8_t> nonce = fromHex("000000000000004a00000000");
+        size_t length = std::strlen(SUNSCREEN);
+        std::vector<uint8_t> output(length);
+        chacha20Xor(key.data(), nonce.data(), 1, reinterpret_cast<const uint8_t*>(SUNSCREEN), output.data(), length);
+        expectBytes(output.data(), fromHex(
+            "6e2e359a2568f98041ba0728dd0d6981e97e7aec1d4360c20a27afccfd9fae0b"
+            "f91b65c5524733ab8f593dabcd62b3571639d624e65152ab8f530c359f0861d8"
+            "07ca0dbf500d6a6156a38e088a22b65e52bc514d16ccf806818ce91ab7793736"
+            "5af90bbf74a35be6b40b8eedf2785e42874d"), "encryption (2.4.2)");
+    }
+
+    // RFC 8439 section 2.5.2 and appendix A.3 edge cases
+    void testPoly1305() {
+        struct Vector {
+            const char* key;
+            const char* message;
+            const char* tag;
+            const char* name;
+        };
+        const Vector vectors[] = {
+            {"85d6be7857556d337f4452fe42d506a80103808afb0db2fd4abff6af4149f51b",
+             "43727970746f6772617068696320466f72756d2052657365617263682047726f7570",
+             "a8061dc1305136c6c22b8baf0c0127a9", "poly1305 (2.5.2)"},
+            {"0000000000000000000000000000000000000000000000000000000000000000",
+             "00000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000",
+             "00000000000000000000000000000000", "poly1305 (A.3 #1)"},
+            {"0200000000000000000000000000000000000000000000000000000000000000",
+             "ffffffffffffffffffffffffffffffff",
+             "03000000000000000000000000000000", "poly1305 (A.3 #5)"},
+            {"02000000000000000000000000000000ffffffffffffffffffffffffffffffff",
+             "02000000000000000000000000000000",
+             "03000000000000000000000000000000", "poly1305 (A.3 #6)"},
+            {"0100000000000000000000000000000000000000000000000000000000000000",
+             "fffffffffffffffffffffffffffffffff0ffffffffffffffffffffffffffffff11000000000000000000000000000000",
+             "05000000000000000000000000000000", "poly1305 (A.3 #7)"},
+            {"0100000000000000000000000000000000000000000000000000000000000000",
+             "fffffffffffffffffffffffffffffffffbfefefefefefefefefefefefefefefe01010101010101010101010101010101",
+             "00000000000000000000000000000000", "poly1305 (A.3 #8)"},
+            {"0200000000000000000000000000000000000000000000000000000000000000",
+             "fdffffffffffffffffffffffffffffff",
+             "faffffffffffffffffffffffffffffff", "poly1305 (A.3 #9)"},
+        };
+
+        for (const Vector& vector : vectors) {
+            std::vector<uint8_t> key = fromHex(vector.key);
+            std::vector<uint8_t> message = fromHex(vector.message);
+            uint8_t tag[POLY1305_TAG_SIZE];
+
+            Poly1305 mac(key.data());
+            mac.update(message.data(), message.size());
+            mac.finish(tag);
+            expectBytes(tag, fromHex(vector.tag), vector.name);
+
+            // Same tag when fed one byte at a time
+            Poly1305 incremental(key.data());
+            for (uint8_t byte : message) {
+                incremental.update(&byte, 1);
+            }
+            incremental.finish(tag);
+            expectBytes(tag, fromHex(vector.tag), vector.name);
+        }
+    }
+
+    // RFC 8439 section 2.8.2
+    void testAead() {
+        std::vector<uint8_t> key = sequence(0x80, 32);
+        std::vector<uint8_t> nonce = fromHex("070000004041424344454647");
+        std::vector<uint8_t> aad = fromHex("50515253c0c1c2c3c4c5c6c7");
+        std::vector<uint8_t> plaintext(SUNSCREEN, SUNSCREEN + std::strlen(SUNSCREEN));
+        std::vector<uint8_t> expectedCiphertext = fromHex(
+            "d31a8d34648e60db7b86afbc53ef7ec2a4aded51296e08fea9e2b5a736ee62d6"
+            "3dbea45e8ca9671282fafb69da92728b1a71de0a9e060b2905d6a5b67ecd3b36"
+            "92ddbd7f2d778b8c9803aee328091b58fab324e4fad675945585808b4831d7bc"
+            "3ff4def08e4b7a9de576d26586cec64b6116");
+        std::vector<uint8_t> expectedTag = fromHex("1ae10b594f09e26a7e902ecbd0600691");
+
+        std::vector<uint8_t> ciphertext(plaintext.size());
+        uint8_t tag[POLY1305_TAG_SIZE];
+        aeadSeal(key.data(), nonce.data(), aad, plaintext, ciphertext.data(), tag);
+        expectBytes(ciphertext.data(), expectedCiphertext, "aead seal ciphertext (2.8.2)");
+        expectBytes(tag, expectedTag, "aead seal tag (2.8.2)");
+
+        std::vector<uint8_t> opened(ciphertext.size());
+        expect(aeadOpen(key.data(), nonce.data(), aad, ciphertext, tag, opened.data()) && opened == plaintext,
+               "aead open (2.8.2)");
+
+        // Streaming in uneven pieces must match the one-shot result
+        ChaCha20Poly1305 encryptor(key.data(), nonce.data(), ChaCha20Poly1305::Direction::ENCRYPT, aad);
+        std::vector<uint8_t> streamed(plaintext.size());
+        size_t offset = 0;
+        for (size_t piece : {1, 7, 64, 13}) {
+            encryptor.update(plaintext.data() + offset, streamed.data() + offset, piece);
+            offset += piece;
+        }
+        encryptor.update(plaintext.data() + offset, streamed.data() + offset, plaintext.size() - offset);
+        encryptor.finish(tag);
+        expect(streamed == expectedCiphertext, "streaming ciphertext");
+        expectBytes(tag, expectedTag, "streaming tag");
+
+        ChaCha20Poly1305 decryptor(key.data(), nonce.data(), ChaCha20Poly1305::Direction::DECRYPT, aad);
+        decryptor.update(streamed.data(), streamed.data(), streamed.size());
+        expect(decryptor.verify(tag) && streamed == plaintext, "streaming decrypt in place");
+
+        // Any flipped bit must be rejected and leave the output untouched
+        for (size_t bit = 0; bit < ciphertext.size() * 8; bit += 37) {
+            std::vector<uint8_t> tampered = ciphertext;
+            tampered[bit / 8] ^= static_cast<uint8_t>(1u << (bit % 8));
+            std::vector<uint8_t> untouched(tampered.size(), 0xEE);
+            bool accepted = aeadOpen(key.data(), nonce.data(), aad, tampered, tag, untouched.data());
+            expect(!accepted && untouched == std::vector<uint8_t>(tampered.size(), 0xEE), "tampered ciphertext rejected");
+        }
+        uint8_t badTag[POLY1305_TAG_SIZE];
+        std::memcpy(badTag, tag, sizeof(badTag));
+        badTag[15] ^= 0x80;
+        expect(!aeadOpen(key.data(), nonce.data(), aad, ciphertext, badTag, opened.data()), "tampered tag rejected");
+    }
+
+    // The multi-block kernels must agree with one block at a time, which only uses the scalar path
+    void testKernelConsistency() {
+        std::vector<uint8_t> key = sequence(0x11, 32);
+        std::vector<uint8_t> nonce = sequence(0x42, 12);
+        std::vector<uint8_t> input(64 * 37 + 29);
+        for (size_t i = 0; i < input.size(); ++i) {
+            input[i] = static_cast<uint8_t>(i * 131 + 7);
+        }
+
+        // Start close to the 32-bit counter boundary so lane increments wrap like the scalar counter
+        for (uint32_t counter : {1u, 0xFFFFFFFAu}) {
+            std::vector<uint8_t> bulk(input.size());
+            chacha20Xor(key.data(), nonce.data(), counter, input.data(), bulk.data(), input.size());
+
+            std::vector<uint8_t> single(input.size());
+            for (size_t offset = 0; offset < input.size(); offset += CHACHA20_BLOCK_SIZE) {
+                size_t length = std::min(CHACHA20_BLOCK_SIZE, input.size() - offset);
+                chacha20Xor(key.data(), nonce.data(), counter + static_cast<uint32_t>(offset / CHACHA20_BLOCK_SIZE),
+                            input.data() + offset, single.data() + offset, length);
+            }
+            expect(bulk == single, "multi-block kernel matches single blocks");
+        }
+    }
+
+    void testNonceSequence() {
+        std::unique_ptr<NonceSequence> sequence = NonceSequence::create();
+        expect(sequence != nullptr, "nonce sequence created");
+        if (sequence == nullptr) {
+            return;
+        }
+        uint8_t first[CHACHA20_NONCE_SIZE];
+        uint8_t second[CHACHA20_NONCE_SIZE];
+        sequence->next(first);
+        sequence->next(second);
+        expect(std::memcmp(first, second, CHACHA20_NONCE_SIZE) != 0, "nonces are unique");
+        expect(std::memcmp(first, second, 4) == 0, "nonce prefix is stable");
+    }
+}
+
+int main() {
+    testBlockFunction();
+    testEncryption();
+    testPoly1305();
+    testAead();
+    testKernelConsistency();
+    testNonceSequence();
+
+    return finishTest(std::string("chacha20 kernel ") + chacha20KernelName());
+}
@@ -0,0 +1,146 @@
+// Chunked container round trips (sequential and on the thread pool), random access,
+// and rejection of tampered, reordered and truncated containers.
+//
+// Usage: chunked_cipher_test
+
+#include "chunked_cipher.h"
+#include "chacha20_poly1305.h"
+#include "thread_manager.h"
+#include "test_support.h"
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+namespace {
+    std::vector<uint8_t> makePayload(size_t length) {
+        std::vector<uint8_t> payload(length);
+        for (size_t i = 0; i < length; ++i) {
+            payload[i] = static_cast<uint8_t>((i * 2654435761u) >> 13);
+        }
+        return payload;
+    }
+
+    std::vector<uint8_t> seal(const uint8_t* key, const std::vector<uint8_t>& payload,
+                              ThreadManager* threadManager, size_t chunkSize) {
+        std::vector<uint8_t> container(chunkedCiphertextSize(payload.size(), chunkSize));
+        size_t written = 0;
+        bool sealed = encryptChunked(key, payload, container, written, threadManager, chunkSize);
+        expect(sealed && written == container.size(), "encrypt");
+        return container;
+    }
+
+    bool open(const uint8_t* key, const std::vector<uint8_t>& container, std::vector<uint8_t>& output,
+              ThreadManager* threadManager) {
+        ChunkedHeader header;
+        if (!parseChunkedHeader(container, header)) {
+            return false;
+        }
+        output.assign(static_cast<size_t>(header.plaintextLength), 0xEE);
+        size_t written = 0;
+        return decryptChunked(key, container, output, written, threadManager) && written == output.size();
+    }
+
+    void testRoundTrips(const uint8_t* key, ThreadManager* threadManager) {
+        const size_t lengths[] = {0, 1, 4095, 4096, 4097, 3 * 4096, 1000003};
+        for (size_t length : lengths) {
+            std::vector<uint8_t> payload = makePayload(length);
+            std::vector<uint8_t> container = seal(key, payload, threadManager, MIN_CHUNK_SIZE);
+            std::vector<uint8_t> output;
+            expect(open(key, container, output, threadManager) && output == payload, "round trip");
+        }
+
+        std::vector<uint8_t> payload = makePayload(5 * 1024 * 1024 + 17);
+        std::vector<uint8_t> container = seal(key, payload, threadManager, DEFAULT_CHUNK_SIZE);
+        std::vector<uint8_t> output;
+        expect(open(key, container, output, threadManager) && output == payload, "round trip with default chunks");
+    }
+
+    void testRandomAccess(const uint8_t* key) {
+        std::vector<uint8_t> payload = makePayload(10 * MIN_CHUNK_SIZE + 123);
+        std::vector<uint8_t> container = seal(key, payload, nullptr, MIN_CHUNK_SIZE);
+
+        ChunkedHeader header;
+        expect(parseChunkedHeader(container, header) && header.chunkCount() == 11, "header");
+
+        std::vector<uint8_t> chunk(MIN_CHUNK_SIZE);
+        for (size_t index : {0, 5, 10}) {
+            size_t written = 0;
+            bool opened = decryptChunk(key, container, index, chunk, written);
+            expect(opened && written == header.chunkLength(index) &&
+                   std::memcmp(chunk.data(), payload.data() + header.chunkOffset(index), written) == 0,
+                   "random access chunk");
+        }
+        size_t written = 0;
+        expect(!decryptChunk(key, container, 11, chunk, written), "chunk index out of range");
+    }
+
+    void testTampering(const uint8_t* key, ThreadManager* threadManager) {
+        std::vector<uint8_t> payload = makePayload(4 * MIN_CHUNK_SIZE);
+        std::vector<uint8_t> container = seal(key, payload, threadManager, MIN_CHUNK_SIZE);
+        std::vector<uint8_t> output;
+        size_t stride = MIN_CHUNK_SIZE + POLY1305_TAG_SIZE;
+
+        // Flipped ciphertext bit: whole decrypt fails and leaves nothing behind, other chunks still open
+        std::vector<uint8_t> flipped = container;
+        flipped[CHUNKED_HEADER_SIZE + 2 * stride + 100] ^= 0x01;
+        expect(!open(key, flipped, output, threadManager), "flipped bit rejected");
+        expect(output == std::vector<uint8_t>(output.size(), 0), "output zeroed on failure");
+        std::vector<uint8_t> chunk(MIN_CHUNK_SIZE);
+        size_t written = 0;
+        expect(decryptChunk(key, flipped, 1, chunk, written), "untouched chunk still opens");
+        expect(!decryptChunk(key, flipped, 2, chunk, written), "tampered chunk rejected");
+
+        // Swapped chunks
+        std::vector<uint8_t> swapped = container;
+        std::swap_ranges(swapped.begin() + CHUNKED_HEADER_SIZE, swapped.begin() + CHUNKED_HEADER_SIZE + stride,
+                         swapped.begin() + CHUNKED_HEADER_SIZE + stride);
+        expect(!open(key, swapped, output, threadManager), "reordered chunks rejected");
+
+        // Truncated to fewer chunks with a matching length field
+        std::vector<uint8_t> truncated(container.begin(), container.begin() + CHUNKED_HEADER_SIZE + 2 * stride);
+        uint64_t shorter = 2 * MIN_CHUNK_SIZE;
+        for (int i = 0; i < 8; ++i) {
+            truncated[16 + i] = static_cast<uint8_t>(shorter >> (8 * i));
+        }
+        expect(!open(key, truncated, output, threadManager), "truncation rejected");
+
+        // Shorter than the header declares
+        std::vector<uint8_t> clipped(container.begin(), container.end() - 1);
+        ChunkedHeader header;
+        expect(!parseChunkedHeader(clipped, header), "clipped container rejected");
+
+        // Wrong key
+        uint8_t otherKey[CHACHA20_KEY_SIZE];
+        std::memcpy(otherKey, key, sizeof(otherKey));
+        otherKey[0] ^= 0xFF;
+        expect(!open(otherKey, container, output, threadManager), "wrong key rejected");
+
+        // Empty payloads are authenticated too
+        std::vector<uint8_t> empty = seal(key, std::vector<uint8_t>(), nullptr, MIN_CHUNK_SIZE);
+        empty[CHUNKED_HEADER_SIZE] ^= 0x01;
+        expect(!open(key, empty, output, nullptr), "empty container tag checked");
+
+        written = 0;
+        std::vector<uint8_t> small(100);
+        expect(!encryptChunked(key, payload, small, written, nullptr, MIN_CHUNK_SIZE), "short output rejected");
+        expect(!encryptChunked(key, payload, container, written, nullptr, 5000), "invalid chunk size rejected");
+    }
+}
+
+int main() {
+    uint8_t key[CHACHA20_KEY_SIZE];
+    secureRandomBytes(key, sizeof(key));
+
+    ThreadManager threadManager;
+    threadManager.initializeThreadPool(4);
+
+    testRoundTrips(key, nullptr);
+    testRoundTrips(key, &threadManager);
+    testRandomAccess(key);
+    testTampering(key, nullptr);
+    testTampering(key, &threadManager);
+
+    threadManager.shutdownThreadPool();
+
+    return finishTest("chunked cipher");
+}
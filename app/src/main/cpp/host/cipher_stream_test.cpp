@@ -0,0 +1,171 @@
+// Streaming encrypt/decrypt contexts: interoperability with the one-shot chunked
+// container, arbitrary piece sizes, rejection of tampered or incomplete streams, and
+// encrypted BlobStorage files.
+//
+// Usage: cipher_stream_test
+
+#include "cipher_stream.h"
+#include "blob_storage.h"
+#include "test_support.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <unistd.h>
+#include <vector>
+
+namespace {
+    std::vector<uint8_t> makePayload(size_t length) {
+        std::vector<uint8_t> payload(length);
+        for (size_t i = 0; i < length; ++i) {
+            payload[i] = static_cast<uint8_t>((i * 2654435761u) >> 13);
+        }
+        return payload;
+    }
+
+    // Encrypt in pieces of the given size
+    std::vector<uint8_t> streamSeal(const uint8_t* key, const std::vector<uint8_t>& payload, size_t piece,
+                                    size_t chunkSize) {
+        std::vector<uint8_t> container;
+        StreamEncryptor encryptor(key, payload.size(), [&container](ConstByteSpan bytes) {
+            container.insert(container.end(), bytes.begin(), bytes.end());
+            return true;
+        }, chunkSize);
+
+        bool ok = true;
+        for (size_t offset = 0; offset < payload.size(); offset += piece) {
+            ok = ok && encryptor.update(ConstByteSpan(payload.data() + offset,
+                                                      std::min(piece, payload.size() - offset)));
+        }
+        ok = ok && encryptor.finalize();
+        expect(ok && container.size() == encryptor.containerSize(), "stream encrypt");
+        return container;
+    }
+
+    // Decrypt in pieces of the given size; false if any step rejects the stream
+    bool streamOpen(const uint8_t* key, const std::vector<uint8_t>& container, size_t piece,
+                    std::vector<uint8_t>& output) {
+        output.clear();
+        StreamDecryptor decryptor(key, [&output](ConstByteSpan bytes) {
+            output.insert(output.end(), bytes.begin(), bytes.end());
+            return true;
+        });
+
+        for (size_t offset = 0; offset < container.size(); offset += piece) {
+            if (!decryptor.update(ConstByteSpan(container.data() + offset,
+                                                std::min(piece, container.size() - offset)))) {
+                return false;
+            }
+        }
+        return decryptor.finalize();
+    }
+
+    void testInterop(const uint8_t* key) {
+        const size_t lengths[] = {0, 1, 4095, 4096, 4097, 3 * 4096 + 5, 100000};
+        const size_t pieces[] = {1, 17, 4096, 1 << 20};
+        for (size_t length : lengths) {
+            std::vector<uint8_t> payload = makePayload(length);
+            for (size_t piece : pieces) {
+                if (piece == 1 && length > 5000) {
+                    continue;
+                }
+
+                // Stream encrypt, one-shot decrypt
+                std::vector<uint8_t> container = streamSeal(key, payload, piece, MIN_CHUNK_SIZE);
+                std::vector<uint8_t> output(length);
+                size_t written = 0;
+                expect(decryptChunked(key, container, output, written) && written == length && output == payload,
+                       "stream seal opens one-shot");
+
+                // One-shot encrypt, stream decrypt
+                std::vector<uint8_t> sealed(chunkedCiphertextSize(length, MIN_CHUNK_SIZE));
+                encryptChunked(key, payload, sealed, written, nullptr, MIN_CHUNK_SIZE);
+                expect(streamOpen(key, sealed, piece, output) && output == payload, "one-shot seal opens streamed");
+            }
+        }
+    }
+
+    void testRejection(const uint8_t* key) {
+        std::vector<uint8_t> payload = makePayload(3 * MIN_CHUNK_SIZE + 10);
+        std::vector<uint8_t> container = streamSeal(key, payload, 1000, MIN_CHUNK_SIZE);
+        std::vector<uint8_t> output;
+
+        // A tampered second chunk releases exactly the first chunk
+        std::vector<uint8_t> flipped = container;
+        flipped[CHUNKED_HEADER_SIZE + MIN_CHUNK_SIZE + POLY1305_TAG_SIZE + 7] ^= 0x40;
+        expect(!streamOpen(key, flipped, 777, output), "tampered chunk rejected");
+        expect(output.size() == MIN_CHUNK_SIZE, "only authenticated chunks released");
+
+        std::vector<uint8_t> truncated(container.begin(), container.end() - 1);
+        expect(!streamOpen(key, truncated, 4096, output), "truncated stream incomplete");
+
+        std::vector<uint8_t> trailing = container;
+        trailing.push_back(0);
+        expect(!streamOpen(key, trailing, 4096, output), "trailing bytes rejected");
+
+        std::vector<uint8_t> badHeader = container;
+        badHeader[0] = 'X';
+        expect(!streamOpen(key, badHeader, 4096, output) && output.empty(), "bad magic rejected");
+
+        // The encryptor holds the caller to the declared length
+        std::vector<uint8_t> sink;
+        StreamEncryptor shortStream(key, 10, [&sink](ConstByteSpan bytes) {
+            sink.insert(sink.end(), bytes.begin(), bytes.end());
+            return true;
+        });
+        expect(shortStream.update(ConstByteSpan(payload.data(), 5)) && !shortStream.finalize(), "short input rejected");
+
+        StreamEncryptor longStream(key, 10, [](ConstByteSpan) {
+            return true;
+        });
+        expect(!longStream.update(ConstByteSpan(payload.data(), 11)), "excess input rejected");
+
+        StreamEncryptor refused(key, payload.size(), [](ConstByteSpan) {
+            return false;
+        });
+        expect(!refused.update(payload) && !refused.finalize(), "sink refusal stops the stream");
+    }
+
+    void testBlobStorage(const uint8_t* key) {
+        std::string directory = makeTempDirectory("cipher_stream_test");
+        if (directory.empty()) {
+            return;
+        }
+        std::string path = directory + "/messages.bin";
+        std::vector<uint8_t> payload = makePayload(200000);
+        std::vector<uint8_t> loaded;
+
+        // Plaintext saved before encryption was enabled still loads
+        BlobStorage storage;
+        expect(storage.saveMessages(path, payload.data(), payload.size()), "plain save");
+        storage.setEncryptionKey(key);
+        expect(storage.loadMessages(path, loaded) && loaded == payload, "plain file loads with a key set");
+
+        expect(storage.saveMessages(path, payload.data(), payload.size()), "encrypted save");
+        expect(storage.getStorageSize(path) == static_cast<int64_t>(chunkedCiphertextSize(payload.size())),
+               "file holds a container");
+        expect(storage.loadMessages(path, loaded) && loaded == payload, "encrypted load");
+
+        uint8_t otherKey[CHACHA20_KEY_SIZE];
+        std::memcpy(otherKey, key, sizeof(otherKey));
+        otherKey[31] ^= 0x01;
+        BlobStorage other;
+        other.setEncryptionKey(otherKey);
+        expect(!other.loadMessages(path, loaded) && loaded.empty(), "wrong key rejected");
+
+        storage.clearMessages(path);
+        rmdir(directory.c_str());
+    }
+}
+
+int main() {
+    uint8_t key[CHACHA20_KEY_SIZE];
+    secureRandomBytes(key, sizeof(key));
+
+    testInterop(key);
+    testRejection(key);
+    testBlobStorage(key);
+
+    return finishTest("cipher stream");
+}
@@ -0,0 +1,169 @@
+// Block compression of stored messages against uncompressed storage: the size on disk,
+// the save time (compress, write and sync) and the load time (read and decompress) of a
+// chat history through BlobStorage, with blocks handled on the calling thread and on the
+// thread pool, followed by the throughput of the block compressor itself.
+//
+// The history is generated from a fixed seed: messages of 3 to 40 words drawn from a
+// small vocabulary, which is about as repetitive as real chat text. Times are the median
+// of the repetitions.
+//
+// Usage: compression_benchmark [--quick] [--messages N] [--repeat N]
+
+#include "block_compression.h"
+#include "blob_storage.h"
+#include "message_codec.h"
+#include "thread_manager.h"
+#include "test_support.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <string>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+namespace {
+    struct Options {
+        size_t messages = 200000;
+        size_t repeat = 5;
+    };
+
+    const char* const WORDS[] = {
+        "the", "a", "to", "you", "I", "and", "is", "it", "that", "for", "on", "be", "at", "with",
+        "meeting", "tomorrow", "today", "tonight", "sounds", "good", "thanks", "see", "there", "later",
+        "can", "we", "move", "call", "sorry", "running", "late", "lunch", "office", "photo", "sent",
+        "ok", "great", "what", "time", "where", "are", "how", "about", "the", "weekend", "plan",
+    };
+
+    std::vector<uint8_t> makeHistory(size_t count) {
+        std::mt19937 random(42);
+        std::vector<uint8_t> batch;
+        MessageBatchWriter writer(batch);
+        int64_t timestamp = 1700000000000LL;
+        for (size_t i = 0; i < count; ++i) {
+            std::string text;
+            size_t words = 3 + random() % 38;
+            for (size_t w = 0; w < words; ++w) {
+                text += (w == 0 ? "" : " ");
+                text += WORDS[random() % (sizeof(WORDS) / sizeof(WORDS[0]))];
+            }
+            timestamp += 1000 + random() % 600000;
+            writer.add(text, random() % 2 == 0, static_cast<uint8_t>(random() % 4 == 0 ? 1 : 0), timestamp);
+        }
+        return batch;
+    }
+
+    double millisecondsSince(std::chrono::steady_clock::time_point start) {
+        return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    double median(std::vector<double> values) {
+        std::sort(values.begin(), values.end());
+        return values[values.size() / 2];
+    }
+
+    bool parseOptions(int argc, char** argv, Options& options) {
+        for (int i = 1; i < argc; ++i) {
+            std::string arg = argv[i];
+            auto next = [&](size_t& value) {
+                if (i + 1 >= argc) {
+                    return false;
+                }
+                value = static_cast<size_t>(std::strtoull(argv[++i], nullptr, 10));
+                return value > 0;
+            };
+            if (arg == "--quick") {
+                options.messages = 20000;
+                options.repeat = 3;
+            } else if (arg == "--messages" && next(options.messages)) {
+            } else if (arg == "--repeat" && next(options.repeat)) {
+            } else {
+                std::fprintf(stderr, "Unknown or incomplete option: %s\n", arg.c_str());
+                return false;
+            }
+        }
+        return true;
+    }
+}
+
+int main(int argc, char** argv) {
+    Options options;
+    if (!parseOptions(argc, argv, options)) {
+        return 2;
+    }
+
+    std::string directory = makeTempDirectory("compression_benchmark");
+    if (directory.empty()) {
+        return 1;
+    }
+    std::string path = directory + "/messages.blob";
+
+    size_t workers = std::max(std::thread::hardware_concurrency(), 1u);
+    ThreadManager threadManager;
+    threadManager.initializeThreadPool(workers);
+
+    std::vector<uint8_t> history = makeHistory(options.messages);
+    std::printf("%zu messages, %.2f MB serialized, %zu pool threads\n", options.messages,
+                history.size() / (1024.0 * 1024.0), workers);
+    std::printf("%-18s %12s %8s %10s %10s\n", "storage", "bytes", "ratio", "save ms", "load ms");
+
+    bool ok = true;
+    struct Mode {
+        const char* name;
+        bool compression;
+        ThreadManager* pool;
+    };
+    for (const Mode& mode : {Mode{"uncompressed", false, nullptr}, Mode{"compressed", true, nullptr},
+                             Mode{"compressed, pool", true, &threadManager}}) {
+        BlobStorage storage;
+        storage.setCompression(mode.compression);
+        storage.setThreadManager(mode.pool);
+        std::vector<double> saves;
+        std::vector<double> loads;
+        std::vector<uint8_t> loaded;
+        for (size_t i = 0; i < options.repeat; ++i) {
+            auto start = std::chrono::steady_clock::now();
+            ok = storage.saveMessages(path, history.data(), history.size()) && ok;
+            saves.push_back(millisecondsSince(start));
+
+            start = std::chrono::steady_clock::now();
+            ok = storage.loadMessages(path, loaded) && loaded == history && ok;
+            loads.push_back(millisecondsSince(start));
+        }
+        int64_t size = fileSize(path);
+        std::printf("%-18s %12lld %8.3f %10.2f %10.2f\n", mode.name, static_cast<long long>(size),
+                    static_cast<double>(size) / history.size(), median(saves), median(loads));
+        storage.clearMessages(path);
+    }
+
+    // The compressor alone, without the file system
+    std::printf("\n%-18s %12s %12s\n", "blocks", "compress MB/s", "expand MB/s");
+    for (ThreadManager* pool : {static_cast<ThreadManager*>(nullptr), &threadManager}) {
+        std::vector<double> compressTimes;
+        std::vector<double> expandTimes;
+        std::vector<uint8_t> container;
+        std::vector<uint8_t> expanded;
+        for (size_t i = 0; i < options.repeat; ++i) {
+            auto start = std::chrono::steady_clock::now();
+            ok = compressBlocks(history, container, pool) && ok;
+            compressTimes.push_back(millisecondsSince(start));
+
+            start = std::chrono::steady_clock::now();
+            ok = decompressBlocks(container, expanded, pool) && expanded == history && ok;
+            expandTimes.push_back(millisecondsSince(start));
+        }
+        double megabytes = history.size() / (1024.0 * 1024.0);
+        std::printf("%-18s %12.1f %12.1f\n", pool == nullptr ? "calling thread" : "pool",
+                    megabytes / (median(compressTimes) / 1000.0), megabytes / (median(expandTimes) / 1000.0));
+    }
+
+    threadManager.shutdownThreadPool();
+    rmdir(directory.c_str());
+    if (!ok) {
+        std::fprintf(stderr, "FAIL: a save or load did not round trip\n");
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,152 @@
+// Event records and the payload pool: inline and spilled payloads, buffers up to image
+// sizes reused within their size class, buffers moved between events, and releases of
+// buffers that were already released, cached or freed, or were never handed out by the
+// pool, including two racing releases.
+//
+// Usage: event_record_test
+
+#include "event_record.h"
+#include "test_support.h"
+#include <atomic>
+#include <cstring>
+#include <thread>
+#include <vector>
+
+namespace {
+    void testInlineAndSpilled() {
+        PayloadPool pool;
+        Event event = makeEvent(EventType::BYTE_ARRAY, 7);
+        expect(event.eventId == 7 && event.length == 0 && !event.isSpilled(), "new event is empty");
+
+        uint8_t* inlinePayload = event.allocatePayload(pool, Event::INLINE_CAPACITY);
+        expect(inlinePayload == event.inlineData && !event.isSpilled() && event.length == Event::INLINE_CAPACITY,
+               "payload up to the inline capacity stays inline");
+        event.releasePayload(pool);
+        expect(event.length == 0, "inline payload released");
+
+        uint8_t* spilled = event.allocatePayload(pool, Event::INLINE_CAPACITY + 1);
+        expect(spilled != nullptr && spilled != event.inlineData && event.isSpilled() &&
+               event.payload() == spilled, "larger payload spills to the pool");
+        std::memset(spilled, 0x5A, Event::INLINE_CAPACITY + 1);
+        event.releasePayload(pool);
+        expect(!event.isSpilled() && event.length == 0, "spilled payload released");
+
+        // Back to inline after spilling
+        expect(event.allocatePayload(pool, 3) == event.inlineData && !event.isSpilled(), "inline after spill");
+        event.releasePayload(pool);
+    }
+
+    void testReuse() {
+        PayloadPool pool;
+        uint8_t* first = pool.acquire(100);
+        expect(first != nullptr && pool.release(first), "acquire and release");
+        expect(pool.acquire(128) == first, "released buffer reused within its size class");
+        uint8_t* larger = pool.acquire(129);
+        expect(larger != nullptr && larger != first, "next size class gets its own buffer");
+        pool.release(first);
+        pool.release(larger);
+
+        // Image-sized payloads are reused as well, a couple per class
+        const size_t image = 3 * 1024 * 1024;
+        uint8_t* photo = pool.acquire(image);
+        uint8_t* secondPhoto = pool.acquire(image);
+        expect(photo != nullptr && secondPhoto != nullptr, "image-sized buffers");
+        std::memset(photo, 0x3C, image);
+        pool.release(photo);
+        pool.release(secondPhoto);
+        uint8_t* reused = pool.acquire(2 * 1024 * 1024 + 1);
+        uint8_t* reusedSecond = pool.acquire(4 * 1024 * 1024);
+        expect((reused == photo && reusedSecond == secondPhoto) || (reused == secondPhoto && reusedSecond == photo),
+               "image-sized buffers reused within their size class");
+        pool.release(reused);
+        pool.release(reusedSecond);
+
+        // Buffers above the largest class are not cached
+        uint8_t* huge = pool.acquire(32 * 1024 * 1024);
+        expect(huge != nullptr && pool.release(huge), "unpooled buffer freed on release");
+
+        // Moving a buffer between events keeps a single owner
+        Event source = makeEvent(EventType::BYTE_ARRAY, 1);
+        uint8_t* data = source.allocatePayload(pool, 4096);
+        uint8_t* detached = source.detachPayload();
+        expect(detached == data && !source.isSpilled() && source.detachPayload() == nullptr, "detach");
+        Event target = makeEvent(EventType::BYTE_ARRAY, 2);
+        target.adoptPayload(detached, 4096);
+        expect(target.isSpilled() && target.payload() == data && target.length == 4096, "adopt");
+        target.releasePayload(pool);
+        expect(pool.acquire(4096) == data, "adopted buffer returned to the pool");
+        pool.release(data);
+        pool.trim();
+    }
+
+    void testDoubleRelease() {
+        PayloadPool pool;
+        uint8_t* buffer = pool.acquire(200);
+        expect(pool.release(buffer), "first release");
+        expect(!pool.release(buffer), "second release rejected");
+
+        // Had the second release gone through, the free list would hand the buffer out twice
+        uint8_t* again = pool.acquire(200);
+        uint8_t* other = pool.acquire(200);
+        expect(again == buffer && other != buffer, "buffer handed out once");
+        expect(pool.release(again) && pool.release(other), "buffers handed out again release");
+
+        // Buffers the pool freed rather than cached are rejected without being looked at:
+        // one above the largest class, and those beyond what a full free list keeps
+        uint8_t* unpooled = pool.acquire(64 * 1024 * 1024);
+        expect(unpooled != nullptr && pool.release(unpooled), "unpooled buffer released");
+        expect(!pool.release(unpooled), "unpooled buffer released twice rejected");
+        std::vector<uint8_t*> many;
+        for (int i = 0; i < 100; ++i) {
+            many.push_back(pool.acquire(500));
+        }
+        bool releasedOnce = true;
+        bool rejectedTwice = true;
+        for (uint8_t* data : many) {
+            releasedOnce = pool.release(data) && releasedOnce;
+        }
+        for (uint8_t* data : many) {
+            rejectedTwice = !pool.release(data) && rejectedTwice;
+        }
+        expect(releasedOnce && rejectedTwice, "buffers past a full free list released twice rejected");
+
+        std::vector<uint8_t> foreign(64, 0);
+        expect(!pool.release(foreign.data() + 16) && !pool.release(nullptr), "foreign buffers rejected");
+
+        // Two threads releasing the same buffer: exactly one of them wins every round
+        int doubleWins = 0;
+        for (int round = 0; round < 500; ++round) {
+            uint8_t* shared = pool.acquire(300);
+            std::atomic<int> wins{0};
+            std::atomic<bool> go{false};
+            auto releaser = [&]() {
+                while (!go.load()) {
+                }
+                if (pool.release(shared)) {
+                    wins.fetch_add(1);
+                }
+            };
+            std::thread a(releaser);
+            std::thread b(releaser);
+            go = true;
+            a.join();
+            b.join();
+            if (wins.load() != 1) {
+                doubleWins++;
+            }
+        }
+        expect(doubleWins == 0, "racing releases accepted once");
+        uint8_t* first = pool.acquire(300);
+        uint8_t* second = pool.acquire(300);
+        expect(first != second, "racing releases cached once");
+        pool.release(first);
+        pool.release(second);
+    }
+}
+
+int main() {
+    testInlineAndSpilled();
+    testReuse();
+    testDoubleRelease();
+    return finishTest("event record");
+}
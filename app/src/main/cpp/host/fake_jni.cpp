@@ -0,0 +1,363 @@
+#include "fake_jni.h"
+#include <chrono>
+#include <cstring>
+#include <cstdio>
+
+namespace {
+    struct FakeMethod {
+        const char* name;
+        const char* signature;
+    };
+
+    // Methods exposed by the fake listener class
+    FakeMethod LISTENER_METHODS[] = {
+        {"onStringEvent", "(Ljava/lang/String;Ljava/lang/String;)V"},
+        {"onIntEvent", "(Ljava/lang/String;I)V"},
+        {"onFloatEvent", "(Ljava/lang/String;F)V"},
+        {"onDoubleEvent", "(Ljava/lang/String;D)V"},
+        {"onBooleanEvent", "(Ljava/lang/String;Z)V"},
+        {"onByteArrayEvent", "(Ljava/lang/String;[B)V"},
+        {"onByteBufferEvent", "(Ljava/lang/String;Ljava/nio/ByteBuffer;J)V"},
+    };
+
+    class FakeString : public _jstring {
+    public:
+        explicit FakeString(std::string v) : value(std::move(v)) {}
+        std::string value;
+    };
+
+    class FakeClass : public _jclass {};
+
+    class FakeByteArray : public _jbyteArray {
+    public:
+        explicit FakeByteArray(size_t length) : data(length) {}
+        std::vector<uint8_t> data;
+    };
+
+    class FakeDirectBuffer : public _jobject {
+    public:
+        FakeDirectBuffer(void* a, jlong c) : address(a), capacity(c) {}
+        void* address;
+        jlong capacity;
+    };
+
+    bool isFakeOwned(jobject obj) {
+        return dynamic_cast<FakeString*>(obj) != nullptr ||
+               dynamic_cast<FakeClass*>(obj) != nullptr ||
+               dynamic_cast<FakeByteArray*>(obj) != nullptr ||
+               dynamic_cast<FakeDirectBuffer*>(obj) != nullptr;
+    }
+
+    class FakeJNIEnv : public JNIEnv {
+    public:
+        explicit FakeJNIEnv(FakeJavaVM* vm) : vm_(vm), pendingException_(false) {}
+
+        FakeJavaVM* vm() const { return vm_; }
+
+        jint GetJavaVM(_JavaVM** vm) override {
+            *vm = vm_;
+            return JNI_OK;
+        }
+
+        jclass FindClass(const char*) override {
+            return new FakeClass();
+        }
+
+        jclass GetObjectClass(jobject) override {
+            return new FakeClass();
+        }
+
+        jmethodID GetMethodID(jclass, const char* name, const char* sig) override {
+            vm_->stats().getMethodID++;
+            for (auto& method : LISTENER_METHODS) {
+                if (std::strcmp(method.name, name) == 0 && std::strcmp(method.signature, sig) == 0) {
+                    if (!vm_->config().directBufferSupport && std::strcmp(name, "onByteBufferEvent") == 0) {
+                        break;
+                    }
+                    return reinterpret_cast<jmethodID>(&method);
+                }
+            }
+            pendingException_ = true; // NoSuchMethodError
+            return nullptr;
+        }
+
+        jobject NewGlobalRef(jobject obj) override {
+            vm_->stats().newGlobalRef++;
+            fakeJniSpin(vm_->config().allocationCostNs);
+            if (auto* str = dynamic_cast<FakeString*>(obj)) {
+                return new FakeString(str->value);
+            }
+            if (dynamic_cast<FakeClass*>(obj) != nullptr) {
+                return new FakeClass();
+            }
+            return obj; // Caller-owned objects such as FakeListener
+        }
+
+        void DeleteGlobalRef(jobject globalRef) override {
+            vm_->stats().deleteGlobalRef++;
+            if (isFakeOwned(globalRef)) {
+                delete globalRef;
+            }
+        }
+
+        void DeleteLocalRef(jobject localRef) override {
+            vm_->stats().deleteLocalRef++;
+            if (isFakeOwned(localRef)) {
+                delete localRef;
+            }
+        }
+
+        jstring NewStringUTF(const char* bytes) override {
+            vm_->stats().newStringUTF++;
+            fakeJniSpin(vm_->config().allocationCostNs);
+            return new FakeString(bytes != nullptr ? bytes : "");
+        }
+
+        const char* GetStringUTFChars(jstring string, jboolean* isCopy) override {
+            if (isCopy != nullptr) {
+                *isCopy = JNI_FALSE;
+            }
+            auto* str = dynamic_cast<FakeString*>(string);
+            return str != nullptr ? str->value.c_str() : nullptr;
+        }
+
+        void ReleaseStringUTFChars(jstring, const char*) override {
+        }
+
+        jsize GetArrayLength(jarray array) override {
+            auto* bytes = dynamic_cast<FakeByteArray*>(array);
+            return bytes != nullptr ? static_cast<jsize>(bytes->data.size()) : 0;
+        }
+
+        jbyteArray NewByteArray(jsize length) override {
+            vm_->stats().newByteArray++;
+            fakeJniSpin(vm_->config().allocationCostNs);
+            return new FakeByteArray(static_cast<size_t>(length));
+        }
+
+        void GetByteArrayRegion(jbyteArray array, jsize start, jsize len, jbyte* buf) override {
+            auto* bytes = static_cast<FakeByteArray*>(array);
+            std::memcpy(buf, bytes->data.data() + start, static_cast<size_t>(len));
+            chargeCopy(static_cast<size_t>(len));
+        }
+
+        void SetByteArrayRegion(jbyteArray array, jsize start, jsize len, const jbyte* buf) override {
+            auto* bytes = static_cast<FakeByteArray*>(array);
+            std::memcpy(bytes->data.data() + start, buf, static_cast<size_t>(len));
+            chargeCopy(static_cast<size_t>(len));
+        }
+
+        jbyte* GetByteArrayElements(jbyteArray array, jboolean* isCopy) override {
+            if (isCopy != nullptr) {
+                *isCopy = JNI_FALSE;
+            }
+            return reinterpret_cast<jbyte*>(static_cast<FakeByteArray*>(array)->data.data());
+        }
+
+        void ReleaseByteArrayElements(jbyteArray, jbyte*, jint) override {
+        }
+
+        void* GetPrimitiveArrayCritical(jarray array, jboolean* isCopy) override {
+            return GetByteArrayElements(static_cast<jbyteArray>(array), isCopy);
+        }
+
+        void ReleasePrimitiveArrayCritical(jarray, void*, jint) override {
+        }
+
+        jobjectArray NewObjectArray(jsize, jclass, jobject) override {
+            return nullptr; // Not needed by the bridge
+        }
+
+        void SetObjectArrayElement(jobjectArray, jsize, jobject) override {
+        }
+
+        jobject NewDirectByteBuffer(void* address, jlong capacity) override {
+            vm_->stats().newDirectByteBuffer++;
+            fakeJniSpin(vm_->config().allocationCostNs);
+            return new FakeDirectBuffer(address, capacity);
+        }
+
+        void* GetDirectBufferAddress(jobject buf) override {
+            auto* direct = dynamic_cast<FakeDirectBuffer*>(buf);
+            return direct != nullptr ? direct->address : nullptr;
+        }
+
+        jlong GetDirectBufferCapacity(jobject buf) override {
+            auto* direct = dynamic_cast<FakeDirectBuffer*>(buf);
+            return direct != nullptr ? direct->capacity : -1;
+        }
+
+        void CallVoidMethodV(jobject, jmethodID methodID, va_list args) override {
+            vm_->stats().callVoidMethod++;
+            auto* method = reinterpret_cast<FakeMethod*>(methodID);
+            if (method == nullptr) {
+                pendingException_ = true;
+                return;
+            }
+
+            FakeCallback callback;
+            callback.method = method->name;
+            auto* eventId = dynamic_cast<FakeString*>(va_arg(args, jstring));
+            if (eventId != nullptr) {
+                callback.eventId = eventId->value;
+            }
+
+            const char* name = method->name;
+            if (std::strcmp(name, "onStringEvent") == 0) {
+                auto* data = dynamic_cast<FakeString*>(va_arg(args, jstring));
+                if (data != nullptr) {
+                    callback.stringValue = data->value;
+                }
+            } else if (std::strcmp(name, "onIntEvent") == 0) {
+                callback.intValue = va_arg(args, jint);
+            } else if (std::strcmp(name, "onFloatEvent") == 0) {
+                callback.floatValue = static_cast<jfloat>(va_arg(args, double));
+            } else if (std::strcmp(name, "onDoubleEvent") == 0) {
+                callback.doubleValue = va_arg(args, jdouble);
+            } else if (std::strcmp(name, "onBooleanEvent") == 0) {
+                callback.boolValue = va_arg(args, int) != 0;
+            } else if (std::strcmp(name, "onByteArrayEvent") == 0) {
+                auto* data = dynamic_cast<FakeByteArray*>(va_arg(args, jbyteArray));
+                if (data != nullptr) {
+                    callback.bytes = data->data.data();
+                    callback.length = data->data.size();
+                }
+            } else if (std::strcmp(name, "onByteBufferEvent") == 0) {
+                auto* data = dynamic_cast<FakeDirectBuffer*>(va_arg(args, jobject));
+                if (data != nullptr) {
+                    callback.bytes = static_cast<const uint8_t*>(data->address);
+                    callback.length = static_cast<size_t>(data->capacity);
+                }
+                callback.bufferHandle = va_arg(args, jlong);
+            }
+
+            vm_->dispatchCallback(callback);
+        }
+
+        void raiseException() {
+            pendingException_ = true;
+        }
+
+        jboolean ExceptionCheck() override {
+            return pendingException_ ? JNI_TRUE : JNI_FALSE;
+        }
+
+        void ExceptionDescribe() override {
+            if (pendingException_) {
+                std::fprintf(stderr, "FakeJNI: pending exception\n");
+            }
+        }
+
+        void ExceptionClear() override {
+            pendingException_ = false;
+        }
+
+    private:
+        FakeJavaVM* vm_;
+        bool pendingException_;
+
+        void chargeCopy(size_t length) {
+            vm_->stats().bytesCopied += length;
+            fakeJniSpin(static_cast<uint64_t>(vm_->config().perByteCostNs * static_cast<double>(length)));
+        }
+    };
+
+    thread_local FakeJNIEnv* t_env = nullptr;
+
+    // Frees the env of a thread that exits still attached, as pool workers do
+    struct AttachedEnvReaper {
+        ~AttachedEnvReaper() {
+            delete t_env;
+            t_env = nullptr;
+        }
+    };
+    thread_local AttachedEnvReaper t_envReaper;
+}
+
+void fakeJniSpin(uint64_t nanoseconds) {
+    if (nanoseconds == 0) {
+        return;
+    }
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::nanoseconds(nanoseconds);
+    while (std::chrono::steady_clock::now() < deadline) {
+    }
+}
+
+void FakeJniStats::reset() {
+    getMethodID = 0;
+    newStringUTF = 0;
+    newByteArray = 0;
+    bytesCopied = 0;
+    newDirectByteBuffer = 0;
+    newGlobalRef = 0;
+    deleteGlobalRef = 0;
+    deleteLocalRef = 0;
+    callVoidMethod = 0;
+    attachCurrentThread = 0;
+    detachCurrentThread = 0;
+}
+
+FakeJavaVM::FakeJavaVM(const FakeJniConfig& config) : config_(config) {
+}
+
+FakeJavaVM::~FakeJavaVM() {
+    if (t_env != nullptr && t_env->vm() == this) {
+        DetachCurrentThread();
+    }
+}
+
+void FakeJavaVM::setCallbackHandler(std::function<void(const FakeCallback&)> handler) {
+    handler_ = std::move(handler);
+}
+
+void FakeJavaVM::dispatchCallback(const FakeCallback& callback) {
+    if (handler_) {
+        handler_(callback);
+    }
+}
+
+JNIEnv* FakeJavaVM::attachCurrentThread() {
+    JNIEnv* env = nullptr;
+    AttachCurrentThread(&env, nullptr);
+    return env;
+}
+
+void FakeJavaVM::throwException() {
+    if (t_env != nullptr) {
+        t_env->raiseException();
+    }
+}
+
+jint FakeJavaVM::GetEnv(void** env, jint /* version */) {
+    if (t_env == nullptr || t_env->vm() != this) {
+        *env = nullptr;
+        return JNI_EDETACHED;
+    }
+    *env = t_env;
+    return JNI_OK;
+}
+
+jint FakeJavaVM::AttachCurrentThread(JNIEnv** env, void* /* args */) {
+    if (t_env == nullptr) {
+        stats_.attachCurrentThread++;
+        fakeJniSpin(config_.attachCostNs);
+        t_env = new FakeJNIEnv(this);
+        static_cast<void>(&t_envReaper);
+    }
+    *env = t_env;
+    return JNI_OK;
+}
+
+jint FakeJavaVM::AttachCurrentThreadAsDaemon(JNIEnv** env, void* args) {
+    return AttachCurrentThread(env, args);
+}
+
+jint FakeJavaVM::DetachCurrentThread() {
+    if (t_env == nullptr) {
+        return JNI_ERR;
+    }
+    stats_.detachCurrentThread++;
+    delete t_env;
+    t_env = nullptr;
+    return JNI_OK;
+}
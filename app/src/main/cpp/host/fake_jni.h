@@ -0,0 +1,97 @@
+#ifndef FAKE_JNI_H
+#define FAKE_JNI_H
+
+#include <jni.h>
+#include <atomic>
+#include <functional>
+#include <string>
+#include <vector>
+#include <cstdint>
+
+/**
+ * Fake JavaVM/JNIEnv for host builds
+ *
+ * Implements the JNI subset from include/jni.h in plain C++ so IOBridge and friends can
+ * run and be profiled without a JVM. Every call is counted in FakeJniStats, allocation
+ * and thread-attach costs can be simulated with busy-waits, and listener callbacks are
+ * decoded and forwarded to a C++ handler.
+ */
+
+struct FakeJniConfig {
+    uint32_t allocationCostNs = 0;   // Per NewStringUTF/NewByteArray/NewDirectByteBuffer/NewGlobalRef
+    double perByteCostNs = 0.0;      // Per byte copied into a Java array
+    uint32_t attachCostNs = 0;       // Per AttachCurrentThread on an unattached thread
+    bool directBufferSupport = true; // Whether the listener implements onByteBufferEvent
+};
+
+struct FakeJniStats {
+    std::atomic<uint64_t> getMethodID{0};
+    std::atomic<uint64_t> newStringUTF{0};
+    std::atomic<uint64_t> newByteArray{0};
+    std::atomic<uint64_t> bytesCopied{0};
+    std::atomic<uint64_t> newDirectByteBuffer{0};
+    std::atomic<uint64_t> newGlobalRef{0};
+    std::atomic<uint64_t> deleteGlobalRef{0};
+    std::atomic<uint64_t> deleteLocalRef{0};
+    std::atomic<uint64_t> callVoidMethod{0};
+    std::atomic<uint64_t> attachCurrentThread{0};
+    std::atomic<uint64_t> detachCurrentThread{0};
+
+    void reset();
+};
+
+// A listener callback as seen by the fake JVM
+struct FakeCallback {
+    std::string method;          // e.g. "onIntEvent"
+    std::string eventId;
+    jint intValue = 0;
+    jfloat floatValue = 0.0f;
+    jdouble doubleValue = 0.0;
+    bool boolValue = false;
+    std::string stringValue;
+    const uint8_t* bytes = nullptr;  // onByteArrayEvent / onByteBufferEvent payload
+    size_t length = 0;
+    jlong bufferHandle = 0;          // onByteBufferEvent only
+};
+
+// Stand-in for the Kotlin listener object passed to registerListener()
+class FakeListener : public _jobject {};
+
+class FakeJavaVM : public JavaVM {
+public:
+    explicit FakeJavaVM(const FakeJniConfig& config = FakeJniConfig());
+    ~FakeJavaVM() override;
+
+    FakeJavaVM(const FakeJavaVM&) = delete;
+    FakeJavaVM& operator=(const FakeJavaVM&) = delete;
+
+    // Called synchronously on the delivering thread for each CallVoidMethod
+    void setCallbackHandler(std::function<void(const FakeCallback&)> handler);
+
+    FakeJniStats& stats() { return stats_; }
+    const FakeJniConfig& config() const { return config_; }
+
+    // Attach the calling thread and return its env (convenience for test drivers)
+    JNIEnv* attachCurrentThread();
+
+    // Leave an exception pending on the calling thread's env, as a listener callback that throws
+    void throwException();
+
+    jint GetEnv(void** env, jint version) override;
+    jint AttachCurrentThread(JNIEnv** env, void* args) override;
+    jint AttachCurrentThreadAsDaemon(JNIEnv** env, void* args) override;
+    jint DetachCurrentThread() override;
+
+    // Internal, used by FakeJNIEnv
+    void dispatchCallback(const FakeCallback& callback);
+
+private:
+    FakeJniConfig config_;
+    FakeJniStats stats_;
+    std::function<void(const FakeCallback&)> handler_;
+};
+
+// Busy-wait for the given number of nanoseconds
+void fakeJniSpin(uint64_t nanoseconds);
+
+#endif // FAKE_JNI_H
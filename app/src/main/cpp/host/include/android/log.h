@@ -0,0 +1,43 @@
+#ifndef FLUXOR_HOST_ANDROID_LOG_H
+#define FLUXOR_HOST_ANDROID_LOG_H
+
+/**
+ * Host-only stand-in for <android/log.h>
+ *
+ * Writes to stderr. Messages below FLUXOR_HOST_LOG_LEVEL (default: ANDROID_LOG_WARN)
+ * are dropped so benchmarks are not dominated by logging.
+ */
+
+#include <cstdio>
+#include <cstdarg>
+
+enum android_LogPriority {
+    ANDROID_LOG_UNKNOWN = 0,
+    ANDROID_LOG_DEFAULT,
+    ANDROID_LOG_VERBOSE,
+    ANDROID_LOG_DEBUG,
+    ANDROID_LOG_INFO,
+    ANDROID_LOG_WARN,
+    ANDROID_LOG_ERROR,
+    ANDROID_LOG_FATAL,
+    ANDROID_LOG_SILENT
+};
+
+#ifndef FLUXOR_HOST_LOG_LEVEL
+#define FLUXOR_HOST_LOG_LEVEL ANDROID_LOG_WARN
+#endif
+
+inline int __android_log_print(int prio, const char* tag, const char* fmt, ...) {
+    if (prio < FLUXOR_HOST_LOG_LEVEL) {
+        return 0;
+    }
+    va_list args;
+    va_start(args, fmt);
+    std::fprintf(stderr, "%s: ", tag);
+    int written = std::vfprintf(stderr, fmt, args);
+    std::fputc('\n', stderr);
+    va_end(args);
+    return written;
+}
+
+#endif // FLUXOR_HOST_ANDROID_LOG_H
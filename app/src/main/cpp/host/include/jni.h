@@ -0,0 +1,129 @@
+#ifndef FLUXOR_HOST_JNI_H
+#define FLUXOR_HOST_JNI_H
+
+/**
+ * Host-only stand-in for <jni.h>
+ *
+ * Declares just the JNI surface the native library uses, with JNIEnv and JavaVM as
+ * abstract classes so fake_jni.h can implement them without a JVM. Never compiled
+ * into the Android build, which uses the NDK's real header.
+ */
+
+#include <cstdint>
+#include <cstdarg>
+
+typedef int32_t jint;
+typedef int64_t jlong;
+typedef int8_t jbyte;
+typedef uint8_t jboolean;
+typedef uint16_t jchar;
+typedef int16_t jshort;
+typedef float jfloat;
+typedef double jdouble;
+typedef jint jsize;
+
+class _jobject {
+public:
+    virtual ~_jobject() = default;
+};
+class _jclass : public _jobject {};
+class _jstring : public _jobject {};
+class _jthrowable : public _jobject {};
+class _jarray : public _jobject {};
+class _jbyteArray : public _jarray {};
+class _jobjectArray : public _jarray {};
+
+typedef _jobject* jobject;
+typedef _jclass* jclass;
+typedef _jstring* jstring;
+typedef _jthrowable* jthrowable;
+typedef _jarray* jarray;
+typedef _jbyteArray* jbyteArray;
+typedef _jobjectArray* jobjectArray;
+
+struct _jmethodID;
+typedef _jmethodID* jmethodID;
+
+#define JNI_FALSE 0
+#define JNI_TRUE 1
+
+#define JNI_OK 0
+#define JNI_ERR (-1)
+#define JNI_EDETACHED (-2)
+#define JNI_EVERSION (-3)
+
+#define JNI_COMMIT 1
+#define JNI_ABORT 2
+
+#define JNI_VERSION_1_6 0x00010006
+
+#define JNIEXPORT __attribute__((visibility("default")))
+#define JNICALL
+
+struct JavaVMAttachArgs {
+    jint version;
+    const char* name;
+    jobject group;
+};
+
+struct _JavaVM;
+
+struct _JNIEnv {
+    virtual ~_JNIEnv() = default;
+
+    virtual jint GetJavaVM(_JavaVM** vm) = 0;
+
+    virtual jclass FindClass(const char* name) = 0;
+    virtual jclass GetObjectClass(jobject obj) = 0;
+    virtual jmethodID GetMethodID(jclass clazz, const char* name, const char* sig) = 0;
+
+    virtual jobject NewGlobalRef(jobject obj) = 0;
+    virtual void DeleteGlobalRef(jobject globalRef) = 0;
+    virtual void DeleteLocalRef(jobject localRef) = 0;
+
+    virtual jstring NewStringUTF(const char* bytes) = 0;
+    virtual const char* GetStringUTFChars(jstring string, jboolean* isCopy) = 0;
+    virtual void ReleaseStringUTFChars(jstring string, const char* utf) = 0;
+
+    virtual jsize GetArrayLength(jarray array) = 0;
+    virtual jbyteArray NewByteArray(jsize length) = 0;
+    virtual void GetByteArrayRegion(jbyteArray array, jsize start, jsize len, jbyte* buf) = 0;
+    virtual void SetByteArrayRegion(jbyteArray array, jsize start, jsize len, const jbyte* buf) = 0;
+    virtual jbyte* GetByteArrayElements(jbyteArray array, jboolean* isCopy) = 0;
+    virtual void ReleaseByteArrayElements(jbyteArray array, jbyte* elems, jint mode) = 0;
+    virtual void* GetPrimitiveArrayCritical(jarray array, jboolean* isCopy) = 0;
+    virtual void ReleasePrimitiveArrayCritical(jarray array, void* carray, jint mode) = 0;
+
+    virtual jobjectArray NewObjectArray(jsize length, jclass elementClass, jobject initialElement) = 0;
+    virtual void SetObjectArrayElement(jobjectArray array, jsize index, jobject value) = 0;
+
+    virtual jobject NewDirectByteBuffer(void* address, jlong capacity) = 0;
+    virtual void* GetDirectBufferAddress(jobject buf) = 0;
+    virtual jlong GetDirectBufferCapacity(jobject buf) = 0;
+
+    virtual void CallVoidMethodV(jobject obj, jmethodID methodID, va_list args) = 0;
+    void CallVoidMethod(jobject obj, jmethodID methodID, ...) {
+        va_list args;
+        va_start(args, methodID);
+        CallVoidMethodV(obj, methodID, args);
+        va_end(args);
+    }
+
+    virtual jboolean ExceptionCheck() = 0;
+    virtual void ExceptionDescribe() = 0;
+    virtual void ExceptionClear() = 0;
+};
+
+struct _JavaVM {
+    virtual ~_JavaVM() = default;
+
+    virtual jint GetEnv(void** env, jint version) = 0;
+    virtual jint AttachCurrentThread(_JNIEnv** env, void* args) = 0;
+    virtual jint AttachCurrentThreadAsDaemon(_JNIEnv** env, void* args) = 0;
+    virtual jint DetachCurrentThread() = 0;
+};
+
+typedef _JNIEnv JNIEnv;
+typedef _JavaVM JavaVM;
+
+#endif // FLUXOR_HOST_JNI_H
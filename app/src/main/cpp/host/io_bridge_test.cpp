@@ -0,0 +1,266 @@
+// IOBridge against the fake JVM: CONFLATE keeps the latest value in the first one's queue
+// position, COALESCE sums numeric values (int sums saturating), and RATE_LIMIT holds back
+// the latest event over budget and delivers it once the window reopens, from the pool and
+// from the dedicated dispatcher; a RATE_LIMIT of zero is refused. Direct buffer handles release once, are rejected when stale, repeated,
+// forged or from another bridge, and buffers lent to a listener that throws are reclaimed.
+//
+// Usage: io_bridge_test
+
+#include "fake_jni.h"
+#include "io_bridge.h"
+#include "thread_manager.h"
+#include "test_support.h"
+#include <chrono>
+#include <cstring>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace {
+    int64_t nowMs() {
+        return std::chrono::duration_cast<std::chrono::milliseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+    /**
+     * Callbacks seen by the fake JVM, in delivery order
+     */
+    class Recorder {
+    public:
+        explicit Recorder(FakeJavaVM& vm) {
+            vm.setCallbackHandler([this](const FakeCallback& callback) {
+                std::lock_guard<std::mutex> lock(mutex_);
+                callbacks_.push_back(callback);
+                times_.push_back(nowMs());
+            });
+        }
+
+        std::vector<FakeCallback> callbacks() {
+            std::lock_guard<std::mutex> lock(mutex_);
+            return callbacks_;
+        }
+
+        int64_t timeOf(size_t index) {
+            std::lock_guard<std::mutex> lock(mutex_);
+            return index < times_.size() ? times_[index] : -1;
+        }
+
+        void clear() {
+            std::lock_guard<std::mutex> lock(mutex_);
+            callbacks_.clear();
+            times_.clear();
+        }
+
+        /**
+         * Wait until an int callback with the given value arrives
+         */
+        bool waitForInt(int32_t value, int64_t timeoutMs) {
+            int64_t deadline = nowMs() + timeoutMs;
+            while (nowMs() < deadline) {
+                for (const FakeCallback& callback : callbacks()) {
+                    if (callback.method == "onIntEvent" && callback.intValue == value) {
+                        return true;
+                    }
+                }
+                std::this_thread::sleep_for(std::chrono::milliseconds(5));
+            }
+            return false;
+        }
+
+    private:
+        std::mutex mutex_;
+        std::vector<FakeCallback> callbacks_;
+        std::vector<int64_t> times_;
+    };
+
+    // Without a thread manager or dispatcher, events wait in the queue until processEvents()
+    void testConflateAndCoalesce() {
+        FakeJavaVM vm;
+        Recorder recorder(vm);
+        IOBridge bridge;
+        bridge.initialize(&vm);
+        bridge.enableEncryption(false);
+        FakeListener listener;
+        bridge.registerListener(vm.attachCurrentThread(), &listener);
+
+        bridge.setDeliveryPolicy("latest", DeliveryPolicy::CONFLATE);
+        bridge.postStringEvent("latest", "first");
+        bridge.postIntEvent("other", 1);
+        bridge.postStringEvent("latest", "second");
+        bridge.postIntEvent("other", 2);
+        bridge.postStringEvent("latest", "third");
+        bridge.processEvents();
+        std::vector<FakeCallback> delivered = recorder.callbacks();
+        expect(delivered.size() == 3 && delivered[0].eventId == "latest" && delivered[0].stringValue == "third" &&
+               delivered[1].intValue == 1 && delivered[2].intValue == 2,
+               "conflated to the latest value in the first one's position");
+
+        recorder.clear();
+        bridge.setDeliveryPolicy("sum", DeliveryPolicy::COALESCE);
+        bridge.setDeliveryPolicy("total", DeliveryPolicy::COALESCE);
+        for (int i = 1; i <= 10; ++i) {
+            bridge.postIntEvent("sum", i);
+            bridge.postDoubleEvent("total", 0.5);
+        }
+        bridge.processEvents();
+        delivered = recorder.callbacks();
+        expect(delivered.size() == 2 && delivered[0].intValue == 55 && delivered[1].doubleValue == 5.0,
+               "coalesced values summed");
+
+        // Int sums stop at the ends of the range instead of wrapping around
+        recorder.clear();
+        bridge.postIntEvent("sum", INT32_MAX - 1);
+        bridge.postIntEvent("sum", 5);
+        bridge.postIntEvent("sum", -3);
+        bridge.postIntEvent("total", -5);
+        bridge.postIntEvent("total", INT32_MIN);
+        bridge.processEvents();
+        delivered = recorder.callbacks();
+        expect(delivered.size() == 2 && delivered[0].intValue == INT32_MAX - 3 && delivered[1].intValue == INT32_MIN,
+               "coalesced int sums saturate");
+
+        // Values of another type are conflated instead
+        recorder.clear();
+        bridge.postIntEvent("sum", 4);
+        bridge.postStringEvent("sum", "text");
+        bridge.postIntEvent("sum", 6);
+        bridge.processEvents();
+        delivered = recorder.callbacks();
+        expect(delivered.size() == 1 && delivered[0].method == "onIntEvent" && delivered[0].intValue == 6,
+               "mixed types conflated");
+
+        // Once delivered, the next value starts a new sum
+        recorder.clear();
+        bridge.postIntEvent("sum", 3);
+        bridge.processEvents();
+        delivered = recorder.callbacks();
+        expect(delivered.size() == 1 && delivered[0].intValue == 3, "new sum after delivery");
+
+        // A RATE_LIMIT without a budget would drop everything; it is refused instead
+        recorder.clear();
+        bridge.setDeliveryPolicy("latest", DeliveryPolicy::RATE_LIMIT, 0);
+        bridge.postStringEvent("latest", "kept");
+        bridge.postStringEvent("latest", "conflated");
+        bridge.processEvents();
+        delivered = recorder.callbacks();
+        expect(delivered.size() == 1 && delivered[0].stringValue == "conflated", "zero rate limit refused");
+
+        bridge.cleanup();
+    }
+
+    void testRateLimit(bool dispatcher) {
+        FakeJavaVM vm;
+        Recorder recorder(vm);
+        ThreadManager threadManager;
+        threadManager.initializeThreadPool(2);
+        IOBridge bridge;
+        bridge.initialize(&vm);
+        bridge.enableEncryption(false);
+        bridge.setThreadManager(&threadManager);
+        FakeListener listener;
+        bridge.registerListener(vm.attachCurrentThread(), &listener);
+        if (dispatcher) {
+            bridge.startDispatcher();
+        }
+
+        // Use up the budget and let it drain, so the events over it find nothing pending
+        bridge.setDeliveryPolicy("progress", DeliveryPolicy::RATE_LIMIT, 2);
+        int64_t windowStart = nowMs();
+        bridge.postIntEvent("progress", 1);
+        bridge.postIntEvent("progress", 2);
+        expect(recorder.waitForInt(2, 2000), "deliveries within the budget");
+        for (int i = 3; i <= 20; ++i) {
+            bridge.postIntEvent("progress", i);
+        }
+
+        expect(recorder.waitForInt(20, 3000), "last value over budget delivered");
+        std::vector<FakeCallback> delivered = recorder.callbacks();
+        expect(delivered.size() == 3 && delivered[0].intValue == 1 && delivered[1].intValue == 2,
+               "only the last value over budget delivered");
+        expect(recorder.timeOf(2) - windowStart >= 990, "last value waits for the next window");
+
+        // The held-back value used one delivery of the new window, leaving one
+        bridge.postIntEvent("progress", 21);
+        expect(recorder.waitForInt(21, 500), "new window delivers");
+        bridge.postIntEvent("progress", 22);
+        std::this_thread::sleep_for(std::chrono::milliseconds(200));
+        expect(recorder.callbacks().size() == 4, "new window keeps the budget");
+
+        bridge.cleanup();
+        threadManager.shutdownThreadPool();
+    }
+
+    void postBuffer(IOBridge& bridge, size_t length, uint8_t fill) {
+        uint8_t* buffer = bridge.acquireBuffer(length);
+        std::memset(buffer, fill, length);
+        bridge.postByteArrayBuffer("image", buffer, length);
+    }
+
+    void testLentBuffers() {
+        const size_t length = 64 * 1024;
+        FakeJavaVM vm;
+        IOBridge bridge;
+        bridge.initialize(&vm);
+        bridge.enableEncryption(false);
+        FakeListener listener;
+        bridge.registerListener(vm.attachCurrentThread(), &listener);
+
+        int64_t handle = 0;
+        const uint8_t* lent = nullptr;
+        bool intact = false;
+        bool throwing = false;
+        vm.setCallbackHandler([&](const FakeCallback& callback) {
+            handle = callback.bufferHandle;
+            lent = callback.bytes;
+            intact = callback.method == "onByteBufferEvent" && callback.length == length &&
+                     callback.bytes[0] == 0x42 && callback.bytes[length - 1] == 0x42;
+            if (throwing) {
+                vm.throwException();
+            }
+        });
+
+        postBuffer(bridge, length, 0x42);
+        bridge.processEvents();
+        expect(intact && handle != 0, "large payload lent as a direct buffer");
+        expect(bridge.releaseLentBuffer(handle), "handle releases");
+        expect(!bridge.releaseLentBuffer(handle), "repeated release rejected");
+        expect(bridge.acquireBuffer(length) == lent, "released buffer back in the pool");
+        bridge.releaseBuffer(const_cast<uint8_t*>(lent));
+
+        postBuffer(bridge, length, 0x42);
+        bridge.processEvents();
+        expect(!bridge.releaseLentBuffer(handle + (1LL << 32)) && !bridge.releaseLentBuffer(handle + 1) &&
+               !bridge.releaseLentBuffer(0) && !bridge.releaseLentBuffer(-1), "forged handles rejected");
+
+        // A handle from another bridge, e.g. one rebuilt after this one, matches none of its slots
+        IOBridge other;
+        other.initialize(&vm);
+        other.enableEncryption(false);
+        other.registerListener(vm.attachCurrentThread(), &listener);
+        int64_t ownHandle = handle;
+        postBuffer(other, length, 0x42);
+        other.processEvents();
+        expect(!other.releaseLentBuffer(ownHandle) && other.releaseLentBuffer(handle), "other bridge's handle rejected");
+        expect(bridge.releaseLentBuffer(ownHandle), "own handle still releases");
+        other.cleanup();
+
+        // The listener throws without releasing: the bridge takes the buffer back
+        throwing = true;
+        postBuffer(bridge, length, 0x42);
+        bridge.processEvents();
+        expect(intact && !bridge.releaseLentBuffer(handle), "buffer reclaimed after the listener threw");
+        expect(bridge.acquireBuffer(length) == lent, "reclaimed buffer back in the pool");
+        bridge.releaseBuffer(const_cast<uint8_t*>(lent));
+
+        bridge.cleanup();
+    }
+}
+
+int main() {
+    testConflateAndCoalesce();
+    testLentBuffers();
+    testRateLimit(false);
+    testRateLimit(true);
+    return finishTest("io bridge");
+}
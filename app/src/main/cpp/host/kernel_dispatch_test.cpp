@@ -0,0 +1,174 @@
+// Kernel dispatch: every variant this CPU supports, in every family, must produce the
+// same output as the portable one, and the dispatcher must bind the best variant by
+// default and refuse unknown or unsupported ones. Also checks CRC-32C against known values.
+//
+// Usage: kernel_dispatch_test
+
+#include "kernel_dispatch.h"
+#include "base64_codec.h"
+#include "bulk_copy.h"
+#include "chacha20_poly1305.h"
+#include "checksum.h"
+#include "message_encryption.h"
+#include "test_support.h"
+#include <cstdio>
+#include <cstring>
+#include <functional>
+#include <string>
+#include <vector>
+
+namespace {
+    std::vector<uint8_t> makeData(size_t length, uint32_t seed) {
+        std::vector<uint8_t> data(length);
+        for (size_t i = 0; i < length; ++i) {
+            seed = seed * 1664525u + 1013904223u;
+            data[i] = static_cast<uint8_t>(seed >> 24);
+        }
+        return data;
+    }
+
+    void append(std::vector<uint8_t>& out, const void* data, size_t length) {
+        const uint8_t* bytes = static_cast<const uint8_t*>(data);
+        out.insert(out.end(), bytes, bytes + length);
+    }
+
+    // Lengths straddling every vector width and unrolled group
+    const size_t LENGTHS[] = {0, 1, 3, 4, 7, 8, 15, 16, 17, 31, 32, 33, 63, 64, 65, 127, 128, 129, 255, 256, 1000, 4099};
+
+    /**
+     * Run the family's workload under every supported variant and compare each result
+     * with the last, most portable variant
+     */
+    void checkFamily(const char* name, const std::function<std::vector<uint8_t>()>& workload) {
+        KernelFamily* family = findKernelFamily(name);
+        expect(family != nullptr, "family registered");
+        if (family == nullptr) {
+            return;
+        }
+
+        std::vector<const char*> variants = family->supportedVariants();
+        expect(!variants.empty(), "portable variant always supported");
+        if (variants.empty()) {
+            return;
+        }
+
+        expect(family->select(variants.back()), "select portable variant");
+        std::vector<uint8_t> reference = workload();
+        for (const char* variant : variants) {
+            expect(family->select(variant) && std::strcmp(family->activeName(), variant) == 0, "select variant");
+            if (workload() != reference) {
+                std::fprintf(stderr, "FAIL: %s variant %s differs from %s\n", name, variant, variants.back());
+                failures++;
+            }
+        }
+
+        expect(!family->select("no-such-variant"), "unknown variant refused");
+        expect(family->select(nullptr) && std::strcmp(family->activeName(), variants.front()) == 0,
+               "best variant restored");
+        std::printf("%-9s %s (available:", name, family->activeName());
+        for (const char* variant : variants) {
+            std::printf(" %s", variant);
+        }
+        std::printf(")\n");
+    }
+
+    std::vector<uint8_t> base64Workload() {
+        std::vector<uint8_t> out;
+        for (size_t length : LENGTHS) {
+            std::vector<uint8_t> data = makeData(length, static_cast<uint32_t>(length));
+            std::vector<char> encoded(base64EncodedLength(length));
+            base64Encode(data.data(), length, encoded.data());
+            append(out, encoded.data(), encoded.size());
+
+            std::vector<uint8_t> decoded(base64DecodedMaxLength(encoded.size()));
+            size_t written = base64Decode(encoded.data(), encoded.size(), decoded.data());
+            expect(written == length && std::equal(data.begin(), data.end(), decoded.begin()), "base64 round trip");
+        }
+        return out;
+    }
+
+    std::vector<uint8_t> xorWorkload() {
+        std::vector<uint8_t> out;
+        for (size_t length : LENGTHS) {
+            std::vector<uint8_t> data = makeData(length, static_cast<uint32_t>(length) + 1);
+            std::vector<uint8_t> encrypted(requiredSize(length, PayloadEncoding::BINARY));
+            size_t written = 0;
+            encryptInto(data, encrypted, written, PayloadEncoding::BINARY);
+            append(out, encrypted.data(), written);
+        }
+        return out;
+    }
+
+    std::vector<uint8_t> chacha20Workload() {
+        std::vector<uint8_t> key = makeData(CHACHA20_KEY_SIZE, 7);
+        std::vector<uint8_t> nonce = makeData(CHACHA20_NONCE_SIZE, 8);
+        std::vector<uint8_t> out;
+        for (size_t length : {1, 64, 65, 255, 256, 257, 511, 512, 1000, 4099}) {
+            std::vector<uint8_t> data = makeData(length, static_cast<uint32_t>(length) + 2);
+            chacha20Xor(key.data(), nonce.data(), 1, data.data(), data.data(), length);
+            append(out, data.data(), length);
+        }
+        return out;
+    }
+
+    std::vector<uint8_t> checksumWorkload() {
+        const char* check = "123456789";
+        expect(crc32c(reinterpret_cast<const uint8_t*>(check), 9) == 0xE3069283, "CRC-32C check value");
+        std::vector<uint8_t> zeros(32, 0);
+        expect(crc32c(zeros.data(), zeros.size()) == 0x8A9136AA, "CRC-32C of 32 zero bytes");
+
+        std::vector<uint8_t> out;
+        std::vector<uint8_t> data = makeData(5000, 3);
+        for (size_t length : LENGTHS) {
+            // Every alignment of the start, and a stream split in two must match one call
+            for (size_t offset = 0; offset < 8; ++offset) {
+                uint32_t whole = crc32c(data.data() + offset, length);
+                uint32_t split = crc32c(data.data() + offset + length / 3, length - length / 3,
+                                        crc32c(data.data() + offset, length / 3));
+                expect(whole == split, "CRC-32C continuation");
+                append(out, &whole, sizeof(whole));
+            }
+        }
+        return out;
+    }
+
+    std::vector<uint8_t> copyWorkload() {
+        std::vector<uint8_t> out;
+        for (size_t length : {BULK_COPY_STREAM_THRESHOLD - 1, BULK_COPY_STREAM_THRESHOLD,
+                              BULK_COPY_STREAM_THRESHOLD + 77, 3 * BULK_COPY_STREAM_THRESHOLD + 5}) {
+            std::vector<uint8_t> data = makeData(length, static_cast<uint32_t>(length));
+            for (size_t offset : {0, 1, 13}) {
+                std::vector<uint8_t> destination(length + offset + 1, 0xEE);
+                bulkCopy(destination.data() + offset, data.data(), length);
+                expect(std::equal(data.begin(), data.end(), destination.begin() + offset) &&
+                       destination[offset + length] == 0xEE && (offset == 0 || destination[offset - 1] == 0xEE),
+                       "bulk copy stays in bounds");
+                out.push_back(destination[offset + length / 2]);
+            }
+        }
+        return out;
+    }
+}
+
+int main() {
+    initKernelDispatch();
+    std::string report = kernelDiagnostics();
+    std::printf("%s\n", report.c_str());
+    expect(report.compare(0, 5, "cpu: ") == 0, "report lists cpu features");
+
+    std::vector<KernelFamily*> families = kernelFamilies();
+    expect(families.size() == 5, "five kernel families");
+    for (KernelFamily* family : families) {
+        expect(report.find(std::string(family->name()) + "=" + family->activeName()) != std::string::npos,
+               "report names each bound variant");
+    }
+    expect(findKernelFamily("no-such-family") == nullptr, "unknown family");
+
+    checkFamily("base64", base64Workload);
+    checkFamily("xor", xorWorkload);
+    checkFamily("chacha20", chacha20Workload);
+    checkFamily("checksum", checksumWorkload);
+    checkFamily("copy", copyWorkload);
+
+    return finishTest("kernel dispatch");
+}
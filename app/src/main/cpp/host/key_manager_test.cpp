@@ -0,0 +1,280 @@
+// SHA-256, HMAC-SHA256 (RFC 4231) and HKDF (RFC 5869) known-answer tests, plus the
+// KeyManager session cache: determinism, hit counting, eviction and concurrent readers
+// racing writers over more sessions than there are cache slots.
+//
+// Usage: key_manager_test
+
+#include "hkdf_sha256.h"
+#include "key_manager.h"
+#include "blob_storage.h"
+#include "test_support.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+namespace {
+    std::vector<uint8_t> fromHex(const char* hex) {
+        std::vector<uint8_t> bytes;
+        for (size_t i = 0; hex[i] != '\0' && hex[i + 1] != '\0'; i += 2) {
+            unsigned int value = 0;
+            std::sscanf(hex + i, "%2x", &value);
+            bytes.push_back(static_cast<uint8_t>(value));
+        }
+        return bytes;
+    }
+
+    std::vector<uint8_t> sequence(uint8_t first, size_t count) {
+        std::vector<uint8_t> bytes(count);
+        for (size_t i = 0; i < count; ++i) {
+            bytes[i] = static_cast<uint8_t>(first + i);
+        }
+        return bytes;
+    }
+
+    std::vector<uint8_t> bytesOf(const char* text) {
+        return std::vector<uint8_t>(text, text + std::strlen(text));
+    }
+
+    std::vector<uint8_t> sha256(const std::vector<uint8_t>& data, size_t piece) {
+        Sha256 hash;
+        for (size_t offset = 0; offset < data.size(); offset += piece) {
+            hash.update(data.data() + offset, std::min(piece, data.size() - offset));
+        }
+        std::vector<uint8_t> digest(SHA256_DIGEST_SIZE);
+        hash.finish(digest.data());
+        return digest;
+    }
+
+    void testSha256() {
+        struct Vector {
+            std::vector<uint8_t> message;
+            const char* digest;
+        };
+        const Vector vectors[] = {
+            {bytesOf(""), "e3b0c44298fc1c149afbf4c8996fb92427ae41e4649b934ca495991b7852b855"},
+            {bytesOf("abc"), "ba7816bf8f01cfea414140de5dae2223b00361a396177a9cb410ff61f20015ad"},
+            {bytesOf("abcdbcdecdefdefgefghfghighijhijkijkljklmklmnlmnomnopnopq"),
+             "248d6a61d20638b8e5c026930c3e6039a33ce45964ff2167f6ecedd419db06c1"},
+            {std::vector<uint8_t>(1000000, 'a'), "cdc76e5c9914fb9281a1c7e284d73e67f1809a48a497200e046d39ccc7112cd0"},
+        };
+        for (const Vector& vector : vectors) {
+            for (size_t piece : {1, 63, 64, 65, 1 << 20}) {
+                if (piece == 1 && vector.message.size() > 1000) {
+                    continue;
+                }
+                expect(sha256(vector.message, piece) == fromHex(vector.digest), "SHA-256 digest");
+            }
+        }
+    }
+
+    void testHmac() {
+        struct Vector {
+            std::vector<uint8_t> key;
+            std::vector<uint8_t> data;
+            const char* mac;
+        };
+        // RFC 4231 test cases 1, 2, 4 and 6
+        const Vector vectors[] = {
+            {std::vector<uint8_t>(20, 0x0b), bytesOf("Hi There"),
+             "b0344c61d8db38535ca8afceaf0bf12b881dc200c9833da726e9376c2e32cff7"},
+            {bytesOf("Jefe"), bytesOf("what do ya want for nothing?"),
+             "5bdcc146bf60754e6a042426089575c75a003f089d2739839dec58b964ec3843"},
+            {sequence(0x01, 25), std::vector<uint8_t>(50, 0xcd),
+             "82558a389a443c0ea4cc819899f2083a85f0faa3e578f8077a2e3ff46729665b"},
+            {std::vector<uint8_t>(131, 0xaa), bytesOf("Test Using Larger Than Block-Size Key - Hash Key First"),
+             "60e431591ee0b67f0d8a26aacbf5b77f8e0bc6213728c5140546040f0ee37f54"},
+        };
+        for (const Vector& vector : vectors) {
+            HmacSha256 hmac(vector.key.data(), vector.key.size());
+            std::vector<uint8_t> mac(SHA256_DIGEST_SIZE);
+            hmac.compute(vector.data.data(), vector.data.size(), mac.data());
+            expect(mac == fromHex(vector.mac), "HMAC-SHA256");
+
+            // The precomputed pads are reusable
+            std::fill(mac.begin(), mac.end(), 0);
+            hmac.compute(vector.data.data(), vector.data.size(), mac.data());
+            expect(mac == fromHex(vector.mac), "HMAC-SHA256 reused");
+        }
+    }
+
+    void testHkdf() {
+        struct Vector {
+            std::vector<uint8_t> ikm;
+            std::vector<uint8_t> salt;
+            std::vector<uint8_t> info;
+            const char* prk;
+            const char* okm;
+        };
+        // RFC 5869 test cases 1-3
+        const Vector vectors[] = {
+            {std::vector<uint8_t>(22, 0x0b), sequence(0x00, 13), sequence(0xf0, 10),
+             "077709362c2e32df0ddc3f0dc47bba6390b6c73bb50f9c3122ec844ad7c2b3e5",
+             "3cb25f25faacd57a90434f64d0362f2a2d2d0a90cf1a5a4c5db02d56ecc4c5bf34007208d5b887185865"},
+            {sequence(0x00, 80), sequence(0x60, 80), sequence(0xb0, 80),
+             "06a6b88c5853361a06104c9ceb35b45cef760014904671014a193f40c15fc244",
+             "b11e398dc80327a1c8e7f78c596a49344f012eda2d4efad8a050cc4c19afa97c"
+             "59045a99cac7827271cb41c65e590e09da3275600c2f09b8367793a9aca3db71"
+             "cc30c58179ec3e87c14c01d5c1f3434f1d87"},
+            {std::vector<uint8_t>(22, 0x0b), {}, {},
+             "19ef24a32c717b167f33a91d6f648bdf96596776afdb6377ac434c1c293ccb04",
+             "8da4e775a563c18f715f802a063c5a31b8a11f5c5ee1879ec3454e5f3c738d2d9d201395faa4b61a96c8"},
+        };
+        for (const Vector& vector : vectors) {
+            std::vector<uint8_t> prk(SHA256_DIGEST_SIZE);
+            hkdfExtract(vector.salt.data(), vector.salt.size(), vector.ikm.data(), vector.ikm.size(), prk.data());
+            expect(prk == fromHex(vector.prk), "HKDF-Extract");
+
+            std::vector<uint8_t> expected = fromHex(vector.okm);
+            std::vector<uint8_t> okm(expected.size());
+            expect(hkdf(vector.salt.data(), vector.salt.size(), vector.ikm.data(), vector.ikm.size(),
+                        vector.info.data(), vector.info.size(), okm.data(), okm.size()) && okm == expected, "HKDF");
+        }
+
+        std::vector<uint8_t> tooLong(255 * SHA256_DIGEST_SIZE + 1);
+        uint8_t ikm[32] = {};
+        expect(!hkdf(nullptr, 0, ikm, sizeof(ikm), nullptr, 0, tooLong.data(), tooLong.size()),
+               "HKDF output limit");
+    }
+
+    std::vector<uint8_t> keyOf(KeyManager& manager, uint64_t sessionId) {
+        SessionKey key;
+        manager.sessionKey(sessionId, key);
+        expect(key.sessionId == sessionId, "session id reported");
+        return std::vector<uint8_t>(key.key, key.key + sizeof(key.key));
+    }
+
+    void testKeyManager() {
+        std::vector<uint8_t> secret = sequence(0x40, 32);
+        KeyManager manager(secret);
+        KeyManager same(secret);
+        KeyManager other(sequence(0x41, 32));
+
+        std::vector<uint8_t> first = keyOf(manager, 1);
+        expect(manager.derivationCount() == 1, "first lookup derives");
+        expect(keyOf(manager, 1) == first && manager.derivationCount() == 1, "second lookup hits the cache");
+        expect(keyOf(same, 1) == first, "same secret, same key");
+        expect(keyOf(other, 1) != first, "different secret, different key");
+        expect(keyOf(manager, 2) != first, "different session, different key");
+
+        std::unique_ptr<KeyManager> random = KeyManager::createRandom();
+        std::unique_ptr<KeyManager> random2 = KeyManager::createRandom();
+        expect(random != nullptr && random2 != nullptr && keyOf(*random, 1) != keyOf(*random2, 1),
+               "random master secrets differ");
+
+        expect(KeyManager::sessionIdFor("/data/a.bin") == KeyManager::sessionIdFor("/data/a.bin") &&
+               KeyManager::sessionIdFor("/data/a.bin") != KeyManager::sessionIdFor("/data/b.bin"),
+               "session ids from names");
+
+        // Many more sessions than slots: evicted ones are derived again, to the same key
+        KeyManager reference(secret);
+        std::vector<std::vector<uint8_t>> expected;
+        const uint64_t sessions = KeyManager::CACHE_SLOTS * 8;
+        for (uint64_t id = 0; id < sessions; ++id) {
+            expected.push_back(keyOf(reference, id * 7919));
+        }
+        for (int pass = 0; pass < 2; ++pass) {
+            bool allMatch = true;
+            for (uint64_t id = 0; id < sessions; ++id) {
+                allMatch = allMatch && keyOf(reference, id * 7919) == expected[id];
+            }
+            expect(allMatch, "keys stable across eviction");
+        }
+
+        // A working set that fits stays cached
+        KeyManager small(secret);
+        for (int pass = 0; pass < 4; ++pass) {
+            for (uint64_t id = 0; id < 16; ++id) {
+                keyOf(small, id);
+            }
+        }
+        expect(small.derivationCount() < 32, "small working set stays cached");
+    }
+
+    void testConcurrentLookups() {
+        std::vector<uint8_t> secret = sequence(0x10, 32);
+        KeyManager reference(secret);
+        const uint64_t sessions = KeyManager::CACHE_SLOTS * 4;
+        std::vector<std::vector<uint8_t>> expected;
+        for (uint64_t id = 0; id < sessions; ++id) {
+            expected.push_back(keyOf(reference, id));
+        }
+
+        KeyManager shared(secret);
+        std::vector<int> mismatches(4, 0);
+        std::vector<std::thread> threads;
+        for (int t = 0; t < 4; ++t) {
+            threads.emplace_back([&, t]() {
+                for (int i = 0; i < 20000; ++i) {
+                    uint64_t id = static_cast<uint64_t>(i * 31 + t * 17) % sessions;
+                    SessionKey key;
+                    shared.sessionKey(id, key);
+                    if (!std::equal(expected[id].begin(), expected[id].end(), key.key)) {
+                        mismatches[t]++;
+                    }
+                }
+            });
+        }
+        for (std::thread& thread : threads) {
+            thread.join();
+        }
+        int total = 0;
+        for (int count : mismatches) {
+            total += count;
+        }
+        expect(total == 0, "concurrent lookups return the derived key");
+    }
+
+    void testBlobStorage() {
+        std::string directory = makeTempDirectory("key_manager_test");
+        if (directory.empty()) {
+            return;
+        }
+        std::string pathA = directory + "/a.bin";
+        std::string pathB = directory + "/b.bin";
+        std::vector<uint8_t> payload = sequence(0x20, 200);
+        std::vector<uint8_t> loaded;
+
+        std::unique_ptr<KeyManager> manager = KeyManager::createRandom();
+        if (manager == nullptr) {
+            expect(false, "random key manager");
+            rmdir(directory.c_str());
+            return;
+        }
+        BlobStorage storage;
+        storage.setKeyManager(manager.get());
+        expect(storage.saveMessages(pathA, payload.data(), payload.size()) &&
+               storage.saveMessages(pathB, payload.data(), payload.size()), "save with per-file keys");
+        expect(storage.loadMessages(pathA, loaded) && loaded == payload, "load with per-file key");
+
+        // Each file is sealed under its own key, so swapping them fails authentication
+        std::rename(pathB.c_str(), pathA.c_str());
+        expect(!storage.loadMessages(pathA, loaded) && loaded.empty(), "file key bound to path");
+
+        // Plaintext files from before encryption still load
+        storage.setKeyManager(nullptr);
+        storage.saveMessages(pathB, payload.data(), payload.size());
+        storage.setKeyManager(manager.get());
+        expect(storage.loadMessages(pathB, loaded) && loaded == payload, "plaintext file loads");
+
+        storage.clearMessages(pathA);
+        storage.clearMessages(pathB);
+        rmdir(directory.c_str());
+    }
+}
+
+int main() {
+    testSha256();
+    testHmac();
+    testHkdf();
+    testKeyManager();
+    testConcurrentLookups();
+    testBlobStorage();
+
+    return finishTest("key manager");
+}
@@ -0,0 +1,198 @@
+// Message cache: least recently used eviction within the capacity, stamps that no longer
+// match, loads racing an invalidation, and BlobStorage serving repeated loads, views and
+// size queries from memory while noticing its own writes and files replaced by others.
+//
+// Usage: message_cache_test
+
+#include "message_cache.h"
+#include "blob_storage.h"
+#include "message_codec.h"
+#include "message_log.h"
+#include "test_support.h"
+#include <cstdio>
+#include <string>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+namespace {
+    std::vector<uint8_t> messageBatch(int first, int count) {
+        std::vector<uint8_t> batch;
+        MessageBatchWriter writer(batch);
+        for (int i = first; i < first + count; ++i) {
+            writer.add("Message " + std::to_string(i), i % 2 == 0, 0, 1700000000000LL + i * 1000LL);
+        }
+        return batch;
+    }
+
+    std::shared_ptr<const std::vector<uint8_t>> bytes(size_t size, uint8_t value) {
+        return std::make_shared<const std::vector<uint8_t>>(size, value);
+    }
+
+    StorageStamp stampOf(uint64_t size) {
+        StorageStamp stamp;
+        stamp.snapshotExists = true;
+        stamp.snapshot.inode = 7;
+        stamp.snapshot.size = size;
+        stamp.snapshot.mtimeNs = 1000;
+        stamp.snapshot.regular = true;
+        return stamp;
+    }
+
+    void testCache() {
+        MessageCache disabled;
+        disabled.store("a", stampOf(1), bytes(10, 1), disabled.generation());
+        StorageStamp stamp;
+        expect(!disabled.find("a", stampOf(1)) && !disabled.findStamp("a", stamp), "capacity 0 caches nothing");
+
+        // Room for two entries of 1000 bytes but not three
+        MessageCache cache(2 * 1000 + 2 * 300);
+        cache.store("a", stampOf(1), bytes(1000, 1), cache.generation());
+        cache.store("b", stampOf(2), bytes(1000, 2), cache.generation());
+        expect(cache.find("a", stampOf(1)) != nullptr, "entry found");
+        cache.store("c", stampOf(3), bytes(1000, 3), cache.generation());
+        expect(cache.find("a", stampOf(1)) && cache.find("c", stampOf(3)) && !cache.findStamp("b", stamp),
+               "least recently used entry evicted");
+        expect(cache.hitCount() == 3 && cache.size() <= cache.capacity(), "hits counted within capacity");
+
+        expect(!cache.find("a", stampOf(5)) && !cache.findStamp("a", stamp), "changed files dropped");
+
+        uint64_t generation = cache.generation();
+        cache.invalidate("other");
+        cache.store("d", stampOf(4), bytes(10, 4), generation);
+        expect(!cache.findStamp("d", stamp), "load racing a write not cached");
+
+        cache.store("big", stampOf(9), bytes(10000, 9), cache.generation());
+        expect(!cache.find("big", stampOf(9)) && cache.findStamp("big", stamp) && stamp == stampOf(9),
+               "oversized messages leave the stamp");
+        cache.store("c", stampOf(3), nullptr, cache.generation());
+        expect(cache.find("c", stampOf(3)) != nullptr, "stamp refresh keeps the messages");
+
+        cache.setCapacity(1000);
+        expect(cache.size() <= 1000 && !cache.find("c", stampOf(3)), "smaller capacity evicts");
+        cache.clear();
+        expect(cache.size() == 0 && !cache.findStamp("big", stamp), "clear empties the cache");
+
+        expect(readStorageStamp("/nonexistent/messages.blob", stamp) && !stamp.snapshotExists &&
+               stamp.segments.empty(), "missing files stamped as absent");
+    }
+
+    void testStorage(const std::string& path) {
+        uint8_t key[32];
+        for (int i = 0; i < 32; ++i) {
+            key[i] = static_cast<uint8_t>(i * 3);
+        }
+        BlobStorage storage;
+        storage.setEncryptionKey(key);
+        storage.setCompression(true);
+        storage.setCacheCapacity(16 * 1024 * 1024);
+
+        std::vector<uint8_t> snapshot = messageBatch(0, 2000);
+        std::vector<uint8_t> loaded;
+        expect(storage.saveMessages(path, snapshot.data(), snapshot.size()), "save");
+        expect(storage.loadMessages(path, loaded) && loaded == snapshot && storage.cacheHitCount() == 0, "first load reads");
+        expect(storage.loadMessages(path, loaded) && loaded == snapshot && storage.cacheHitCount() == 1, "second load cached");
+        MessageView view;
+        expect(storage.viewMessages(path, view) && !view.isMapped() && storage.cacheHitCount() == 2 &&
+               std::vector<uint8_t>(view.bytes().begin(), view.bytes().end()) == snapshot, "view shares the cache");
+
+        // Our own writes invalidate; the view keeps the bytes it was given
+        std::vector<uint8_t> batch = messageBatch(2000, 10);
+        expect(storage.appendMessages(path, batch.data(), batch.size()), "append");
+        expect(storage.loadMessages(path, loaded) && loaded == messageBatch(0, 2010) && storage.cacheHitCount() == 2,
+               "append invalidates");
+        expect(std::vector<uint8_t>(view.bytes().begin(), view.bytes().end()) == snapshot, "view outlives invalidation");
+        expect(storage.loadMessages(path, loaded) && storage.cacheHitCount() == 3, "reloaded after append");
+
+        // Size queries come from the stamp of the last load
+        int64_t size = storage.getStorageSize(path);
+        BlobStorage uncached;
+        uncached.setEncryptionKey(key);
+        expect(size > 0 && size == uncached.getStorageSize(path) && storage.hasMessages(path), "size from the stamp");
+
+        // Files replaced by someone else are noticed on load
+        std::vector<uint8_t> other = messageBatch(500, 30);
+        expect(uncached.saveMessages(path, other.data(), other.size()), "save elsewhere");
+        expect(storage.loadMessages(path, loaded) && loaded == other && storage.cacheHitCount() == 3,
+               "replaced file reloaded");
+        expect(storage.getStorageSize(path) == uncached.getStorageSize(path), "size follows the reload");
+
+        // A different key must not be served what the old one read
+        uint8_t otherKey[32] = {1};
+        storage.setEncryptionKey(otherKey);
+        expect(!storage.loadMessages(path, loaded), "key change clears the cache");
+        storage.setEncryptionKey(key);
+
+        expect(storage.clearMessages(path) && !storage.hasMessages(path) && storage.getStorageSize(path) == 0,
+               "clear invalidates");
+        expect(storage.loadMessages(path, loaded) && loaded.empty(), "cleared file loads empty");
+    }
+
+    void testSmallCapacity(const std::string& path) {
+        BlobStorage storage;
+        storage.setCompression(true);
+        storage.setCacheCapacity(4096);
+        std::vector<uint8_t> snapshot = messageBatch(0, 2000);
+        std::vector<uint8_t> loaded;
+        storage.saveMessages(path, snapshot.data(), snapshot.size());
+        expect(storage.loadMessages(path, loaded) && storage.loadMessages(path, loaded) && loaded == snapshot &&
+               storage.cacheHitCount() == 0, "file larger than the cache read every time");
+        storage.clearMessages(path);
+    }
+
+    void testConcurrentLoads(const std::string& path) {
+        BlobStorage storage;
+        storage.setPayloadEncoding(PayloadEncoding::BASE64);
+        storage.setCacheCapacity(16 * 1024 * 1024);
+        std::vector<uint8_t> snapshot = messageBatch(0, 100);
+        storage.saveMessages(path, snapshot.data(), snapshot.size());
+
+        const int appends = 40;
+        std::thread writer([&storage, &path]() {
+            for (int i = 0; i < appends; ++i) {
+                std::vector<uint8_t> batch = messageBatch(100 + i, 1);
+                storage.appendMessages(path, batch.data(), batch.size());
+            }
+        });
+        std::vector<std::thread> readers;
+        for (int r = 0; r < 3; ++r) {
+            readers.emplace_back([&storage, &path]() {
+                std::vector<uint8_t> loaded;
+                uint32_t previous = 0;
+                for (int i = 0; i < 50; ++i) {
+                    uint32_t count = 0;
+                    if (!storage.loadMessages(path, loaded) || !readMessageCount(loaded, count) || count < previous ||
+                        loaded != messageBatch(0, static_cast<int>(count))) {
+                        std::fprintf(stderr, "FAIL: load during appends\n");
+                        failures++;
+                        return;
+                    }
+                    previous = count;
+                }
+            });
+        }
+        writer.join();
+        for (std::thread& reader : readers) {
+            reader.join();
+        }
+        std::vector<uint8_t> loaded;
+        expect(storage.loadMessages(path, loaded) && loaded == messageBatch(0, 100 + appends), "final load current");
+        storage.clearMessages(path);
+    }
+}
+
+int main() {
+    std::string directory = makeTempDirectory("message_cache_test");
+    if (directory.empty()) {
+        return 1;
+    }
+    std::string path = directory + "/messages.blob";
+
+    testCache();
+    testStorage(path);
+    testSmallCapacity(path);
+    testConcurrentLoads(path);
+    rmdir(directory.c_str());
+
+    return finishTest("message cache");
+}
@@ -0,0 +1,138 @@
+// Message record codec: byte-exact agreement with the Kotlin (big-endian) and Swift
+// (little-endian) serializers, round trips through the writer and cursor, rejection of
+// truncated and forged batches at every length, and cursor seek/skip and selection.
+//
+// Usage: message_codec_test
+
+#include "message_codec.h"
+#include "test_support.h"
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+
+namespace {
+    std::string messageText(int i) {
+        // Mixed ASCII and multi-byte UTF-8, including an empty text
+        return i % 5 == 0 ? std::string() : "msg " + std::to_string(i) + " \xC3\xA9\xE2\x82\xAC" + std::string(static_cast<size_t>(i % 11), 'x');
+    }
+
+    std::vector<uint8_t> makeBatch(int count, MessageByteOrder order) {
+        std::vector<uint8_t> batch;
+        MessageBatchWriter writer(batch, order);
+        for (int i = 0; i < count; ++i) {
+            writer.add(messageText(i), i % 2 == 0, static_cast<uint8_t>(i % 4), 1700000000000LL + i * 1000LL - (i == 3 ? 1800000000000LL : 0));
+        }
+        return batch;
+    }
+
+    void testKnownBytes() {
+        // Message("hi", isSent = true, IMAGE, timestamp = 0x0102030405060708) as DataOutputStream writes it
+        const uint8_t kotlin[] = {0, 0, 0, 1, 0, 0, 0, 2, 'h', 'i', 1, 2, 1, 2, 3, 4, 5, 6, 7, 8};
+        const uint8_t swift[] = {1, 0, 0, 0, 2, 0, 0, 0, 'h', 'i', 1, 2, 8, 7, 6, 5, 4, 3, 2, 1};
+        for (MessageByteOrder order : {MessageByteOrder::BIG, MessageByteOrder::LITTLE}) {
+            const uint8_t* expected = order == MessageByteOrder::BIG ? kotlin : swift;
+            std::vector<uint8_t> batch;
+            MessageBatchWriter writer(batch, order);
+            writer.add("hi", true, static_cast<uint8_t>(MessageType::IMAGE), 0x0102030405060708LL);
+            expect(batch.size() == sizeof(kotlin) && std::memcmp(batch.data(), expected, batch.size()) == 0,
+                   "writer matches the managed serializers");
+
+            std::vector<MessageRecordView> records;
+            expect(decodeMessages(ConstByteSpan(expected, sizeof(kotlin)), records, order) && records.size() == 1 &&
+                   records[0].text == "hi" && records[0].isSent && records[0].type == 2 &&
+                   records[0].timestamp == 0x0102030405060708LL && records[0].offset == MESSAGE_COUNT_SIZE,
+                   "decode the managed serializers' output");
+        }
+    }
+
+    void testRoundTrip() {
+        for (MessageByteOrder order : {MessageByteOrder::BIG, MessageByteOrder::LITTLE}) {
+            for (int count : {0, 1, 2, 50}) {
+                std::vector<uint8_t> batch = makeBatch(count, order);
+                std::vector<MessageRecordView> records;
+                bool decoded = decodeMessages(batch, records, order);
+                expect(decoded && records.size() == static_cast<size_t>(count), "round trip count");
+                for (size_t i = 0; decoded && i < records.size(); ++i) {
+                    int n = static_cast<int>(i);
+                    expect(records[i].text == messageText(n) && records[i].isSent == (n % 2 == 0) &&
+                           records[i].type == n % 4 &&
+                           records[i].timestamp == 1700000000000LL + n * 1000LL - (n == 3 ? 1800000000000LL : 0),
+                           "round trip fields");
+                    // Views point into the batch instead of copying it
+                    const char* begin = reinterpret_cast<const char*>(batch.data());
+                    expect(records[i].text.data() >= begin && records[i].text.data() <= begin + batch.size(),
+                           "text is a view into the batch");
+                }
+            }
+        }
+    }
+
+    void testMalformed() {
+        std::vector<uint8_t> batch = makeBatch(6, MessageByteOrder::BIG);
+        std::vector<MessageRecordView> records;
+
+        // Every truncation is caught, after the records that fit
+        for (size_t length = 0; length < batch.size(); ++length) {
+            bool decoded = decodeMessages(ConstByteSpan(batch.data(), length), records);
+            if (decoded) {
+                std::fprintf(stderr, "FAIL: truncated batch of %zu bytes accepted\n", length);
+                failures++;
+            }
+        }
+
+        // A text length running past the end, or negative
+        std::vector<uint8_t> forged = batch;
+        forged[4] = 0x7F;
+        expect(!decodeMessages(forged, records) && records.empty(), "oversized text length rejected");
+        forged[4] = 0xFF;
+        expect(!decodeMessages(forged, records), "negative text length rejected");
+
+        // A count larger than the records present, and a negative one
+        forged = batch;
+        writeMessageCount(forged, 7);
+        expect(!decodeMessages(forged, records) && records.size() == 6, "count beyond records rejected");
+        writeMessageCount(forged, 0x7FFFFFFF);
+        expect(!decodeMessages(forged, records) && records.size() == 6, "forged count rejected");
+        forged[0] = 0x80;
+        uint32_t count = 0;
+        expect(!readMessageCount(forged, count) && !decodeMessages(forged, records), "negative count rejected");
+    }
+
+    void testCursor() {
+        std::vector<uint8_t> batch = makeBatch(30, MessageByteOrder::BIG);
+        MessageCursor cursor(batch);
+        expect(cursor.count() == 30 && !cursor.atEnd(), "cursor count");
+        expect(cursor.skip(10) && cursor.index() == 10, "skip");
+        size_t offset = cursor.offset();
+
+        MessageRecordView record;
+        expect(cursor.next(record) && record.text == messageText(10) && record.offset == offset, "next after skip");
+        expect(!cursor.skip(25) && cursor.atEnd() && !cursor.failed(), "skip stops at the end");
+        expect(!cursor.next(record) && !cursor.failed(), "end is not an error");
+
+        // Resume from a saved position, as an index would
+        MessageCursor resumed(batch);
+        expect(resumed.seek(offset, 10) && resumed.next(record) && record.text == messageText(10), "seek");
+        expect(!resumed.seek(batch.size() + 1, 0) && !resumed.seek(offset, 31), "seek outside refused");
+
+        // Select the sent messages, copying their records as they are
+        std::vector<uint8_t> selected;
+        expect(selectMessages(batch, [](const MessageRecordView& r) { return r.isSent; }, selected),
+               "select");
+        std::vector<MessageRecordView> records;
+        expect(decodeMessages(selected, records) && records.size() == 15, "selected count");
+        for (size_t i = 0; i < records.size(); ++i) {
+            expect(records[i].isSent && records[i].text == messageText(static_cast<int>(2 * i)), "selected records");
+        }
+    }
+}
+
+int main() {
+    testKnownBytes();
+    testRoundTrip();
+    testMalformed();
+    testCursor();
+
+    return finishTest("message codec");
+}
@@ -0,0 +1,169 @@
+// XOR message cipher against the byte-at-a-time cipher it replaced, under every keystream
+// kernel variant the host supports: both encodings at lengths around the key and vector
+// widths, and bare base64 ciphertext from before the header byte, including wrapped lines
+// and junk characters. The span API writes exactly what the string API returns, in place or
+// not, and refuses buffers that are too small or inputs it cannot encode without writing.
+//
+// Usage: message_encryption_test
+
+#include "message_encryption.h"
+#include "base64_codec.h"
+#include "kernel_dispatch.h"
+#include "test_support.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <random>
+#include <string>
+#include <vector>
+
+namespace {
+    const std::string ENCRYPTION_KEY = "FluxorSecretKey2024!";
+
+    std::string referenceXor(const std::string& input) {
+        std::string output;
+        for (size_t i = 0; i < input.size(); ++i) {
+            output.push_back(static_cast<char>(input[i] ^ ENCRYPTION_KEY[i % ENCRYPTION_KEY.size()]));
+        }
+        return output;
+    }
+
+    std::string base64(const std::string& input) {
+        std::string output(base64EncodedLength(input.size()), '\0');
+        output.resize(base64Encode(reinterpret_cast<const uint8_t*>(input.data()), input.size(), &output[0]));
+        return output;
+    }
+
+    std::string randomText(std::mt19937& random, size_t size) {
+        std::string text(size, '\0');
+        for (char& c : text) {
+            c = static_cast<char>(random());
+        }
+        return text;
+    }
+
+    std::vector<size_t> testLengths() {
+        std::vector<size_t> lengths;
+        for (size_t length = 1; length <= 100; ++length) {
+            lengths.push_back(length);
+        }
+        for (size_t length : {127, 128, 129, 255, 256, 257, 1000, 4099, 1 << 20}) {
+            lengths.push_back(length);
+        }
+        return lengths;
+    }
+
+    void testAgainstReference(std::mt19937& random) {
+        expect(encryptMessage("").empty() && decryptMessage("").empty(), "empty message");
+        for (size_t length : testLengths()) {
+            std::string message = randomText(random, length);
+            std::string xored = referenceXor(message);
+
+            std::string asBase64 = encryptMessage(message, PayloadEncoding::BASE64);
+            std::string asBinary = encryptMessage(message, PayloadEncoding::BINARY);
+            expect(asBase64 == "#" + base64(xored), "base64 ciphertext matches the reference");
+            expect(asBinary == std::string(1, '\x01') + xored, "binary ciphertext matches the reference");
+            expect(decryptMessage(asBase64) == message && decryptMessage(asBinary) == message, "round trip");
+            expect(encryptMessage(message, PayloadEncoding::NONE).empty(), "NONE rejected");
+        }
+    }
+
+    void testLegacyCiphertext(std::mt19937& random) {
+        for (size_t length : testLengths()) {
+            std::string message = randomText(random, length);
+            std::string legacy = base64(referenceXor(message));
+            expect(decryptMessage(legacy) == message, "bare base64 ciphertext decrypts");
+
+            // Legacy text that went through a line-wrapping or whitespace-adding transport
+            std::string wrapped = legacy;
+            for (size_t at = 76; at < wrapped.size(); at += 77) {
+                wrapped.insert(at, "\n");
+            }
+            wrapped.insert(0, " ");
+            wrapped += "\r\n";
+            expect(decryptMessage(wrapped) == message, "wrapped bare base64 ciphertext decrypts");
+        }
+
+        // Bare base64 never starts with a header byte, so it is not mistaken for either encoding
+        std::string legacy = base64(referenceXor("hello"));
+        expect(legacy[0] != '#' && legacy[0] != '\x01' && decryptMessage(legacy) == "hello", "legacy detection");
+
+        // Junk or a misplaced '=' decodes as the original decoder did: up to the '='
+        std::string message = "The quick brown fox jumps over the lazy dog";
+        std::string text = base64(referenceXor(message));
+        std::string truncated = text.substr(0, 8) + "=" + text.substr(8);
+        expect(decryptMessage(truncated) == message.substr(0, 6), "misplaced '=' ends the message");
+        expect(decryptMessage("#" + text.substr(0, 4) + "!!" + text.substr(4)) == message, "junk skipped");
+    }
+
+    void testSpans(std::mt19937& random) {
+        for (size_t length : testLengths()) {
+            std::string message = randomText(random, length);
+            ConstByteSpan plaintext = asBytes(message);
+            for (PayloadEncoding encoding : {PayloadEncoding::BASE64, PayloadEncoding::BINARY}) {
+                std::string expected = encryptMessage(message, encoding);
+                expect(requiredSize(length, encoding) == expected.size(), "required size is exact");
+
+                std::vector<uint8_t> output(expected.size() + 1, 0xEE);
+                size_t written = 1;
+                expect(encryptInto(plaintext, ByteSpan(output.data(), output.size()), written, encoding) &&
+                       written == expected.size() && std::string(output.begin(), output.begin() +
+                       static_cast<long>(written)) == expected && output.back() == 0xEE, "encryptInto");
+
+                std::vector<uint8_t> small(expected.size() - 1, 0xEE);
+                expect(!encryptInto(plaintext, ByteSpan(small.data(), small.size()), written, encoding) &&
+                       written == 0 && small[0] == 0xEE, "encryptInto refuses a short buffer untouched");
+
+                std::vector<uint8_t> buffer(expected.size());
+                std::copy(message.begin(), message.end(), buffer.begin());
+                expect(encryptInPlace(ByteSpan(buffer.data(), buffer.size()), length, encoding) == expected.size() &&
+                       std::string(buffer.begin(), buffer.end()) == expected, "encryptInPlace");
+                expect(encryptInPlace(ByteSpan(buffer.data(), buffer.size() - 1), length, encoding) == 0,
+                       "encryptInPlace refuses a short buffer");
+
+                std::vector<uint8_t> decrypted(requiredDecryptSize(expected.size()));
+                expect(decryptInto(asBytes(expected), ByteSpan(decrypted.data(), decrypted.size()), written) &&
+                       std::string(decrypted.begin(), decrypted.begin() + static_cast<long>(written)) == message,
+                       "decryptInto");
+                expect(!decryptInto(asBytes(expected), ByteSpan(decrypted.data(), length / 2), written) &&
+                       written == 0, "decryptInto refuses a short buffer");
+                expect(decryptInPlace(ByteSpan(buffer.data(), buffer.size())) == length &&
+                       std::string(buffer.begin(), buffer.begin() + static_cast<long>(length)) == message,
+                       "decryptInPlace");
+            }
+
+            size_t written = 1;
+            std::vector<uint8_t> output(length + 8);
+            expect(!encryptInto(plaintext, ByteSpan(output.data(), output.size()), written, PayloadEncoding::NONE) &&
+                   written == 0, "encryptInto refuses NONE");
+        }
+
+        // Bare base64 decrypts in place, and headers without a body decrypt to nothing
+        std::string legacy = base64(referenceXor("legacy message"));
+        std::vector<uint8_t> buffer(legacy.begin(), legacy.end());
+        size_t length = decryptInPlace(ByteSpan(buffer.data(), buffer.size()));
+        expect(std::string(buffer.begin(), buffer.begin() + static_cast<long>(length)) == "legacy message",
+               "bare base64 decrypts in place");
+        for (const char* header : {"#", "\x01", "#=", "#====", "#!"}) {
+            std::vector<uint8_t> bytes(header, header + std::strlen(header));
+            expect(decryptInPlace(ByteSpan(bytes.data(), bytes.size())) == 0, "header without a body");
+        }
+    }
+}
+
+int main() {
+    KernelFamily& kernels = keystreamKernels();
+    for (const char* variant : kernels.supportedVariants()) {
+        expect(kernels.select(variant), "select variant");
+        std::mt19937 random(2024);
+        int before = failures;
+        testAgainstReference(random);
+        testLegacyCiphertext(random);
+        testSpans(random);
+        if (failures != before) {
+            std::fprintf(stderr, "FAIL: keystream variant %s\n", variant);
+        }
+    }
+    kernels.select(nullptr);
+    return finishTest("message encryption");
+}
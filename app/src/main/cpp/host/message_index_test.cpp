@@ -0,0 +1,222 @@
+// BlobStorage message index: ranges and latest pages match paging through a full load,
+// across a snapshot and several log segments, for plaintext and BINARY files and through
+// the full-load fallback for BASE64 and encrypted ones; the sidecar is reused by a fresh
+// instance, caught up after appends made elsewhere, and rebuilt when corrupt or stale.
+// Time range queries match filtering a full load, with timestamps out of order.
+//
+// Usage: message_index_test
+
+#include "blob_storage.h"
+#include "message_codec.h"
+#include "message_index.h"
+#include "test_support.h"
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <unistd.h>
+#include <vector>
+
+namespace {
+    /**
+     * Mostly increasing, with late arrivals and a stretch after the clock was set back
+     */
+    int64_t timestampOf(int i) {
+        int64_t timestamp = 1700000000000LL + i * 1000LL;
+        if (i % 37 == 5) {
+            timestamp -= 500000;
+        }
+        if (i >= 120 && i < 135) {
+            timestamp -= 3600000;
+        }
+        return timestamp;
+    }
+
+    std::vector<uint8_t> makeBatch(int first, int count) {
+        std::vector<uint8_t> batch;
+        MessageBatchWriter writer(batch);
+        for (int i = first; i < first + count; ++i) {
+            writer.add("message " + std::to_string(i) + std::string(static_cast<size_t>(i % 13), '.'), i % 2 == 0,
+                       static_cast<uint8_t>(i % 4), timestampOf(i));
+        }
+        return batch;
+    }
+
+    /**
+     * Messages first..first+count-1 of a full load, as a batch
+     */
+    std::vector<uint8_t> pageOf(BlobStorage& storage, const std::string& path, int64_t first, uint32_t count) {
+        std::vector<uint8_t> all;
+        std::vector<uint8_t> page;
+        storage.loadMessages(path, all);
+        MessageCursor cursor(all);
+        MessageBatchWriter writer(page);
+        uint32_t begin = first < 0 ? cursor.count() - std::min(cursor.count(), count) : static_cast<uint32_t>(first);
+        MessageRecordView record;
+        cursor.skip(begin);
+        while (writer.count() < count && cursor.next(record)) {
+            writer.add(record);
+        }
+        return page;
+    }
+
+    bool pagesMatch(BlobStorage& storage, const std::string& path, int total) {
+        bool ok = storage.countMessages(path) == total;
+        std::vector<uint8_t> page;
+        for (int first : {0, 1, total / 3, total - 7, total - 1, total, total + 5}) {
+            for (uint32_t count : {0u, 1u, 7u, 50u, 100000u}) {
+                ok = ok && storage.loadRange(path, static_cast<uint32_t>(first), count, page) &&
+                     page == pageOf(storage, path, first, count);
+            }
+        }
+        for (uint32_t count : {0u, 1u, 30u, 100000u}) {
+            ok = ok && storage.loadLatest(path, count, page) && page == pageOf(storage, path, -1, count);
+        }
+        return ok;
+    }
+
+    bool timesMatch(BlobStorage& storage, const std::string& path, int total) {
+        bool ok = true;
+        std::vector<uint8_t> all;
+        std::vector<uint8_t> page;
+        std::vector<uint8_t> expected;
+        storage.loadMessages(path, all);
+        for (int a : {-10, 0, 5, 42, 64, 100, 127, 128, 150, total - 1, total + 10}) {
+            for (int span : {0, 1, 30, 1000}) {
+                int64_t from = timestampOf(std::max(a, 0)) + (a < 0 ? a * 1000LL : 0);
+                int64_t to = from + span * 1000LL;
+                selectMessages(all, [from, to](const MessageRecordView& r) {
+                    return r.timestamp >= from && r.timestamp <= to;
+                }, expected);
+                ok = ok && storage.loadBetween(path, from, to, page) && page == expected;
+                selectMessages(all, [from](const MessageRecordView& r) { return r.timestamp >= from; }, expected);
+                ok = ok && storage.loadSince(path, from, page) && page == expected;
+            }
+        }
+        ok = ok && storage.loadBetween(path, 10, 5, page) && page == makeBatch(0, 0);
+        return ok;
+    }
+
+    /**
+     * Save 60 messages and append 140 more in small batches over several segments
+     */
+    void fill(BlobStorage& storage, const std::string& path) {
+        storage.setLogSegmentSize(1024);
+        std::vector<uint8_t> snapshot = makeBatch(0, 60);
+        storage.saveMessages(path, snapshot.data(), snapshot.size());
+        for (int i = 60; i < 200; i += 7) {
+            std::vector<uint8_t> batch = makeBatch(i, std::min(7, 200 - i));
+            storage.appendMessages(path, batch.data(), batch.size());
+        }
+    }
+
+    void testEncodings(const std::string& path) {
+        uint8_t key[32];
+        for (int i = 0; i < 32; ++i) {
+            key[i] = static_cast<uint8_t>(i * 5 + 3);
+        }
+        for (PayloadEncoding encoding : {PayloadEncoding::NONE, PayloadEncoding::BINARY, PayloadEncoding::BASE64}) {
+            for (bool encrypted : {false, true}) {
+                BlobStorage storage;
+                storage.setPayloadEncoding(encoding);
+                if (encrypted) {
+                    storage.setEncryptionKey(key);
+                }
+                fill(storage, path);
+                expect(fileSize(logSegmentPath(path, 2)) > 0, "log spans several segments");
+                expect(pagesMatch(storage, path, 200), "pages match the full load");
+                expect(timesMatch(storage, path, 200), "time ranges match the full load");
+                bool indexed = !encrypted && encoding != PayloadEncoding::BASE64;
+                expect((fileSize(messageIndexPath(path)) > 0) == indexed, "only plaintext files are indexed");
+                storage.clearMessages(path);
+                expect(fileSize(messageIndexPath(path)) == -1, "clear removes the index");
+            }
+        }
+    }
+
+    void testPersisted(const std::string& path) {
+        {
+            BlobStorage storage;
+            fill(storage, path);
+        }
+        std::string indexPath = messageIndexPath(path);
+        MessageIndex index;
+        expect(readMessageIndex(indexPath, index) && index.entries.size() == 200, "appends keep the sidecar current");
+
+        // Another instance appends without this one knowing; the index catches up
+        BlobStorage reader;
+        reader.setLogSegmentSize(1024);
+        expect(reader.countMessages(path) == 200, "sidecar reused");
+        {
+            BlobStorage writer;
+            writer.setLogSegmentSize(1024);
+            std::vector<uint8_t> batch = makeBatch(200, 30);
+            writer.appendMessages(path, batch.data(), batch.size());
+        }
+        expect(pagesMatch(reader, path, 230), "index caught up with foreign appends");
+        expect(timesMatch(reader, path, 230), "time blocks extended after appends");
+
+        // A damaged sidecar is rebuilt
+        FILE* file = std::fopen(indexPath.c_str(), "r+b");
+        if (file != nullptr) {
+            std::fseek(file, 20, SEEK_SET);
+            std::fputc(0x5A, file);
+            std::fclose(file);
+        }
+        BlobStorage reopened;
+        expect(pagesMatch(reopened, path, 230), "corrupt sidecar rebuilt");
+        expect(readMessageIndex(indexPath, index) && index.entries.size() == 230, "rebuilt sidecar written");
+
+        // As is one left over from an older snapshot
+        std::string kept = path + ".kept";
+        std::rename(indexPath.c_str(), kept.c_str());
+        std::vector<uint8_t> snapshot = makeBatch(500, 10);
+        reopened.saveMessages(path, snapshot.data(), snapshot.size());
+        std::rename(kept.c_str(), indexPath.c_str());
+        BlobStorage fresh;
+        expect(pagesMatch(fresh, path, 10), "stale sidecar rebuilt");
+        fresh.clearMessages(path);
+    }
+
+    void testTiming(const std::string& path) {
+        BlobStorage storage;
+        std::vector<uint8_t> snapshot = makeBatch(0, 100000);
+        storage.saveMessages(path, snapshot.data(), snapshot.size());
+        std::vector<uint8_t> page;
+        storage.loadLatest(path, 50, page);
+
+        auto start = std::chrono::steady_clock::now();
+        std::vector<uint8_t> all;
+        storage.loadMessages(path, all);
+        auto loaded = std::chrono::steady_clock::now();
+        storage.loadLatest(path, 50, page);
+        auto paged = std::chrono::steady_clock::now();
+        std::vector<uint8_t> recent;
+        storage.loadSince(path, timestampOf(99900), recent);
+        auto since = std::chrono::steady_clock::now();
+        std::printf("100000 messages: full load %.2f ms, latest 50 %.3f ms, since a time %.3f ms\n",
+                    std::chrono::duration<double, std::milli>(loaded - start).count(),
+                    std::chrono::duration<double, std::milli>(paged - loaded).count(),
+                    std::chrono::duration<double, std::milli>(since - paged).count());
+        expect(page == pageOf(storage, path, -1, 50), "latest page of a large snapshot");
+        std::vector<uint8_t> expected;
+        selectMessages(all, [](const MessageRecordView& r) { return r.timestamp >= timestampOf(99900); }, expected);
+        expect(recent == expected, "messages since a time in a large snapshot");
+        storage.clearMessages(path);
+    }
+}
+
+int main() {
+    std::string directory = makeTempDirectory("message_index_test");
+    if (directory.empty()) {
+        return 1;
+    }
+    std::string path = directory + "/messages.blob";
+
+    testEncodings(path);
+    testPersisted(path);
+    testTiming(path);
+    rmdir(directory.c_str());
+
+    return finishTest("message index");
+}
@@ -0,0 +1,299 @@
+// BlobStorage message log: appended batches merge into the loaded snapshot, malformed ones
+// are refused, appends cost only the new record, segments roll over, torn and corrupt
+// tails are cut off at the last intact record (and truncated before the next append),
+// saves and clears fold the log away, a log left behind by an interrupted save is
+// ignored, and appends racing saves either land in the new log or are folded away with
+// the old one.
+//
+// Usage: message_log_test
+
+#include "blob_storage.h"
+#include "message_codec.h"
+#include "message_log.h"
+#include "snapshot_checksum.h"
+#include "test_support.h"
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+namespace {
+    void putBigEndian(std::vector<uint8_t>& out, uint64_t value, int bytes) {
+        for (int i = bytes - 1; i >= 0; --i) {
+            out.push_back(static_cast<uint8_t>(value >> (8 * i)));
+        }
+    }
+
+    /**
+     * Messages first..first+count-1 in the managed side's batch format
+     */
+    std::vector<uint8_t> makeBatch(int first, int count) {
+        std::vector<uint8_t> batch;
+        putBigEndian(batch, static_cast<uint32_t>(count), 4);
+        for (int i = first; i < first + count; ++i) {
+            std::string text = "message " + std::to_string(i) + std::string(static_cast<size_t>(i % 7), '!');
+            putBigEndian(batch, text.size(), 4);
+            batch.insert(batch.end(), text.begin(), text.end());
+            batch.push_back(static_cast<uint8_t>(i & 1));
+            batch.push_back(static_cast<uint8_t>(i % 3));
+            putBigEndian(batch, 1700000000000ULL + static_cast<uint64_t>(i), 8);
+        }
+        return batch;
+    }
+
+    /**
+     * Batch holding the messages of first followed by those of second
+     */
+    std::vector<uint8_t> mergedBatch(const std::vector<uint8_t>& first, const std::vector<uint8_t>& second) {
+        uint32_t firstCount = 0;
+        uint32_t secondCount = 0;
+        readMessageCount(first, firstCount);
+        readMessageCount(second, secondCount);
+        std::vector<uint8_t> merged = first;
+        writeMessageCount(merged, firstCount + secondCount);
+        merged.insert(merged.end(), second.begin() + 4, second.end());
+        return merged;
+    }
+
+    bool loadsAs(BlobStorage& storage, const std::string& path, const std::vector<uint8_t>& expected) {
+        std::vector<uint8_t> loaded;
+        return storage.loadMessages(path, loaded) && loaded == expected;
+    }
+
+    void testAppendAndMerge(const std::string& path) {
+        BlobStorage storage;
+        std::vector<uint8_t> batch = makeBatch(0, 3);
+        expect(storage.appendMessages(path, batch.data(), batch.size()), "append without snapshot");
+        expect(fileSize(path) == -1, "append leaves the snapshot alone");
+        expect(storage.hasMessages(path), "appended messages are found");
+        expect(loadsAs(storage, path, batch), "log alone loads as its batch");
+
+        std::vector<uint8_t> snapshot = makeBatch(0, 10);
+        expect(storage.saveMessages(path, snapshot.data(), snapshot.size()), "save");
+        expect(fileSize(logSegmentPath(path, 0)) == -1, "save folds the log away");
+
+        // Each append writes just its record
+        std::string segment = logSegmentPath(path, 0);
+        for (int i = 10; i < 20; ++i) {
+            std::vector<uint8_t> single = makeBatch(i, 1);
+            int64_t before = fileSize(segment);
+            expect(storage.appendMessages(path, single.data(), single.size()), "append one");
+            int64_t overhead = static_cast<int64_t>(LOG_RECORD_HEADER_SIZE + (before < 0 ? LOG_SEGMENT_HEADER_SIZE : 0));
+            expect(fileSize(segment) - std::max<int64_t>(before, 0) == overhead + static_cast<int64_t>(single.size()),
+                   "append writes one record");
+        }
+        expect(fileSize(path) == static_cast<int64_t>(snapshot.size() + snapshotChecksumsSize(snapshot.size())),
+               "snapshot untouched by appends");
+        expect(loadsAs(storage, path, makeBatch(0, 20)), "snapshot and log merge");
+        expect(storage.getStorageSize(path) == fileSize(path) + fileSize(segment), "size counts the log");
+
+        std::vector<uint8_t> tooShort(3, 0);
+        expect(!storage.appendMessages(path, tooShort.data(), tooShort.size()), "batch without count refused");
+
+        // Batches merge by their counts, so the records must match the count exactly
+        std::vector<uint8_t> trailing = makeBatch(20, 2);
+        trailing.push_back(0);
+        std::vector<uint8_t> overcounted = makeBatch(20, 2);
+        overcounted[3] = 3;
+        std::vector<uint8_t> cut = makeBatch(20, 2);
+        cut.resize(cut.size() - 1);
+        expect(!storage.appendMessages(path, trailing.data(), trailing.size()) &&
+               !storage.appendMessages(path, overcounted.data(), overcounted.size()) &&
+               !storage.appendMessages(path, cut.data(), cut.size()), "malformed batches refused");
+        expect(loadsAs(storage, path, makeBatch(0, 20)), "refused batches not stored");
+
+        expect(storage.clearMessages(path), "clear");
+        expect(!storage.hasMessages(path) && fileSize(segment) == -1, "clear removes the log");
+    }
+
+    void testSegments(const std::string& path) {
+        BlobStorage storage;
+        storage.setLogSegmentSize(512);
+        for (int i = 0; i < 40; ++i) {
+            std::vector<uint8_t> single = makeBatch(i, 1);
+            storage.appendMessages(path, single.data(), single.size());
+        }
+        expect(fileSize(logSegmentPath(path, 3)) > 0, "log rolls over into segments");
+        for (uint32_t index = 0; fileSize(logSegmentPath(path, index)) > 0; ++index) {
+            expect(fileSize(logSegmentPath(path, index)) <= 512, "segments stay within their size");
+        }
+        expect(loadsAs(storage, path, makeBatch(0, 40)), "segments load in order");
+
+        // A fresh instance recovers the tail from disk
+        BlobStorage reopened;
+        reopened.setLogSegmentSize(512);
+        std::vector<uint8_t> next = makeBatch(40, 5);
+        expect(reopened.appendMessages(path, next.data(), next.size()), "append after reopening");
+        expect(loadsAs(reopened, path, makeBatch(0, 45)), "reopened log continues");
+        storage.clearMessages(path);
+    }
+
+    void testTornTail(const std::string& path) {
+        std::string segment = logSegmentPath(path, 0);
+        std::vector<uint8_t> first = makeBatch(0, 4);
+        std::vector<uint8_t> second = makeBatch(4, 4);
+        {
+            BlobStorage storage;
+            storage.appendMessages(path, first.data(), first.size());
+            storage.appendMessages(path, second.data(), second.size());
+        }
+
+        // Cut the second record short, as a crash mid-write would
+        expect(truncate(segment.c_str(), fileSize(segment) - 5) == 0, "truncate segment");
+        BlobStorage storage;
+        expect(loadsAs(storage, path, first), "torn record dropped");
+
+        // The next append replaces the torn record instead of following it
+        std::vector<uint8_t> third = makeBatch(8, 2);
+        expect(storage.appendMessages(path, third.data(), third.size()), "append after torn tail");
+        std::vector<uint8_t> expected = makeBatch(0, 4);
+        std::vector<uint8_t> tail = makeBatch(8, 2);
+        expected[3] = 6;
+        expected.insert(expected.end(), tail.begin() + 4, tail.end());
+        expect(loadsAs(storage, path, expected), "log continues after the intact prefix");
+
+        // A flipped payload byte fails the record checksum
+        FILE* file = std::fopen(segment.c_str(), "r+b");
+        if (file != nullptr) {
+            std::fseek(file, -3, SEEK_END);
+            int byte = std::fgetc(file);
+            std::fseek(file, -3, SEEK_END);
+            std::fputc(byte ^ 0x40, file);
+            std::fclose(file);
+        }
+        expect(loadsAs(storage, path, first), "corrupt record dropped");
+        storage.clearMessages(path);
+    }
+
+    void testStaleLog(const std::string& path) {
+        BlobStorage storage;
+        std::vector<uint8_t> snapshot = makeBatch(0, 5);
+        std::vector<uint8_t> extra = makeBatch(5, 2);
+        storage.saveMessages(path, snapshot.data(), snapshot.size());
+        storage.appendMessages(path, extra.data(), extra.size());
+
+        // Keep the log across a rewrite of the snapshot, as if the save crashed before
+        // deleting it
+        std::string segment = logSegmentPath(path, 0);
+        std::string kept = path + ".kept";
+        std::rename(segment.c_str(), kept.c_str());
+        std::vector<uint8_t> rewritten = makeBatch(100, 3);
+        storage.saveMessages(path, rewritten.data(), rewritten.size());
+        std::rename(kept.c_str(), segment.c_str());
+
+        expect(loadsAs(storage, path, rewritten), "stale log ignored");
+        BlobStorage reopened;
+        expect(reopened.appendMessages(path, extra.data(), extra.size()), "append over stale log");
+        std::vector<uint8_t> expected = rewritten;
+        expected[3] = 5;
+        expected.insert(expected.end(), extra.begin() + 4, extra.end());
+        expect(loadsAs(reopened, path, expected), "stale log replaced");
+        storage.clearMessages(path);
+    }
+
+    void testEncrypted(const std::string& path) {
+        uint8_t key[32];
+        for (int i = 0; i < 32; ++i) {
+            key[i] = static_cast<uint8_t>(i * 7 + 1);
+        }
+        BlobStorage storage;
+        storage.setEncryptionKey(key);
+        storage.setPayloadEncoding(PayloadEncoding::BINARY);
+        std::vector<uint8_t> snapshot = makeBatch(0, 6);
+        std::vector<uint8_t> extra = makeBatch(6, 6);
+        storage.saveMessages(path, snapshot.data(), snapshot.size());
+        expect(storage.appendMessages(path, extra.data(), extra.size()), "encrypted append");
+        expect(loadsAs(storage, path, makeBatch(0, 12)), "encrypted log merges");
+
+        std::vector<uint8_t> raw(static_cast<size_t>(fileSize(logSegmentPath(path, 0))));
+        FILE* file = std::fopen(logSegmentPath(path, 0).c_str(), "rb");
+        if (file != nullptr) {
+            raw.resize(std::fread(raw.data(), 1, raw.size(), file));
+            std::fclose(file);
+        }
+        const char* plaintext = "message 7";
+        expect(std::search(raw.begin(), raw.end(), plaintext, plaintext + std::strlen(plaintext)) == raw.end(),
+               "log records are encrypted");
+
+        // The wrong key fails the whole load rather than returning part of the log
+        std::vector<uint8_t> loaded;
+        storage.setEncryptionKey(raw.data());
+        expect(!storage.loadMessages(path, loaded) && loaded.empty(), "wrong key rejected");
+        storage.clearMessages(path);
+    }
+
+    void testConcurrentSaves(const std::string& path) {
+        BlobStorage storage;
+        std::vector<uint8_t> snapshot = makeBatch(0, 10);
+        const int racing = 300;
+        const int after = 20;
+        std::atomic<int> appended(0);
+        std::atomic<int> saves(0);
+        bool saved = true;
+        std::thread saver([&]() {
+            while (appended.load() < racing) {
+                saved = storage.saveMessages(path, snapshot.data(), snapshot.size()) && saved;
+                saves.fetch_add(1);
+            }
+        });
+        bool ok = true;
+        int seen = 0;
+        for (int i = 0; i < racing; ++i) {
+            // Appends are much quicker than saves; let a save go by every so often
+            if (i % 30 == 0) {
+                while (saves.load() == seen) {
+                    std::this_thread::yield();
+                }
+                seen = saves.load();
+            }
+            std::vector<uint8_t> single = makeBatch(1000 + i, 1);
+            ok = storage.appendMessages(path, single.data(), single.size()) && ok;
+            appended.fetch_add(1);
+        }
+        saver.join();
+        for (int i = racing; i < racing + after; ++i) {
+            std::vector<uint8_t> single = makeBatch(1000 + i, 1);
+            ok = storage.appendMessages(path, single.data(), single.size()) && ok;
+        }
+        expect(ok && saved, "appends and saves succeed side by side");
+
+        // The last save replaced whatever was appended before it; the rest follows its
+        // snapshot in order, including every append made once the saves stopped
+        std::vector<uint8_t> loaded;
+        bool consistent = false;
+        if (storage.loadMessages(path, loaded)) {
+            for (int first = 0; first <= racing && !consistent; ++first) {
+                consistent = loaded == mergedBatch(snapshot, makeBatch(1000 + first, racing + after - first));
+            }
+        }
+        expect(consistent, "appends after the last save all kept");
+
+        BlobStorage reopened;
+        std::vector<uint8_t> reloaded;
+        expect(reopened.loadMessages(path, reloaded) && reloaded == loaded, "racing appends persisted");
+        storage.clearMessages(path);
+    }
+}
+
+int main() {
+    std::string directory = makeTempDirectory("message_log_test");
+    if (directory.empty()) {
+        return 1;
+    }
+    std::string path = directory + "/messages.blob";
+
+    testAppendAndMerge(path);
+    testSegments(path);
+    testTornTail(path);
+    testStaleLog(path);
+    testEncrypted(path);
+    testConcurrentSaves(path);
+    rmdir(directory.c_str());
+
+    return finishTest("message log");
+}
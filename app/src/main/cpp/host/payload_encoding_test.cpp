@@ -0,0 +1,177 @@
+// Payload encodings: one-shot and streaming round trips for every encoding, header
+// detection including headerless legacy payloads, and the BINARY/BASE64 modes of the
+// XOR message cipher and BlobStorage.
+//
+// Usage: payload_encoding_test
+
+#include "payload_encoding.h"
+#include "message_encryption.h"
+#include "blob_storage.h"
+#include "base64_codec.h"
+#include "chacha20_poly1305.h"
+#include "test_support.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <unistd.h>
+#include <vector>
+
+namespace {
+    std::vector<uint8_t> makePayload(size_t length) {
+        std::vector<uint8_t> payload(length);
+        for (size_t i = 0; i < length; ++i) {
+            payload[i] = static_cast<uint8_t>((i * 2654435761u) >> 13);
+        }
+        return payload;
+    }
+
+    const PayloadEncoding ENCODINGS[] = {PayloadEncoding::NONE, PayloadEncoding::BINARY, PayloadEncoding::BASE64};
+
+    std::vector<uint8_t> encode(const std::vector<uint8_t>& payload, PayloadEncoding encoding) {
+        std::vector<uint8_t> encoded(encodedPayloadSize(payload.size(), encoding));
+        size_t written = 0;
+        expect(encodePayload(payload, encoded, encoding, written) && written == encoded.size(), "encode");
+        return encoded;
+    }
+
+    void testOneShot() {
+        for (size_t length : {0, 1, 2, 3, 4, 31, 32, 33, 100, 4099}) {
+            std::vector<uint8_t> payload = makePayload(length);
+            for (PayloadEncoding encoding : ENCODINGS) {
+                std::vector<uint8_t> encoded = encode(payload, encoding);
+                expect(detectPayloadEncoding(encoded, PayloadEncoding::NONE) == encoding || length == 0 ||
+                       encoding == PayloadEncoding::NONE, "header detected");
+
+                std::vector<uint8_t> decoded(decodedPayloadMaxSize(encoded.size()));
+                size_t written = 0;
+                expect(decodePayload(encoded, decoded, written, PayloadEncoding::NONE) && written == length &&
+                       std::equal(payload.begin(), payload.end(), decoded.begin()), "decode");
+
+                // In place
+                std::vector<uint8_t> buffer = encoded;
+                decodePayload(buffer, buffer, written, PayloadEncoding::NONE);
+                expect(written == length && std::equal(payload.begin(), payload.end(), buffer.begin()),
+                       "decode in place");
+            }
+        }
+
+        // Headerless base64 from before the header byte existed
+        std::vector<uint8_t> payload = makePayload(50);
+        std::vector<uint8_t> legacy(base64EncodedLength(payload.size()));
+        base64Encode(payload.data(), payload.size(), reinterpret_cast<char*>(legacy.data()));
+        std::vector<uint8_t> decoded(decodedPayloadMaxSize(legacy.size()));
+        size_t written = 0;
+        expect(decodePayload(legacy, decoded, written, PayloadEncoding::BASE64) && written == payload.size() &&
+               std::equal(payload.begin(), payload.end(), decoded.begin()), "legacy base64 fallback");
+    }
+
+    void testStreaming() {
+        for (size_t length : {0, 1, 2, 5, 1000, 50000}) {
+            std::vector<uint8_t> payload = makePayload(length);
+            for (PayloadEncoding encoding : ENCODINGS) {
+                std::vector<uint8_t> expected = encode(payload, encoding);
+                for (size_t piece : {1, 2, 7, 4096, 1 << 20}) {
+                    std::vector<uint8_t> streamed;
+                    PayloadEncoder encoder(encoding, [&streamed](ConstByteSpan bytes) {
+                        streamed.insert(streamed.end(), bytes.begin(), bytes.end());
+                        return true;
+                    });
+                    for (size_t offset = 0; offset < length; offset += piece) {
+                        encoder.update(ConstByteSpan(payload.data() + offset, std::min(piece, length - offset)));
+                    }
+                    expect(encoder.finalize() && streamed == expected, "streaming encode matches one-shot");
+
+                    std::vector<uint8_t> decoded;
+                    PayloadDecoder decoder(PayloadEncoding::NONE, [&decoded](ConstByteSpan bytes) {
+                        decoded.insert(decoded.end(), bytes.begin(), bytes.end());
+                        return true;
+                    });
+                    for (size_t offset = 0; offset < streamed.size(); offset += piece) {
+                        decoder.update(ConstByteSpan(streamed.data() + offset, std::min(piece, streamed.size() - offset)));
+                    }
+                    expect(decoder.finalize() && decoded == payload, "streaming decode");
+                }
+            }
+        }
+
+        PayloadEncoder refused(PayloadEncoding::BASE64, [](ConstByteSpan) {
+            return false;
+        });
+        expect(!refused.update(makePayload(10)) && !refused.finalize(), "sink refusal reported");
+    }
+
+    void testMessageEncryption() {
+        std::string message = "Binary mode skips the base64 pass \xF0\x9F\x94\x92";
+        std::string base64 = encryptMessage(message);
+        std::string binary = encryptMessage(message, PayloadEncoding::BINARY);
+        expect(base64.size() == requiredSize(message.size()) && base64[0] == '#', "base64 header");
+        expect(binary.size() == message.size() + 1 && static_cast<uint8_t>(binary[0]) == PAYLOAD_HEADER_BINARY,
+               "binary header");
+        expect(decryptMessage(base64) == message && decryptMessage(binary) == message, "round trips");
+        expect(decryptMessage(base64.substr(1)) == message, "headerless legacy message");
+        expect(encryptMessage(message, PayloadEncoding::NONE).empty(), "NONE rejected");
+
+        for (PayloadEncoding encoding : {PayloadEncoding::BINARY, PayloadEncoding::BASE64}) {
+            for (size_t length : {1, 31, 32, 33, 64, 333, 4096}) {
+                std::vector<uint8_t> payload = makePayload(length);
+                std::vector<uint8_t> buffer(requiredSize(length, encoding));
+                std::copy(payload.begin(), payload.end(), buffer.begin());
+                size_t encrypted = encryptInPlace(buffer, length, encoding);
+                expect(encrypted == buffer.size(), "encrypt in place");
+
+                std::vector<uint8_t> copied(buffer.size());
+                size_t written = 0;
+                encryptInto(payload, copied, written, encoding);
+                expect(written == encrypted && copied == buffer, "in place matches encryptInto");
+
+                size_t decrypted = decryptInPlace(buffer);
+                expect(decrypted == length && std::equal(payload.begin(), payload.end(), buffer.begin()),
+                       "decrypt in place");
+            }
+        }
+    }
+
+    void testBlobStorage() {
+        std::string directory = makeTempDirectory("payload_encoding_test");
+        if (directory.empty()) {
+            return;
+        }
+        std::string path = directory + "/messages.bin";
+        std::vector<uint8_t> payload = makePayload(100000);
+        std::vector<uint8_t> loaded;
+        uint8_t key[CHACHA20_KEY_SIZE];
+        secureRandomBytes(key, sizeof(key));
+
+        BlobStorage storage;
+        for (bool encrypted : {false, true}) {
+            storage.setEncryptionKey(encrypted ? key : nullptr);
+            for (PayloadEncoding encoding : ENCODINGS) {
+                storage.setPayloadEncoding(encoding);
+                expect(storage.saveMessages(path, payload.data(), payload.size()), "save");
+                expect(storage.loadMessages(path, loaded) && loaded == payload, "load");
+            }
+        }
+
+        // A headerless file still loads once an encoding is configured
+        storage.setEncryptionKey(nullptr);
+        storage.setPayloadEncoding(PayloadEncoding::NONE);
+        std::vector<uint8_t> text(payload.size(), 'a');
+        storage.saveMessages(path, text.data(), text.size());
+        storage.setPayloadEncoding(PayloadEncoding::BASE64);
+        expect(storage.loadMessages(path, loaded) && loaded == text, "headerless file loads");
+
+        storage.clearMessages(path);
+        rmdir(directory.c_str());
+    }
+}
+
+int main() {
+    testOneShot();
+    testStreaming();
+    testMessageEncryption();
+    testBlobStorage();
+
+    return finishTest("payload encoding");
+}
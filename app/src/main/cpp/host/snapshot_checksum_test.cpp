@@ -0,0 +1,270 @@
+// Snapshot checksums: tables written in uneven pieces read back at every size around the
+// block size, damaged blocks found and checked once, damaged trailers still placed from the
+// file size, damaged batches and containers cut back to their intact messages, and
+// BlobStorage loading, viewing and paging a damaged snapshot up to the damage followed by
+// its intact log, including a snapshot damaged from its first block.
+//
+// Usage: snapshot_checksum_test
+
+#include "snapshot_checksum.h"
+#include "blob_storage.h"
+#include "block_compression.h"
+#include "message_codec.h"
+#include "message_log.h"
+#include "test_support.h"
+#include <algorithm>
+#include <cstdio>
+#include <random>
+#include <string>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <vector>
+
+namespace {
+    void addMessages(MessageBatchWriter& writer, int first, int count) {
+        for (int i = first; i < first + count; ++i) {
+            writer.add("Message " + std::to_string(i), i % 2 == 0, 0, 1700000000000LL + i * 1000LL);
+        }
+    }
+
+    std::vector<uint8_t> messageBatch(int first, int count) {
+        std::vector<uint8_t> batch;
+        MessageBatchWriter writer(batch);
+        addMessages(writer, first, count);
+        return batch;
+    }
+
+    /**
+     * The first kept snapshot messages followed by the appended ones, as a load merges them
+     */
+    std::vector<uint8_t> mergedBatch(int kept, int appendedFirst, int appendedCount) {
+        std::vector<uint8_t> batch;
+        MessageBatchWriter writer(batch);
+        addMessages(writer, 0, kept);
+        addMessages(writer, appendedFirst, appendedCount);
+        return batch;
+    }
+
+    std::vector<uint8_t> randomBytes(size_t size, uint32_t seed) {
+        std::mt19937 random(seed);
+        std::vector<uint8_t> bytes(size);
+        for (uint8_t& byte : bytes) {
+            byte = static_cast<uint8_t>(random());
+        }
+        return bytes;
+    }
+
+    /**
+     * Stored bytes followed by their table and trailer, written in pieces of growing size
+     */
+    std::vector<uint8_t> checksummed(const std::vector<uint8_t>& stored) {
+        SnapshotChecksumWriter writer;
+        size_t piece = 1;
+        for (size_t offset = 0; offset < stored.size(); offset += piece, piece = piece * 3 + 1) {
+            writer.update(ConstByteSpan(stored.data() + offset, std::min(piece, stored.size() - offset)));
+        }
+        std::vector<uint8_t> file = stored;
+        std::vector<uint8_t> trailer = writer.finish();
+        file.insert(file.end(), trailer.begin(), trailer.end());
+        return file;
+    }
+
+    /**
+     * Damage one byte the way the storage medium would, leaving the modification time alone
+     */
+    void flipByte(const std::string& path, long offset) {
+        struct stat info;
+        FILE* file = std::fopen(path.c_str(), "r+b");
+        if (file == nullptr || stat(path.c_str(), &info) != 0) {
+            if (file != nullptr) {
+                std::fclose(file);
+            }
+            return;
+        }
+        std::fseek(file, offset, SEEK_SET);
+        int byte = std::fgetc(file);
+        std::fseek(file, offset, SEEK_SET);
+        std::fputc(byte ^ 0x20, file);
+        std::fclose(file);
+#ifdef __APPLE__
+        struct timespec times[2] = {info.st_atimespec, info.st_mtimespec};
+#else
+        struct timespec times[2] = {info.st_atim, info.st_mtim};
+#endif
+        utimensat(AT_FDCWD, path.c_str(), times, 0);
+    }
+
+    void testChecksums() {
+        const size_t block = SNAPSHOT_CHECKSUM_BLOCK_SIZE;
+        for (size_t size : {size_t(0), size_t(1), block - 1, block, block + 1, 3 * block + 5, 40 * block}) {
+            std::vector<uint8_t> stored = randomBytes(size, static_cast<uint32_t>(size));
+            std::vector<uint8_t> file = checksummed(stored);
+            SnapshotChecksums checksums;
+            expect(file.size() == size + snapshotChecksumsSize(size), "table and trailer size");
+            expect(checksums.read(file) && checksums.storedLength() == size && checksums.intactLength() == size,
+                   "intact file verifies");
+            expect(checksums.verify(0, size) && !checksums.verify(0, size + 1) && !checksums.verify(size + 1, 0),
+                   "verify stays within the stored bytes");
+        }
+
+        std::vector<uint8_t> stored = randomBytes(10 * block + 100, 7);
+        std::vector<uint8_t> file = checksummed(stored);
+        file[4 * block + 17] ^= 0x01;
+        SnapshotChecksums checksums;
+        expect(checksums.read(file) && checksums.intactLength() == 4 * block, "damaged block ends the intact bytes");
+        expect(checksums.verify(block, 3 * block) && checksums.verify(5 * block, 5 * block + 100) &&
+               !checksums.verify(4 * block - 1, 2) && !checksums.verify(4 * block + 1000, 1),
+               "only ranges touching the damaged block fail");
+
+        // The trailer's own fields damaged: the file size still places the table
+        std::vector<uint8_t> trailerDamaged = checksummed(stored);
+        trailerDamaged[trailerDamaged.size() - SNAPSHOT_TRAILER_SIZE + 2] ^= 0x01;
+        expect(checksums.read(trailerDamaged) && checksums.storedLength() == stored.size() &&
+               checksums.intactLength() == stored.size(), "damaged trailer placed from the file size");
+
+        // No stored length fits this file size, so nothing can be trusted
+        std::vector<uint8_t> unplaced = checksummed(randomBytes(4093, 1));
+        unplaced.insert(unplaced.begin(), 4, 0);
+        unplaced[unplaced.size() - SNAPSHOT_TRAILER_SIZE + 2] ^= 0x01;
+        expect(checksums.read(unplaced) && checksums.intactLength() == 0 && checksums.storedLength() > 0,
+               "unplaceable table leaves nothing intact");
+
+        expect(!checksums.read(stored) && !checksums.read(ConstByteSpan()), "files without a trailer");
+    }
+
+    void testTruncation() {
+        std::vector<uint8_t> batch = messageBatch(0, 10);
+        std::vector<uint8_t> cut(batch.begin(), batch.begin() + static_cast<long>(messageBatch(0, 6).size()) - 3);
+        expect(truncateMessages(cut) == 5 && cut == messageBatch(0, 5), "cut record dropped");
+
+        std::vector<uint8_t> junk = batch;
+        junk.insert(junk.end(), 7, 0xEE);
+        expect(truncateMessages(junk) == 10 && junk == batch, "bytes after the last record dropped");
+
+        std::vector<uint8_t> badCount = batch;
+        badCount[0] = 0xFF;
+        expect(truncateMessages(badCount) == 0 && badCount == messageBatch(0, 0), "unreadable count empties the batch");
+
+        std::vector<uint8_t> tooShort(3, 0);
+        expect(truncateMessages(tooShort) == 0 && tooShort.empty(), "batch without a count becomes empty");
+    }
+
+    void testSalvageBlocks() {
+        std::vector<uint8_t> plaintext = messageBatch(0, 3000);
+        std::vector<uint8_t> container;
+        expect(compressBlocks(plaintext, container, nullptr, MIN_COMPRESSION_BLOCK_SIZE), "compress");
+
+        std::vector<uint8_t> salvaged;
+        expect(salvageBlocks(container, salvaged) && salvaged == plaintext, "intact container salvaged whole");
+
+        std::vector<uint8_t> damaged = container;
+        damaged[damaged.size() - 10] ^= 0x08;
+        std::vector<uint8_t> decompressed;
+        expect(!decompressBlocks(damaged, decompressed) && salvageBlocks(damaged, salvaged) &&
+               !salvaged.empty() && salvaged.size() < plaintext.size() &&
+               salvaged.size() % MIN_COMPRESSION_BLOCK_SIZE == 0 &&
+               std::equal(salvaged.begin(), salvaged.end(), plaintext.begin()), "leading blocks salvaged");
+
+        std::vector<uint8_t> truncated(container.begin(), container.end() - 1000);
+        expect(salvageBlocks(truncated, salvaged) && salvaged.size() < plaintext.size() &&
+               std::equal(salvaged.begin(), salvaged.end(), plaintext.begin()), "truncated container salvaged");
+
+        damaged = container;
+        damaged[6] ^= 0x01;
+        expect(!salvageBlocks(damaged, salvaged) && salvaged.empty(), "damaged header salvages nothing");
+    }
+
+    void testStorage(const std::string& path) {
+        std::vector<uint8_t> snapshot = messageBatch(0, 2000);
+        std::vector<uint8_t> extra = messageBatch(2000, 10);
+        for (PayloadEncoding encoding : {PayloadEncoding::NONE, PayloadEncoding::BINARY}) {
+            BlobStorage storage;
+            storage.setPayloadEncoding(encoding);
+            expect(storage.saveMessages(path, snapshot.data(), snapshot.size()) &&
+                   storage.appendMessages(path, extra.data(), extra.size()), "save and append");
+            std::vector<uint8_t> loaded;
+            MessageView view;
+            expect(storage.loadMessages(path, loaded) && loaded == messageBatch(0, 2010), "intact file loads");
+            expect(storage.countMessages(path) == 2010, "intact file indexed");
+            storage.saveMessages(path, snapshot.data(), snapshot.size());
+            expect(storage.viewMessages(path, view) && view.isMapped() &&
+                   std::vector<uint8_t>(view.bytes().begin(), view.bytes().end()) == snapshot, "intact file mapped");
+            storage.appendMessages(path, extra.data(), extra.size());
+
+            // Damage the middle of the snapshot: loads keep the messages before the damaged block,
+            // then the intact log
+            flipByte(path, static_cast<long>(snapshot.size() / 2));
+            uint32_t count = 0;
+            expect(storage.loadMessages(path, loaded) && readMessageCount(loaded, count) && count > 10 &&
+                   count < 2010 && loaded == mergedBatch(static_cast<int>(count) - 10, 2000, 10),
+                   "damaged file loads up to the damage, then the log");
+
+            // Pages before the damage are still served from the index; one touching it falls
+            // back to the load, after which the index is not rebuilt over the damaged file
+            std::vector<uint8_t> page;
+            expect(storage.loadRange(path, 0, 5, page) && page == messageBatch(0, 5), "page before the damage");
+            expect(storage.loadRange(path, 0, 2010, page) && page == loaded, "page across the damage");
+            expect(storage.countMessages(path) == count, "count stops at the damage");
+            expect(storage.loadLatest(path, 3, page) && page == messageBatch(2007, 3), "latest messages from the log");
+            expect(storage.viewMessages(path, view) && !view.isMapped() &&
+                   std::vector<uint8_t>(view.bytes().begin(), view.bytes().end()) == loaded,
+                   "damaged file viewed as a copy");
+
+            // Saving replaces the damaged file
+            expect(storage.saveMessages(path, snapshot.data(), snapshot.size()) &&
+                   storage.loadMessages(path, loaded) && loaded == snapshot, "save over a damaged file");
+
+            // Damage the first block: nothing of the snapshot survives, but the log does, and
+            // saving what was loaded keeps it
+            storage.appendMessages(path, extra.data(), extra.size());
+            flipByte(path, 10);
+            expect(storage.loadMessages(path, loaded) && loaded == extra, "log loads after a damaged first block");
+            expect(storage.countMessages(path) == 10 && storage.viewMessages(path, view) &&
+                   std::vector<uint8_t>(view.bytes().begin(), view.bytes().end()) == extra,
+                   "log counted and viewed after a damaged first block");
+            // A fresh storage appending to that log picks up where it ends rather than discarding it
+            {
+                BlobStorage reopened;
+                reopened.setPayloadEncoding(encoding);
+                std::vector<uint8_t> more = messageBatch(2010, 5);
+                expect(reopened.appendMessages(path, more.data(), more.size()) &&
+                       reopened.loadMessages(path, loaded) && loaded == messageBatch(2000, 15),
+                       "append extends the log of a damaged first block");
+            }
+            expect(storage.saveMessages(path, loaded.data(), loaded.size()) &&
+                   storage.loadMessages(path, loaded) && loaded == messageBatch(2000, 15), "save keeps the log's messages");
+            storage.clearMessages(path);
+        }
+
+        // Files from before the checksums load as they are
+        FILE* file = std::fopen(path.c_str(), "wb");
+        if (file != nullptr) {
+            std::fwrite(snapshot.data(), 1, snapshot.size(), file);
+            std::fclose(file);
+        }
+        BlobStorage storage;
+        std::vector<uint8_t> loaded;
+        MessageView view;
+        expect(storage.loadMessages(path, loaded) && loaded == snapshot, "file without checksums loads");
+        expect(storage.viewMessages(path, view) && view.isMapped() && view.bytes().size() == snapshot.size(),
+               "file without checksums mapped");
+        storage.clearMessages(path);
+    }
+}
+
+int main() {
+    std::string directory = makeTempDirectory("snapshot_checksum_test");
+    if (directory.empty()) {
+        return 1;
+    }
+    std::string path = directory + "/messages.blob";
+
+    testChecksums();
+    testTruncation();
+    testSalvageBlocks();
+    testStorage(path);
+    rmdir(directory.c_str());
+
+    return finishTest("snapshot checksum");
+}
@@ -0,0 +1,61 @@
+#ifndef TEST_SUPPORT_H
+#define TEST_SUPPORT_H
+
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/**
+ * Scaffolding shared by the host tests and benchmarks
+ *
+ * Each test counts failed expectations, prints one line per failure and a summary at the
+ * end, and exits non-zero if anything failed so that ctest reports it.
+ */
+
+inline int failures = 0;
+
+/**
+ * Record a failure, naming the expectation, unless the condition holds
+ */
+inline void expect(bool condition, const char* name) {
+    if (!condition) {
+        std::fprintf(stderr, "FAIL: %s\n", name);
+        failures++;
+    }
+}
+
+/**
+ * Print the summary line
+ * @return The process exit status
+ */
+inline int finishTest(const std::string& name) {
+    std::printf("%s: %d failure(s)\n", name.c_str(), failures);
+    return failures == 0 ? 0 : 1;
+}
+
+/**
+ * Size of a file, or -1 if it does not exist
+ */
+inline int64_t fileSize(const std::string& path) {
+    struct stat info;
+    return stat(path.c_str(), &info) == 0 ? static_cast<int64_t>(info.st_size) : -1;
+}
+
+/**
+ * Create a fresh directory under /tmp, to be removed with rmdir() once its files are gone
+ * @param prefix Start of the directory name, usually the test's name
+ * @return Its path, or an empty string after recording a failure
+ */
+inline std::string makeTempDirectory(const char* prefix) {
+    std::string directory = std::string("/tmp/") + prefix + "XXXXXX";
+    if (mkdtemp(&directory[0]) == nullptr) {
+        expect(false, "temp directory");
+        return std::string();
+    }
+    return directory;
+}
+
+#endif // TEST_SUPPORT_H
@@ -0,0 +1,282 @@
+// Write-behind BlobStorage: saves and appends queued while the writer is held up coalesce
+// into one commit and one log record, loads and size queries see queued writes, failures
+// reach the callback and flush(), writers of many files run concurrently, and destroying
+// the storage flushes it even with its pool tasks still to come.
+//
+// Usage: write_behind_test
+
+#include "blob_storage.h"
+#include "message_codec.h"
+#include "message_log.h"
+#include "thread_manager.h"
+#include "test_support.h"
+#include <atomic>
+#include <condition_variable>
+#include <cstdio>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+namespace {
+    std::vector<uint8_t> messageBatch(int first, int count) {
+        std::vector<uint8_t> batch;
+        MessageBatchWriter writer(batch);
+        for (int i = first; i < first + count; ++i) {
+            writer.add("Message " + std::to_string(i), i % 2 == 0, 0, 1700000000000LL + i * 1000LL);
+        }
+        return batch;
+    }
+
+    /**
+     * Occupies every thread of a pool until released, so that queued writes stay queued
+     */
+    class PoolBlocker {
+    public:
+        PoolBlocker(ThreadManager& threadManager, size_t threads) {
+            for (size_t i = 0; i < threads; ++i) {
+                threadManager.submitTask([this]() {
+                    std::unique_lock<std::mutex> lock(mutex_);
+                    started_++;
+                    changed_.notify_all();
+                    changed_.wait(lock, [this]() { return released_; });
+                    started_--;
+                    changed_.notify_all();
+                });
+            }
+            std::unique_lock<std::mutex> lock(mutex_);
+            changed_.wait(lock, [this, threads]() { return started_ == threads; });
+        }
+
+        ~PoolBlocker() {
+            release();
+            std::unique_lock<std::mutex> lock(mutex_);
+            changed_.wait(lock, [this]() { return started_ == 0; });
+        }
+
+        void release() {
+            std::lock_guard<std::mutex> lock(mutex_);
+            released_ = true;
+            changed_.notify_all();
+        }
+
+    private:
+        std::mutex mutex_;
+        std::condition_variable changed_;
+        size_t started_ = 0;
+        bool released_ = false;
+    };
+
+    void testCoalescing(const std::string& path) {
+        ThreadManager threadManager;
+        threadManager.initializeThreadPool(1);
+        BlobStorage storage;
+        storage.setThreadManager(&threadManager);
+        storage.setWriteBehind(true);
+        std::atomic<int> callbacks(0);
+        storage.setWriteCallback([&callbacks, &path](const std::string& filePath, bool ok) {
+            if (filePath == path && ok) {
+                callbacks++;
+            }
+        });
+
+        // Saves queued behind a busy pool: only the newest one is committed
+        {
+            PoolBlocker blocker(threadManager, 1);
+            for (int i = 1; i <= 10; ++i) {
+                std::vector<uint8_t> snapshot = messageBatch(0, i);
+                expect(storage.saveMessages(path, snapshot.data(), snapshot.size()), "save queued");
+            }
+            expect(storage.commitCount() == 0 && fileSize(path) < 0, "nothing written while queued");
+        }
+        expect(storage.flush(), "flush after saves");
+        std::vector<uint8_t> loaded;
+        expect(storage.commitCount() == 1 && callbacks == 1, "saves coalesced into one commit");
+        expect(storage.loadMessages(path, loaded) && loaded == messageBatch(0, 10), "newest save stored");
+
+        // A save followed by appends: one commit, then the appends as a single log record
+        callbacks = 0;
+        std::vector<uint8_t> appended[3] = {messageBatch(100, 5), messageBatch(105, 7), messageBatch(112, 1)};
+        {
+            PoolBlocker blocker(threadManager, 1);
+            std::vector<uint8_t> stale = messageBatch(50, 3);
+            std::vector<uint8_t> snapshot = messageBatch(0, 4);
+            expect(storage.appendMessages(path, stale.data(), stale.size()), "append queued");
+            expect(storage.saveMessages(path, snapshot.data(), snapshot.size()), "save queued after append");
+            for (const std::vector<uint8_t>& batch : appended) {
+                expect(storage.appendMessages(path, batch.data(), batch.size()), "append queued after save");
+            }
+        }
+        expect(storage.flush(), "flush after appends");
+        std::vector<uint8_t> merged = messageBatch(0, 4);
+        writeMessageCount(merged, 17);
+        for (const std::vector<uint8_t>& batch : appended) {
+            merged.insert(merged.end(), batch.begin() + MESSAGE_COUNT_SIZE, batch.end());
+        }
+        std::vector<uint8_t> record = messageBatch(100, 13);
+        expect(storage.commitCount() == 2 && callbacks == 1, "save and appends written together");
+        expect(fileSize(logSegmentPath(path, 0)) ==
+               static_cast<int64_t>(LOG_SEGMENT_HEADER_SIZE + LOG_RECORD_HEADER_SIZE + record.size()),
+               "appends merged into one record");
+        expect(storage.loadMessages(path, loaded) && loaded == merged, "appends follow the save");
+        storage.clearMessages(path);
+        threadManager.shutdownThreadPool();
+    }
+
+    void testReadYourWrites(const std::string& path) {
+        ThreadManager threadManager;
+        threadManager.initializeThreadPool(1);
+        BlobStorage storage;
+        storage.setThreadManager(&threadManager);
+        storage.setWriteBehind(true);
+        std::vector<uint8_t> snapshot = messageBatch(0, 20);
+        std::vector<uint8_t> batch = messageBatch(20, 5);
+        std::vector<uint8_t> expected = messageBatch(0, 25);
+
+        // The pool never gets to these writes; the accesses write them themselves
+        PoolBlocker blocker(threadManager, 1);
+        expect(storage.saveMessages(path, snapshot.data(), snapshot.size()), "save queued");
+        expect(storage.hasMessages(path) && storage.getStorageSize(path) > 0, "queued save visible to size queries");
+        expect(storage.appendMessages(path, batch.data(), batch.size()), "append queued");
+        std::vector<uint8_t> loaded;
+        expect(storage.loadMessages(path, loaded) && loaded == expected, "queued append visible to loads");
+        expect(storage.countMessages(path) == 25, "queued append counted");
+        std::vector<uint8_t> page;
+        expect(storage.loadLatest(path, 5, page) && page == batch, "queued append paged");
+
+        expect(storage.saveMessages(path, snapshot.data(), snapshot.size()), "save queued before clear");
+        expect(storage.clearMessages(path) && !storage.hasMessages(path), "clear after queued save");
+
+        // Synchronous writes are ordered after queued ones
+        expect(storage.appendMessages(path, batch.data(), batch.size()), "append queued before sync save");
+        storage.setWriteBehind(false);
+        expect(storage.saveMessages(path, snapshot.data(), snapshot.size()), "sync save");
+        expect(storage.loadMessages(path, loaded) && loaded == snapshot, "sync save comes last");
+        blocker.release();
+        expect(storage.flush(), "nothing left to flush");
+        storage.clearMessages(path);
+        threadManager.shutdownThreadPool();
+    }
+
+    void testWithoutPool(const std::string& path) {
+        BlobStorage storage;
+        storage.setWriteBehind(true);
+        int calls = 0;
+        storage.setWriteCallback([&calls](const std::string&, bool ok) {
+            calls += ok ? 1 : 0;
+        });
+        std::vector<uint8_t> snapshot = messageBatch(0, 3);
+        expect(storage.saveMessages(path, snapshot.data(), snapshot.size()) && storage.commitCount() == 1 &&
+               calls == 1, "written on the calling thread without a pool");
+        storage.clearMessages(path);
+    }
+
+    void testFailure(const std::string& directory) {
+        ThreadManager threadManager;
+        threadManager.initializeThreadPool(2);
+        BlobStorage storage;
+        storage.setThreadManager(&threadManager);
+        storage.setWriteBehind(true);
+        std::atomic<int> failed(0);
+        storage.setWriteCallback([&failed](const std::string&, bool ok) {
+            failed += ok ? 0 : 1;
+        });
+
+        // A regular file where the directory should be
+        std::string blocker = directory + "/not_a_directory";
+        FILE* file = std::fopen(blocker.c_str(), "wb");
+        if (file != nullptr) {
+            std::fclose(file);
+        }
+        std::string path = blocker + "/messages.blob";
+        std::vector<uint8_t> snapshot = messageBatch(0, 3);
+        expect(storage.saveMessages(path, snapshot.data(), snapshot.size()), "failing save still queued");
+        expect(!storage.flush() && failed == 1, "failed write reported");
+        expect(storage.flush(), "failure reported once");
+
+        std::vector<uint8_t> bad(2, 0);
+        expect(!storage.appendMessages(path, bad.data(), bad.size()), "malformed batch refused");
+        unlink(blocker.c_str());
+        threadManager.shutdownThreadPool();
+    }
+
+    void testConcurrentFiles(const std::string& directory) {
+        ThreadManager threadManager;
+        threadManager.initializeThreadPool(4);
+        BlobStorage storage;
+        storage.setThreadManager(&threadManager);
+        storage.setWriteBehind(true);
+        std::atomic<int> written(0);
+        storage.setWriteCallback([&written](const std::string&, bool ok) {
+            written += ok ? 1 : 0;
+        });
+
+        const int files = 4;
+        const int appends = 50;
+        std::vector<std::thread> writers;
+        for (int f = 0; f < files; ++f) {
+            writers.emplace_back([&storage, &directory, f]() {
+                std::string path = directory + "/file" + std::to_string(f) + ".blob";
+                std::vector<uint8_t> snapshot = messageBatch(0, 10);
+                storage.saveMessages(path, snapshot.data(), snapshot.size());
+                for (int i = 0; i < appends; ++i) {
+                    std::vector<uint8_t> batch = messageBatch(10 + i * 2, 2);
+                    storage.appendMessages(path, batch.data(), batch.size());
+                }
+            });
+        }
+        for (std::thread& writer : writers) {
+            writer.join();
+        }
+        expect(storage.flush(), "concurrent writes flushed");
+        expect(written > 0 && written <= files * (appends + 1), "concurrent writes reported");
+        for (int f = 0; f < files; ++f) {
+            std::string path = directory + "/file" + std::to_string(f) + ".blob";
+            std::vector<uint8_t> loaded;
+            expect(storage.loadMessages(path, loaded) && loaded == messageBatch(0, 10 + appends * 2),
+                   "every append of every file stored in order");
+            storage.clearMessages(path);
+        }
+        threadManager.shutdownThreadPool();
+    }
+
+    void testDestructorFlushes(const std::string& path) {
+        ThreadManager threadManager;
+        threadManager.initializeThreadPool(1);
+        std::vector<uint8_t> snapshot = messageBatch(0, 8);
+        {
+            PoolBlocker blocker(threadManager, 1);
+            {
+                BlobStorage storage;
+                storage.setThreadManager(&threadManager);
+                storage.setWriteBehind(true);
+                storage.saveMessages(path, snapshot.data(), snapshot.size());
+            }
+            // The storage is gone; its task runs once released and must not touch it
+        }
+        threadManager.shutdownThreadPool();
+        BlobStorage storage;
+        std::vector<uint8_t> loaded;
+        expect(storage.loadMessages(path, loaded) && loaded == snapshot, "destructor flushed queued save");
+        storage.clearMessages(path);
+    }
+}
+
+int main() {
+    std::string directory = makeTempDirectory("write_behind_test");
+    if (directory.empty()) {
+        return 1;
+    }
+    std::string path = directory + "/messages.blob";
+
+    testCoalescing(path);
+    testReadYourWrites(path);
+    testWithoutPool(path);
+    testFailure(directory);
+    testConcurrentFiles(directory);
+    testDestructorFlushes(path);
+    rmdir(directory.c_str());
+
+    return finishTest("write behind");
+}
@@ -1,24 +1,79 @@
 #include "io_bridge.h"
 #include "thread_manager.h"
+#include "bulk_copy.h"
 #include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <sys/eventfd.h>
+#include <unistd.h>
+#include <cerrno>
 #include <android/log.h>
 
 #define LOG_TAG "IOBridge"
 #define LOGI(...) __android_log_print(ANDROID_LOG_INFO, LOG_TAG, __VA_ARGS__)
 #define LOGE(...) __android_log_print(ANDROID_LOG_ERROR, LOG_TAG, __VA_ARGS__)
 
+namespace {
+    // Adaptive spin window bounds (in queue polls) for the dedicated dispatcher
+    constexpr uint32_t MIN_SPIN_ITERATIONS = 64;
+    constexpr uint32_t MAX_SPIN_ITERATIONS = 16384;
+    
+    // Byte array payloads at least this large are delivered as direct buffers
+    constexpr size_t DEFAULT_DIRECT_BUFFER_THRESHOLD = 16 * 1024;
+    
+    constexpr int64_t RATE_LIMIT_WINDOW_MS = 1000;
+    
+    // Source of lent buffer generations, shared by every bridge in the process
+    std::atomic<uint32_t> nextLendGeneration(1);
+    
+    int64_t steadyNowMs() {
+        return std::chrono::duration_cast<std::chrono::milliseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+    
+    inline void cpuRelax() {
+#if defined(__x86_64__) || defined(__i386__)
+        __builtin_ia32_pause();
+#elif defined(__aarch64__) || defined(__arm__)
+        __asm__ __volatile__("yield");
+#endif
+    }
+}
+
 IOBridge::IOBridge()
     : jvm_(nullptr),
       listenerObject_(nullptr),
       listenerClass_(nullptr),
+      onStringEventMethod_(nullptr),
+      onIntEventMethod_(nullptr),
+      onFloatEventMethod_(nullptr),
+      onDoubleEventMethod_(nullptr),
+      onBooleanEventMethod_(nullptr),
+      onByteArrayEventMethod_(nullptr),
+      onByteBufferEventMethod_(nullptr),
       threadManager_(nullptr),
+      queueGeneration_(1),
+      stopRateLimit_(false),
+      directBufferThreshold_(DEFAULT_DIRECT_BUFFER_THRESHOLD),
       stopProcessing_(false),
       processingScheduled_(false),
-      encryptionEnabled_(false) {
+      pendingEvents_(0),
+      dispatcherRunning_(false),
+      stopDispatcher_(false),
+      dispatcherSleeping_(false),
+      wakeFd_(-1),
+      encryptionEnabled_(false),
+      payloadEncoding_(PayloadEncoding::BINARY) {
 }
 
 IOBridge::~IOBridge() {
     cleanup();
+    
+    // Closed only here: a producer that saw the dispatcher running may still write to it
+    int wakeFd = wakeFd_.exchange(-1);
+    if (wakeFd >= 0) {
+        close(wakeFd);
+    }
 }
 
 void IOBridge::initialize(JavaVM* jvm) {
@@ -37,16 +92,31 @@ void IOBridge::enableEncryption(bool enable) {
     LOGI("IOBridge encryption %s", enable ? "enabled" : "disabled");
 }
 
+void IOBridge::setPayloadEncoding(PayloadEncoding encoding) {
+    if (encoding == PayloadEncoding::NONE) {
+        LOGE("Encrypted payloads need a BINARY or BASE64 encoding");
+        return;
+    }
+    // Events already queued keep their encoding; dispatch detects it from the header byte
+    payloadEncoding_ = encoding;
+}
+
 void IOBridge::cleanup() {
-    if (jvm_ != nullptr && listenerObject_ != nullptr) {
+    stopDispatcher();
+    stopRateLimitTimer();
+    
+    if (jvm_ != nullptr) {
         JNIEnv* env = getJNIEnv();
         if (env != nullptr) {
-            env->DeleteGlobalRef(listenerObject_);
-            listenerObject_ = nullptr;
-        }
-        if (listenerClass_ != nullptr) {
-            env->DeleteGlobalRef(listenerClass_);
-            listenerClass_ = nullptr;
+            if (listenerObject_ != nullptr) {
+                env->DeleteGlobalRef(listenerObject_);
+                listenerObject_ = nullptr;
+            }
+            if (listenerClass_ != nullptr) {
+                env->DeleteGlobalRef(listenerClass_);
+                listenerClass_ = nullptr;
+            }
+            releaseEventIdStrings(env);
         }
     }
     
@@ -55,7 +125,18 @@ void IOBridge::cleanup() {
     
     {
         std::lock_guard<std::mutex> lock(queueMutex_);
+        for (auto& event : eventQueue_) {
+            event.releasePayload(payloadPool_);
+        }
         eventQueue_.clear();
+        for (auto& state : policies_) {
+            if (state.hasTrailing) {
+                state.trailing.releasePayload(payloadPool_);
+                state.hasTrailing = false;
+            }
+        }
+        pendingEvents_ = 0;
+        queueGeneration_++;
     }
     
     jvm_ = nullptr;
@@ -97,9 +178,31 @@ void IOBridge::registerListener(JNIEnv* env, jobject listener) {
         return;
     }
     
+    resolveListenerMethods(env);
+    
     LOGI("Listener registered successfully");
 }
 
+void IOBridge::resolveListenerMethods(JNIEnv* env) {
+    onStringEventMethod_ = env->GetMethodID(listenerClass_, "onStringEvent", "(Ljava/lang/String;Ljava/lang/String;)V");
+    onIntEventMethod_ = env->GetMethodID(listenerClass_, "onIntEvent", "(Ljava/lang/String;I)V");
+    onFloatEventMethod_ = env->GetMethodID(listenerClass_, "onFloatEvent", "(Ljava/lang/String;F)V");
+    onDoubleEventMethod_ = env->GetMethodID(listenerClass_, "onDoubleEvent", "(Ljava/lang/String;D)V");
+    onBooleanEventMethod_ = env->GetMethodID(listenerClass_, "onBooleanEvent", "(Ljava/lang/String;Z)V");
+    onByteArrayEventMethod_ = env->GetMethodID(listenerClass_, "onByteArrayEvent", "(Ljava/lang/String;[B)V");
+    if (env->ExceptionCheck()) {
+        env->ExceptionClear();
+        LOGE("Listener is missing one or more callback methods");
+    }
+    
+    // Optional: listeners without it receive every payload as a byte array
+    onByteBufferEventMethod_ = env->GetMethodID(listenerClass_, "onByteBufferEvent", "(Ljava/lang/String;Ljava/nio/ByteBuffer;J)V");
+    if (env->ExceptionCheck()) {
+        env->ExceptionClear();
+        onByteBufferEventMethod_ = nullptr;
+    }
+}
+
 void IOBridge::unregisterListener(JNIEnv* env) {
     if (env == nullptr) {
         return;
@@ -115,6 +218,14 @@ void IOBridge::unregisterListener(JNIEnv* env) {
         listenerClass_ = nullptr;
     }
     
+    onStringEventMethod_ = nullptr;
+    onIntEventMethod_ = nullptr;
+    onFloatEventMethod_ = nullptr;
+    onDoubleEventMethod_ = nullptr;
+    onBooleanEventMethod_ = nullptr;
+    onByteArrayEventMethod_ = nullptr;
+    onByteBufferEventMethod_ = nullptr;
+    
     LOGI("Listener unregistered");
 }
 
@@ -124,32 +235,22 @@ void IOBridge::postStringEvent(const std::string& eventId, const std::string& da
         return;
     }
     
-    Event event;
-    event.type = EventType::STRING;
-    event.eventId = eventId;
+    Event event = makeEvent(EventType::STRING, eventIds_.intern(eventId));
     
-    // Encrypt data if encryption is enabled
-    if (encryptionEnabled_) {
-        event.stringValue = encryptMessage(data);
+    // Encrypt data if encryption is enabled, directly into the event's payload
+    bool stored;
+    if (encryptionEnabled_ && !data.empty()) {
+        stored = storeEncryptedPayload(event, asBytes(data));
     } else {
-        event.stringValue = data;
+        stored = storePayload(event, data.data(), data.size());
     }
     
-    {
-        std::lock_guard<std::mutex> lock(queueMutex_);
-        eventQueue_.push_back(std::move(event));
+    if (!stored) {
+        LOGE("Failed to allocate payload for event: %s", eventId.c_str());
+        return;
     }
     
-    // Submit to thread pool for processing (only if not already scheduled)
-    if (threadManager_ != nullptr) {
-        bool expected = false;
-        if (processingScheduled_.compare_exchange_strong(expected, true)) {
-            threadManager_->submitTask([this]() {
-                processEvents();
-                processingScheduled_ = false;
-            });
-        }
-    }
+    enqueueEvent(std::move(event));
 }
 
 void IOBridge::postIntEvent(const std::string& eventId, int32_t data) {
@@ -158,25 +259,10 @@ void IOBridge::postIntEvent(const std::string& eventId, int32_t data) {
         return;
     }
     
-    Event event;
-    event.type = EventType::INT;
-    event.eventId = eventId;
+    Event event = makeEvent(EventType::INT, eventIds_.intern(eventId));
     event.intValue = data;
     
-    {
-        std::lock_guard<std::mutex> lock(queueMutex_);
-        eventQueue_.push_back(std::move(event));
-    }
-    
-    if (threadManager_ != nullptr) {
-        bool expected = false;
-        if (processingScheduled_.compare_exchange_strong(expected, true)) {
-            threadManager_->submitTask([this]() {
-                processEvents();
-                processingScheduled_ = false;
-            });
-        }
-    }
+    enqueueEvent(std::move(event));
 }
 
 void IOBridge::postFloatEvent(const std::string& eventId, float data) {
@@ -185,25 +271,10 @@ void IOBridge::postFloatEvent(const std::string& eventId, float data) {
         return;
     }
     
-    Event event;
-    event.type = EventType::FLOAT;
-    event.eventId = eventId;
+    Event event = makeEvent(EventType::FLOAT, eventIds_.intern(eventId));
     event.floatValue = data;
     
-    {
-        std::lock_guard<std::mutex> lock(queueMutex_);
-        eventQueue_.push_back(std::move(event));
-    }
-    
-    if (threadManager_ != nullptr) {
-        bool expected = false;
-        if (processingScheduled_.compare_exchange_strong(expected, true)) {
-            threadManager_->submitTask([this]() {
-                processEvents();
-                processingScheduled_ = false;
-            });
-        }
-    }
+    enqueueEvent(std::move(event));
 }
 
 void IOBridge::postDoubleEvent(const std::string& eventId, double data) {
@@ -212,25 +283,10 @@ void IOBridge::postDoubleEvent(const std::string& eventId, double data) {
         return;
     }
     
-    Event event;
-    event.type = EventType::DOUBLE;
-    event.eventId = eventId;
+    Event event = makeEvent(EventType::DOUBLE, eventIds_.intern(eventId));
     event.doubleValue = data;
     
-    {
-        std::lock_guard<std::mutex> lock(queueMutex_);
-        eventQueue_.push_back(std::move(event));
-    }
-    
-    if (threadManager_ != nullptr) {
-        bool expected = false;
-        if (processingScheduled_.compare_exchange_strong(expected, true)) {
-            threadManager_->submitTask([this]() {
-                processEvents();
-                processingScheduled_ = false;
-            });
-        }
-    }
+    enqueueEvent(std::move(event));
 }
 
 void IOBridge::postBooleanEvent(const std::string& eventId, bool data) {
@@ -239,63 +295,346 @@ void IOBridge::postBooleanEvent(const std::string& eventId, bool data) {
         return;
     }
     
-    Event event;
-    event.type = EventType::BOOLEAN;
-    event.eventId = eventId;
+    Event event = makeEvent(EventType::BOOLEAN, eventIds_.intern(eventId));
     event.boolValue = data;
     
-    {
-        std::lock_guard<std::mutex> lock(queueMutex_);
-        eventQueue_.push_back(std::move(event));
+    enqueueEvent(std::move(event));
+}
+
+void IOBridge::postByteArrayEvent(const std::string& eventId, const uint8_t* data, size_t length) {
+    if (!isInitialized()) {
+        LOGE("Cannot post event: bridge not initialized");
+        return;
     }
     
-    if (threadManager_ != nullptr) {
-        bool expected = false;
-        if (processingScheduled_.compare_exchange_strong(expected, true)) {
-            threadManager_->submitTask([this]() {
-                processEvents();
-                processingScheduled_ = false;
-            });
-        }
+    Event event = makeEvent(EventType::BYTE_ARRAY, eventIds_.intern(eventId));
+    
+    // Encrypt byte array if encryption is enabled
+    bool stored;
+    if (encryptionEnabled_ && length > 0) {
+        stored = storeEncryptedPayload(event, ConstByteSpan(data, length));
+    } else {
+        stored = storePayload(event, data, length);
+    }
+    
+    if (!stored) {
+        LOGE("Failed to allocate payload for event: %s", eventId.c_str());
+        return;
     }
+    
+    enqueueEvent(std::move(event));
 }
 
-void IOBridge::postByteArrayEvent(const std::string& eventId, const uint8_t* data, size_t length) {
+void IOBridge::postByteArrayBuffer(const std::string& eventId, uint8_t* buffer, size_t length) {
     if (!isInitialized()) {
         LOGE("Cannot post event: bridge not initialized");
+        releaseBuffer(buffer);
         return;
     }
     
-    Event event;
-    event.type = EventType::BYTE_ARRAY;
-    event.eventId = eventId;
+    Event event = makeEvent(EventType::BYTE_ARRAY, eventIds_.intern(eventId));
     
-    // Encrypt byte array if encryption is enabled
+    bool stored = true;
     if (encryptionEnabled_ && length > 0) {
-        // Convert byte array to string, encrypt, then convert back
-        std::string dataString(reinterpret_cast<const char*>(data), length);
-        std::string encryptedString = encryptMessage(dataString);
-        event.byteArrayValue.assign(
-            reinterpret_cast<const uint8_t*>(encryptedString.data()),
-            reinterpret_cast<const uint8_t*>(encryptedString.data()) + encryptedString.size()
-        );
+        stored = storeEncryptedPayload(event, ConstByteSpan(buffer, length));
+        releaseBuffer(buffer);
+    } else if (length <= Event::INLINE_CAPACITY) {
+        stored = storePayload(event, buffer, length);
+        releaseBuffer(buffer);
+    } else {
+        event.adoptPayload(buffer, length);
+    }
+    
+    if (!stored) {
+        LOGE("Failed to allocate payload for event: %s", eventId.c_str());
+        return;
+    }
+    
+    enqueueEvent(std::move(event));
+}
+
+uint8_t* IOBridge::acquireBuffer(size_t length) {
+    return payloadPool_.acquire(length);
+}
+
+void IOBridge::releaseBuffer(uint8_t* buffer) {
+    payloadPool_.release(buffer);
+}
+
+int64_t IOBridge::lendBuffer(uint8_t* buffer) {
+    uint32_t generation = nextLendGeneration.fetch_add(1);
+    if (generation == 0) {
+        generation = nextLendGeneration.fetch_add(1); // 0 marks a free slot
+    }
+    
+    std::lock_guard<std::mutex> lock(lentMutex_);
+    uint32_t slot;
+    if (!freeLentSlots_.empty()) {
+        slot = freeLentSlots_.back();
+        freeLentSlots_.pop_back();
     } else {
-        event.byteArrayValue.assign(data, data + length);
+        slot = static_cast<uint32_t>(lentBuffers_.size());
+        lentBuffers_.emplace_back();
+    }
+    lentBuffers_[slot].buffer = buffer;
+    lentBuffers_[slot].generation = generation;
+    return static_cast<int64_t>((static_cast<uint64_t>(generation) << 32) | slot);
+}
+
+bool IOBridge::releaseLentBuffer(int64_t handle) {
+    uint32_t slot = static_cast<uint32_t>(static_cast<uint64_t>(handle));
+    uint32_t generation = static_cast<uint32_t>(static_cast<uint64_t>(handle) >> 32);
+    
+    uint8_t* buffer;
+    {
+        std::lock_guard<std::mutex> lock(lentMutex_);
+        if (generation == 0 || slot >= lentBuffers_.size() || lentBuffers_[slot].generation != generation) {
+            return false;
+        }
+        buffer = lentBuffers_[slot].buffer;
+        lentBuffers_[slot] = LentBuffer();
+        freeLentSlots_.push_back(slot);
+    }
+    
+    payloadPool_.release(buffer);
+    return true;
+}
+
+void IOBridge::setDirectBufferThreshold(size_t threshold) {
+    directBufferThreshold_ = threshold;
+}
+
+bool IOBridge::storePayload(Event& event, const void* data, size_t length) {
+    uint8_t* payload = event.allocatePayload(payloadPool_, length);
+    if (payload == nullptr) {
+        return false;
+    }
+    bulkCopy(payload, data, length);
+    return true;
+}
+
+bool IOBridge::storeEncryptedPayload(Event& event, ConstByteSpan data) {
+    PayloadEncoding encoding = payloadEncoding_;
+    size_t encryptedLength = requiredSize(data.size(), encoding);
+    uint8_t* payload = event.allocatePayload(payloadPool_, encryptedLength);
+    if (payload == nullptr) {
+        return false;
+    }
+    size_t written = 0;
+    return encryptInto(data, ByteSpan(payload, encryptedLength), written, encoding);
+}
+
+void IOBridge::decryptPayload(Event& event) {
+    if (event.length > 0) {
+        event.length = static_cast<uint32_t>(decryptInPlace(ByteSpan(event.payload(), event.length)));
+    }
+}
+
+void IOBridge::setDeliveryPolicy(const std::string& eventId, DeliveryPolicy policy, uint32_t maxPerSecond) {
+    if (policy == DeliveryPolicy::RATE_LIMIT && maxPerSecond == 0) {
+        LOGE("RATE_LIMIT for %s needs a budget of at least one event per second", eventId.c_str());
+        return;
+    }
+    
+    uint32_t id = eventIds_.intern(eventId);
+    
+    std::lock_guard<std::mutex> lock(queueMutex_);
+    if (id >= policies_.size()) {
+        policies_.resize(id + 1);
+    }
+    
+    PolicyState& state = policies_[id];
+    state.policy = policy;
+    state.maxPerSecond = maxPerSecond;
+    state.deliveriesInWindow = 0;
+    state.windowStartMs = 0;
+    state.pendingGeneration = 0;
+    if (state.hasTrailing) {
+        state.trailing.releasePayload(payloadPool_);
+        state.hasTrailing = false;
+    }
+    
+    if (policy == DeliveryPolicy::RATE_LIMIT && !rateLimitThread_.joinable()) {
+        stopRateLimit_ = false;
+        rateLimitThread_ = std::thread(&IOBridge::rateLimitLoop, this);
+    }
+}
+
+bool IOBridge::applyDeliveryPolicy(Event& event) {
+    // Called with queueMutex_ held. Returns true if the event should be appended to the
+    // queue, false if it was folded into a pending event or dropped.
+    if (event.eventId >= policies_.size()) {
+        return true;
+    }
+    
+    PolicyState& state = policies_[event.eventId];
+    if (state.policy == DeliveryPolicy::DELIVER_ALL) {
+        return true;
+    }
+    
+    bool hasPending = state.pendingGeneration == queueGeneration_;
+    Event* pending = hasPending ? &eventQueue_[state.pendingSlot] : nullptr;
+    
+    if (state.policy == DeliveryPolicy::RATE_LIMIT) {
+        int64_t nowMs = steadyNowMs();
+        if (nowMs - state.windowStartMs >= RATE_LIMIT_WINDOW_MS) {
+            state.windowStartMs = nowMs;
+            state.deliveriesInWindow = 0;
+        }
+        if (state.deliveriesInWindow < state.maxPerSecond) {
+            // Anything held back is older than this event
+            if (state.hasTrailing) {
+                state.trailing.releasePayload(payloadPool_);
+                state.hasTrailing = false;
+            }
+            state.deliveriesInWindow++;
+            state.pendingSlot = eventQueue_.size();
+            state.pendingGeneration = queueGeneration_;
+            return true;
+        }
+        // Over budget: refresh the undelivered event if there is one, otherwise hold this
+        // one back so the last value still arrives once the window reopens
+        if (pending != nullptr) {
+            pending->releasePayload(payloadPool_);
+            *pending = event;
+        } else {
+            holdTrailingEvent(state, event);
+        }
+        return false;
+    }
+    
+    if (pending == nullptr) {
+        state.pendingSlot = eventQueue_.size();
+        state.pendingGeneration = queueGeneration_;
+        return true;
+    }
+    
+    if (state.policy == DeliveryPolicy::COALESCE && pending->type == event.type) {
+        switch (event.type) {
+            case EventType::INT: {
+                // Sums that leave the int range stop at its ends rather than wrap
+                int64_t sum = static_cast<int64_t>(pending->intValue) + event.intValue;
+                pending->intValue = static_cast<int32_t>(std::clamp<int64_t>(sum, INT32_MIN, INT32_MAX));
+                return false;
+            }
+            case EventType::FLOAT:
+                pending->floatValue += event.floatValue;
+                return false;
+            case EventType::DOUBLE:
+                pending->doubleValue += event.doubleValue;
+                return false;
+            default:
+                break; // Non-numeric values are conflated
+        }
+    }
+    
+    // Keep the latest value in the pending event's queue position
+    pending->releasePayload(payloadPool_);
+    *pending = event;
+    return false;
+}
+
+void IOBridge::holdTrailingEvent(PolicyState& state, Event& event) {
+    // Called with queueMutex_ held
+    if (state.hasTrailing) {
+        state.trailing.releasePayload(payloadPool_);
+    }
+    state.trailing = event;
+    state.hasTrailing = true;
+    rateLimitCondition_.notify_one();
+}
+
+void IOBridge::rateLimitLoop() {
+    std::unique_lock<std::mutex> lock(queueMutex_);
+    while (!stopRateLimit_) {
+        // Queue every trailing event whose window has reopened, as the first delivery of
+        // the new window, and sleep until the earliest of the others is due
+        int64_t nowMs = steadyNowMs();
+        int64_t nextDueMs = INT64_MAX;
+        bool queued = false;
+        for (auto& state : policies_) {
+            if (!state.hasTrailing) {
+                continue;
+            }
+            int64_t dueMs = state.windowStartMs + RATE_LIMIT_WINDOW_MS;
+            if (nowMs < dueMs) {
+                nextDueMs = std::min(nextDueMs, dueMs);
+                continue;
+            }
+            state.windowStartMs = nowMs;
+            state.deliveriesInWindow = 1;
+            state.pendingSlot = eventQueue_.size();
+            state.pendingGeneration = queueGeneration_;
+            state.hasTrailing = false;
+            eventQueue_.push_back(state.trailing);
+            pendingEvents_.fetch_add(1);
+            queued = true;
+        }
+        
+        if (queued) {
+            lock.unlock();
+            signalPendingEvents();
+            lock.lock();
+        } else if (nextDueMs == INT64_MAX) {
+            rateLimitCondition_.wait(lock);
+        } else {
+            rateLimitCondition_.wait_until(lock, std::chrono::steady_clock::time_point(
+                std::chrono::milliseconds(nextDueMs)));
+        }
+    }
+}
+
+void IOBridge::stopRateLimitTimer() {
+    if (!rateLimitThread_.joinable()) {
+        return;
     }
     
     {
         std::lock_guard<std::mutex> lock(queueMutex_);
+        stopRateLimit_ = true;
+    }
+    rateLimitCondition_.notify_one();
+    rateLimitThread_.join();
+}
+
+void IOBridge::enqueueEvent(Event&& event) {
+    {
+        std::lock_guard<std::mutex> lock(queueMutex_);
+        if (!applyDeliveryPolicy(event)) {
+            return;
+        }
         eventQueue_.push_back(std::move(event));
+        pendingEvents_.fetch_add(1);
+    }
+    
+    signalPendingEvents();
+}
+
+void IOBridge::signalPendingEvents() {
+    if (dispatcherRunning_.load()) {
+        wakeDispatcher();
+    } else {
+        scheduleProcessing();
+    }
+}
+
+void IOBridge::scheduleProcessing() {
+    if (threadManager_ == nullptr) {
+        return;
     }
     
-    if (threadManager_ != nullptr) {
-        bool expected = false;
-        if (processingScheduled_.compare_exchange_strong(expected, true)) {
-            threadManager_->submitTask([this]() {
+    // Submit to thread pool for processing (only if not already scheduled)
+    bool expected = false;
+    if (processingScheduled_.compare_exchange_strong(expected, true)) {
+        threadManager_->submitTask([this]() {
+            // Re-check after clearing the flag: an event posted between the final drain
+            // and the reset would otherwise see the flag still set and never be scheduled
+            do {
                 processEvents();
                 processingScheduled_ = false;
-            });
-        }
+            } while (pendingEvents_.load() > 0 && !dispatcherRunning_.load() &&
+                     !processingScheduled_.exchange(true));
+        });
     }
 }
 
@@ -310,65 +649,70 @@ void IOBridge::processEvents() {
         return;
     }
     
-    std::vector<Event> eventsToProcess;
+    dispatchPendingEvents(env);
+}
+
+void IOBridge::dispatchPendingEvents(JNIEnv* env) {
+    if (listenerObject_ == nullptr) {
+        return;
+    }
     
-    // Move events from queue (more efficient than copying)
+    // Only one thread delivers at a time, even while switching between pool and dispatcher
+    std::lock_guard<std::mutex> dispatchLock(dispatchMutex_);
+    
+    // Swap queues so both vectors keep their capacity across batches
     {
         std::lock_guard<std::mutex> lock(queueMutex_);
-        eventsToProcess.reserve(eventQueue_.size());
-        eventsToProcess = std::move(eventQueue_);
-        eventQueue_.clear();
+        dispatchBuffer_.swap(eventQueue_);
+        pendingEvents_ = 0;
+        queueGeneration_++;
     }
     
     // Process each event
-    for (const auto& event : eventsToProcess) {
-        jstring eventIdStr = env->NewStringUTF(event.eventId.c_str());
+    for (auto& event : dispatchBuffer_) {
+        jstring eventIdStr = eventIdString(env, event.eventId);
+        const uint8_t* payload = event.payload();
         
         switch (event.type) {
             case EventType::STRING: {
-                // Decrypt string data if encryption is enabled
-                std::string dataToSend = event.stringValue;
+                // Decrypt string data in place if encryption is enabled
                 if (encryptionEnabled_) {
-                    dataToSend = decryptMessage(event.stringValue);
+                    decryptPayload(event);
                 }
-                invokeStringCallback(env, event.eventId, dataToSend);
+                invokeStringCallback(env, eventIdStr,
+                                     std::string(reinterpret_cast<const char*>(payload), event.length));
                 break;
             }
             case EventType::INT:
-                invokeIntCallback(env, event.eventId, event.intValue);
+                invokeIntCallback(env, eventIdStr, event.intValue);
                 break;
             case EventType::FLOAT:
-                invokeFloatCallback(env, event.eventId, event.floatValue);
+                invokeFloatCallback(env, eventIdStr, event.floatValue);
                 break;
             case EventType::DOUBLE:
-                invokeDoubleCallback(env, event.eventId, event.doubleValue);
+                invokeDoubleCallback(env, eventIdStr, event.doubleValue);
                 break;
             case EventType::BOOLEAN:
-                invokeBooleanCallback(env, event.eventId, event.boolValue);
+                invokeBooleanCallback(env, eventIdStr, event.boolValue);
                 break;
             case EventType::BYTE_ARRAY: {
-                // Decrypt byte array if encryption is enabled
-                if (encryptionEnabled_ && !event.byteArrayValue.empty()) {
-                    std::string encryptedString(
-                        reinterpret_cast<const char*>(event.byteArrayValue.data()),
-                        event.byteArrayValue.size()
-                    );
-                    std::string decryptedString = decryptMessage(encryptedString);
-                    std::vector<uint8_t> decryptedData(
-                        reinterpret_cast<const uint8_t*>(decryptedString.data()),
-                        reinterpret_cast<const uint8_t*>(decryptedString.data()) + decryptedString.size()
-                    );
-                    invokeByteArrayCallback(env, event.eventId, decryptedData.data(), decryptedData.size());
+                // Decrypt byte array in place if encryption is enabled
+                if (encryptionEnabled_) {
+                    decryptPayload(event);
+                }
+                
+                // Large payloads cross as a direct buffer over the pooled slice itself
+                if (event.isSpilled() && event.length >= directBufferThreshold_ && onByteBufferEventMethod_ != nullptr) {
+                    size_t length = event.length;
+                    invokeByteBufferCallback(env, eventIdStr, event.detachPayload(), length);
                 } else {
-                    invokeByteArrayCallback(env, event.eventId, event.byteArrayValue.data(), event.byteArrayValue.size());
+                    invokeByteArrayCallback(env, eventIdStr, event.payload(), event.length);
                 }
                 break;
             }
         }
         
-        if (eventIdStr != nullptr) {
-            env->DeleteLocalRef(eventIdStr);
-        }
+        event.releasePayload(payloadPool_);
         
         // Check for exceptions
         if (env->ExceptionCheck()) {
@@ -376,12 +720,172 @@ void IOBridge::processEvents() {
             env->ExceptionClear();
         }
     }
+    
+    dispatchBuffer_.clear();
+}
+
+jstring IOBridge::eventIdString(JNIEnv* env, uint32_t eventId) {
+    if (eventId >= eventIdStrings_.size()) {
+        eventIdStrings_.resize(eventIds_.size(), nullptr);
+    }
+    
+    jstring& cached = eventIdStrings_[eventId];
+    if (cached == nullptr) {
+        jstring localStr = env->NewStringUTF(eventIds_.name(eventId).c_str());
+        if (localStr == nullptr) {
+            return nullptr;
+        }
+        cached = static_cast<jstring>(env->NewGlobalRef(localStr));
+        env->DeleteLocalRef(localStr);
+    }
+    
+    return cached;
+}
+
+void IOBridge::releaseEventIdStrings(JNIEnv* env) {
+    std::lock_guard<std::mutex> dispatchLock(dispatchMutex_);
+    for (jstring str : eventIdStrings_) {
+        if (str != nullptr) {
+            env->DeleteGlobalRef(str);
+        }
+    }
+    eventIdStrings_.clear();
 }
 
 void IOBridge::setThreadManager(ThreadManager* threadManager) {
     threadManager_ = threadManager;
 }
 
+bool IOBridge::startDispatcher(bool adaptiveSpin) {
+    if (jvm_ == nullptr) {
+        LOGE("Cannot start dispatcher: bridge not initialized");
+        return false;
+    }
+    if (dispatcherThread_.joinable()) {
+        return dispatcherRunning_.load();
+    }
+    
+    // The eventfd is created once and kept until the bridge is destroyed, so a late
+    // wakeup from a producer never lands on a closed or reused descriptor
+    if (wakeFd_.load() < 0) {
+        int wakeFd = eventfd(0, EFD_CLOEXEC);
+        if (wakeFd < 0) {
+            LOGE("Failed to create dispatcher eventfd: %d", errno);
+            return false;
+        }
+        wakeFd_ = wakeFd;
+    }
+    
+    stopDispatcher_ = false;
+    dispatcherSleeping_ = false;
+    dispatcherRunning_ = true;
+    dispatcherThread_ = std::thread(&IOBridge::dispatcherLoop, this, adaptiveSpin);
+    
+    // Pick up anything queued while the pool was still responsible for delivery
+    wakeDispatcher();
+    
+    LOGI("IOBridge dispatcher started (adaptive spin %s)", adaptiveSpin ? "on" : "off");
+    return true;
+}
+
+void IOBridge::stopDispatcher() {
+    if (!dispatcherThread_.joinable()) {
+        return;
+    }
+    
+    // Producers that see the flag cleared schedule the pool themselves from here on
+    dispatcherRunning_ = false;
+    stopDispatcher_ = true;
+    uint64_t one = 1;
+    if (write(wakeFd_.load(), &one, sizeof(one)) < 0 && errno != EAGAIN) {
+        LOGE("Failed to wake dispatcher for shutdown: %d", errno);
+    }
+    
+    if (dispatcherThread_.joinable()) {
+        dispatcherThread_.join();
+    }
+    
+    // Hand any leftovers back to the pool. A producer still in flight either increments
+    // pendingEvents_ before this load, or loads dispatcherRunning_ after it was cleared and
+    // schedules the pool itself: both sides are sequentially consistent, so one of them sees
+    // the other's write.
+    if (pendingEvents_.load() > 0) {
+        scheduleProcessing();
+    }
+    
+    LOGI("IOBridge dispatcher stopped");
+}
+
+DispatchMode IOBridge::getDispatchMode() const {
+    return dispatcherRunning_.load() ? DispatchMode::DEDICATED_THREAD : DispatchMode::THREAD_POOL;
+}
+
+void IOBridge::wakeDispatcher() {
+    // Only pay for the syscall when the dispatcher is actually parked. The sequentially
+    // consistent pendingEvents_ increment and dispatcherSleeping_ load pair with the
+    // dispatcher's store/load in the opposite order, so a wakeup cannot be lost.
+    if (!dispatcherSleeping_.load()) {
+        return;
+    }
+    
+    uint64_t one = 1;
+    if (write(wakeFd_.load(), &one, sizeof(one)) < 0 && errno != EAGAIN) {
+        LOGE("Failed to wake dispatcher: %d", errno);
+    }
+}
+
+void IOBridge::dispatcherLoop(bool adaptiveSpin) {
+    JNIEnv* env = nullptr;
+    JavaVMAttachArgs attachArgs;
+    attachArgs.version = JNI_VERSION_1_6;
+    attachArgs.name = "IOBridgeDispatch";
+    attachArgs.group = nullptr;
+    
+    if (jvm_->AttachCurrentThread(&env, &attachArgs) != JNI_OK || env == nullptr) {
+        LOGE("Dispatcher failed to attach to JVM");
+        dispatcherRunning_ = false;
+        return;
+    }
+    
+    uint32_t spinIterations = MIN_SPIN_ITERATIONS;
+    
+    while (!stopDispatcher_.load()) {
+        if (pendingEvents_.load() > 0 && listenerObject_ != nullptr) {
+            dispatchPendingEvents(env);
+            continue;
+        }
+        
+        // Under load, the next event usually arrives within a few microseconds.
+        // Grow the spin window when spinning pays off and shrink it when it doesn't.
+        if (adaptiveSpin) {
+            bool found = false;
+            for (uint32_t i = 0; i < spinIterations; ++i) {
+                if (pendingEvents_.load(std::memory_order_relaxed) > 0 || stopDispatcher_.load(std::memory_order_relaxed)) {
+                    found = true;
+                    break;
+                }
+                cpuRelax();
+            }
+            if (found) {
+                spinIterations = std::min(spinIterations * 2, MAX_SPIN_ITERATIONS);
+                continue;
+            }
+            spinIterations = std::max(spinIterations / 2, MIN_SPIN_ITERATIONS);
+        }
+        
+        dispatcherSleeping_.store(true);
+        if ((pendingEvents_.load() == 0 || listenerObject_ == nullptr) && !stopDispatcher_.load()) {
+            uint64_t counter = 0;
+            if (read(wakeFd_.load(), &counter, sizeof(counter)) < 0 && errno != EINTR) {
+                LOGE("Dispatcher eventfd read failed: %d", errno);
+            }
+        }
+        dispatcherSleeping_.store(false);
+    }
+    
+    jvm_->DetachCurrentThread();
+}
+
 bool IOBridge::isInitialized() const {
     return jvm_ != nullptr && listenerObject_ != nullptr;
 }
@@ -409,127 +913,90 @@ JNIEnv* IOBridge::getJNIEnv() {
     return env;
 }
 
-void IOBridge::invokeStringCallback(JNIEnv* env, const std::string& eventId, const std::string& data) {
-    if (listenerClass_ == nullptr || listenerObject_ == nullptr) {
+void IOBridge::invokeStringCallback(JNIEnv* env, jstring eventIdStr, const std::string& data) {
+    if (listenerObject_ == nullptr || onStringEventMethod_ == nullptr) {
         return;
     }
     
-    jmethodID methodId = env->GetMethodID(listenerClass_, "onStringEvent", "(Ljava/lang/String;Ljava/lang/String;)V");
-    if (methodId == nullptr) {
-        LOGE("Failed to find onStringEvent method");
-        return;
-    }
-    
-    jstring eventIdStr = env->NewStringUTF(eventId.c_str());
     jstring dataStr = env->NewStringUTF(data.c_str());
     
-    env->CallVoidMethod(listenerObject_, methodId, eventIdStr, dataStr);
+    env->CallVoidMethod(listenerObject_, onStringEventMethod_, eventIdStr, dataStr);
     
-    if (eventIdStr != nullptr) {
-        env->DeleteLocalRef(eventIdStr);
-    }
     if (dataStr != nullptr) {
         env->DeleteLocalRef(dataStr);
     }
 }
 
-void IOBridge::invokeIntCallback(JNIEnv* env, const std::string& eventId, int32_t data) {
-    if (listenerClass_ == nullptr || listenerObject_ == nullptr) {
+void IOBridge::invokeIntCallback(JNIEnv* env, jstring eventIdStr, int32_t data) {
+    if (listenerObject_ == nullptr || onIntEventMethod_ == nullptr) {
         return;
     }
     
-    jmethodID methodId = env->GetMethodID(listenerClass_, "onIntEvent", "(Ljava/lang/String;I)V");
-    if (methodId == nullptr) {
-        LOGE("Failed to find onIntEvent method");
-        return;
-    }
-    
-    jstring eventIdStr = env->NewStringUTF(eventId.c_str());
-    env->CallVoidMethod(listenerObject_, methodId, eventIdStr, data);
-    
-    if (eventIdStr != nullptr) {
-        env->DeleteLocalRef(eventIdStr);
-    }
+    env->CallVoidMethod(listenerObject_, onIntEventMethod_, eventIdStr, data);
 }
 
-void IOBridge::invokeFloatCallback(JNIEnv* env, const std::string& eventId, float data) {
-    if (listenerClass_ == nullptr || listenerObject_ == nullptr) {
+void IOBridge::invokeFloatCallback(JNIEnv* env, jstring eventIdStr, float data) {
+    if (listenerObject_ == nullptr || onFloatEventMethod_ == nullptr) {
         return;
     }
     
-    jmethodID methodId = env->GetMethodID(listenerClass_, "onFloatEvent", "(Ljava/lang/String;F)V");
-    if (methodId == nullptr) {
-        LOGE("Failed to find onFloatEvent method");
-        return;
-    }
-    
-    jstring eventIdStr = env->NewStringUTF(eventId.c_str());
-    env->CallVoidMethod(listenerObject_, methodId, eventIdStr, data);
-    
-    if (eventIdStr != nullptr) {
-        env->DeleteLocalRef(eventIdStr);
-    }
+    env->CallVoidMethod(listenerObject_, onFloatEventMethod_, eventIdStr, data);
 }
 
-void IOBridge::invokeDoubleCallback(JNIEnv* env, const std::string& eventId, double data) {
-    if (listenerClass_ == nullptr || listenerObject_ == nullptr) {
-        return;
-    }
-    
-    jmethodID methodId = env->GetMethodID(listenerClass_, "onDoubleEvent", "(Ljava/lang/String;D)V");
-    if (methodId == nullptr) {
-        LOGE("Failed to find onDoubleEvent method");
+void IOBridge::invokeDoubleCallback(JNIEnv* env, jstring eventIdStr, double data) {
+    if (listenerObject_ == nullptr || onDoubleEventMethod_ == nullptr) {
         return;
     }
     
-    jstring eventIdStr = env->NewStringUTF(eventId.c_str());
-    env->CallVoidMethod(listenerObject_, methodId, eventIdStr, data);
-    
-    if (eventIdStr != nullptr) {
-        env->DeleteLocalRef(eventIdStr);
-    }
+    env->CallVoidMethod(listenerObject_, onDoubleEventMethod_, eventIdStr, data);
 }
 
-void IOBridge::invokeBooleanCallback(JNIEnv* env, const std::string& eventId, bool data) {
-    if (listenerClass_ == nullptr || listenerObject_ == nullptr) {
+void IOBridge::invokeBooleanCallback(JNIEnv* env, jstring eventIdStr, bool data) {
+    if (listenerObject_ == nullptr || onBooleanEventMethod_ == nullptr) {
         return;
     }
     
-    jmethodID methodId = env->GetMethodID(listenerClass_, "onBooleanEvent", "(Ljava/lang/String;Z)V");
-    if (methodId == nullptr) {
-        LOGE("Failed to find onBooleanEvent method");
+    env->CallVoidMethod(listenerObject_, onBooleanEventMethod_, eventIdStr, data ? JNI_TRUE : JNI_FALSE);
+}
+
+void IOBridge::invokeByteArrayCallback(JNIEnv* env, jstring eventIdStr, const uint8_t* data, size_t length) {
+    if (listenerObject_ == nullptr || onByteArrayEventMethod_ == nullptr) {
         return;
     }
     
-    jstring eventIdStr = env->NewStringUTF(eventId.c_str());
-    env->CallVoidMethod(listenerObject_, methodId, eventIdStr, data ? JNI_TRUE : JNI_FALSE);
+    jbyteArray byteArray = env->NewByteArray(static_cast<jsize>(length));
     
-    if (eventIdStr != nullptr) {
-        env->DeleteLocalRef(eventIdStr);
+    if (byteArray != nullptr) {
+        env->SetByteArrayRegion(byteArray, 0, static_cast<jsize>(length), reinterpret_cast<const jbyte*>(data));
+        env->CallVoidMethod(listenerObject_, onByteArrayEventMethod_, eventIdStr, byteArray);
+        env->DeleteLocalRef(byteArray);
     }
 }
 
-void IOBridge::invokeByteArrayCallback(JNIEnv* env, const std::string& eventId, const uint8_t* data, size_t length) {
-    if (listenerClass_ == nullptr || listenerObject_ == nullptr) {
+void IOBridge::invokeByteBufferCallback(JNIEnv* env, jstring eventIdStr, uint8_t* buffer, size_t length) {
+    if (listenerObject_ == nullptr || onByteBufferEventMethod_ == nullptr) {
+        releaseBuffer(buffer);
         return;
     }
     
-    jmethodID methodId = env->GetMethodID(listenerClass_, "onByteArrayEvent", "(Ljava/lang/String;[B)V");
-    if (methodId == nullptr) {
-        LOGE("Failed to find onByteArrayEvent method");
+    jobject directBuffer = env->NewDirectByteBuffer(buffer, static_cast<jlong>(length));
+    if (directBuffer == nullptr) {
+        LOGE("Failed to create direct buffer, falling back to byte array");
+        if (env->ExceptionCheck()) {
+            env->ExceptionClear();
+        }
+        invokeByteArrayCallback(env, eventIdStr, buffer, length);
+        releaseBuffer(buffer);
         return;
     }
     
-    jstring eventIdStr = env->NewStringUTF(eventId.c_str());
-    jbyteArray byteArray = env->NewByteArray(static_cast<jsize>(length));
-    
-    if (byteArray != nullptr) {
-        env->SetByteArrayRegion(byteArray, 0, static_cast<jsize>(length), reinterpret_cast<const jbyte*>(data));
-        env->CallVoidMethod(listenerObject_, methodId, eventIdStr, byteArray);
-        env->DeleteLocalRef(byteArray);
-    }
+    // Ownership of the buffer passes to the listener, which returns it through releaseLentBuffer()
+    int64_t handle = lendBuffer(buffer);
+    env->CallVoidMethod(listenerObject_, onByteBufferEventMethod_, eventIdStr, directBuffer, static_cast<jlong>(handle));
+    env->DeleteLocalRef(directBuffer);
     
-    if (eventIdStr != nullptr) {
-        env->DeleteLocalRef(eventIdStr);
+    // A listener that threw may never release it; if it did before throwing, the handle is stale
+    if (env->ExceptionCheck()) {
+        releaseLentBuffer(handle);
     }
 }
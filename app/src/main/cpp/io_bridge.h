@@ -5,39 +5,29 @@
 #include <string>
 #include <vector>
 #include <mutex>
+#include <condition_variable>
 #include <memory>
 #include <functional>
 #include <atomic>
 #include <cstdint>
+#include <thread>
 #include "message_encryption.h"
+#include "event_record.h"
 
 // Forward declaration
 class ThreadManager;
 
-enum class EventType {
-    STRING,
-    INT,
-    FLOAT,
-    DOUBLE,
-    BOOLEAN,
-    BYTE_ARRAY
+enum class DispatchMode {
+    THREAD_POOL,        // Events are delivered by whichever pool worker picks up the task
+    DEDICATED_THREAD    // Events are delivered by one long-lived, JVM-attached thread
 };
 
-struct Event {
-    EventType type;
-    std::string eventId;
-    
-    // Union for different event data types
-    union {
-        int32_t intValue;
-        float floatValue;
-        double doubleValue;
-        bool boolValue;
-    };
-    std::string stringValue;
-    std::vector<uint8_t> byteArrayValue;
-    
-    Event() : type(EventType::STRING), intValue(0) {}
+// How queued events with the same ID are combined before JNI dispatch
+enum class DeliveryPolicy : uint8_t {
+    DELIVER_ALL,    // Every event is delivered (default)
+    CONFLATE,       // Only the latest undelivered value is kept
+    COALESCE,       // Undelivered numeric values of the same type are summed, INT sums saturating; anything else is conflated
+    RATE_LIMIT      // At most maxPerSecond deliveries; the latest excess event is delivered once the budget allows
 };
 
 class IOBridge {
@@ -65,14 +55,39 @@ public:
     void postBooleanEvent(const std::string& eventId, bool data);
     void postByteArrayEvent(const std::string& eventId, const uint8_t* data, size_t length);
     
+    // Zero-copy byte array posting: fill a buffer from acquireBuffer() and hand it over with
+    // postByteArrayBuffer(), which takes ownership. Payloads of at least the direct buffer
+    // threshold reach listeners implementing onByteBufferEvent as a DirectByteBuffer over
+    // the same memory, along with an opaque handle the listener returns it with through
+    // releaseLentBuffer(). Stale, repeated or forged handles are rejected.
+    uint8_t* acquireBuffer(size_t length);
+    void releaseBuffer(uint8_t* buffer);
+    bool releaseLentBuffer(int64_t handle);
+    void postByteArrayBuffer(const std::string& eventId, uint8_t* buffer, size_t length);
+    void setDirectBufferThreshold(size_t threshold);
+    
     // Process events (internal, called by ThreadManager)
     void processEvents();
     
     // Set thread manager reference
     void setThreadManager(ThreadManager* threadManager);
     
-    // Encryption control
+    // Dedicated dispatcher control. The dispatcher thread attaches to the JVM once
+    // and parks on an eventfd between posts. With adaptiveSpin it busy-polls the
+    // queue for a short, load-dependent window before parking.
+    bool startDispatcher(bool adaptiveSpin = false);
+    void stopDispatcher();
+    DispatchMode getDispatchMode() const;
+    
+    // Delivery policy control (applied per event ID while events wait in the queue).
+    // RATE_LIMIT needs a maxPerSecond of at least 1; a budget of 0 would drop every event,
+    // so it is rejected and the event ID keeps its previous policy.
+    void setDeliveryPolicy(const std::string& eventId, DeliveryPolicy policy, uint32_t maxPerSecond = 0);
+    
+    // Encryption control. Queued payloads are encrypted as BINARY by default since they never
+    // leave the process; BASE64 remains available. NONE is rejected.
     void enableEncryption(bool enable);
+    void setPayloadEncoding(PayloadEncoding encoding);
     
     // Check if initialized
     bool isInitialized() const;
@@ -83,25 +98,107 @@ private:
     jobject listenerObject_;
     jclass listenerClass_;
     
+    // Listener callbacks, resolved once at registration
+    jmethodID onStringEventMethod_;
+    jmethodID onIntEventMethod_;
+    jmethodID onFloatEventMethod_;
+    jmethodID onDoubleEventMethod_;
+    jmethodID onBooleanEventMethod_;
+    jmethodID onByteArrayEventMethod_;
+    jmethodID onByteBufferEventMethod_;
+    
     // Thread manager reference
     ThreadManager* threadManager_;
     
-    // Event queue
+    // Event queue. dispatchBuffer_ is swapped with eventQueue_ on each drain so
+    // neither vector gives up its capacity.
     std::vector<Event> eventQueue_;
+    std::vector<Event> dispatchBuffer_;
     std::mutex queueMutex_;
+    std::mutex dispatchMutex_;
+    
+    // Interned event IDs, their cached Java strings and out-of-line payload storage
+    EventIdTable eventIds_;
+    std::vector<jstring> eventIdStrings_;
+    PayloadPool payloadPool_;
+    
+    // Per-event-ID delivery policy state, indexed by interned ID and guarded by queueMutex_.
+    // A pending slot is only valid while its generation matches queueGeneration_. A
+    // RATE_LIMIT event over budget with nothing pending waits outside the queue as the
+    // trailing event until the rate limit timer queues it in the next window.
+    struct PolicyState {
+        DeliveryPolicy policy = DeliveryPolicy::DELIVER_ALL;
+        uint32_t maxPerSecond = 0;
+        uint32_t deliveriesInWindow = 0;
+        int64_t windowStartMs = 0;
+        size_t pendingSlot = 0;
+        uint64_t pendingGeneration = 0;
+        bool hasTrailing = false;
+        Event trailing;
+    };
+    std::vector<PolicyState> policies_;
+    uint64_t queueGeneration_;
+    
+    // Rate limit timer, started with the first RATE_LIMIT policy and waiting on queueMutex_
+    std::thread rateLimitThread_;
+    std::condition_variable rateLimitCondition_;
+    bool stopRateLimit_;
+    
+    size_t directBufferThreshold_;
+    
+    // Buffers lent to the listener, addressed by handles holding the slot index in the low
+    // 32 bits and the slot's generation in the high ones. Generations come from a
+    // process-wide counter, so a handle from an earlier bridge does not match this one.
+    struct LentBuffer {
+        uint8_t* buffer = nullptr;
+        uint32_t generation = 0;
+    };
+    std::vector<LentBuffer> lentBuffers_;
+    std::vector<uint32_t> freeLentSlots_;
+    std::mutex lentMutex_;
+    
     std::atomic<bool> stopProcessing_;
     std::atomic<bool> processingScheduled_;
+    std::atomic<size_t> pendingEvents_;
+    
+    // Dedicated dispatcher state
+    std::thread dispatcherThread_;
+    std::atomic<bool> dispatcherRunning_;
+    std::atomic<bool> stopDispatcher_;
+    std::atomic<bool> dispatcherSleeping_;
+    std::atomic<int> wakeFd_;   // Lives as long as the bridge once created
     
     // Encryption state
     bool encryptionEnabled_;
+    PayloadEncoding payloadEncoding_;
+    
+    // Queueing and dispatch helpers
+    void enqueueEvent(Event&& event);
+    bool applyDeliveryPolicy(Event& event);
+    void holdTrailingEvent(PolicyState& state, Event& event);
+    void rateLimitLoop();
+    void stopRateLimitTimer();
+    void signalPendingEvents();
+    void scheduleProcessing();
+    void dispatchPendingEvents(JNIEnv* env);
+    void dispatcherLoop(bool adaptiveSpin);
+    void wakeDispatcher();
+    int64_t lendBuffer(uint8_t* buffer);
+    bool storePayload(Event& event, const void* data, size_t length);
+    bool storeEncryptedPayload(Event& event, ConstByteSpan data);
+    void decryptPayload(Event& event);
+    jstring eventIdString(JNIEnv* env, uint32_t eventId);
+    void releaseEventIdStrings(JNIEnv* env);
     
     // Helper methods
-    void invokeStringCallback(JNIEnv* env, const std::string& eventId, const std::string& data);
-    void invokeIntCallback(JNIEnv* env, const std::string& eventId, int32_t data);
-    void invokeFloatCallback(JNIEnv* env, const std::string& eventId, float data);
-    void invokeDoubleCallback(JNIEnv* env, const std::string& eventId, double data);
-    void invokeBooleanCallback(JNIEnv* env, const std::string& eventId, bool data);
-    void invokeByteArrayCallback(JNIEnv* env, const std::string& eventId, const uint8_t* data, size_t length);
+    void invokeStringCallback(JNIEnv* env, jstring eventIdStr, const std::string& data);
+    void invokeIntCallback(JNIEnv* env, jstring eventIdStr, int32_t data);
+    void invokeFloatCallback(JNIEnv* env, jstring eventIdStr, float data);
+    void invokeDoubleCallback(JNIEnv* env, jstring eventIdStr, double data);
+    void invokeBooleanCallback(JNIEnv* env, jstring eventIdStr, bool data);
+    void invokeByteArrayCallback(JNIEnv* env, jstring eventIdStr, const uint8_t* data, size_t length);
+    void invokeByteBufferCallback(JNIEnv* env, jstring eventIdStr, uint8_t* buffer, size_t length);
+    void resolveListenerMethods(JNIEnv* env);
     
     // Helper to get JNIEnv for current thread
     JNIEnv* getJNIEnv();
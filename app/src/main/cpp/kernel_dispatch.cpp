@@ -0,0 +1,44 @@
+#include "kernel_dispatch.h"
+#include "base64_codec.h"
+#include "bulk_copy.h"
+#include "chacha20_poly1305.h"
+#include "checksum.h"
+#include "message_encryption.h"
+#include <android/log.h>
+
+#define LOG_TAG "KernelDispatch"
+#define LOGI(...) __android_log_print(ANDROID_LOG_INFO, LOG_TAG, __VA_ARGS__)
+#define LOGE(...) __android_log_print(ANDROID_LOG_ERROR, LOG_TAG, __VA_ARGS__)
+
+void initKernelDispatch() {
+    for (KernelFamily* family : kernelFamilies()) {
+        if (!family->select(nullptr)) {
+            LOGE("No usable %s kernel", family->name());
+        }
+    }
+    LOGI("%s", kernelDiagnostics().c_str());
+}
+
+std::vector<KernelFamily*> kernelFamilies() {
+    return {&base64Kernels(), &keystreamKernels(), &chacha20Kernels(), &checksumKernels(), &copyKernels()};
+}
+
+KernelFamily* findKernelFamily(const std::string& name) {
+    for (KernelFamily* family : kernelFamilies()) {
+        if (name == family->name()) {
+            return family;
+        }
+    }
+    return nullptr;
+}
+
+std::string kernelDiagnostics() {
+    std::string report = "cpu: " + cpuFeatureNames(cpuFeatures()) + ";";
+    for (KernelFamily* family : kernelFamilies()) {
+        report += ' ';
+        report += family->name();
+        report += '=';
+        report += family->activeName();
+    }
+    return report;
+}
@@ -0,0 +1,139 @@
+#ifndef KERNEL_DISPATCH_H
+#define KERNEL_DISPATCH_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstring>
+#include <string>
+#include <vector>
+#include "cpu_features.h"
+
+// Runtime selection of SIMD kernels. Each module with several implementations of a hot
+// loop lists them in a KernelTable, best first, each with a predicate on CpuFeatures.
+// The table binds the first variant the CPU supports, either eagerly from
+// initKernelDispatch() at JNI_OnLoad or lazily on first use, so one build runs on every
+// device and host tools that never load the JNI library still get the best kernels.
+
+/**
+ * A named group of interchangeable kernels, e.g. "base64"
+ */
+class KernelFamily {
+public:
+    const char* name() const {
+        return name_;
+    }
+
+    /**
+     * Name of the bound variant, binding the best one first if needed
+     */
+    virtual const char* activeName() = 0;
+
+    /**
+     * Bind a variant by name, for benchmarks and tests
+     * @param variant Variant name, or nullptr for the best one this CPU supports
+     * @return false if the variant is unknown or this CPU lacks the instructions it needs
+     */
+    virtual bool select(const char* variant) = 0;
+
+    /**
+     * Names of the variants this CPU can run, best first
+     */
+    virtual std::vector<const char*> supportedVariants() const = 0;
+
+protected:
+    constexpr explicit KernelFamily(const char* name) : name_(name) {
+    }
+    ~KernelFamily() = default;
+
+private:
+    const char* name_;
+};
+
+/**
+ * Variant table for one family. Variant is a struct of function pointers with a
+ * `const char* name` and a `bool (*supported)(const CpuFeatures&)`; the last entry must
+ * be supported everywhere. Constant-initialized, so usable from static initializers.
+ */
+template <typename Variant>
+class KernelTable final : public KernelFamily {
+public:
+    template <size_t N>
+    constexpr KernelTable(const char* family, const Variant (&variants)[N])
+        : KernelFamily(family), variants_(variants), count_(N), active_(nullptr) {
+    }
+
+    /**
+     * Bound variant; one acquire load on the hot path
+     */
+    const Variant& active() {
+        const Variant* variant = active_.load(std::memory_order_acquire);
+        if (variant == nullptr) {
+            select(nullptr);
+            variant = active_.load(std::memory_order_acquire);
+        }
+        return *variant;
+    }
+
+    const char* activeName() override {
+        return active().name;
+    }
+
+    bool select(const char* variant) override {
+        const CpuFeatures& features = cpuFeatures();
+        for (size_t i = 0; i < count_; ++i) {
+            const Variant& candidate = variants_[i];
+            if ((variant == nullptr || std::strcmp(candidate.name, variant) == 0) && candidate.supported(features)) {
+                active_.store(&candidate, std::memory_order_release);
+                return true;
+            }
+        }
+        return false;
+    }
+
+    std::vector<const char*> supportedVariants() const override {
+        const CpuFeatures& features = cpuFeatures();
+        std::vector<const char*> names;
+        for (size_t i = 0; i < count_; ++i) {
+            if (variants_[i].supported(features)) {
+                names.push_back(variants_[i].name);
+            }
+        }
+        return names;
+    }
+
+private:
+    const Variant* variants_;
+    size_t count_;
+    std::atomic<const Variant*> active_;
+};
+
+/**
+ * Predicate for variants that run everywhere
+ */
+inline bool anyCpu(const CpuFeatures&) {
+    return true;
+}
+
+/**
+ * Detect CPU features and bind the best variant of every family. Called from JNI_OnLoad
+ * so the choice is made once, before any worker thread runs a kernel.
+ */
+void initKernelDispatch();
+
+/**
+ * All kernel families: base64, xor, chacha20, checksum and copy
+ */
+std::vector<KernelFamily*> kernelFamilies();
+
+/**
+ * @return The family with this name, or nullptr
+ */
+KernelFamily* findKernelFamily(const std::string& name);
+
+/**
+ * One-line report of the detected features and the bound variant of each family, e.g.
+ * "cpu: sse2 ssse3 sse4.2 avx2; base64=avx2 xor=avx2 chacha20=avx2 checksum=sse4.2 copy=avx2-stream"
+ */
+std::string kernelDiagnostics();
+
+#endif // KERNEL_DISPATCH_H
@@ -0,0 +1,149 @@
+#include "key_manager.h"
+#include "chacha20_poly1305.h"
+#include <cstring>
+#include <android/log.h>
+
+#define LOG_TAG "KeyManager"
+#define LOGI(...) __android_log_print(ANDROID_LOG_INFO, LOG_TAG, __VA_ARGS__)
+#define LOGE(...) __android_log_print(ANDROID_LOG_ERROR, LOG_TAG, __VA_ARGS__)
+
+namespace {
+    // Fixed HKDF salt and info label; changing either changes every derived key
+    constexpr char EXTRACT_SALT[] = "fluxorio key manager v1";
+    constexpr char SESSION_LABEL[] = "fluxorio session key";
+    constexpr size_t SESSION_LABEL_LENGTH = sizeof(SESSION_LABEL) - 1;
+
+    constexpr size_t MASTER_SECRET_SIZE = 32;
+
+    // Fibonacci hashing onto the 64 cache slots
+    inline size_t slotIndex(uint64_t sessionId) {
+        return static_cast<size_t>((sessionId * 0x9E3779B97F4A7C15ull) >> 58);
+    }
+}
+
+SessionKey::~SessionKey() {
+    secureZero(key, sizeof(key));
+}
+
+std::unique_ptr<KeyManager> KeyManager::createRandom() {
+    uint8_t secret[MASTER_SECRET_SIZE];
+    if (!secureRandomBytes(secret, sizeof(secret))) {
+        secureZero(secret, sizeof(secret));
+        LOGE("Failed to read a random master secret");
+        return nullptr;
+    }
+    std::unique_ptr<KeyManager> manager(new KeyManager(ConstByteSpan(secret, sizeof(secret))));
+    secureZero(secret, sizeof(secret));
+    return manager;
+}
+
+KeyManager::KeyManager(ConstByteSpan masterSecret) : derivations_(0) {
+    init(masterSecret);
+}
+
+KeyManager::~KeyManager() {
+    for (Slot& slot : slots_) {
+        for (std::atomic<uint64_t>& word : slot.keyWords) {
+            word.store(0, std::memory_order_relaxed);
+        }
+    }
+}
+
+void KeyManager::init(ConstByteSpan masterSecret) {
+    static_assert(KeyManager::CACHE_SLOTS == 64, "slotIndex() keeps the top 6 bits");
+    uint8_t prk[SHA256_DIGEST_SIZE];
+    hkdfExtract(reinterpret_cast<const uint8_t*>(EXTRACT_SALT), sizeof(EXTRACT_SALT) - 1,
+                masterSecret.data(), masterSecret.size(), prk);
+    prk_.emplace(prk, sizeof(prk));
+    secureZero(prk, sizeof(prk));
+}
+
+void KeyManager::derive(uint64_t sessionId, uint8_t* key) {
+    // info = label || big-endian session id
+    uint8_t info[SESSION_LABEL_LENGTH + 8];
+    std::memcpy(info, SESSION_LABEL, SESSION_LABEL_LENGTH);
+    for (int i = 0; i < 8; ++i) {
+        info[SESSION_LABEL_LENGTH + i] = static_cast<uint8_t>(sessionId >> (56 - 8 * i));
+    }
+    hkdfExpand(*prk_, info, sizeof(info), key, CHACHA20_KEY_SIZE);
+    derivations_.fetch_add(1, std::memory_order_relaxed);
+}
+
+bool KeyManager::lookup(size_t index, uint64_t sessionId, uint8_t* key) const {
+    const Slot& slot = slots_[index];
+    uint32_t before = slot.sequence.load(std::memory_order_acquire);
+    if (before == 0 || (before & 1) != 0) {
+        return false;
+    }
+    if (slot.sessionId.load(std::memory_order_relaxed) != sessionId) {
+        return false;
+    }
+
+    uint64_t words[4];
+    for (int i = 0; i < 4; ++i) {
+        words[i] = slot.keyWords[i].load(std::memory_order_relaxed);
+    }
+    std::atomic_thread_fence(std::memory_order_acquire);
+    if (slot.sequence.load(std::memory_order_relaxed) != before) {
+        secureZero(words, sizeof(words));
+        return false;
+    }
+
+    std::memcpy(key, words, sizeof(words));
+    secureZero(words, sizeof(words));
+    return true;
+}
+
+void KeyManager::store(size_t index, uint64_t sessionId, const uint8_t* key) {
+    Slot& slot = slots_[index];
+    uint32_t sequence = slot.sequence.load(std::memory_order_relaxed);
+    // Another writer owns the slot; the key is still returned, just not cached
+    if ((sequence & 1) != 0 ||
+        !slot.sequence.compare_exchange_strong(sequence, sequence + 1, std::memory_order_acquire,
+                                               std::memory_order_relaxed)) {
+        return;
+    }
+    std::atomic_thread_fence(std::memory_order_release);
+
+    uint64_t words[4];
+    std::memcpy(words, key, sizeof(words));
+    slot.sessionId.store(sessionId, std::memory_order_relaxed);
+    for (int i = 0; i < 4; ++i) {
+        slot.keyWords[i].store(words[i], std::memory_order_relaxed);
+    }
+    secureZero(words, sizeof(words));
+
+    // Skip 0 on wraparound so a filled slot never reads as empty
+    uint32_t next = sequence + 2;
+    slot.sequence.store(next == 0 ? 2 : next, std::memory_order_release);
+}
+
+void KeyManager::sessionKey(uint64_t sessionId, SessionKey& out) {
+    out.sessionId = sessionId;
+
+    // Each session may live in its home slot or the one after it
+    size_t home = slotIndex(sessionId);
+    size_t neighbour = (home + 1) % CACHE_SLOTS;
+    if (lookup(home, sessionId, out.key) || lookup(neighbour, sessionId, out.key)) {
+        return;
+    }
+
+    derive(sessionId, out.key);
+    bool homeTaken = slots_[home].sequence.load(std::memory_order_relaxed) != 0;
+    bool neighbourFree = slots_[neighbour].sequence.load(std::memory_order_relaxed) == 0;
+    store(homeTaken && neighbourFree ? neighbour : home, sessionId, out.key);
+}
+
+uint64_t KeyManager::derivationCount() const {
+    return derivations_.load(std::memory_order_relaxed);
+}
+
+uint64_t KeyManager::sessionIdFor(const std::string& name) {
+    // 64-bit FNV-1a
+    uint64_t hash = 0xcbf29ce484222325ull;
+    for (unsigned char c : name) {
+        hash ^= c;
+        hash *= 0x100000001b3ull;
+    }
+    return hash;
+}
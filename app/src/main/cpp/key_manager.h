@@ -0,0 +1,90 @@
+#ifndef KEY_MANAGER_H
+#define KEY_MANAGER_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <string>
+#include "hkdf_sha256.h"
+#include "span.h"
+
+/**
+ * A 256-bit ChaCha20-Poly1305 key derived for one session; wiped on destruction
+ */
+struct SessionKey {
+    uint64_t sessionId = 0;
+    uint8_t key[32] = {};
+
+    ~SessionKey();
+};
+
+/**
+ * KeyManager - Derives per-session keys from a master secret with HKDF-SHA256.
+ *
+ * HKDF-Extract runs once at construction and its HMAC pads are kept precomputed, so a
+ * derivation costs a single HKDF-Expand block. Derived keys are then kept in a small
+ * fixed-size cache that readers probe without locking, so looking up the key for a
+ * message costs the same however many sessions are active. Sessions evicted from the
+ * cache are simply derived again.
+ *
+ * All methods are safe to call from any thread.
+ */
+class KeyManager {
+public:
+    /**
+     * Use a random master secret; keys then live only as long as the manager
+     * @return nullptr if the system random source fails, rather than a manager whose
+     *         keys derive from an unknown or predictable secret
+     */
+    static std::unique_ptr<KeyManager> createRandom();
+
+    /**
+     * @param masterSecret Input keying material, ideally at least 32 bytes
+     */
+    explicit KeyManager(ConstByteSpan masterSecret);
+    ~KeyManager();
+
+    KeyManager(const KeyManager&) = delete;
+    KeyManager& operator=(const KeyManager&) = delete;
+
+    /**
+     * Key for a session, from the cache or derived and cached on a miss
+     * @param sessionId Any 64-bit identifier, e.g. from sessionIdFor()
+     * @param out Receives the session id and key
+     */
+    void sessionKey(uint64_t sessionId, SessionKey& out);
+
+    /**
+     * Number of HKDF derivations performed, i.e. cache misses
+     */
+    uint64_t derivationCount() const;
+
+    /**
+     * Stable 64-bit session id for a name such as a file path or peer address
+     */
+    static uint64_t sessionIdFor(const std::string& name);
+
+    static constexpr size_t CACHE_SLOTS = 64;
+
+private:
+    // Seqlock-protected cache entry. sequence is 0 while empty and odd while being
+    // written; a reader that races a writer treats the slot as a miss instead of spinning.
+    struct Slot {
+        std::atomic<uint32_t> sequence{0};
+        std::atomic<uint64_t> sessionId{0};
+        std::atomic<uint64_t> keyWords[4] = {};
+    };
+
+    std::optional<HmacSha256> prk_;
+    Slot slots_[CACHE_SLOTS];
+    std::atomic<uint64_t> derivations_;
+
+    void init(ConstByteSpan masterSecret);
+    void derive(uint64_t sessionId, uint8_t* key);
+    bool lookup(size_t index, uint64_t sessionId, uint8_t* key) const;
+    void store(size_t index, uint64_t sessionId, const uint8_t* key);
+};
+
+#endif // KEY_MANAGER_H
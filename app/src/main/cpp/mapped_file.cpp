@@ -0,0 +1,63 @@
+#include "mapped_file.h"
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <utility>
+
+MappedFile::~MappedFile() {
+    close();
+}
+
+MappedFile::MappedFile(MappedFile&& other) noexcept
+    : address_(std::exchange(other.address_, nullptr)), size_(std::exchange(other.size_, 0)) {
+}
+
+MappedFile& MappedFile::operator=(MappedFile&& other) noexcept {
+    if (this != &other) {
+        close();
+        address_ = std::exchange(other.address_, nullptr);
+        size_ = std::exchange(other.size_, 0);
+    }
+    return *this;
+}
+
+bool MappedFile::open(const std::string& path) {
+    close();
+    int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return false;
+    }
+    
+    struct stat info;
+    bool ok = fstat(fd, &info) == 0 && S_ISREG(info.st_mode);
+    if (ok && info.st_size > 0) {
+        void* address = mmap(nullptr, static_cast<size_t>(info.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+        ok = address != MAP_FAILED;
+        if (ok) {
+            address_ = address;
+            size_ = static_cast<size_t>(info.st_size);
+        }
+    }
+    // The mapping holds its own reference to the file
+    ::close(fd);
+    return ok;
+}
+
+void MappedFile::close() {
+    if (address_ != nullptr) {
+        munmap(address_, size_);
+        address_ = nullptr;
+        size_ = 0;
+    }
+}
+
+void MappedFile::advise(size_t offset, size_t length, int advice) const {
+    if (address_ == nullptr || offset >= size_) {
+        return;
+    }
+    size_t pageSize = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+    size_t start = offset - offset % pageSize;
+    size_t end = length > size_ - offset ? size_ : offset + length;
+    madvise(static_cast<uint8_t*>(address_) + start, end - start, advice);
+}
@@ -0,0 +1,52 @@
+#ifndef MAPPED_FILE_H
+#define MAPPED_FILE_H
+
+#include <cstddef>
+#include <string>
+#include "span.h"
+
+/**
+ * Read-only memory mapping of a whole file. Pages are read from the file when first
+ * touched, so only the parts a reader looks at cost I/O. The mapping keeps showing the
+ * original contents when the file is replaced by a rename, as BlobStorage saves do, but
+ * must not outlive a truncation of the file in place.
+ */
+class MappedFile {
+public:
+    MappedFile() : address_(nullptr), size_(0) {}
+    ~MappedFile();
+    
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+    MappedFile(MappedFile&& other) noexcept;
+    MappedFile& operator=(MappedFile&& other) noexcept;
+    
+    /**
+     * Map a file, replacing the current mapping. An empty file gives an empty view.
+     * @return false if the file cannot be opened, is not a regular file or cannot be mapped
+     */
+    bool open(const std::string& path);
+    
+    /**
+     * Unmap the file
+     */
+    void close();
+    
+    /**
+     * Pass an access pattern hint for part of the mapping to the kernel
+     * @param offset Start of the range, rounded down to a page boundary
+     * @param length Length of the range, clipped to the mapping
+     * @param advice MADV_SEQUENTIAL, MADV_WILLNEED, ...
+     */
+    void advise(size_t offset, size_t length, int advice) const;
+    
+    ConstByteSpan bytes() const {
+        return ConstByteSpan(static_cast<const uint8_t*>(address_), size_);
+    }
+    
+private:
+    void* address_;
+    size_t size_;
+};
+
+#endif // MAPPED_FILE_H
@@ -0,0 +1,169 @@
+#include "message_cache.h"
+#include "message_log.h"
+#include <sys/stat.h>
+#include <cerrno>
+
+namespace {
+    // Bookkeeping charged to every entry on top of its messages: the map node, the list
+    // node and the stamp
+    constexpr size_t ENTRY_OVERHEAD = 256;
+
+    uint64_t modificationTimeNs(const struct stat& info) {
+#ifdef __APPLE__
+        const struct timespec& mtime = info.st_mtimespec;
+#else
+        const struct timespec& mtime = info.st_mtim;
+#endif
+        return static_cast<uint64_t>(mtime.tv_sec) * 1000000000ULL + static_cast<uint64_t>(mtime.tv_nsec);
+    }
+
+    /**
+     * @return false if the file does not exist; errno tells it apart from other failures
+     */
+    bool statFile(const std::string& path, FileStamp& stamp) {
+        struct stat info;
+        if (stat(path.c_str(), &info) != 0) {
+            return false;
+        }
+        stamp.inode = static_cast<uint64_t>(info.st_ino);
+        stamp.size = static_cast<uint64_t>(info.st_size);
+        stamp.mtimeNs = modificationTimeNs(info);
+        stamp.regular = S_ISREG(info.st_mode);
+        return true;
+    }
+
+    size_t entryCost(const std::string& filePath, const StorageStamp& stamp,
+                     const std::shared_ptr<const std::vector<uint8_t>>& messages) {
+        return ENTRY_OVERHEAD + filePath.size() + stamp.segments.size() * sizeof(FileStamp) +
+               (messages ? messages->size() : 0);
+    }
+}
+
+bool readStorageStamp(const std::string& filePath, StorageStamp& stamp) {
+    stamp = StorageStamp();
+    stamp.snapshotExists = statFile(filePath, stamp.snapshot);
+    if (!stamp.snapshotExists && errno != ENOENT) {
+        return false;
+    }
+    for (uint32_t index = 0;; ++index) {
+        FileStamp segment;
+        if (!statFile(logSegmentPath(filePath, index), segment)) {
+            return errno == ENOENT;
+        }
+        stamp.segments.push_back(segment);
+    }
+}
+
+MessageCache::MessageCache(size_t capacity) : capacity_(capacity), size_(0), generation_(0), hits_(0) {
+}
+
+void MessageCache::setCapacity(size_t bytes) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    capacity_ = bytes;
+    evict();
+}
+
+size_t MessageCache::capacity() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return capacity_;
+}
+
+size_t MessageCache::size() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return size_;
+}
+
+uint64_t MessageCache::hitCount() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return hits_;
+}
+
+uint64_t MessageCache::generation() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return generation_;
+}
+
+std::shared_ptr<const std::vector<uint8_t>> MessageCache::find(const std::string& filePath,
+                                                               const StorageStamp& current) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto entry = entries_.find(filePath);
+    if (entry == entries_.end()) {
+        return nullptr;
+    }
+    if (entry->second.stamp != current) {
+        erase(entry); // Changed behind our back
+        return nullptr;
+    }
+    order_.splice(order_.begin(), order_, entry->second.position);
+    if (!entry->second.messages) {
+        return nullptr;
+    }
+    hits_++;
+    return entry->second.messages;
+}
+
+bool MessageCache::findStamp(const std::string& filePath, StorageStamp& stamp) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto entry = entries_.find(filePath);
+    if (entry == entries_.end()) {
+        return false;
+    }
+    order_.splice(order_.begin(), order_, entry->second.position);
+    stamp = entry->second.stamp;
+    return true;
+}
+
+void MessageCache::store(const std::string& filePath, const StorageStamp& stamp,
+                         std::shared_ptr<const std::vector<uint8_t>> messages, uint64_t generation) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (generation != generation_ || capacity_ == 0) {
+        return;
+    }
+    if (messages && entryCost(filePath, stamp, messages) > capacity_) {
+        messages.reset(); // Too large to hold; the stamp still answers size queries
+    }
+    auto entry = entries_.find(filePath);
+    if (entry != entries_.end()) {
+        if (!messages && entry->second.stamp == stamp) {
+            messages = entry->second.messages; // Keep what was loaded from these same files
+        }
+        erase(entry);
+    }
+    size_t cost = entryCost(filePath, stamp, messages);
+    if (cost > capacity_) {
+        return;
+    }
+    order_.push_front(filePath);
+    entries_[filePath] = Entry{stamp, std::move(messages), cost, order_.begin()};
+    size_ += cost;
+    evict();
+}
+
+void MessageCache::invalidate(const std::string& filePath) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    generation_++;
+    auto entry = entries_.find(filePath);
+    if (entry != entries_.end()) {
+        erase(entry);
+    }
+}
+
+void MessageCache::clear() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    generation_++;
+    entries_.clear();
+    order_.clear();
+    size_ = 0;
+}
+
+void MessageCache::erase(std::unordered_map<std::string, Entry>::iterator entry) {
+    size_ -= entry->second.cost;
+    order_.erase(entry->second.position);
+    entries_.erase(entry);
+}
+
+void MessageCache::evict() {
+    while (size_ > capacity_ && !order_.empty()) {
+        erase(entries_.find(order_.back()));
+    }
+}
@@ -0,0 +1,146 @@
+#ifndef MESSAGE_CACHE_H
+#define MESSAGE_CACHE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// In-memory cache of loaded message batches, least recently used first out, so that
+// loading the same conversation again costs a copy rather than reading, decrypting and
+// decompressing the storage file and its log. An entry is only used while the files look
+// as they did when it was loaded: their inode, size and modification time are compared
+// with a fresh stat() on every load. Entries also remember that stamp on its own, which
+// answers size and existence queries without touching the file system.
+
+/**
+ * What one file looked like on disk
+ */
+struct FileStamp {
+    uint64_t inode = 0;
+    uint64_t size = 0;
+    uint64_t mtimeNs = 0;
+    bool regular = false;
+
+    bool operator==(const FileStamp& other) const {
+        return inode == other.inode && size == other.size && mtimeNs == other.mtimeNs && regular == other.regular;
+    }
+};
+
+/**
+ * What a storage file and its log segments looked like on disk
+ */
+struct StorageStamp {
+    bool snapshotExists = false;
+    FileStamp snapshot;
+    std::vector<FileStamp> segments; // Log segments 0, 1, ... up to the first missing one
+
+    bool operator==(const StorageStamp& other) const {
+        return snapshotExists == other.snapshotExists && snapshot == other.snapshot && segments == other.segments;
+    }
+    bool operator!=(const StorageStamp& other) const {
+        return !(*this == other);
+    }
+};
+
+/**
+ * Stat a storage file and its log segments
+ * @return false if one of them exists but cannot be examined
+ */
+bool readStorageStamp(const std::string& filePath, StorageStamp& stamp);
+
+class MessageCache {
+public:
+    /**
+     * @param capacity Bytes of messages to hold at most; 0 disables the cache
+     */
+    explicit MessageCache(size_t capacity = 0);
+
+    MessageCache(const MessageCache&) = delete;
+    MessageCache& operator=(const MessageCache&) = delete;
+
+    /**
+     * Change the capacity, evicting entries as needed
+     */
+    void setCapacity(size_t bytes);
+    size_t capacity() const;
+
+    /**
+     * Bytes currently held, entry bookkeeping included
+     */
+    size_t size() const;
+
+    /**
+     * Number of loads served from the cache so far
+     */
+    uint64_t hitCount() const;
+
+    /**
+     * Counter advanced by every invalidation. A load reads it before looking at the files
+     * and hands it to store(), which drops what was loaded if a write got in between.
+     */
+    uint64_t generation() const;
+
+    /**
+     * Cached messages of a storage file, if they were loaded from files matching current.
+     * An entry that does not match is dropped.
+     * @return nullptr on a miss
+     */
+    std::shared_ptr<const std::vector<uint8_t>> find(const std::string& filePath, const StorageStamp& current);
+
+    /**
+     * Last known stamp of a storage file
+     * @return false if the file has no entry
+     */
+    bool findStamp(const std::string& filePath, StorageStamp& stamp);
+
+    /**
+     * Remember what a storage file was loaded as, or only its stamp when messages is
+     * nullptr or would not fit
+     * @param generation generation() as read before the files were examined
+     */
+    void store(const std::string& filePath, const StorageStamp& stamp,
+               std::shared_ptr<const std::vector<uint8_t>> messages, uint64_t generation);
+
+    /**
+     * Forget a storage file, after writing to it
+     */
+    void invalidate(const std::string& filePath);
+
+    /**
+     * Forget every storage file, e.g. when the key they are read with changes
+     */
+    void clear();
+
+private:
+    struct Entry {
+        StorageStamp stamp;
+        std::shared_ptr<const std::vector<uint8_t>> messages;
+        size_t cost;
+        std::list<std::string>::iterator position;
+    };
+
+    mutable std::mutex mutex_;
+    size_t capacity_;
+    size_t size_;
+    uint64_t generation_;
+    uint64_t hits_;
+    std::list<std::string> order_; // Most recently used first
+    std::unordered_map<std::string, Entry> entries_;
+
+    /**
+     * Drop one entry. Caller holds mutex_.
+     */
+    void erase(std::unordered_map<std::string, Entry>::iterator entry);
+
+    /**
+     * Drop least recently used entries until size_ fits the capacity. Caller holds mutex_.
+     */
+    void evict();
+};
+
+#endif // MESSAGE_CACHE_H
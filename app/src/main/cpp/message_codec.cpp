@@ -0,0 +1,187 @@
+#include "message_codec.h"
+#include <algorithm>
+#include <cstring>
+#include <limits>
+
+namespace {
+    uint64_t loadUnsigned(const uint8_t* p, int bytes, MessageByteOrder order) {
+        uint64_t value = 0;
+        for (int i = 0; i < bytes; ++i) {
+            int shift = order == MessageByteOrder::BIG ? 8 * (bytes - 1 - i) : 8 * i;
+            value |= static_cast<uint64_t>(p[i]) << shift;
+        }
+        return value;
+    }
+
+    void storeUnsigned(uint8_t* p, uint64_t value, int bytes, MessageByteOrder order) {
+        for (int i = 0; i < bytes; ++i) {
+            int shift = order == MessageByteOrder::BIG ? 8 * (bytes - 1 - i) : 8 * i;
+            p[i] = static_cast<uint8_t>(value >> shift);
+        }
+    }
+
+    void appendUnsigned(std::vector<uint8_t>& output, uint64_t value, int bytes, MessageByteOrder order) {
+        size_t at = output.size();
+        output.resize(at + static_cast<size_t>(bytes));
+        storeUnsigned(output.data() + at, value, bytes, order);
+    }
+
+    // Both counts and text lengths are signed 32-bit on the managed side
+    constexpr uint32_t MAX_FIELD_VALUE = static_cast<uint32_t>(std::numeric_limits<int32_t>::max());
+}
+
+bool readMessageCount(ConstByteSpan batch, uint32_t& count, MessageByteOrder order) {
+    count = 0;
+    if (batch.size() < MESSAGE_COUNT_SIZE) {
+        return false;
+    }
+    uint32_t value = static_cast<uint32_t>(loadUnsigned(batch.data(), 4, order));
+    if (value > MAX_FIELD_VALUE) {
+        return false;
+    }
+    count = value;
+    return true;
+}
+
+void writeMessageCount(ByteSpan batch, uint32_t count, MessageByteOrder order) {
+    storeUnsigned(batch.data(), count, 4, order);
+}
+
+bool readMessageRecord(ConstByteSpan bytes, size_t offset, MessageRecordView& record, MessageByteOrder order) {
+    if (offset > bytes.size() || bytes.size() - offset < MESSAGE_RECORD_FIXED_SIZE) {
+        return false;
+    }
+    size_t remaining = bytes.size() - offset;
+    const uint8_t* p = bytes.data() + offset;
+    uint32_t textLength = static_cast<uint32_t>(loadUnsigned(p, 4, order));
+    if (textLength > MAX_FIELD_VALUE || textLength > remaining - MESSAGE_RECORD_FIXED_SIZE) {
+        return false;
+    }
+
+    const uint8_t* fields = p + 4 + textLength;
+    record.text = std::string_view(reinterpret_cast<const char*>(p + 4), textLength);
+    record.isSent = fields[0] == 1;
+    record.type = fields[1];
+    record.timestamp = static_cast<int64_t>(loadUnsigned(fields + 2, 8, order));
+    record.offset = offset;
+    return true;
+}
+
+MessageCursor::MessageCursor(ConstByteSpan batch, MessageByteOrder order)
+    : batch_(batch),
+      order_(order),
+      count_(0),
+      index_(0),
+      offset_(MESSAGE_COUNT_SIZE),
+      failed_(false) {
+    if (!readMessageCount(batch, count_, order)) {
+        failed_ = true;
+        offset_ = 0;
+    }
+}
+
+bool MessageCursor::next(MessageRecordView& record) {
+    if (failed_ || index_ == count_) {
+        return false;
+    }
+    if (!readMessageRecord(batch_, offset_, record, order_)) {
+        failed_ = true;
+        return false;
+    }
+    offset_ += record.encodedSize();
+    index_++;
+    return true;
+}
+
+bool MessageCursor::skip(uint32_t records) {
+    MessageRecordView record;
+    for (uint32_t i = 0; i < records; ++i) {
+        if (!next(record)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool MessageCursor::seek(size_t offset, uint32_t index) {
+    if (batch_.size() < MESSAGE_COUNT_SIZE || offset < MESSAGE_COUNT_SIZE || offset > batch_.size() ||
+        index > count_) {
+        return false;
+    }
+    offset_ = offset;
+    index_ = index;
+    failed_ = false;
+    return true;
+}
+
+MessageBatchWriter::MessageBatchWriter(std::vector<uint8_t>& output, MessageByteOrder order)
+    : output_(output),
+      order_(order),
+      start_(output.size()),
+      count_(0) {
+    appendUnsigned(output_, 0, 4, order_);
+}
+
+bool MessageBatchWriter::add(std::string_view text, bool isSent, uint8_t type, int64_t timestamp) {
+    if (text.size() > MAX_FIELD_VALUE || count_ == MAX_FIELD_VALUE) {
+        return false;
+    }
+    appendUnsigned(output_, text.size(), 4, order_);
+    output_.insert(output_.end(), text.begin(), text.end());
+    output_.push_back(isSent ? 1 : 0);
+    output_.push_back(type);
+    appendUnsigned(output_, static_cast<uint64_t>(timestamp), 8, order_);
+    storeUnsigned(output_.data() + start_, ++count_, 4, order_);
+    return true;
+}
+
+bool MessageBatchWriter::add(const MessageRecordView& record) {
+    if (count_ == MAX_FIELD_VALUE) {
+        return false;
+    }
+    // The text is preceded by its length and followed by the fixed fields
+    const uint8_t* begin = reinterpret_cast<const uint8_t*>(record.text.data()) - 4;
+    output_.insert(output_.end(), begin, begin + record.encodedSize());
+    storeUnsigned(output_.data() + start_, ++count_, 4, order_);
+    return true;
+}
+
+bool decodeMessages(ConstByteSpan batch, std::vector<MessageRecordView>& records, MessageByteOrder order) {
+    records.clear();
+    MessageCursor cursor(batch, order);
+    // Every record takes at least the fixed bytes, which bounds what a forged count can reserve
+    records.reserve(std::min<size_t>(cursor.count(), batch.size() / MESSAGE_RECORD_FIXED_SIZE));
+    MessageRecordView record;
+    while (cursor.next(record)) {
+        records.push_back(record);
+    }
+    return !cursor.failed();
+}
+
+bool selectMessages(ConstByteSpan batch, const std::function<bool(const MessageRecordView&)>& predicate,
+                    std::vector<uint8_t>& output, MessageByteOrder order) {
+    output.clear();
+    MessageBatchWriter writer(output, order);
+    MessageCursor cursor(batch, order);
+    MessageRecordView record;
+    while (cursor.next(record)) {
+        if (predicate(record)) {
+            writer.add(record);
+        }
+    }
+    return !cursor.failed();
+}
+
+uint32_t truncateMessages(std::vector<uint8_t>& batch, MessageByteOrder order) {
+    if (batch.size() < MESSAGE_COUNT_SIZE) {
+        batch.clear();
+        return 0;
+    }
+    MessageCursor cursor(batch, order);
+    MessageRecordView record;
+    while (cursor.next(record)) {
+    }
+    batch.resize(std::max(cursor.offset(), MESSAGE_COUNT_SIZE));
+    writeMessageCount(batch, cursor.index(), order);
+    return cursor.index();
+}
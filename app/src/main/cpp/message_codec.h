@@ -0,0 +1,165 @@
+#ifndef MESSAGE_CODEC_H
+#define MESSAGE_CODEC_H
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <string_view>
+#include <vector>
+#include "span.h"
+
+// Message batches as the managed side serializes them:
+//
+//   batch    count i32 | record*
+//   record   text length i32 | text (UTF-8) | isSent u8 | type u8 | timestamp i64
+//
+// Kotlin writes them with DataOutputStream, so big-endian. The Swift package writes the
+// same layout little-endian.
+
+enum class MessageByteOrder {
+    BIG,    // Kotlin (DataOutputStream)
+    LITTLE  // Swift
+};
+
+/**
+ * Ordinals of the managed MessageType enum
+ */
+enum class MessageType : uint8_t {
+    SHORT_MESSAGE = 0,
+    LONG_MESSAGE = 1,
+    IMAGE = 2,
+    VIDEO = 3
+};
+
+constexpr size_t MESSAGE_COUNT_SIZE = 4;
+// Record bytes besides the text
+constexpr size_t MESSAGE_RECORD_FIXED_SIZE = 4 + 1 + 1 + 8;
+
+/**
+ * One message, viewing the batch it was read from
+ */
+struct MessageRecordView {
+    std::string_view text;
+    bool isSent;
+    uint8_t type;       // Raw ordinal; the managed side reads unknown ones as SHORT_MESSAGE
+    int64_t timestamp;
+    size_t offset;      // Of the record within the batch
+
+    size_t encodedSize() const {
+        return MESSAGE_RECORD_FIXED_SIZE + text.size();
+    }
+};
+
+/**
+ * Read the message count at the start of a batch
+ * @return false if the batch is too short or the count is negative
+ */
+bool readMessageCount(ConstByteSpan batch, uint32_t& count, MessageByteOrder order = MessageByteOrder::BIG);
+
+/**
+ * Overwrite the message count at the start of a batch of at least MESSAGE_COUNT_SIZE bytes
+ */
+void writeMessageCount(ByteSpan batch, uint32_t count, MessageByteOrder order = MessageByteOrder::BIG);
+
+/**
+ * Read one record at a known position, e.g. from an index
+ * @param bytes Buffer holding the record, such as a whole mapped file
+ * @param offset Position of the record within bytes
+ * @return false if the record is malformed or runs past the end of bytes
+ */
+bool readMessageRecord(ConstByteSpan bytes, size_t offset, MessageRecordView& record,
+                       MessageByteOrder order = MessageByteOrder::BIG);
+
+/**
+ * Forward-only reader over the records of a batch, bounds-checked against the batch and
+ * its declared count. Records are views into the batch, which must outlive them.
+ */
+class MessageCursor {
+public:
+    explicit MessageCursor(ConstByteSpan batch, MessageByteOrder order = MessageByteOrder::BIG);
+
+    /**
+     * Read the next record
+     * @return false at the end of the batch or at a malformed record; failed() tells which
+     */
+    bool next(MessageRecordView& record);
+
+    /**
+     * Skip records without looking at their contents
+     * @return false if the batch ends or is malformed before all were skipped
+     */
+    bool skip(uint32_t records);
+
+    /**
+     * Continue from a position previously taken from offset() and index() on the same batch
+     * @return false if the position is outside the batch
+     */
+    bool seek(size_t offset, uint32_t index);
+
+    uint32_t count() const { return count_; }
+    uint32_t index() const { return index_; }
+    size_t offset() const { return offset_; }
+    bool atEnd() const { return index_ == count_; }
+    bool failed() const { return failed_; }
+
+private:
+    ConstByteSpan batch_;
+    MessageByteOrder order_;
+    uint32_t count_;
+    uint32_t index_;
+    size_t offset_;
+    bool failed_;
+};
+
+/**
+ * Appends records to a batch, keeping its count current so the output is a valid batch
+ * after every add()
+ */
+class MessageBatchWriter {
+public:
+    /**
+     * Start a batch at the end of output
+     */
+    explicit MessageBatchWriter(std::vector<uint8_t>& output, MessageByteOrder order = MessageByteOrder::BIG);
+
+    /**
+     * @return false if the text or the batch would exceed the format's 32-bit limits
+     */
+    bool add(std::string_view text, bool isSent, uint8_t type, int64_t timestamp);
+
+    /**
+     * Copy a record read from a batch in the same byte order, without re-encoding it
+     */
+    bool add(const MessageRecordView& record);
+
+    uint32_t count() const { return count_; }
+
+private:
+    std::vector<uint8_t>& output_;
+    MessageByteOrder order_;
+    size_t start_;
+    uint32_t count_;
+};
+
+/**
+ * Decode every record of a batch
+ * @return false if the batch is malformed; records then holds those read before the error
+ */
+bool decodeMessages(ConstByteSpan batch, std::vector<MessageRecordView>& records,
+                    MessageByteOrder order = MessageByteOrder::BIG);
+
+/**
+ * Copy the records matching a predicate into a new batch, record bytes as they are
+ * @return false if the input batch is malformed
+ */
+bool selectMessages(ConstByteSpan batch, const std::function<bool(const MessageRecordView&)>& predicate,
+                    std::vector<uint8_t>& output, MessageByteOrder order = MessageByteOrder::BIG);
+
+/**
+ * Cut a batch back to its leading complete records and make its count say so, e.g. to
+ * keep what survived of a damaged file. A batch too short to hold a count becomes empty.
+ * @return Number of records kept
+ */
+uint32_t truncateMessages(std::vector<uint8_t>& batch, MessageByteOrder order = MessageByteOrder::BIG);
+
+#endif // MESSAGE_CODEC_H
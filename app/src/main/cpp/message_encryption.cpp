@@ -1,108 +1,240 @@
 #include "message_encryption.h"
+#include "base64_codec.h"
+#include "payload_encoding.h"
+#include "kernel_dispatch.h"
 #include <string>
+#include <cstdint>
+#include <cstring>
 #include <algorithm>
 #include <sstream>
 #include <iomanip>
 
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define KEYSTREAM_X86 1
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#define KEYSTREAM_NEON 1
+#endif
+
 namespace {
     // Encryption key (in production, this should be securely stored/derived)
     const std::string ENCRYPTION_KEY = "FluxorSecretKey2024!";
     
-    // Base64 encoding characters
-    const char BASE64_CHARS[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+    // The key repeated out to lcm(key length, 64) bytes, so whole 16/32-byte vectors can
+    // be XORed without a modulo per byte. The extra tail repeats the start of the period,
+    // letting a vector that begins anywhere in the period be loaded without wrapping.
+    constexpr size_t KEYSTREAM_PERIOD = 320;
+    constexpr size_t KEYSTREAM_SLACK = 64;
     
-    // Simple base64 encoding
-    std::string base64Encode(const std::string& input) {
-        std::string output;
-        int val = 0;
-        int valb = -6;
+    struct Keystream {
+        alignas(64) uint8_t bytes[KEYSTREAM_PERIOD + KEYSTREAM_SLACK];
         
-        for (unsigned char c : input) {
-            val = (val << 8) + c;
-            valb += 8;
-            while (valb >= 0) {
-                output.push_back(BASE64_CHARS[(val >> valb) & 0x3F]);
-                valb -= 6;
+        Keystream() {
+            static_assert(KEYSTREAM_PERIOD % 64 == 0, "Keystream period must be a whole number of cache lines");
+            for (size_t i = 0; i < sizeof(bytes); ++i) {
+                bytes[i] = static_cast<uint8_t>(ENCRYPTION_KEY[i % ENCRYPTION_KEY.size()]);
             }
         }
-        
-        if (valb > -6) {
-            output.push_back(BASE64_CHARS[((val << 8) >> (valb + 8)) & 0x3F]);
+    };
+    
+    const Keystream& keystream() {
+        static const Keystream instance;
+        return instance;
+    }
+    
+    // XOR length bytes with the keystream starting at phase; input and output may alias.
+    // Returns the phase following the last byte.
+    size_t applyKeystreamScalar(const uint8_t* input, uint8_t* output, size_t length, size_t phase) {
+        const uint8_t* key = keystream().bytes;
+        for (size_t i = 0; i < length; ++i) {
+            output[i] = input[i] ^ key[phase];
+            if (++phase == KEYSTREAM_PERIOD) {
+                phase = 0;
+            }
         }
-        
-        while (output.size() % 4) {
-            output.push_back('=');
+        return phase;
+    }
+    
+#if KEYSTREAM_X86
+    __attribute__((target("avx2")))
+    size_t applyKeystreamAvx2(const uint8_t* input, uint8_t* output, size_t length, size_t phase) {
+        const uint8_t* key = keystream().bytes;
+        size_t i = 0;
+        for (; i + 32 <= length; i += 32) {
+            __m256i data = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(input + i));
+            __m256i k = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(key + phase));
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(output + i), _mm256_xor_si256(data, k));
+            phase += 32;
+            if (phase >= KEYSTREAM_PERIOD) {
+                phase -= KEYSTREAM_PERIOD;
+            }
         }
-        
-        return output;
+        return applyKeystreamScalar(input + i, output + i, length - i, phase);
     }
     
-    // Simple base64 decoding
-    std::string base64Decode(const std::string& input) {
-        std::string output;
-        int val = 0;
-        int valb = -8;
-        
-        for (char c : input) {
-            if (c == '=') break;
-            
-            size_t pos = 0;
-            bool found = false;
-            for (size_t i = 0; i < 64; ++i) {
-                if (BASE64_CHARS[i] == c) {
-                    pos = i;
-                    found = true;
-                    break;
-                }
+    // SSE2 is part of the x86-64 and Android x86 baseline, so this needs no target attribute
+    size_t applyKeystreamSse2(const uint8_t* input, uint8_t* output, size_t length, size_t phase) {
+        const uint8_t* key = keystream().bytes;
+        size_t i = 0;
+        for (; i + 16 <= length; i += 16) {
+            __m128i data = _mm_loadu_si128(reinterpret_cast<const __m128i*>(input + i));
+            __m128i k = _mm_loadu_si128(reinterpret_cast<const __m128i*>(key + phase));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(output + i), _mm_xor_si128(data, k));
+            phase += 16;
+            if (phase >= KEYSTREAM_PERIOD) {
+                phase -= KEYSTREAM_PERIOD;
             }
-            if (!found) continue; // Skip invalid characters
-            
-            val = (val << 6) + static_cast<int>(pos);
-            valb += 6;
-            if (valb >= 0) {
-                output.push_back(static_cast<char>((val >> valb) & 0xFF));
-                valb -= 8;
+        }
+        return applyKeystreamScalar(input + i, output + i, length - i, phase);
+    }
+#endif // KEYSTREAM_X86
+    
+#if KEYSTREAM_NEON
+    size_t applyKeystreamNeon(const uint8_t* input, uint8_t* output, size_t length, size_t phase) {
+        const uint8_t* key = keystream().bytes;
+        size_t i = 0;
+        for (; i + 32 <= length; i += 32) {
+            uint8x16_t lo = veorq_u8(vld1q_u8(input + i), vld1q_u8(key + phase));
+            uint8x16_t hi = veorq_u8(vld1q_u8(input + i + 16), vld1q_u8(key + phase + 16));
+            vst1q_u8(output + i, lo);
+            vst1q_u8(output + i + 16, hi);
+            phase += 32;
+            if (phase >= KEYSTREAM_PERIOD) {
+                phase -= KEYSTREAM_PERIOD;
             }
         }
-        
-        return output;
+        return applyKeystreamScalar(input + i, output + i, length - i, phase);
+    }
+#endif // KEYSTREAM_NEON
+    
+    struct KeystreamKernel {
+        size_t (*apply)(const uint8_t*, uint8_t*, size_t, size_t);
+        const char* name;
+        bool (*supported)(const CpuFeatures&);
+    };
+    
+    constexpr KeystreamKernel VARIANTS[] = {
+#if KEYSTREAM_X86
+        {applyKeystreamAvx2, "avx2", [](const CpuFeatures& cpu) { return cpu.avx2; }},
+        {applyKeystreamSse2, "sse2", [](const CpuFeatures& cpu) { return cpu.sse2; }},
+#elif KEYSTREAM_NEON
+        {applyKeystreamNeon, "neon", [](const CpuFeatures& cpu) { return cpu.neon; }},
+#endif
+        {applyKeystreamScalar, "scalar", anyCpu},
+    };
+    
+    KernelTable<KeystreamKernel> kernels("xor", VARIANTS);
+    
+    void applyKeystream(const uint8_t* input, uint8_t* output, size_t length) {
+        kernels.active().apply(input, output, length, 0);
     }
 }
 
-std::string encryptMessage(const std::string& message) {
-    if (message.empty()) {
-        return message;
+size_t requiredSize(size_t plaintextLength, PayloadEncoding encoding) {
+    return encodedPayloadSize(plaintextLength, encoding);
+}
+
+size_t requiredDecryptSize(size_t encryptedLength) {
+    return decodedPayloadMaxSize(encryptedLength);
+}
+
+bool encryptInto(ConstByteSpan input, ByteSpan output, size_t& written, PayloadEncoding encoding) {
+    written = 0;
+    size_t encryptedLength = requiredSize(input.size(), encoding);
+    if (encoding == PayloadEncoding::NONE || output.size() < encryptedLength) {
+        return false;
     }
     
-    // XOR encryption with key
-    std::string encrypted;
-    encrypted.reserve(message.size());
+    if (encoding == PayloadEncoding::BINARY) {
+        output[0] = PAYLOAD_HEADER_BINARY;
+        applyKeystream(input.data(), output.data() + 1, input.size());
+    } else {
+        // XOR into the tail of output, then base64 encode forward over it
+        output[0] = PAYLOAD_HEADER_BASE64;
+        uint8_t* staged = output.data() + encryptedLength - input.size();
+        applyKeystream(input.data(), staged, input.size());
+        base64Encode(staged, input.size(), reinterpret_cast<char*>(output.data() + 1));
+    }
+    written = encryptedLength;
+    return true;
+}
+
+bool decryptInto(ConstByteSpan input, ByteSpan output, size_t& written) {
+    written = 0;
+    if (output.data() != input.data() && output.size() < requiredDecryptSize(input.size())) {
+        return false;
+    }
+    
+    // Messages from before the header byte existed are bare base64
+    PayloadEncoding encoding = detectPayloadEncoding(input, PayloadEncoding::BASE64);
+    ConstByteSpan body = input;
+    if (!input.empty() && (input[0] == PAYLOAD_HEADER_BINARY || input[0] == PAYLOAD_HEADER_BASE64)) {
+        body = input.subspan(1);
+    }
     
-    for (size_t i = 0; i < message.size(); ++i) {
-        char keyChar = ENCRYPTION_KEY[i % ENCRYPTION_KEY.size()];
-        encrypted.push_back(message[i] ^ keyChar);
+    if (encoding == PayloadEncoding::BINARY) {
+        // Output trails the body, so the forward XOR kernels never overwrite unread input
+        applyKeystream(body.data(), output.data(), body.size());
+        written = body.size();
+        return true;
     }
     
-    // Encode to base64 for safe storage/transmission
-    return base64Encode(encrypted);
+    // Decode from base64, then XOR decryption with key in place
+    written = base64Decode(reinterpret_cast<const char*>(body.data()), body.size(), output.data());
+    applyKeystream(output.data(), output.data(), written);
+    return true;
 }
 
-std::string decryptMessage(const std::string& encryptedMessage) {
-    if (encryptedMessage.empty()) {
-        return encryptedMessage;
+size_t encryptInPlace(ByteSpan buffer, size_t length, PayloadEncoding encoding) {
+    size_t encryptedLength = requiredSize(length, encoding);
+    if (encoding == PayloadEncoding::NONE || length > buffer.size() || buffer.size() < encryptedLength) {
+        return 0;
     }
     
-    // Decode from base64
-    std::string encrypted = base64Decode(encryptedMessage);
-    
-    // XOR decryption with key
-    std::string decrypted;
-    decrypted.reserve(encrypted.size());
+    // Move the plaintext to the tail: behind the header byte for binary, where the
+    // base64 encoder can run forward over it otherwise
+    uint8_t* staged = buffer.data() + encryptedLength - length;
+    std::memmove(staged, buffer.data(), length);
+    applyKeystream(staged, staged, length);
+    if (encoding == PayloadEncoding::BINARY) {
+        buffer[0] = PAYLOAD_HEADER_BINARY;
+    } else {
+        base64Encode(staged, length, reinterpret_cast<char*>(buffer.data() + 1));
+        buffer[0] = PAYLOAD_HEADER_BASE64;
+    }
+    return encryptedLength;
+}
+
+size_t decryptInPlace(ByteSpan buffer) {
+    size_t written = 0;
+    decryptInto(buffer, buffer, written);
+    return written;
+}
+
+std::string encryptMessage(const std::string& message, PayloadEncoding encoding) {
+    if (message.empty()) {
+        return message;
+    }
     
-    for (size_t i = 0; i < encrypted.size(); ++i) {
-        char keyChar = ENCRYPTION_KEY[i % ENCRYPTION_KEY.size()];
-        decrypted.push_back(encrypted[i] ^ keyChar);
+    std::string encrypted(requiredSize(message.size(), encoding), '\0');
+    size_t written = 0;
+    encryptInto(asBytes(message), ByteSpan(reinterpret_cast<uint8_t*>(&encrypted[0]), encrypted.size()), written,
+                encoding);
+    encrypted.resize(written);
+    return encrypted;
+}
+
+std::string decryptMessage(const std::string& encryptedMessage) {
+    if (encryptedMessage.empty()) {
+        return encryptedMessage;
     }
     
+    std::string decrypted(encryptedMessage);
+    decrypted.resize(decryptInPlace(ByteSpan(reinterpret_cast<uint8_t*>(&decrypted[0]), decrypted.size())));
     return decrypted;
 }
+
+KernelFamily& keystreamKernels() {
+    return kernels;
+}
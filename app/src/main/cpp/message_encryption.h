@@ -2,19 +2,87 @@
 #define MESSAGE_ENCRYPTION_H
 
 #include <string>
+#include <cstddef>
+#include <cstdint>
+#include "payload_encoding.h"
+#include "span.h"
+
+class KernelFamily;
+
+// Encrypted messages carry a payload header byte (see payload_encoding.h) naming their
+// encoding: base64 for text-safe transports, or raw binary, which is a third smaller
+// and skips the codec. Decryption detects either, as well as the bare base64 written
+// before the header existed. PayloadEncoding::NONE is not accepted for encryption.
 
 /**
- * Encrypt a message using XOR cipher with base64 encoding
+ * Encrypt a message using XOR cipher
  * @param message The message to encrypt
- * @return Encrypted message in base64 format
+ * @param encoding BASE64 or BINARY
+ * @return Encrypted message with its header byte, empty if encoding is NONE
  */
-std::string encryptMessage(const std::string& message);
+std::string encryptMessage(const std::string& message, PayloadEncoding encoding = PayloadEncoding::BASE64);
 
 /**
  * Decrypt a message (for future use if needed)
- * @param encryptedMessage The encrypted message in base64 format
+ * @param encryptedMessage The encrypted message in either encoding
  * @return Decrypted message
  */
 std::string decryptMessage(const std::string& encryptedMessage);
 
+/**
+ * Size of the encrypted form of a plaintext, for sizing buffers passed to encryptInto
+ * @param plaintextLength Plaintext length in bytes
+ * @param encoding BASE64 or BINARY
+ * @return Exact encrypted length in bytes, header byte included
+ */
+size_t requiredSize(size_t plaintextLength, PayloadEncoding encoding = PayloadEncoding::BASE64);
+
+/**
+ * Upper bound on the decrypted size of an encrypted message, for sizing buffers passed to decryptInto
+ * @param encryptedLength Encrypted length in bytes
+ * @return Maximum decrypted length in bytes
+ */
+size_t requiredDecryptSize(size_t encryptedLength);
+
+/**
+ * Encrypt into a caller-provided buffer without allocating
+ * @param input Plaintext
+ * @param output Destination, at least requiredSize(input.size(), encoding) bytes; must not overlap input
+ * @param written Receives the number of bytes written
+ * @param encoding BASE64 or BINARY
+ * @return true on success, false if output is too small or encoding is NONE
+ */
+bool encryptInto(ConstByteSpan input, ByteSpan output, size_t& written,
+                 PayloadEncoding encoding = PayloadEncoding::BASE64);
+
+/**
+ * Decrypt into a caller-provided buffer without allocating
+ * @param input Encrypted message in either encoding
+ * @param output Destination, at least requiredDecryptSize(input.size()) bytes; may be input.data() itself
+ * @param written Receives the number of bytes written
+ * @return true on success, false if output is too small
+ */
+bool decryptInto(ConstByteSpan input, ByteSpan output, size_t& written);
+
+/**
+ * Encrypt the first length bytes of buffer in place
+ * @param buffer Holds the plaintext and receives the result; at least requiredSize(length, encoding) bytes
+ * @param length Plaintext length at the start of buffer
+ * @param encoding BASE64 or BINARY
+ * @return Encrypted length, or 0 if buffer is too small or encoding is NONE
+ */
+size_t encryptInPlace(ByteSpan buffer, size_t length, PayloadEncoding encoding = PayloadEncoding::BASE64);
+
+/**
+ * Decrypt an encrypted message in place; the result always fits in the input
+ * @param buffer The encrypted message, overwritten with the plaintext
+ * @return Decrypted length
+ */
+size_t decryptInPlace(ByteSpan buffer);
+
+/**
+ * Variant table of the XOR keystream kernels, for kernel_dispatch
+ */
+KernelFamily& keystreamKernels();
+
 #endif // MESSAGE_ENCRYPTION_H
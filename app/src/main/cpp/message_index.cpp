@@ -0,0 +1,226 @@
+#include "message_index.h"
+#include "checksum.h"
+#include <algorithm>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <cerrno>
+
+namespace {
+    const uint8_t INDEX_MAGIC[4] = {'F', 'X', 'I', 'X'};
+    constexpr uint8_t INDEX_VERSION = 1;
+
+    void store32(uint8_t* p, uint32_t v) {
+        for (int i = 0; i < 4; ++i) {
+            p[i] = static_cast<uint8_t>(v >> (8 * i));
+        }
+    }
+
+    void store64(uint8_t* p, uint64_t v) {
+        for (int i = 0; i < 8; ++i) {
+            p[i] = static_cast<uint8_t>(v >> (8 * i));
+        }
+    }
+
+    uint32_t load32(const uint8_t* p) {
+        uint32_t v = 0;
+        for (int i = 0; i < 4; ++i) {
+            v |= static_cast<uint32_t>(p[i]) << (8 * i);
+        }
+        return v;
+    }
+
+    uint64_t load64(const uint8_t* p) {
+        uint64_t v = 0;
+        for (int i = 0; i < 8; ++i) {
+            v |= static_cast<uint64_t>(p[i]) << (8 * i);
+        }
+        return v;
+    }
+
+    void writeHeader(uint8_t* header, const MessageIndex& index) {
+        std::memcpy(header, INDEX_MAGIC, sizeof(INDEX_MAGIC));
+        header[4] = INDEX_VERSION;
+        header[5] = 0;
+        header[6] = 0;
+        header[7] = 0;
+        store64(header + 8, index.base.size);
+        store64(header + 16, index.base.mtimeNs);
+        store32(header + 24, index.base.crc);
+        store32(header + 28, index.logSegment);
+        store64(header + 32, index.logLength);
+        store64(header + 40, index.entries.size());
+        store32(header + 48, 0);
+        store32(header + 52, crc32c(header, 52));
+    }
+
+    void writeEntries(std::vector<uint8_t>& out, const MessageIndex& index, size_t from) {
+        out.resize((index.entries.size() - from) * MESSAGE_INDEX_ENTRY_SIZE);
+        uint8_t* p = out.data();
+        for (size_t i = from; i < index.entries.size(); ++i, p += MESSAGE_INDEX_ENTRY_SIZE) {
+            store64(p, index.entries[i].location);
+            store64(p + 8, static_cast<uint64_t>(index.entries[i].timestamp));
+        }
+    }
+
+    bool preadFully(int fd, uint8_t* data, size_t length, off_t offset) {
+        while (length > 0) {
+            ssize_t n = pread(fd, data, length, offset);
+            if (n < 0 && errno == EINTR) {
+                continue;
+            }
+            if (n <= 0) {
+                return false;
+            }
+            data += n;
+            length -= static_cast<size_t>(n);
+            offset += n;
+        }
+        return true;
+    }
+
+    bool pwriteFully(int fd, const uint8_t* data, size_t length, off_t offset) {
+        while (length > 0) {
+            ssize_t n = pwrite(fd, data, length, offset);
+            if (n < 0 && errno == EINTR) {
+                continue;
+            }
+            if (n <= 0) {
+                return false;
+            }
+            data += n;
+            length -= static_cast<size_t>(n);
+            offset += n;
+        }
+        return true;
+    }
+}
+
+std::string messageIndexPath(const std::string& snapshotPath) {
+    return snapshotPath + ".idx";
+}
+
+bool readMessageIndex(const std::string& path, MessageIndex& index) {
+    index = MessageIndex();
+    int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return false;
+    }
+
+    uint8_t header[MESSAGE_INDEX_HEADER_SIZE];
+    struct stat info;
+    bool ok = fstat(fd, &info) == 0 && preadFully(fd, header, sizeof(header), 0) &&
+              std::memcmp(header, INDEX_MAGIC, sizeof(INDEX_MAGIC)) == 0 && header[4] == INDEX_VERSION &&
+              load32(header + 52) == crc32c(header, 52);
+    uint64_t count = ok ? load64(header + 40) : 0;
+    // Entries beyond the count are left over from an interrupted append
+    ok = ok && count <= (static_cast<uint64_t>(info.st_size) - MESSAGE_INDEX_HEADER_SIZE) / MESSAGE_INDEX_ENTRY_SIZE;
+
+    std::vector<uint8_t> entries;
+    if (ok) {
+        entries.resize(static_cast<size_t>(count) * MESSAGE_INDEX_ENTRY_SIZE);
+        ok = preadFully(fd, entries.data(), entries.size(), MESSAGE_INDEX_HEADER_SIZE);
+    }
+    close(fd);
+    if (!ok) {
+        return false;
+    }
+
+    index.base.size = load64(header + 8);
+    index.base.mtimeNs = load64(header + 16);
+    index.base.crc = load32(header + 24);
+    index.logSegment = load32(header + 28);
+    index.logLength = load64(header + 32);
+    index.entries.resize(static_cast<size_t>(count));
+    for (size_t i = 0; i < index.entries.size(); ++i) {
+        const uint8_t* p = entries.data() + i * MESSAGE_INDEX_ENTRY_SIZE;
+        index.entries[i].location = load64(p);
+        index.entries[i].timestamp = static_cast<int64_t>(load64(p + 8));
+    }
+    return true;
+}
+
+bool writeMessageIndex(const std::string& path, const MessageIndex& index) {
+    std::vector<uint8_t> contents;
+    writeEntries(contents, index, 0);
+    contents.insert(contents.begin(), MESSAGE_INDEX_HEADER_SIZE, 0);
+    writeHeader(contents.data(), index);
+
+    // Written aside and renamed, so readers never see a half-written index. It is not
+    // synced: after a power loss a stale or empty index is rebuilt.
+    std::string tempPath = path + ".tmp";
+    int fd = open(tempPath.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        return false;
+    }
+    bool ok = pwriteFully(fd, contents.data(), contents.size(), 0);
+    ok = close(fd) == 0 && ok;
+    if (!ok || rename(tempPath.c_str(), path.c_str()) != 0) {
+        unlink(tempPath.c_str());
+        return false;
+    }
+    return true;
+}
+
+bool appendMessageIndex(const std::string& path, const MessageIndex& index, size_t from) {
+    int fd = open(path.c_str(), O_WRONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return false;
+    }
+    std::vector<uint8_t> entries;
+    writeEntries(entries, index, from);
+    uint8_t header[MESSAGE_INDEX_HEADER_SIZE];
+    writeHeader(header, index);
+    bool ok = pwriteFully(fd, entries.data(), entries.size(),
+                          static_cast<off_t>(MESSAGE_INDEX_HEADER_SIZE + from * MESSAGE_INDEX_ENTRY_SIZE)) &&
+              pwriteFully(fd, header, sizeof(header), 0);
+    ok = close(fd) == 0 && ok;
+    return ok;
+}
+
+void indexMessageTimes(MessageIndex& index) {
+    if (index.timedEntries == index.entries.size()) {
+        return;
+    }
+    // A partial last block is summarized again with its new entries
+    size_t block = index.timedEntries / MESSAGE_TIME_BLOCK_SIZE;
+    index.timeBlocks.resize(block);
+    for (size_t first = block * MESSAGE_TIME_BLOCK_SIZE; first < index.entries.size(); first += MESSAGE_TIME_BLOCK_SIZE) {
+        size_t last = std::min(first + MESSAGE_TIME_BLOCK_SIZE, index.entries.size());
+        MessageTimeBlock summary;
+        summary.minTimestamp = index.entries[first].timestamp;
+        summary.maxTimestamp = index.entries[first].timestamp;
+        for (size_t i = first + 1; i < last; ++i) {
+            summary.minTimestamp = std::min(summary.minTimestamp, index.entries[i].timestamp);
+            summary.maxTimestamp = std::max(summary.maxTimestamp, index.entries[i].timestamp);
+        }
+        summary.maxUpTo = index.timeBlocks.empty() ? summary.maxTimestamp
+                                                   : std::max(summary.maxTimestamp, index.timeBlocks.back().maxUpTo);
+        summary.minFrom = summary.minTimestamp;
+        index.timeBlocks.push_back(summary);
+    }
+    index.timedEntries = index.entries.size();
+    
+    // New blocks can only lower the minimum after earlier ones; stop once they are unaffected
+    for (size_t i = index.timeBlocks.size() - 1; i-- > 0;) {
+        int64_t minFrom = std::min(index.timeBlocks[i].minTimestamp, index.timeBlocks[i + 1].minFrom);
+        if (i < block && minFrom == index.timeBlocks[i].minFrom) {
+            break;
+        }
+        index.timeBlocks[i].minFrom = minFrom;
+    }
+}
+
+void findMessageTimes(const MessageIndex& index, int64_t from, int64_t to, size_t& begin, size_t& end) {
+    const std::vector<MessageTimeBlock>& blocks = index.timeBlocks;
+    // Blocks before the first to reach from hold only earlier messages, and blocks from the
+    // first whose later messages are all after to onwards hold only later ones
+    auto first = std::partition_point(blocks.begin(), blocks.end(),
+                                      [from](const MessageTimeBlock& block) { return block.maxUpTo < from; });
+    auto last = std::partition_point(first, blocks.end(),
+                                     [to](const MessageTimeBlock& block) { return block.minFrom <= to; });
+    begin = static_cast<size_t>(first - blocks.begin()) * MESSAGE_TIME_BLOCK_SIZE;
+    end = std::min(static_cast<size_t>(last - blocks.begin()) * MESSAGE_TIME_BLOCK_SIZE, index.timedEntries);
+    begin = std::min(begin, end);
+}
@@ -0,0 +1,113 @@
+#ifndef MESSAGE_INDEX_H
+#define MESSAGE_INDEX_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "message_log.h"
+
+// Sidecar index of where every stored message starts, kept in <snapshot>.idx so that a
+// page of messages can be read without parsing the ones before it:
+//
+//   header   "FXIX" | version u8 | reserved u8[3] | base size u64 | base mtime ns u64 |
+//            base crc u32 | log segment u32 | log length u64 | entry count u64 | reserved u32 |
+//            header crc u32
+//   entry    location u64 | timestamp i64                                        (all LE)
+//
+// A location names the file holding the record (0 for the snapshot, 1 + n for log segment
+// n) in its top bits and the record's byte offset in that file below. The index covers
+// the snapshot described by the base and the log up to the given length of the given
+// segment; whatever was appended beyond that is indexed by catching up from there. The
+// index only describes files stored in plaintext, and it is derived data: a sidecar that
+// is missing, malformed or out of step is simply rebuilt.
+//
+// Time queries go through a sparse index on top, kept in memory only: the timestamp range
+// of every block of MESSAGE_TIME_BLOCK_SIZE entries, with the running maximum before it
+// and the minimum after it. Those two are monotonic even when message timestamps are not
+// (clock changes, messages received late), so the blocks that may hold a time range are
+// found by binary search and only their entries are looked at.
+
+constexpr size_t MESSAGE_INDEX_HEADER_SIZE = 56;
+constexpr size_t MESSAGE_INDEX_ENTRY_SIZE = 16;
+constexpr int MESSAGE_LOCATION_OFFSET_BITS = 40;
+constexpr size_t MESSAGE_TIME_BLOCK_SIZE = 64;
+
+struct MessageIndexEntry {
+    uint64_t location;
+    int64_t timestamp;
+};
+
+inline uint64_t messageLocation(uint32_t source, uint64_t offset) {
+    return (static_cast<uint64_t>(source) << MESSAGE_LOCATION_OFFSET_BITS) | offset;
+}
+
+inline uint32_t messageLocationSource(uint64_t location) {
+    return static_cast<uint32_t>(location >> MESSAGE_LOCATION_OFFSET_BITS);
+}
+
+inline uint64_t messageLocationOffset(uint64_t location) {
+    return location & ((1ULL << MESSAGE_LOCATION_OFFSET_BITS) - 1);
+}
+
+/**
+ * Timestamps of one block of index entries
+ */
+struct MessageTimeBlock {
+    int64_t minTimestamp;
+    int64_t maxTimestamp;
+    int64_t maxUpTo;        // Largest timestamp in this block and the ones before it
+    int64_t minFrom;        // Smallest timestamp in this block and the ones after it
+};
+
+struct MessageIndex {
+    LogBase base;
+    uint32_t logSegment = 0;    // Last log segment covered
+    uint64_t logLength = 0;     // Bytes of it covered; 0 if the log was empty
+    std::vector<MessageIndexEntry> entries;
+    
+    // Sparse time index over the first timedEntries entries, see indexMessageTimes()
+    std::vector<MessageTimeBlock> timeBlocks;
+    size_t timedEntries = 0;
+};
+
+/**
+ * Path of the sidecar index of a snapshot
+ */
+std::string messageIndexPath(const std::string& snapshotPath);
+
+/**
+ * Read a sidecar index
+ * @return false if it is missing or malformed
+ */
+bool readMessageIndex(const std::string& path, MessageIndex& index);
+
+/**
+ * Replace a sidecar index with the whole of index
+ * @return true on success, false on error
+ */
+bool writeMessageIndex(const std::string& path, const MessageIndex& index);
+
+/**
+ * Add the entries from position from onwards to a sidecar that holds the ones before it,
+ * then update its header. A crash in between leaves extra entries the header does not
+ * count, which readers ignore.
+ * @return true on success, false on error
+ */
+bool appendMessageIndex(const std::string& path, const MessageIndex& index, size_t from);
+
+/**
+ * Bring the time blocks of an index up to date with entries added since the last call
+ */
+void indexMessageTimes(MessageIndex& index);
+
+/**
+ * Find the entries that may have a timestamp in [from, to]: every entry outside the
+ * returned range is outside the time range, while entries inside it still need checking
+ * @param index An index whose time blocks are up to date
+ * @param begin Receives the first entry of the range
+ * @param end Receives the entry after the range; begin == end if nothing matches
+ */
+void findMessageTimes(const MessageIndex& index, int64_t from, int64_t to, size_t& begin, size_t& end);
+
+#endif // MESSAGE_INDEX_H
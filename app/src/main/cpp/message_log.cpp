@@ -0,0 +1,133 @@
+#include "message_log.h"
+#include "checksum.h"
+#include <cstring>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <cerrno>
+
+namespace {
+    const uint8_t LOG_MAGIC[4] = {'F', 'X', 'L', 'G'};
+    constexpr uint8_t LOG_VERSION = 1;
+
+    // Bytes of the snapshot covered by the base checksum
+    constexpr size_t BASE_CHECKSUM_BYTES = 4096;
+
+    void store32(uint8_t* p, uint32_t v) {
+        for (int i = 0; i < 4; ++i) {
+            p[i] = static_cast<uint8_t>(v >> (8 * i));
+        }
+    }
+
+    void store64(uint8_t* p, uint64_t v) {
+        for (int i = 0; i < 8; ++i) {
+            p[i] = static_cast<uint8_t>(v >> (8 * i));
+        }
+    }
+
+    uint32_t load32(const uint8_t* p) {
+        uint32_t v = 0;
+        for (int i = 0; i < 4; ++i) {
+            v |= static_cast<uint32_t>(p[i]) << (8 * i);
+        }
+        return v;
+    }
+
+    uint64_t load64(const uint8_t* p) {
+        uint64_t v = 0;
+        for (int i = 0; i < 8; ++i) {
+            v |= static_cast<uint64_t>(p[i]) << (8 * i);
+        }
+        return v;
+    }
+
+    uint64_t modificationTimeNs(const struct stat& info) {
+#ifdef __APPLE__
+        const struct timespec& mtime = info.st_mtimespec;
+#else
+        const struct timespec& mtime = info.st_mtim;
+#endif
+        return static_cast<uint64_t>(mtime.tv_sec) * 1000000000ULL + static_cast<uint64_t>(mtime.tv_nsec);
+    }
+}
+
+bool readLogBase(const std::string& snapshotPath, LogBase& base) {
+    base = LogBase();
+    struct stat info;
+    if (stat(snapshotPath.c_str(), &info) != 0) {
+        return errno == ENOENT;
+    }
+
+    int fd = open(snapshotPath.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return false;
+    }
+    uint8_t head[BASE_CHECKSUM_BYTES];
+    ssize_t length;
+    do {
+        length = pread(fd, head, sizeof(head), 0);
+    } while (length < 0 && errno == EINTR);
+    close(fd);
+    if (length < 0) {
+        return false;
+    }
+
+    base.size = static_cast<uint64_t>(info.st_size);
+    base.mtimeNs = modificationTimeNs(info);
+    base.crc = crc32c(head, static_cast<size_t>(length));
+    return true;
+}
+
+std::string logSegmentPath(const std::string& snapshotPath, uint32_t segmentIndex) {
+    return snapshotPath + ".log." + std::to_string(segmentIndex);
+}
+
+void writeLogSegmentHeader(uint8_t* output, uint32_t segmentIndex, const LogBase& base) {
+    std::memcpy(output, LOG_MAGIC, sizeof(LOG_MAGIC));
+    output[4] = LOG_VERSION;
+    output[5] = 0;
+    output[6] = 0;
+    output[7] = 0;
+    store32(output + 8, segmentIndex);
+    store64(output + 12, base.size);
+    store64(output + 20, base.mtimeNs);
+    store32(output + 28, base.crc);
+    store32(output + 32, crc32c(output, 32));
+}
+
+bool readLogSegmentHeader(const uint8_t* bytes, uint32_t& segmentIndex, LogBase& base) {
+    if (std::memcmp(bytes, LOG_MAGIC, sizeof(LOG_MAGIC)) != 0 || bytes[4] != LOG_VERSION ||
+        load32(bytes + 32) != crc32c(bytes, 32)) {
+        return false;
+    }
+    segmentIndex = load32(bytes + 8);
+    base.size = load64(bytes + 12);
+    base.mtimeNs = load64(bytes + 20);
+    base.crc = load32(bytes + 28);
+    return true;
+}
+
+void writeLogRecordHeader(uint8_t* output, ConstByteSpan payload) {
+    store32(output, static_cast<uint32_t>(payload.size()));
+    store32(output + 4, crc32c(payload.data(), payload.size()));
+}
+
+size_t scanLogRecords(ConstByteSpan body, const std::function<bool(ConstByteSpan)>& visit) {
+    size_t offset = 0;
+    while (body.size() - offset >= LOG_RECORD_HEADER_SIZE) {
+        const uint8_t* header = body.data() + offset;
+        size_t length = load32(header);
+        if (length > body.size() - offset - LOG_RECORD_HEADER_SIZE) {
+            break; // Torn write at the tail
+        }
+        ConstByteSpan payload = body.subspan(offset + LOG_RECORD_HEADER_SIZE, length);
+        if (crc32c(payload.data(), payload.size()) != load32(header + 4)) {
+            break;
+        }
+        if (!visit(payload)) {
+            break;
+        }
+        offset += LOG_RECORD_HEADER_SIZE + length;
+    }
+    return offset;
+}
@@ -0,0 +1,80 @@
+#ifndef MESSAGE_LOG_H
+#define MESSAGE_LOG_H
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include "span.h"
+
+// Append-only log of message batches kept next to a BlobStorage snapshot file, so adding
+// messages costs I/O proportional to the new data instead of rewriting the history:
+//
+//   segment  header | record*
+//   header   "FXLG" | version u8 | reserved u8[3] | segment index u32 |
+//            base size u64 | base mtime ns u64 | base crc u32 | header crc u32      (LE)
+//   record   payload length u32 | crc32c(payload) u32 | payload                   (LE)
+//
+// Segments are the files <snapshot>.log.0, .log.1, ... and a new one is started once the
+// current one reaches the segment size, which bounds the recovery scan after a crash.
+// Every header records the snapshot the log extends (its size, mtime and a checksum of
+// its first bytes); a log whose base no longer matches was left behind by a snapshot
+// rewrite that crashed before deleting it, and is ignored.
+
+constexpr size_t LOG_SEGMENT_HEADER_SIZE = 36;
+constexpr size_t LOG_RECORD_HEADER_SIZE = 8;
+constexpr size_t DEFAULT_LOG_SEGMENT_SIZE = 4 * 1024 * 1024;
+
+/**
+ * Identity of the snapshot file a log extends
+ */
+struct LogBase {
+    uint64_t size = 0;
+    uint64_t mtimeNs = 0;
+    uint32_t crc = 0;
+
+    bool operator==(const LogBase& other) const {
+        return size == other.size && mtimeNs == other.mtimeNs && crc == other.crc;
+    }
+    bool operator!=(const LogBase& other) const {
+        return !(*this == other);
+    }
+};
+
+/**
+ * Describe the snapshot at snapshotPath; a missing snapshot has an all-zero base
+ * @return false if the snapshot exists but cannot be read
+ */
+bool readLogBase(const std::string& snapshotPath, LogBase& base);
+
+/**
+ * Path of one log segment of a snapshot
+ */
+std::string logSegmentPath(const std::string& snapshotPath, uint32_t segmentIndex);
+
+/**
+ * @param output LOG_SEGMENT_HEADER_SIZE bytes
+ */
+void writeLogSegmentHeader(uint8_t* output, uint32_t segmentIndex, const LogBase& base);
+
+/**
+ * Parse and check a segment header
+ * @param bytes LOG_SEGMENT_HEADER_SIZE bytes
+ * @return false if the magic, version or header checksum is wrong
+ */
+bool readLogSegmentHeader(const uint8_t* bytes, uint32_t& segmentIndex, LogBase& base);
+
+/**
+ * @param output LOG_RECORD_HEADER_SIZE bytes, followed in the file by the payload
+ */
+void writeLogRecordHeader(uint8_t* output, ConstByteSpan payload);
+
+/**
+ * Visit the records of a segment body (the bytes after its header) in order, stopping at
+ * the first incomplete or corrupt one
+ * @param visit Receives each payload; returning false stops the scan
+ * @return Length of the valid prefix of body, i.e. where the next record belongs
+ */
+size_t scanLogRecords(ConstByteSpan body, const std::function<bool(ConstByteSpan)>& visit);
+
+#endif // MESSAGE_LOG_H
@@ -9,6 +9,7 @@
 #include "socket_manager.h"
 #include "message_encryption.h"
 #include "blob_storage.h"
+#include "kernel_dispatch.h"
 
 // Global thread manager instance
 static ThreadManager* g_threadManager = nullptr;
@@ -19,6 +20,9 @@ static IOBridge* g_ioBridge = nullptr;
 // Global socket manager instance
 static SocketManager* g_socketManager = nullptr;
 
+// Global blob storage instance
+static BlobStorage* g_blobStorage = nullptr;
+
 static JavaVM* g_jvm = nullptr;
 
 // Get JVM reference
@@ -28,6 +32,14 @@ static void getJvmReference(JNIEnv* env) {
     }
 }
 
+// Library load: bind the SIMD kernels for this CPU before any other native call runs
+extern "C" JNIEXPORT jint JNICALL
+JNI_OnLoad(JavaVM* vm, void* /* reserved */) {
+    g_jvm = vm;
+    initKernelDispatch();
+    return JNI_VERSION_1_6;
+}
+
 // Initialize thread manager
 extern "C" JNIEXPORT void JNICALL
 Java_com_fluxorio_MainActivity_initThreadManager(JNIEnv* env, jobject /* this */) {
@@ -42,6 +54,9 @@ Java_com_fluxorio_MainActivity_initThreadManager(JNIEnv* env, jobject /* this */
             threadCount = std::min(threadCount + 1, 8u); // Cap at 8 threads
         }
         g_threadManager->initializeThreadPool(threadCount);
+        if (g_blobStorage != nullptr) {
+            g_blobStorage->setThreadManager(g_threadManager);
+        }
     }
     getJvmReference(env);
 }
@@ -50,6 +65,11 @@ Java_com_fluxorio_MainActivity_initThreadManager(JNIEnv* env, jobject /* this */
 extern "C" JNIEXPORT void JNICALL
 Java_com_fluxorio_MainActivity_cleanupThreadManager(JNIEnv* env, jobject /* this */) {
     if (g_threadManager != nullptr) {
+        if (g_blobStorage != nullptr) {
+            // Queued writes would otherwise wait for the next access to the file
+            g_blobStorage->flush();
+            g_blobStorage->setThreadManager(nullptr);
+        }
         delete g_threadManager;
         g_threadManager = nullptr;
     }
@@ -149,6 +169,10 @@ Java_com_fluxorio_MainActivity_initIOBridge(JNIEnv* env, jobject /* this */) {
             g_ioBridge->setThreadManager(g_threadManager);
         }
         
+        // Deliver events from one long-lived JVM-attached thread instead of
+        // attaching whichever pool worker happens to run processEvents()
+        g_ioBridge->startDispatcher();
+        
         // Set I/O bridge reference in socket manager if already initialized
         if (g_socketManager != nullptr) {
             g_socketManager->setIOBridge(g_ioBridge);
@@ -280,17 +304,35 @@ Java_com_fluxorio_MainActivity_postByteArrayEvent(JNIEnv* env, jobject /* this *
     const char* eventIdStr = env->GetStringUTFChars(eventId, nullptr);
     if (eventIdStr && data != nullptr) {
         jsize length = env->GetArrayLength(data);
-        jbyte* bytes = env->GetByteArrayElements(data, nullptr);
         
-        if (bytes != nullptr) {
+        // Copy straight from the Java array into a pooled bridge buffer
+        uint8_t* buffer = g_ioBridge->acquireBuffer(static_cast<size_t>(length));
+        if (buffer != nullptr) {
+            env->GetByteArrayRegion(data, 0, length, reinterpret_cast<jbyte*>(buffer));
             std::string eventIdCpp = eventIdStr;
-            g_ioBridge->postByteArrayEvent(eventIdCpp, reinterpret_cast<uint8_t*>(bytes), static_cast<size_t>(length));
-            env->ReleaseByteArrayElements(data, bytes, JNI_ABORT);
+            g_ioBridge->postByteArrayBuffer(eventIdCpp, buffer, static_cast<size_t>(length));
         }
         env->ReleaseStringUTFChars(eventId, eventIdStr);
     }
 }
 
+// Return a direct buffer delivered through onByteBufferEvent to the bridge's pool
+extern "C" JNIEXPORT void JNICALL
+Java_com_fluxorio_DirectBufferPool_release(JNIEnv* env, jclass /* clazz */, jlong handle) {
+    if (g_ioBridge == nullptr || handle == 0) {
+        return;
+    }
+    
+    // Handles are validated, so a repeated release or one from a previous bridge is ignored
+    g_ioBridge->releaseLentBuffer(static_cast<int64_t>(handle));
+}
+
+// Report the detected CPU features and the kernel variant bound for each family
+extern "C" JNIEXPORT jstring JNICALL
+Java_com_fluxorio_NativeDiagnostics_kernelReport(JNIEnv* env, jclass /* clazz */) {
+    return env->NewStringUTF(kernelDiagnostics().c_str());
+}
+
 // Initialize socket manager
 extern "C" JNIEXPORT void JNICALL
 Java_com_fluxorio_MainActivity_initSocketManager(JNIEnv* env, jobject /* this */) {
@@ -412,36 +454,30 @@ Java_com_fluxorio_MainActivity_sendImageToThreadHandler(JNIEnv* env, jobject /*
         return;
     }
     
-    // Get byte array elements
-    jbyte* bytes = env->GetByteArrayElements(imageData, nullptr);
-    if (bytes == nullptr) {
+    // Copy image data into a pooled bridge buffer; ownership moves to the I/O bridge on post
+    uint8_t* buffer = g_ioBridge->acquireBuffer(static_cast<size_t>(length));
+    if (buffer == nullptr) {
         return;
     }
-    
-    // Copy image data to C++ vector
-    std::vector<uint8_t> imageDataCpp(reinterpret_cast<uint8_t*>(bytes), reinterpret_cast<uint8_t*>(bytes) + length);
-    
-    // Release byte array elements
-    env->ReleaseByteArrayElements(imageData, bytes, JNI_ABORT);
+    env->GetByteArrayRegion(imageData, 0, length, reinterpret_cast<jbyte*>(buffer));
+    size_t imageSize = static_cast<size_t>(length);
     
     // Submit task to thread pool for processing
-    g_threadManager->submitTask([imageDataCpp]() {
+    g_threadManager->submitTask([buffer, imageSize]() {
         // Simulate image processing (e.g., resize, filter, analyze, etc.)
         // In a real app, this could be actual image processing using OpenCV, image libraries, etc.
         
         // Simulate some processing time
         std::this_thread::sleep_for(std::chrono::milliseconds(300));
         
-        // Process the image (example: echo back processed image data or analysis results)
-        // For demonstration, we'll return a processed version (in real app, do actual processing)
-        std::vector<uint8_t> processedImage = imageDataCpp; // In real app, process the image here
+        // Process the image in place (in real app, do actual processing on buffer here)
         
         // You could also send back metadata as string
-        std::string imageInfo = "Image processed: " + std::to_string(imageDataCpp.size()) + " bytes";
+        std::string imageInfo = "Image processed: " + std::to_string(imageSize) + " bytes";
         
-        // Send processed image data back to Kotlin via I/O bridge
+        // Send processed image data back to Kotlin via I/O bridge without copying it again
         if (g_ioBridge != nullptr) {
-            g_ioBridge->postByteArrayEvent("image_response", processedImage.data(), processedImage.size());
+            g_ioBridge->postByteArrayBuffer("image_response", buffer, imageSize);
             
             // Also send info as string
             g_ioBridge->postStringEvent("image_info", imageInfo);
@@ -449,13 +485,25 @@ Java_com_fluxorio_MainActivity_sendImageToThreadHandler(JNIEnv* env, jobject /*
     });
 }
 
-// Global blob storage instance
-static BlobStorage* g_blobStorage = nullptr;
+// Decoded messages kept in memory by BlobStorage, enough for a few long conversations
+static constexpr size_t DEFAULT_MESSAGE_CACHE_SIZE = 16 * 1024 * 1024;
 
 // Initialize blob storage (called once, can be lazy)
 static BlobStorage* getBlobStorage() {
     if (g_blobStorage == nullptr) {
         g_blobStorage = new BlobStorage();
+        // Saves from several threads coalesce instead of each paying for a sync
+        g_blobStorage->setGroupCommit(true);
+        // Compressed blocks and background writes are spread over the pool
+        g_blobStorage->setThreadManager(g_threadManager);
+        // Going back to a conversation is served from memory
+        g_blobStorage->setCacheCapacity(DEFAULT_MESSAGE_CACHE_SIZE);
+        // Background writes report back through the bridge, with the file path as data
+        g_blobStorage->setWriteCallback([](const std::string& filePath, bool ok) {
+            if (g_ioBridge != nullptr) {
+                g_ioBridge->postStringEvent(ok ? "storage_written" : "storage_write_failed", filePath);
+            }
+        });
     }
     return g_blobStorage;
 }
@@ -496,10 +544,57 @@ Java_com_fluxorio_BlobStorage_00024Companion_saveMessagesNative(JNIEnv* env, jcl
     return result ? JNI_TRUE : JNI_FALSE;
 }
 
-// Load messages from blob storage
+// Append messages to blob storage without rewriting the stored ones
+extern "C" JNIEXPORT jboolean JNICALL
+Java_com_fluxorio_BlobStorage_00024Companion_appendMessagesNative(JNIEnv* env, jclass /* clazz */, jstring filePath, jbyteArray data) {
+    if (filePath == nullptr || data == nullptr) {
+        return JNI_FALSE;
+    }
+    
+    BlobStorage* storage = getBlobStorage();
+    if (storage == nullptr) {
+        return JNI_FALSE;
+    }
+    
+    const char* filePathCStr = env->GetStringUTFChars(filePath, nullptr);
+    if (filePathCStr == nullptr) {
+        return JNI_FALSE;
+    }
+    std::string filePathCpp = filePathCStr;
+    env->ReleaseStringUTFChars(filePath, filePathCStr);
+    
+    jsize length = env->GetArrayLength(data);
+    jbyte* bytes = env->GetByteArrayElements(data, nullptr);
+    if (bytes == nullptr) {
+        return JNI_FALSE;
+    }
+    
+    bool result = storage->appendMessages(filePathCpp, reinterpret_cast<const uint8_t*>(bytes), static_cast<size_t>(length));
+    
+    env->ReleaseByteArrayElements(data, bytes, JNI_ABORT);
+    
+    return result ? JNI_TRUE : JNI_FALSE;
+}
+
+/**
+ * Copy a batch loaded by BlobStorage into a new byte array
+ * @return nullptr if the load failed
+ */
+static jbyteArray messagePageToArray(JNIEnv* env, bool loaded, const std::vector<uint8_t>& data) {
+    if (!loaded) {
+        return nullptr;
+    }
+    jbyteArray result = env->NewByteArray(static_cast<jsize>(data.size()));
+    if (result != nullptr && !data.empty()) {
+        env->SetByteArrayRegion(result, 0, static_cast<jsize>(data.size()), reinterpret_cast<const jbyte*>(data.data()));
+    }
+    return result;
+}
+
+// Load messages first..first+count-1 as a batch, reading only those records where indexed
 extern "C" JNIEXPORT jbyteArray JNICALL
-Java_com_fluxorio_BlobStorage_00024Companion_loadMessagesNative(JNIEnv* env, jclass /* clazz */, jstring filePath) {
-    if (filePath == nullptr) {
+Java_com_fluxorio_BlobStorage_00024Companion_loadRangeNative(JNIEnv* env, jclass /* clazz */, jstring filePath, jint first, jint count) {
+    if (filePath == nullptr || first < 0 || count < 0) {
         return nullptr;
     }
     
@@ -508,7 +603,6 @@ Java_com_fluxorio_BlobStorage_00024Companion_loadMessagesNative(JNIEnv* env, jcl
         return nullptr;
     }
     
-    // Convert Java string to C++ string
     const char* filePathCStr = env->GetStringUTFChars(filePath, nullptr);
     if (filePathCStr == nullptr) {
         return nullptr;
@@ -516,23 +610,163 @@ Java_com_fluxorio_BlobStorage_00024Companion_loadMessagesNative(JNIEnv* env, jcl
     std::string filePathCpp = filePathCStr;
     env->ReleaseStringUTFChars(filePath, filePathCStr);
     
-    // Load messages
     std::vector<uint8_t> data;
-    if (!storage->loadMessages(filePathCpp, data)) {
+    bool loaded = storage->loadRange(filePathCpp, static_cast<uint32_t>(first), static_cast<uint32_t>(count), data);
+    return messagePageToArray(env, loaded, data);
+}
+
+// Load the newest count messages as a batch
+extern "C" JNIEXPORT jbyteArray JNICALL
+Java_com_fluxorio_BlobStorage_00024Companion_loadLatestNative(JNIEnv* env, jclass /* clazz */, jstring filePath, jint count) {
+    if (filePath == nullptr || count < 0) {
         return nullptr;
     }
     
-    // Convert to Java byte array
-    if (data.empty()) {
-        return env->NewByteArray(0);
+    BlobStorage* storage = getBlobStorage();
+    if (storage == nullptr) {
+        return nullptr;
     }
     
-    jbyteArray result = env->NewByteArray(static_cast<jsize>(data.size()));
-    if (result != nullptr) {
-        env->SetByteArrayRegion(result, 0, static_cast<jsize>(data.size()), reinterpret_cast<const jbyte*>(data.data()));
+    const char* filePathCStr = env->GetStringUTFChars(filePath, nullptr);
+    if (filePathCStr == nullptr) {
+        return nullptr;
     }
+    std::string filePathCpp = filePathCStr;
+    env->ReleaseStringUTFChars(filePath, filePathCStr);
     
-    return result;
+    std::vector<uint8_t> data;
+    bool loaded = storage->loadLatest(filePathCpp, static_cast<uint32_t>(count), data);
+    return messagePageToArray(env, loaded, data);
+}
+
+// Load the messages with a timestamp within [from, to] as a batch
+extern "C" JNIEXPORT jbyteArray JNICALL
+Java_com_fluxorio_BlobStorage_00024Companion_loadBetweenNative(JNIEnv* env, jclass /* clazz */, jstring filePath, jlong from, jlong to) {
+    if (filePath == nullptr) {
+        return nullptr;
+    }
+    
+    BlobStorage* storage = getBlobStorage();
+    if (storage == nullptr) {
+        return nullptr;
+    }
+    
+    const char* filePathCStr = env->GetStringUTFChars(filePath, nullptr);
+    if (filePathCStr == nullptr) {
+        return nullptr;
+    }
+    std::string filePathCpp = filePathCStr;
+    env->ReleaseStringUTFChars(filePath, filePathCStr);
+    
+    std::vector<uint8_t> data;
+    bool loaded = storage->loadBetween(filePathCpp, static_cast<int64_t>(from), static_cast<int64_t>(to), data);
+    return messagePageToArray(env, loaded, data);
+}
+
+// Enable or disable block compression of saved and appended messages
+extern "C" JNIEXPORT void JNICALL
+Java_com_fluxorio_BlobStorage_00024Companion_setCompressionNative(JNIEnv* env, jclass /* clazz */, jboolean enabled) {
+    BlobStorage* storage = getBlobStorage();
+    if (storage != nullptr) {
+        storage->setCompression(enabled == JNI_TRUE);
+    }
+}
+
+// Bound the memory held by the message cache; 0 drops it
+extern "C" JNIEXPORT void JNICALL
+Java_com_fluxorio_BlobStorage_00024Companion_setCacheSizeNative(JNIEnv* env, jclass /* clazz */, jlong bytes) {
+    BlobStorage* storage = getBlobStorage();
+    if (storage != nullptr && bytes >= 0) {
+        storage->setCacheCapacity(static_cast<size_t>(bytes));
+    }
+}
+
+// Queue saves and appends for a background writer instead of writing them in the call
+extern "C" JNIEXPORT void JNICALL
+Java_com_fluxorio_BlobStorage_00024Companion_setWriteBehindNative(JNIEnv* env, jclass /* clazz */, jboolean enabled) {
+    BlobStorage* storage = getBlobStorage();
+    if (storage != nullptr) {
+        storage->setWriteBehind(enabled == JNI_TRUE);
+    }
+}
+
+// Wait until every queued save and append is written
+extern "C" JNIEXPORT jboolean JNICALL
+Java_com_fluxorio_BlobStorage_00024Companion_flushNative(JNIEnv* env, jclass /* clazz */) {
+    BlobStorage* storage = getBlobStorage();
+    if (storage == nullptr) {
+        return JNI_FALSE;
+    }
+    return storage->flush() ? JNI_TRUE : JNI_FALSE;
+}
+
+// Count the stored messages
+extern "C" JNIEXPORT jlong JNICALL
+Java_com_fluxorio_BlobStorage_00024Companion_countMessagesNative(JNIEnv* env, jclass /* clazz */, jstring filePath) {
+    if (filePath == nullptr) {
+        return -1;
+    }
+    
+    BlobStorage* storage = getBlobStorage();
+    if (storage == nullptr) {
+        return -1;
+    }
+    
+    const char* filePathCStr = env->GetStringUTFChars(filePath, nullptr);
+    if (filePathCStr == nullptr) {
+        return -1;
+    }
+    std::string filePathCpp = filePathCStr;
+    env->ReleaseStringUTFChars(filePath, filePathCStr);
+    
+    return static_cast<jlong>(storage->countMessages(filePathCpp));
+}
+
+// Load messages from blob storage into a view the managed side reads through
+// messagesBufferNative and returns with closeMessagesNative
+extern "C" JNIEXPORT jlong JNICALL
+Java_com_fluxorio_BlobStorage_00024Companion_openMessagesNative(JNIEnv* env, jclass /* clazz */, jstring filePath) {
+    if (filePath == nullptr) {
+        return 0;
+    }
+    
+    BlobStorage* storage = getBlobStorage();
+    if (storage == nullptr) {
+        return 0;
+    }
+    
+    // Convert Java string to C++ string
+    const char* filePathCStr = env->GetStringUTFChars(filePath, nullptr);
+    if (filePathCStr == nullptr) {
+        return 0;
+    }
+    std::string filePathCpp = filePathCStr;
+    env->ReleaseStringUTFChars(filePath, filePathCStr);
+    
+    MessageView* view = new MessageView();
+    if (!storage->viewMessages(filePathCpp, *view)) {
+        delete view;
+        return 0;
+    }
+    return static_cast<jlong>(reinterpret_cast<uintptr_t>(view));
+}
+
+// Wrap a message view in a direct ByteBuffer without copying it; null if it is empty.
+// The buffer is backed by a read-only mapping and must not be written.
+extern "C" JNIEXPORT jobject JNICALL
+Java_com_fluxorio_BlobStorage_00024Companion_messagesBufferNative(JNIEnv* env, jclass /* clazz */, jlong handle) {
+    MessageView* view = reinterpret_cast<MessageView*>(static_cast<uintptr_t>(handle));
+    if (view == nullptr || view->bytes().empty()) {
+        return nullptr;
+    }
+    ConstByteSpan bytes = view->bytes();
+    return env->NewDirectByteBuffer(const_cast<uint8_t*>(bytes.data()), static_cast<jlong>(bytes.size()));
+}
+
+// Release a message view; buffers wrapping it must not be accessed afterwards
+extern "C" JNIEXPORT void JNICALL
+Java_com_fluxorio_BlobStorage_00024Companion_closeMessagesNative(JNIEnv* /* env */, jclass /* clazz */, jlong handle) {
+    delete reinterpret_cast<MessageView*>(static_cast<uintptr_t>(handle));
 }
 
 // Clear all stored messages
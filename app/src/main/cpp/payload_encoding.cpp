@@ -0,0 +1,265 @@
+#include "payload_encoding.h"
+#include "base64_codec.h"
+#include "bulk_copy.h"
+#include <algorithm>
+#include <cstring>
+
+namespace {
+    // Streaming base64 works on whole groups; a block of this many input bytes encodes
+    // into a 16 KB scratch buffer
+    constexpr size_t STREAM_BLOCK_BYTES = 12 * 1024;
+    constexpr size_t STREAM_BLOCK_CHARS = 16 * 1024;
+
+    uint8_t headerByte(PayloadEncoding encoding) {
+        return encoding == PayloadEncoding::BASE64 ? PAYLOAD_HEADER_BASE64 : PAYLOAD_HEADER_BINARY;
+    }
+}
+
+size_t encodedPayloadSize(size_t length, PayloadEncoding encoding) {
+    switch (encoding) {
+        case PayloadEncoding::BINARY:
+            return 1 + length;
+        case PayloadEncoding::BASE64:
+            return 1 + base64EncodedLength(length);
+        default:
+            return length;
+    }
+}
+
+size_t decodedPayloadMaxSize(size_t encodedLength) {
+    return std::max(encodedLength, base64DecodedMaxLength(encodedLength));
+}
+
+PayloadEncoding detectPayloadEncoding(ConstByteSpan encoded, PayloadEncoding fallback) {
+    if (!encoded.empty()) {
+        if (encoded[0] == PAYLOAD_HEADER_BINARY) {
+            return PayloadEncoding::BINARY;
+        }
+        if (encoded[0] == PAYLOAD_HEADER_BASE64) {
+            return PayloadEncoding::BASE64;
+        }
+    }
+    return fallback;
+}
+
+bool encodePayload(ConstByteSpan input, ByteSpan output, PayloadEncoding encoding, size_t& written) {
+    written = 0;
+    size_t encodedLength = encodedPayloadSize(input.size(), encoding);
+    if (output.size() < encodedLength) {
+        return false;
+    }
+
+    uint8_t* body = output.data();
+    if (encoding != PayloadEncoding::NONE) {
+        *body++ = headerByte(encoding);
+    }
+
+    if (encoding == PayloadEncoding::BASE64) {
+        base64Encode(input.data(), input.size(), reinterpret_cast<char*>(body));
+    } else {
+        bulkCopy(body, input.data(), input.size());
+    }
+    written = encodedLength;
+    return true;
+}
+
+bool decodePayload(ConstByteSpan input, ByteSpan output, size_t& written, PayloadEncoding fallback) {
+    written = 0;
+    if (output.data() != input.data() && output.size() < decodedPayloadMaxSize(input.size())) {
+        return false;
+    }
+
+    PayloadEncoding encoding = detectPayloadEncoding(input, fallback);
+    ConstByteSpan body = input;
+    if (!input.empty() && (input[0] == PAYLOAD_HEADER_BINARY || input[0] == PAYLOAD_HEADER_BASE64)) {
+        body = input.subspan(1);
+    }
+
+    if (encoding == PayloadEncoding::BASE64) {
+        // Output trails the body by at least the header byte, so decoding in place is safe
+        written = base64Decode(reinterpret_cast<const char*>(body.data()), body.size(), output.data());
+    } else {
+        if (!body.empty()) {
+            std::memmove(output.data(), body.data(), body.size());
+        }
+        written = body.size();
+    }
+    return true;
+}
+
+PayloadEncoder::PayloadEncoder(PayloadEncoding encoding, StreamSink sink)
+    : encoding_(encoding),
+      sink_(std::move(sink)),
+      carryLength_(0),
+      headerWritten_(false),
+      failed_(false) {
+    if (encoding_ == PayloadEncoding::BASE64) {
+        scratch_.resize(STREAM_BLOCK_CHARS);
+    }
+}
+
+bool PayloadEncoder::emit(const void* data, size_t length) {
+    if (!failed_ && length > 0 && !sink_(ConstByteSpan(static_cast<const uint8_t*>(data), length))) {
+        failed_ = true;
+    }
+    return !failed_;
+}
+
+bool PayloadEncoder::writeHeader() {
+    if (!headerWritten_ && encoding_ != PayloadEncoding::NONE) {
+        uint8_t header = headerByte(encoding_);
+        headerWritten_ = true;
+        return emit(&header, 1);
+    }
+    headerWritten_ = true;
+    return !failed_;
+}
+
+bool PayloadEncoder::update(ConstByteSpan input) {
+    if (!writeHeader()) {
+        return false;
+    }
+    if (encoding_ != PayloadEncoding::BASE64) {
+        return emit(input.data(), input.size());
+    }
+
+    const uint8_t* data = input.data();
+    size_t remaining = input.size();
+
+    // Complete the group left over from the previous piece
+    if (carryLength_ > 0) {
+        while (carryLength_ < 3 && remaining > 0) {
+            carry_[carryLength_++] = *data++;
+            remaining--;
+        }
+        if (carryLength_ < 3) {
+            return true;
+        }
+        base64Encode(carry_, 3, scratch_.data());
+        carryLength_ = 0;
+        if (!emit(scratch_.data(), 4)) {
+            return false;
+        }
+    }
+
+    while (remaining >= 3) {
+        size_t length = std::min(remaining - remaining % 3, STREAM_BLOCK_BYTES);
+        size_t encoded = base64Encode(data, length, scratch_.data());
+        if (!emit(scratch_.data(), encoded)) {
+            return false;
+        }
+        data += length;
+        remaining -= length;
+    }
+
+    if (remaining > 0) {
+        std::memcpy(carry_, data, remaining);
+    }
+    carryLength_ = remaining;
+    return true;
+}
+
+bool PayloadEncoder::finalize() {
+    if (!writeHeader()) {
+        return false;
+    }
+    if (carryLength_ > 0) {
+        size_t encoded = base64Encode(carry_, carryLength_, scratch_.data());
+        carryLength_ = 0;
+        return emit(scratch_.data(), encoded);
+    }
+    return true;
+}
+
+PayloadDecoder::PayloadDecoder(PayloadEncoding fallback, StreamSink sink)
+    : fallback_(fallback),
+      encoding_(fallback),
+      sink_(std::move(sink)),
+      carryLength_(0),
+      detected_(false),
+      failed_(false) {
+}
+
+bool PayloadDecoder::emit(const uint8_t* data, size_t length) {
+    if (!failed_ && length > 0 && !sink_(ConstByteSpan(data, length))) {
+        failed_ = true;
+    }
+    return !failed_;
+}
+
+bool PayloadDecoder::update(ConstByteSpan input) {
+    if (failed_) {
+        return false;
+    }
+    if (input.empty()) {
+        return true;
+    }
+
+    const uint8_t* data = input.data();
+    size_t remaining = input.size();
+    if (!detected_) {
+        detected_ = true;
+        encoding_ = detectPayloadEncoding(input, fallback_);
+        if (data[0] == PAYLOAD_HEADER_BINARY || data[0] == PAYLOAD_HEADER_BASE64) {
+            data++;
+            remaining--;
+        }
+        if (encoding_ == PayloadEncoding::BASE64) {
+            scratch_.resize(base64DecodedMaxLength(STREAM_BLOCK_CHARS));
+        }
+    }
+
+    if (encoding_ != PayloadEncoding::BASE64) {
+        return emit(data, remaining);
+    }
+
+    const char* chars = reinterpret_cast<const char*>(data);
+
+    // Complete the group left over from the previous piece
+    if (carryLength_ > 0) {
+        while (carryLength_ < 4 && remaining > 0) {
+            carry_[carryLength_++] = *chars++;
+            remaining--;
+        }
+        if (carryLength_ < 4) {
+            return true;
+        }
+        size_t decoded = base64Decode(carry_, 4, scratch_.data());
+        carryLength_ = 0;
+        if (!emit(scratch_.data(), decoded)) {
+            return false;
+        }
+    }
+
+    while (remaining >= 4) {
+        size_t length = std::min(remaining - remaining % 4, STREAM_BLOCK_CHARS);
+        size_t decoded = base64Decode(chars, length, scratch_.data());
+        if (!emit(scratch_.data(), decoded)) {
+            return false;
+        }
+        chars += length;
+        remaining -= length;
+    }
+
+    if (remaining > 0) {
+        std::memcpy(carry_, chars, remaining);
+    }
+    carryLength_ = remaining;
+    return true;
+}
+
+bool PayloadDecoder::finalize() {
+    if (failed_) {
+        return false;
+    }
+    if (carryLength_ > 0) {
+        size_t decoded = base64Decode(carry_, carryLength_, scratch_.data());
+        carryLength_ = 0;
+        return emit(scratch_.data(), decoded);
+    }
+    return true;
+}
+
+PayloadEncoding PayloadDecoder::encoding() const {
+    return encoding_;
+}
@@ -0,0 +1,134 @@
+#ifndef PAYLOAD_ENCODING_H
+#define PAYLOAD_ENCODING_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include "span.h"
+
+// Self-describing payload encodings. An encoded payload starts with one header byte
+// naming its encoding, so readers detect it instead of having to match the writer's
+// configuration. Neither header byte is in the base64 alphabet, so payloads written
+// before the header existed are still recognized as having none.
+
+enum class PayloadEncoding : uint8_t {
+    NONE,       // The bytes as they are, without a header: the original socket and file format
+    BINARY,     // Header byte followed by the raw bytes
+    BASE64      // Header byte followed by padded base64, for text-only transports
+};
+
+constexpr uint8_t PAYLOAD_HEADER_BINARY = 0x01;
+constexpr uint8_t PAYLOAD_HEADER_BASE64 = '#';
+
+/**
+ * Exact encoded size of length bytes, header included
+ */
+size_t encodedPayloadSize(size_t length, PayloadEncoding encoding);
+
+/**
+ * Upper bound on the decoded size of an encoded payload, whatever its encoding
+ */
+size_t decodedPayloadMaxSize(size_t encodedLength);
+
+/**
+ * Encoding named by the payload's header byte
+ * @param fallback Reported for payloads that carry no header
+ */
+PayloadEncoding detectPayloadEncoding(ConstByteSpan encoded, PayloadEncoding fallback);
+
+/**
+ * Encode into a caller-provided buffer
+ * @param output At least encodedPayloadSize(input.size(), encoding) bytes; must not overlap input
+ * @param written Receives the encoded size
+ * @return false if output is too small
+ */
+bool encodePayload(ConstByteSpan input, ByteSpan output, PayloadEncoding encoding, size_t& written);
+
+/**
+ * Decode a payload of any encoding, detected from its header byte
+ * @param output At least decodedPayloadMaxSize(input.size()) bytes, or input.data() itself to decode in place
+ * @param written Receives the decoded size
+ * @param fallback How to decode a payload that carries no header
+ * @return false if output is too small
+ */
+bool decodePayload(ConstByteSpan input, ByteSpan output, size_t& written, PayloadEncoding fallback);
+
+/**
+ * Encodes a stream piece by piece into a sink, starting with the header byte.
+ * Output is identical to encodePayload over the concatenated input.
+ */
+class PayloadEncoder {
+public:
+    PayloadEncoder(PayloadEncoding encoding, StreamSink sink);
+
+    PayloadEncoder(const PayloadEncoder&) = delete;
+    PayloadEncoder& operator=(const PayloadEncoder&) = delete;
+
+    /**
+     * @return false once the sink has refused output
+     */
+    bool update(ConstByteSpan input);
+
+    /**
+     * Flush the final partial base64 group and its padding
+     * @return false if the sink refused any output
+     */
+    bool finalize();
+
+private:
+    PayloadEncoding encoding_;
+    StreamSink sink_;
+    uint8_t carry_[3];
+    size_t carryLength_;
+    std::vector<char> scratch_;
+    bool headerWritten_;
+    bool failed_;
+
+    bool emit(const void* data, size_t length);
+    bool writeHeader();
+};
+
+/**
+ * Decodes a stream piece by piece into a sink, detecting the encoding from the first
+ * byte. Base64 is expected to be well-formed, as PayloadEncoder writes it.
+ */
+class PayloadDecoder {
+public:
+    /**
+     * @param fallback How to decode a stream that starts without a header byte
+     */
+    PayloadDecoder(PayloadEncoding fallback, StreamSink sink);
+
+    PayloadDecoder(const PayloadDecoder&) = delete;
+    PayloadDecoder& operator=(const PayloadDecoder&) = delete;
+
+    /**
+     * @return false once the sink has refused output
+     */
+    bool update(ConstByteSpan input);
+
+    /**
+     * Decode any trailing partial base64 group
+     * @return false if the sink refused any output
+     */
+    bool finalize();
+
+    /**
+     * Encoding of the stream, valid once update() has seen a non-empty piece
+     */
+    PayloadEncoding encoding() const;
+
+private:
+    PayloadEncoding fallback_;
+    PayloadEncoding encoding_;
+    StreamSink sink_;
+    char carry_[4];
+    size_t carryLength_;
+    std::vector<uint8_t> scratch_;
+    bool detected_;
+    bool failed_;
+
+    bool emit(const uint8_t* data, size_t length);
+};
+
+#endif // PAYLOAD_ENCODING_H
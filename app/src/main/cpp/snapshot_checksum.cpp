@@ -0,0 +1,167 @@
+#include "snapshot_checksum.h"
+#include "checksum.h"
+#include <algorithm>
+#include <cstring>
+
+namespace {
+    const uint8_t TRAILER_MAGIC[4] = {'F', 'X', 'S', 'C'};
+    constexpr size_t CHECKSUM_SIZE = 4;
+    constexpr size_t TRAILER_CHECKED_SIZE = 12;     // Fields covered by the trailer crc
+    constexpr uint8_t MIN_BLOCK_SHIFT = 12;
+    constexpr uint8_t MAX_BLOCK_SHIFT = 22;
+
+    void store32(uint8_t* p, uint32_t v) {
+        for (int i = 0; i < 4; ++i) {
+            p[i] = static_cast<uint8_t>(v >> (8 * i));
+        }
+    }
+
+    void store64(uint8_t* p, uint64_t v) {
+        for (int i = 0; i < 8; ++i) {
+            p[i] = static_cast<uint8_t>(v >> (8 * i));
+        }
+    }
+
+    uint32_t load32(const uint8_t* p) {
+        uint32_t v = 0;
+        for (int i = 0; i < 4; ++i) {
+            v |= static_cast<uint32_t>(p[i]) << (8 * i);
+        }
+        return v;
+    }
+
+    uint64_t load64(const uint8_t* p) {
+        uint64_t v = 0;
+        for (int i = 0; i < 8; ++i) {
+            v |= static_cast<uint64_t>(p[i]) << (8 * i);
+        }
+        return v;
+    }
+
+    size_t blockCount(size_t length, size_t blockSize) {
+        return length / blockSize + (length % blockSize != 0 ? 1 : 0);
+    }
+
+    uint8_t log2Of(size_t value) {
+        uint8_t shift = 0;
+        while ((static_cast<size_t>(1) << shift) < value) {
+            shift++;
+        }
+        return shift;
+    }
+}
+
+size_t snapshotChecksumsSize(size_t storedLength) {
+    return blockCount(storedLength, SNAPSHOT_CHECKSUM_BLOCK_SIZE) * CHECKSUM_SIZE + SNAPSHOT_TRAILER_SIZE;
+}
+
+SnapshotChecksumWriter::SnapshotChecksumWriter() : length_(0), blockCrc_(0) {
+}
+
+void SnapshotChecksumWriter::update(ConstByteSpan piece) {
+    while (!piece.empty()) {
+        size_t room = SNAPSHOT_CHECKSUM_BLOCK_SIZE - static_cast<size_t>(length_ % SNAPSHOT_CHECKSUM_BLOCK_SIZE);
+        size_t take = std::min(room, piece.size());
+        blockCrc_ = crc32c(piece.data(), take, blockCrc_);
+        length_ += take;
+        piece = piece.subspan(take);
+        if (take == room) {
+            size_t at = table_.size();
+            table_.resize(at + CHECKSUM_SIZE);
+            store32(table_.data() + at, blockCrc_);
+            blockCrc_ = 0;
+        }
+    }
+}
+
+std::vector<uint8_t> SnapshotChecksumWriter::finish() {
+    std::vector<uint8_t> output;
+    output.swap(table_);
+    if (length_ % SNAPSHOT_CHECKSUM_BLOCK_SIZE != 0) {
+        size_t at = output.size();
+        output.resize(at + CHECKSUM_SIZE);
+        store32(output.data() + at, blockCrc_);
+    }
+    size_t at = output.size();
+    output.resize(at + SNAPSHOT_TRAILER_SIZE, 0);
+    uint8_t* trailer = output.data() + at;
+    store64(trailer, length_);
+    trailer[8] = log2Of(SNAPSHOT_CHECKSUM_BLOCK_SIZE);
+    store32(trailer + TRAILER_CHECKED_SIZE, crc32c(trailer, TRAILER_CHECKED_SIZE));
+    std::memcpy(trailer + 16, TRAILER_MAGIC, sizeof(TRAILER_MAGIC));
+    length_ = 0;
+    blockCrc_ = 0;
+    return output;
+}
+
+SnapshotChecksums::SnapshotChecksums() : storedLength_(0), blockSize_(SNAPSHOT_CHECKSUM_BLOCK_SIZE) {
+}
+
+bool SnapshotChecksums::read(ConstByteSpan file) {
+    file_ = file;
+    storedLength_ = 0;
+    blockSize_ = SNAPSHOT_CHECKSUM_BLOCK_SIZE;
+    blocks_.clear();
+    if (file.size() < SNAPSHOT_TRAILER_SIZE) {
+        return false;
+    }
+    const uint8_t* trailer = file.data() + file.size() - SNAPSHOT_TRAILER_SIZE;
+    if (std::memcmp(trailer + 16, TRAILER_MAGIC, sizeof(TRAILER_MAGIC)) != 0) {
+        return false;
+    }
+
+    size_t body = file.size() - SNAPSHOT_TRAILER_SIZE;
+    uint64_t length = load64(trailer);
+    uint8_t shift = trailer[8];
+    bool placed = load32(trailer + TRAILER_CHECKED_SIZE) == crc32c(trailer, TRAILER_CHECKED_SIZE) &&
+                  shift >= MIN_BLOCK_SHIFT && shift <= MAX_BLOCK_SHIFT && length <= body &&
+                  blockCount(static_cast<size_t>(length), static_cast<size_t>(1) << shift) * CHECKSUM_SIZE ==
+                  body - length;
+    if (placed) {
+        blockSize_ = static_cast<size_t>(1) << shift;
+    } else {
+        // The table takes 4 bytes per block, so only one stored length fits the file size
+        size_t blocks = blockCount(body, SNAPSHOT_CHECKSUM_BLOCK_SIZE + CHECKSUM_SIZE);
+        length = body - blocks * CHECKSUM_SIZE;
+        placed = blockCount(static_cast<size_t>(length), SNAPSHOT_CHECKSUM_BLOCK_SIZE) == blocks;
+    }
+
+    // A table that cannot be placed leaves every stored byte in doubt
+    storedLength_ = placed ? static_cast<size_t>(length) : body;
+    blocks_.assign(blockCount(storedLength_, blockSize_), placed ? BlockState::UNCHECKED : BlockState::DAMAGED);
+    return true;
+}
+
+bool SnapshotChecksums::verify(size_t offset, size_t length) {
+    if (offset > storedLength_ || length > storedLength_ - offset) {
+        return false;
+    }
+    if (length == 0) {
+        return true;
+    }
+    for (size_t block = offset / blockSize_; block <= (offset + length - 1) / blockSize_; ++block) {
+        if (!verifyBlock(block)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+size_t SnapshotChecksums::intactLength() {
+    for (size_t block = 0; block < blocks_.size(); ++block) {
+        if (!verifyBlock(block)) {
+            return block * blockSize_;
+        }
+    }
+    return storedLength_;
+}
+
+bool SnapshotChecksums::verifyBlock(size_t block) {
+    if (blocks_[block] == BlockState::UNCHECKED) {
+        size_t offset = block * blockSize_;
+        size_t length = std::min(blockSize_, storedLength_ - offset);
+        uint32_t expected = load32(file_.data() + storedLength_ + block * CHECKSUM_SIZE);
+        blocks_[block] = crc32c(file_.data() + offset, length) == expected ? BlockState::INTACT : BlockState::DAMAGED;
+    }
+    return blocks_[block] == BlockState::INTACT;
+}
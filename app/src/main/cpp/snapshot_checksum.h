@@ -0,0 +1,102 @@
+#ifndef SNAPSHOT_CHECKSUM_H
+#define SNAPSHOT_CHECKSUM_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include "span.h"
+
+// Block checksums at the end of BlobStorage snapshots whose messages are stored as
+// plaintext, so that a damaged file is caught before its bytes reach the managed side,
+// and the messages before the damage can still be loaded:
+//
+//   snapshot  stored bytes | table | trailer
+//   table     crc32c u32 per block of the stored bytes, the last block possibly short
+//   trailer   stored length u64 | log2(block size) u8 | reserved u8[3] | trailer crc u32 | "FXSC"   (LE)
+//
+// The stored bytes stay at the start of the file, so mappings and index offsets point
+// into them as before. Encrypted snapshots are authenticated and compressed ones carry a
+// checksum per block already, and get no trailer. Neither do files written before it was
+// introduced, which are read unverified.
+
+constexpr size_t SNAPSHOT_TRAILER_SIZE = 20;
+constexpr size_t SNAPSHOT_CHECKSUM_BLOCK_SIZE = 4 * 1024;
+
+/**
+ * Size of the table and trailer that follow storedLength bytes
+ */
+size_t snapshotChecksumsSize(size_t storedLength);
+
+/**
+ * Computes the table and trailer of a snapshot as its stored bytes are written
+ */
+class SnapshotChecksumWriter {
+public:
+    SnapshotChecksumWriter();
+
+    /**
+     * Add the next piece of the stored bytes
+     */
+    void update(ConstByteSpan piece);
+
+    /**
+     * Table and trailer for everything passed to update(), to be written after it
+     */
+    std::vector<uint8_t> finish();
+
+private:
+    std::vector<uint8_t> table_;
+    uint64_t length_;
+    uint32_t blockCrc_;
+};
+
+/**
+ * Checks the stored bytes of a snapshot against its table, a block at a time as they are
+ * needed. Blocks are only checked once.
+ */
+class SnapshotChecksums {
+public:
+    SnapshotChecksums();
+
+    /**
+     * Find the table and trailer at the end of a snapshot file. A trailer that is itself
+     * damaged still locates the table when the file has the size of one written with the
+     * default block size.
+     * @param file The whole file, which must outlive this object
+     * @return false if the file has no trailer
+     */
+    bool read(ConstByteSpan file);
+
+    /**
+     * Length of the stored bytes, i.e. of the file without table and trailer
+     */
+    size_t storedLength() const { return storedLength_; }
+
+    /**
+     * Check the blocks holding a range of the stored bytes
+     * @return false if one of them is damaged or the range extends past the stored bytes
+     */
+    bool verify(size_t offset, size_t length);
+
+    /**
+     * Length of the leading stored bytes whose blocks are all intact; the whole of the
+     * stored bytes when nothing is damaged
+     */
+    size_t intactLength();
+
+private:
+    enum class BlockState : uint8_t {
+        UNCHECKED,
+        INTACT,
+        DAMAGED
+    };
+
+    ConstByteSpan file_;
+    size_t storedLength_;
+    size_t blockSize_;
+    std::vector<BlockState> blocks_;
+
+    bool verifyBlock(size_t block);
+};
+
+#endif // SNAPSHOT_CHECKSUM_H
@@ -1,6 +1,7 @@
 #include "socket_manager.h"
 #include "thread_manager.h"
 #include "io_bridge.h"
+#include "cipher_stream.h"
 #include <android/log.h>
 #include <sys/socket.h>
 #include <netinet/in.h>
@@ -8,7 +9,9 @@
 #include <unistd.h>
 #include <fcntl.h>
 #include <errno.h>
+#include <algorithm>
 #include <cstring>
+#include <optional>
 
 #define LOG_TAG "SocketManager"
 #define LOGI(...) __android_log_print(ANDROID_LOG_INFO, LOG_TAG, __VA_ARGS__)
@@ -18,13 +21,34 @@
 #define MAX_CLIENTS 10
 #define BUFFER_SIZE 4096
 
+namespace {
+    // send() until every byte is written
+    bool sendAll(int socketFd, const void* data, size_t length) {
+        const char* bytes = static_cast<const char*>(data);
+        while (length > 0) {
+            ssize_t sent = send(socketFd, bytes, length, 0);
+            if (sent < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                return false;
+            }
+            bytes += sent;
+            length -= static_cast<size_t>(sent);
+        }
+        return true;
+    }
+}
+
 SocketManager::SocketManager()
     : serverSocket_(-1),
       isRunning_(false),
       port_(0),
       threadManager_(nullptr),
       ioBridge_(nullptr),
-      stopSending_(false) {
+      stopSending_(false),
+      encryptFrames_(false),
+      frameEncoding_(PayloadEncoding::NONE) {
 }
 
 SocketManager::~SocketManager() {
@@ -37,6 +61,25 @@ void SocketManager::setThreadManager(ThreadManager* threadManager) {
 
 void SocketManager::setIOBridge(IOBridge* ioBridge) {
     ioBridge_ = ioBridge;
+    
+    // The client count is state, not history: a connection storm only needs the latest value
+    if (ioBridge_ != nullptr) {
+        ioBridge_->setDeliveryPolicy("socket_client_count", DeliveryPolicy::CONFLATE);
+    }
+}
+
+void SocketManager::setEncryptionKey(const uint8_t* key) {
+    if (key == nullptr) {
+        encryptFrames_.store(false, std::memory_order_release);
+        secureZero(frameKey_, sizeof(frameKey_));
+        return;
+    }
+    std::memcpy(frameKey_, key, sizeof(frameKey_));
+    encryptFrames_.store(true, std::memory_order_release);
+}
+
+void SocketManager::setPayloadEncoding(PayloadEncoding encoding) {
+    frameEncoding_.store(encoding, std::memory_order_release);
 }
 
 bool SocketManager::startServer(int port) {
@@ -188,31 +231,7 @@ void SocketManager::sendWorker() {
         // Send to all clients outside the lock
         std::vector<int> toRemove;
         toRemove.reserve(clientSockets.size());
-        
-        // Pre-calculate message length
-        uint32_t messageLen = htonl(static_cast<uint32_t>(message.length()));
-        const char* messageData = message.c_str();
-        size_t messageSize = message.length();
-        
-        for (int socketFd : clientSockets) {
-            // Send message length prefix
-            ssize_t sent = send(socketFd, &messageLen, sizeof(messageLen), 0);
-            if (sent != sizeof(messageLen)) {
-                toRemove.push_back(socketFd);
-                continue;
-            }
-            
-            // Send message
-            size_t totalSent = 0;
-            while (totalSent < messageSize) {
-                sent = send(socketFd, messageData + totalSent, messageSize - totalSent, 0);
-                if (sent < 0) {
-                    toRemove.push_back(socketFd);
-                    break;
-                }
-                totalSent += sent;
-            }
-        }
+        sendFrame(message, clientSockets, toRemove);
         
         // Remove disconnected clients (outside lock)
         for (int fd : toRemove) {
@@ -221,6 +240,128 @@ void SocketManager::sendWorker() {
     }
 }
 
+void SocketManager::sendFrame(const std::string& message, std::vector<int>& clientSockets,
+                              std::vector<int>& toRemove) {
+    // Writes one piece of the frame to every client that has not failed yet
+    auto broadcast = [&clientSockets, &toRemove](const void* data, size_t length) {
+        for (auto it = clientSockets.begin(); it != clientSockets.end();) {
+            if (sendAll(*it, data, length)) {
+                ++it;
+            } else {
+                toRemove.push_back(*it);
+                it = clientSockets.erase(it);
+            }
+        }
+        return !clientSockets.empty();
+    };
+    
+    PayloadEncoding encoding = frameEncoding_.load(std::memory_order_acquire);
+    PayloadEncoder encoder(encoding, [&broadcast](ConstByteSpan piece) {
+        return broadcast(piece.data(), piece.size());
+    });
+    
+    if (!encryptFrames_.load(std::memory_order_acquire)) {
+        size_t frameSize = encodedPayloadSize(message.size(), encoding);
+        if (frameSize > UINT32_MAX) {
+            LOGE("Cannot frame message of %zu bytes", message.size());
+            return;
+        }
+        uint32_t messageLen = htonl(static_cast<uint32_t>(frameSize));
+        if (broadcast(&messageLen, sizeof(messageLen))) {
+            encoder.update(asBytes(message));
+            encoder.finalize();
+        }
+        return;
+    }
+    
+    // The container is sealed chunk by chunk straight into the sockets, so the encrypted
+    // form of a large message is never held in memory as a whole
+    StreamEncryptor encryptor(frameKey_, message.size(), [&encoder](ConstByteSpan piece) {
+        return encoder.update(piece);
+    });
+    size_t containerSize = encryptor.containerSize();
+    size_t frameSize = encodedPayloadSize(containerSize, encoding);
+    if (containerSize == 0 || frameSize > UINT32_MAX) {
+        LOGE("Cannot encrypt frame of %zu bytes", message.size());
+        return;
+    }
+    
+    uint32_t frameLen = htonl(static_cast<uint32_t>(frameSize));
+    if (broadcast(&frameLen, sizeof(frameLen))) {
+        encryptor.update(asBytes(message));
+        encryptor.finalize();
+        encoder.finalize();
+    }
+}
+
+size_t SocketManager::maxFrameLength() const {
+    size_t maxBodyLen = encryptFrames_.load(std::memory_order_acquire) ? chunkedCiphertextSize(BUFFER_SIZE)
+                                                                       : BUFFER_SIZE;
+    // Peers may send either encoding, whichever one this side uses
+    if (frameEncoding_.load(std::memory_order_acquire) != PayloadEncoding::NONE) {
+        return encodedPayloadSize(maxBodyLen, PayloadEncoding::BASE64);
+    }
+    return maxBodyLen;
+}
+
+bool SocketManager::readFrameBody(int clientSocket, std::vector<char>& buffer, uint32_t frameLen,
+                                  std::string& message) {
+    message.clear();
+    StreamSink appendMessage = [&message](ConstByteSpan piece) {
+        message.append(reinterpret_cast<const char*>(piece.data()), piece.size());
+        return message.size() <= BUFFER_SIZE;
+    };
+    
+    // Received bytes flow through the decoder, then the decryptor, as they arrive;
+    // decrypted plaintext is only appended once its chunk authenticates
+    std::optional<StreamDecryptor> decryptor;
+    StreamSink body = appendMessage;
+    if (encryptFrames_.load(std::memory_order_acquire)) {
+        decryptor.emplace(frameKey_, appendMessage);
+        body = [&decryptor](ConstByteSpan piece) {
+            return decryptor->update(piece);
+        };
+    }
+    
+    // With an encoding configured every frame must carry a header byte: a raw frame has no
+    // way to tell whether its first byte is data or a header, so one starting with '#' or
+    // 0x01 would be misread. Headerless frames are refused rather than guessed at.
+    std::optional<PayloadDecoder> decoder;
+    StreamSink input = body;
+    if (frameEncoding_.load(std::memory_order_acquire) != PayloadEncoding::NONE) {
+        decoder.emplace(PayloadEncoding::NONE, body);
+        input = [&decoder](ConstByteSpan piece) {
+            return decoder->update(piece);
+        };
+    }
+    
+    size_t totalReceived = 0;
+    while (totalReceived < frameLen) {
+        size_t wanted = std::min(buffer.size(), static_cast<size_t>(frameLen) - totalReceived);
+        ssize_t received = recv(clientSocket, buffer.data(), wanted, 0);
+        if (received <= 0) {
+            return false;
+        }
+        ConstByteSpan piece(reinterpret_cast<const uint8_t*>(buffer.data()), static_cast<size_t>(received));
+        if (decoder && totalReceived == 0 && detectPayloadEncoding(piece, PayloadEncoding::NONE) == PayloadEncoding::NONE) {
+            LOGE("Frame from client %d has no payload header", clientSocket);
+            return false;
+        }
+        totalReceived += received;
+        
+        if (!input(piece)) {
+            LOGE("Rejected frame from client %d", clientSocket);
+            return false;
+        }
+    }
+    
+    if ((decoder && !decoder->finalize()) || (decryptor && !decryptor->finalize())) {
+        LOGE("Incomplete frame from client %d", clientSocket);
+        return false;
+    }
+    return true;
+}
+
 void SocketManager::acceptConnections() {
     LOGI("Accept thread started");
     
@@ -287,30 +428,17 @@ void SocketManager::handleClient(int clientSocket) {
         }
         
         messageLen = ntohl(messageLen);
-        if (messageLen == 0 || messageLen > BUFFER_SIZE) {
+        if (messageLen == 0 || messageLen > maxFrameLength()) {
             LOGE("Invalid message length: %u", messageLen);
             break;
         }
         
-        // Resize buffer if needed
-        if (buffer.size() < messageLen) {
-            buffer.resize(messageLen);
-        }
-        
         // Read message
-        size_t totalReceived = 0;
-        while (totalReceived < messageLen) {
-            received = recv(clientSocket, buffer.data() + totalReceived, 
-                           messageLen - totalReceived, 0);
-            if (received <= 0) {
-                goto client_disconnected;
-            }
-            totalReceived += received;
+        std::string message;
+        if (!readFrameBody(clientSocket, buffer, messageLen, message)) {
+            break;
         }
         
-        // Create message string (avoid unnecessary null terminator)
-        std::string message(buffer.data(), messageLen);
-        
         LOGD("Received message from client %d: %s", clientSocket, message.c_str());
         
         // Forward to I/O bridge (use move to avoid copy)
@@ -319,7 +447,6 @@ void SocketManager::handleClient(int clientSocket) {
         }
     }
     
-client_disconnected:
     LOGI("Client %d disconnected", clientSocket);
     removeClient(clientSocket);
 }
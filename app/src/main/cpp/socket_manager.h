@@ -10,6 +10,7 @@
 #include <queue>
 #include <memory>
 #include <cstdint>
+#include "payload_encoding.h"
 
 // Forward declarations
 class ThreadManager;
@@ -47,6 +48,16 @@ public:
     void setThreadManager(ThreadManager* threadManager);
     void setIOBridge(IOBridge* ioBridge);
     
+    // Frame encryption: with a 32-byte key set, every frame body is a chunked ChaCha20-Poly1305
+    // container, encrypted on the fly while it is sent. nullptr sends plaintext frames.
+    // Call before startServer.
+    void setEncryptionKey(const uint8_t* key);
+    
+    // Frame body encoding, applied after encryption (NONE by default). With BINARY or BASE64
+    // every frame starts with a payload header byte and incoming frames are decoded by theirs;
+    // incoming frames without one are refused.
+    void setPayloadEncoding(PayloadEncoding encoding);
+    
     // Server control
     bool startServer(int port);
     void stopServer();
@@ -77,6 +88,11 @@ private:
     std::condition_variable sendCondition_;
     std::atomic<bool> stopSending_;
     
+    // Frame encryption key, valid while encryptFrames_ is set
+    uint8_t frameKey_[32];
+    std::atomic<bool> encryptFrames_;
+    std::atomic<PayloadEncoding> frameEncoding_;
+    
     // References
     ThreadManager* threadManager_;
     IOBridge* ioBridge_;
@@ -89,6 +105,9 @@ private:
     void acceptConnections();
     void handleClient(int clientSocket);
     void sendWorker();
+    void sendFrame(const std::string& message, std::vector<int>& clientSockets, std::vector<int>& toRemove);
+    bool readFrameBody(int clientSocket, std::vector<char>& buffer, uint32_t frameLen, std::string& message);
+    size_t maxFrameLength() const;
     void removeClient(int socketFd);
     void notifyConnectionChange();
 };
@@ -0,0 +1,63 @@
+#ifndef SPAN_H
+#define SPAN_H
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+/**
+ * Non-owning view of a contiguous range, a minimal stand-in for C++20 std::span
+ * while the native build targets C++17.
+ */
+template <typename T>
+class Span {
+public:
+    constexpr Span() : data_(nullptr), size_(0) {}
+    constexpr Span(T* data, size_t size) : data_(data), size_(size) {}
+
+    // Span<const T> from Span<T>
+    template <typename U, typename = typename std::enable_if<std::is_convertible<U(*)[], T(*)[]>::value>::type>
+    constexpr Span(const Span<U>& other) : data_(other.data()), size_(other.size()) {}
+
+    template <typename U, typename = typename std::enable_if<std::is_convertible<U(*)[], T(*)[]>::value>::type>
+    Span(std::vector<U>& vector) : data_(vector.data()), size_(vector.size()) {}
+
+    template <typename U, typename = typename std::enable_if<std::is_convertible<const U(*)[], T(*)[]>::value>::type>
+    Span(const std::vector<U>& vector) : data_(vector.data()), size_(vector.size()) {}
+
+    constexpr T* data() const { return data_; }
+    constexpr size_t size() const { return size_; }
+    constexpr bool empty() const { return size_ == 0; }
+
+    constexpr T* begin() const { return data_; }
+    constexpr T* end() const { return data_ + size_; }
+    constexpr T& operator[](size_t index) const { return data_[index]; }
+
+    constexpr Span first(size_t count) const { return Span(data_, count); }
+    constexpr Span subspan(size_t offset) const { return Span(data_ + offset, size_ - offset); }
+    constexpr Span subspan(size_t offset, size_t count) const { return Span(data_ + offset, count); }
+
+private:
+    T* data_;
+    size_t size_;
+};
+
+using ByteSpan = Span<uint8_t>;
+using ConstByteSpan = Span<const uint8_t>;
+
+/**
+ * View the bytes of a string without copying
+ */
+inline ConstByteSpan asBytes(const std::string& string) {
+    return ConstByteSpan(reinterpret_cast<const uint8_t*>(string.data()), string.size());
+}
+
+/**
+ * Receives bytes as a stream produces them; returning false aborts the stream
+ */
+using StreamSink = std::function<bool(Span<const uint8_t>)>;
+
+#endif // SPAN_H
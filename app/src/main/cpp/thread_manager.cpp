@@ -3,7 +3,7 @@
 #include <chrono>
 
 ThreadManager::ThreadManager() 
-    : threadCounter_(0), stopPool_(false), activeTasks_(0) {
+    : threadCounter_(0), stopPool_(false), activeTasks_(0), poolSize_(0) {
 }
 
 ThreadManager::~ThreadManager() {
@@ -106,6 +106,7 @@ void ThreadManager::initializeThreadPool(size_t poolSize) {
     for (size_t i = 0; i < poolSize; ++i) {
         poolThreads_.emplace_back(&ThreadManager::workerFunction, this);
     }
+    poolSize_ = poolSize;
 }
 
 void ThreadManager::workerFunction() {
@@ -156,6 +157,7 @@ void ThreadManager::shutdownThreadPool() {
     }
     
     condition_.notify_all();
+    poolSize_ = 0;
     
     for (auto& thread : poolThreads_) {
         if (thread.joinable()) {
@@ -170,6 +172,10 @@ void ThreadManager::shutdownThreadPool() {
     taskQueue_.swap(empty);
 }
 
+size_t ThreadManager::getPoolSize() const {
+    return poolSize_;
+}
+
 size_t ThreadManager::getActiveThreadCount() const {
     std::lock_guard<std::mutex> lock(managerMutex_);
     
@@ -247,3 +253,55 @@ void ThreadManager::joinAll() {
         }
     }
 }
+
+namespace {
+    // Shared between the caller and pool helpers. Helpers that start after every index has
+    // been claimed return without touching the caller's data, so the caller only waits for
+    // completed work, never for the helper tasks themselves.
+    struct ParallelJob {
+        std::function<bool(size_t)> work;
+        size_t count = 0;
+        std::atomic<size_t> next{0};
+        std::atomic<size_t> completed{0};
+        std::atomic<bool> failed{false};
+        std::mutex mutex;
+        std::condition_variable done;
+
+        void drain() {
+            size_t index;
+            while ((index = next.fetch_add(1)) < count) {
+                if (!work(index)) {
+                    failed = true;
+                }
+                if (completed.fetch_add(1) + 1 == count) {
+                    std::lock_guard<std::mutex> lock(mutex);
+                    done.notify_all();
+                }
+            }
+        }
+    };
+}
+
+bool runParallel(ThreadManager* threadManager, size_t count, std::function<bool(size_t)> work) {
+    if (count == 0) {
+        return true;
+    }
+    auto job = std::make_shared<ParallelJob>();
+    job->work = std::move(work);
+    job->count = count;
+
+    size_t helpers = threadManager != nullptr ? std::min(threadManager->getPoolSize(), count - 1) : 0;
+    for (size_t i = 0; i < helpers; ++i) {
+        threadManager->submitTask([job]() {
+            job->drain();
+        });
+    }
+
+    job->drain();
+
+    std::unique_lock<std::mutex> lock(job->mutex);
+    job->done.wait(lock, [&job]() {
+        return job->completed.load() == job->count;
+    });
+    return !job->failed;
+}
@@ -46,6 +46,7 @@ public:
     void initializeThreadPool(size_t poolSize);
     void submitTask(std::function<void()> task);
     void shutdownThreadPool();
+    size_t getPoolSize() const;
     
     // Thread information
     size_t getActiveThreadCount() const;
@@ -76,6 +77,7 @@ private:
     std::condition_variable condition_;
     std::atomic<bool> stopPool_;
     std::atomic<size_t> activeTasks_;
+    std::atomic<size_t> poolSize_;
     
     // Synchronization
     std::mutex syncMutex_;
@@ -85,4 +87,12 @@ private:
     void workerFunction();
 };
 
+/**
+ * Run work(0) .. work(count - 1) on the pool, with the calling thread taking part, so it
+ * completes even while every pool thread is busy
+ * @param threadManager Pool to use, or nullptr to run everything on the calling thread
+ * @return true if every call succeeded
+ */
+bool runParallel(ThreadManager* threadManager, size_t count, std::function<bool(size_t)> work);
+
 #endif // THREAD_MANAGER_H
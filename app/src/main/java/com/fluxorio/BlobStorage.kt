@@ -2,6 +2,7 @@ package com.fluxorio
 
 import android.content.Context
 import java.io.*
+import java.nio.ByteBuffer
 
 /**
  * BlobStorage - Handles local persistence of messages using binary file storage
@@ -18,10 +19,56 @@ class BlobStorage(private val context: Context) {
         
         // Native method declarations
         private external fun saveMessagesNative(filePath: String, data: ByteArray): Boolean
-        private external fun loadMessagesNative(filePath: String): ByteArray?
+        private external fun appendMessagesNative(filePath: String, data: ByteArray): Boolean
+        private external fun openMessagesNative(filePath: String): Long
+        private external fun messagesBufferNative(handle: Long): ByteBuffer?
+        private external fun closeMessagesNative(handle: Long)
+        private external fun loadRangeNative(filePath: String, first: Int, count: Int): ByteArray?
+        private external fun loadLatestNative(filePath: String, count: Int): ByteArray?
+        private external fun loadBetweenNative(filePath: String, from: Long, to: Long): ByteArray?
+        private external fun countMessagesNative(filePath: String): Long
+        private external fun setCompressionNative(enabled: Boolean)
+        private external fun setWriteBehindNative(enabled: Boolean)
+        private external fun setCacheSizeNative(bytes: Long)
+        private external fun flushNative(): Boolean
         private external fun clearMessagesNative(filePath: String): Boolean
         private external fun hasMessagesNative(filePath: String): Boolean
         private external fun getStorageSizeNative(filePath: String): Long
+        
+        /**
+         * Compress saved and appended messages in blocks. Messages stored either way stay
+         * readable; compressed files are loaded whole rather than mapped or paged through
+         * the index.
+         */
+        fun setCompression(enabled: Boolean) {
+            setCompressionNative(enabled)
+        }
+        
+        /**
+         * Bound the memory used to keep recently loaded conversations, 16 MB by default.
+         * 0 drops the cache, e.g. when the system asks to trim memory.
+         */
+        fun setCacheSize(bytes: Long) {
+            setCacheSizeNative(bytes)
+        }
+        
+        /**
+         * Write saves and appends behind: they return once queued, and a native pool thread
+         * writes them, coalescing those that pile up for the same file. Each write is
+         * reported as a "storage_written" or "storage_write_failed" string event carrying
+         * the file path. Loads still see everything queued.
+         */
+        fun setWriteBehind(enabled: Boolean) {
+            setWriteBehindNative(enabled)
+        }
+        
+        /**
+         * Wait until every queued save and append is written
+         * @return false if a write failed since the last flush
+         */
+        fun flush(): Boolean {
+            return flushNative()
+        }
     }
     
     private val messagesFile: File by lazy {
@@ -62,39 +109,38 @@ class BlobStorage(private val context: Context) {
     }
     
     /**
-     * Deserialize messages from byte array using the same binary format
+     * Deserialize messages from a buffer in the same binary format. ByteBuffer reads are
+     * big-endian by default, matching DataOutputStream.
      */
-    private fun deserializeMessages(data: ByteArray): List<Message> {
-        if (data.isEmpty()) {
+    private fun deserializeMessages(data: ByteBuffer): List<Message> {
+        if (!data.hasRemaining()) {
             return emptyList()
         }
         
         return try {
             val messages = mutableListOf<Message>()
-            DataInputStream(ByteArrayInputStream(data)).use { dis ->
-                // Read message count
-                val count = dis.readInt()
+            // Read message count
+            val count = data.getInt()
+            
+            // Read each message
+            for (i in 0 until count) {
+                // Read text length and text bytes
+                val textLength = data.getInt()
+                val textBytes = ByteArray(textLength)
+                data.get(textBytes)
+                val text = String(textBytes, Charsets.UTF_8)
                 
-                // Read each message
-                for (i in 0 until count) {
-                    // Read text length and text bytes
-                    val textLength = dis.readInt()
-                    val textBytes = ByteArray(textLength)
-                    dis.readFully(textBytes)
-                    val text = String(textBytes, Charsets.UTF_8)
-                    
-                    // Read isSent
-                    val isSent = dis.readByte().toInt() == 1
-                    
-                    // Read messageType (enum ordinal)
-                    val messageTypeOrdinal = dis.readByte().toInt() and 0xFF
-                    val messageType = MessageType.values().getOrElse(messageTypeOrdinal) { MessageType.SHORT_MESSAGE }
-                    
-                    // Read timestamp
-                    val timestamp = dis.readLong()
-                    
-                    messages.add(Message(text, isSent, messageType, timestamp))
-                }
+                // Read isSent
+                val isSent = data.get().toInt() == 1
+                
+                // Read messageType (enum ordinal)
+                val messageTypeOrdinal = data.get().toInt() and 0xFF
+                val messageType = MessageType.values().getOrElse(messageTypeOrdinal) { MessageType.SHORT_MESSAGE }
+                
+                // Read timestamp
+                val timestamp = data.getLong()
+                
+                messages.add(Message(text, isSent, messageType, timestamp))
             }
             messages
         } catch (e: Exception) {
@@ -119,23 +165,40 @@ class BlobStorage(private val context: Context) {
         }
     }
     
+    /**
+     * Append messages after the stored ones without rewriting them
+     * @return false if the append failed and the messages are not stored
+     */
+    fun appendMessages(messages: List<Message>): Boolean {
+        return try {
+            appendMessagesNative(messagesFilePath, serializeMessages(messages))
+        } catch (e: Exception) {
+            e.printStackTrace()
+            false
+        }
+    }
+    
     /**
      * Load messages from blob storage
      */
     fun loadMessages(): List<Message> {
         return try {
-            val data = loadMessagesNative(messagesFilePath)
-            if (data == null || data.isEmpty()) {
-                emptyList()
-            } else {
-                val messages = deserializeMessages(data)
-                if (messages.isEmpty() && data.isNotEmpty()) {
-                    // Deserialization failed, clear corrupted file
-                    clearMessages()
+            // The buffer maps the file where possible, so the messages are not copied
+            val handle = openMessagesNative(messagesFilePath)
+            if (handle == 0L) {
+                return emptyList()
+            }
+            try {
+                // Damaged files come back cut to their intact messages, which may be none, so an
+                // empty result is no reason to delete what is stored; the next save replaces it
+                val data = messagesBufferNative(handle)?.asReadOnlyBuffer()
+                if (data == null) {
                     emptyList()
                 } else {
-                    messages
+                    deserializeMessages(data)
                 }
+            } finally {
+                closeMessagesNative(handle)
             }
         } catch (e: Exception) {
             // If reading fails, return empty list and clear corrupted file
@@ -144,6 +207,60 @@ class BlobStorage(private val context: Context) {
         }
     }
     
+    /**
+     * Load count messages starting at index first, oldest first, without loading the rest
+     */
+    fun loadRange(first: Int, count: Int): List<Message> {
+        return try {
+            loadRangeNative(messagesFilePath, first, count)?.let { deserializeMessages(ByteBuffer.wrap(it)) } ?: emptyList()
+        } catch (e: Exception) {
+            e.printStackTrace()
+            emptyList()
+        }
+    }
+    
+    /**
+     * Load the newest count messages, oldest first
+     */
+    fun loadLatest(count: Int): List<Message> {
+        return try {
+            loadLatestNative(messagesFilePath, count)?.let { deserializeMessages(ByteBuffer.wrap(it)) } ?: emptyList()
+        } catch (e: Exception) {
+            e.printStackTrace()
+            emptyList()
+        }
+    }
+    
+    /**
+     * Load the messages with a timestamp of since or later, in stored order
+     */
+    fun loadSince(since: Long): List<Message> {
+        return loadBetween(since, Long.MAX_VALUE)
+    }
+    
+    /**
+     * Load the messages with a timestamp within from..to, in stored order
+     */
+    fun loadBetween(from: Long, to: Long): List<Message> {
+        return try {
+            loadBetweenNative(messagesFilePath, from, to)?.let { deserializeMessages(ByteBuffer.wrap(it)) } ?: emptyList()
+        } catch (e: Exception) {
+            e.printStackTrace()
+            emptyList()
+        }
+    }
+    
+    /**
+     * Number of stored messages, or -1 if they cannot be read
+     */
+    fun messageCount(): Long {
+        return try {
+            countMessagesNative(messagesFilePath)
+        } catch (e: Exception) {
+            -1L
+        }
+    }
+    
     /**
      * Clear all stored messages
      */
@@ -0,0 +1,21 @@
+package com.fluxorio
+
+/**
+ * DirectBufferPool - Returns native buffers delivered through
+ * [IoBridgeListener.onByteBufferEvent] to the C++ I/O Bridge's pool.
+ */
+object DirectBufferPool {
+
+    init {
+        System.loadLibrary("fluxorio")
+    }
+
+    /**
+     * Release a native buffer back to the pool. The ByteBuffer that wrapped it
+     * must not be accessed afterwards. Handles that were already released, or that
+     * belong to a bridge that has since been rebuilt, are ignored.
+     * @param bufferHandle Handle passed alongside the buffer to onByteBufferEvent
+     */
+    @JvmStatic
+    external fun release(bufferHandle: Long)
+}
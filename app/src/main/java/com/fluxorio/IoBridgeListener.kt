@@ -1,5 +1,7 @@
 package com.fluxorio
 
+import java.nio.ByteBuffer
+
 /**
  * Interface for receiving events from the C++ I/O Bridge.
  * All callback methods are called from background threads and should
@@ -47,4 +49,20 @@ interface IoBridgeListener {
      * @param data Byte array data
      */
     fun onByteArrayEvent(eventId: String, data: ByteArray)
+    
+    /**
+     * Called when a large byte array event is delivered as a direct buffer over native memory.
+     * The buffer must be returned with [DirectBufferPool.release] once it is no longer needed,
+     * and must not be accessed after that.
+     * The default implementation copies the data and forwards it to [onByteArrayEvent].
+     * @param eventId Unique identifier for the event
+     * @param data Direct buffer viewing the native payload
+     * @param bufferHandle Handle to pass to [DirectBufferPool.release]
+     */
+    fun onByteBufferEvent(eventId: String, data: ByteBuffer, bufferHandle: Long) {
+        val bytes = ByteArray(data.remaining())
+        data.get(bytes)
+        DirectBufferPool.release(bufferHandle)
+        onByteArrayEvent(eventId, bytes)
+    }
 }
@@ -11,6 +11,7 @@ import androidx.appcompat.app.AppCompatActivity
 import androidx.recyclerview.widget.LinearLayoutManager
 import com.fluxorio.databinding.ActivityMainBinding
 import java.io.InputStream
+import java.nio.ByteBuffer
 
 class MainActivity : AppCompatActivity(), IoBridgeListener {
 
@@ -291,4 +292,22 @@ class MainActivity : AppCompatActivity(), IoBridgeListener {
             binding.recyclerViewMessages.smoothScrollToPosition(messageAdapter.itemCount - 1)
         }
     }
+    
+    override fun onByteBufferEvent(eventId: String, data: ByteBuffer, bufferHandle: Long) {
+        // Only the size is shown, so release the native buffer without copying it
+        val size = data.remaining()
+        DirectBufferPool.release(bufferHandle)
+        uiHandler.post {
+            when (eventId) {
+                "image_response" -> {
+                    hideLoader()
+                    messageAdapter.addMessage(Message("✅ Image processing complete: $size bytes", false, MessageType.IMAGE))
+                }
+                else -> {
+                    messageAdapter.addMessage(Message("[$eventId] ByteBuffer: $size bytes", false, MessageType.SHORT_MESSAGE))
+                }
+            }
+            binding.recyclerViewMessages.smoothScrollToPosition(messageAdapter.itemCount - 1)
+        }
+    }
 }
@@ -25,7 +25,10 @@ class MessageList(private val context: Context? = null) {
      */
     fun add(message: Message) {
         messages.add(message)
-        saveToStorage()
+        // Only the new message is written; fall back to a full save if that fails
+        if (storage?.appendMessages(listOf(message)) == false) {
+            saveToStorage()
+        }
     }
     
     /**
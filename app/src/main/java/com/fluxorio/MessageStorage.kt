@@ -17,6 +17,14 @@ class MessageStorage(private val context: Context) {
         blobStorage.saveMessages(messages)
     }
     
+    /**
+     * Append messages to local storage without rewriting the stored ones
+     * @return false if the messages could not be stored
+     */
+    fun appendMessages(messages: List<Message>): Boolean {
+        return blobStorage.appendMessages(messages)
+    }
+    
     /**
      * Load messages from local storage
      */
@@ -24,6 +32,41 @@ class MessageStorage(private val context: Context) {
         return blobStorage.loadMessages()
     }
     
+    /**
+     * Load count messages starting at index first, without loading the rest
+     */
+    fun loadRange(first: Int, count: Int): List<Message> {
+        return blobStorage.loadRange(first, count)
+    }
+    
+    /**
+     * Load the newest count messages
+     */
+    fun loadLatest(count: Int): List<Message> {
+        return blobStorage.loadLatest(count)
+    }
+    
+    /**
+     * Load the messages with a timestamp of since or later, e.g. those unread since the last open
+     */
+    fun loadSince(since: Long): List<Message> {
+        return blobStorage.loadSince(since)
+    }
+    
+    /**
+     * Load the messages with a timestamp within from..to
+     */
+    fun loadBetween(from: Long, to: Long): List<Message> {
+        return blobStorage.loadBetween(from, to)
+    }
+    
+    /**
+     * Number of stored messages, or -1 if they cannot be read
+     */
+    fun messageCount(): Long {
+        return blobStorage.messageCount()
+    }
+    
     /**
      * Clear all stored messages
      */
@@ -0,0 +1,18 @@
+package com.fluxorio
+
+/**
+ * NativeDiagnostics - Reports how the native library adapted to this device
+ */
+object NativeDiagnostics {
+
+    init {
+        System.loadLibrary("fluxorio")
+    }
+
+    /**
+     * Detected CPU features and the kernel variant chosen for each family, e.g.
+     * "cpu: neon aes pmull sha2 crc32; base64=neon xor=neon chacha20=neon checksum=armv8-crc copy=libc"
+     */
+    @JvmStatic
+    external fun kernelReport(): String
+}